@@ -0,0 +1,234 @@
+#include "../include/nlib/nl_modflow.h"
+#include <benchmark/benchmark.h>
+
+using namespace nlib;
+
+/*
+ * Emits are measured on synchronous ModFlows: each iteration is one emit and the slots it calls.
+ * With debug on, every event is excluded by the filters, so the filter evaluation is measured and not the printing.
+ * The same benchmarks are built with NLIB_MODFLOW_UNCHECKED as bench_modflow_unchecked.
+ */
+
+class Sender : public NlModule {
+public:
+	Sender (NlModFlow *modFlow):
+		  NlModule (modFlow, "sender")
+	{}
+
+	void setupNetwork () override {
+		arity0 = createChannel<> ("arity_0");
+		arity1 = createChannel<int> ("arity_1");
+		arity2 = createChannel<int, int> ("arity_2");
+		arity3 = createChannel<int, int, int> ("arity_3");
+		fan = createChannel<int> ("fan");
+		cascade = createChannel<int> ("cascade_0");
+	}
+
+	template<typename ...T>
+	void send (const TypedChannel<T...> &channel, const T &...value) {
+		emit (channel, value...);
+	}
+
+	void sendUntyped (const Channel &channel, int value) {
+		emit (channel, value);
+	}
+
+	void sendByName (const std::string &channel, int value) {
+		emit (channel, value);
+	}
+
+	TypedChannel<> arity0;
+	TypedChannel<int> arity1;
+	TypedChannel<int, int> arity2;
+	TypedChannel<int, int, int> arity3;
+	TypedChannel<int> fan;
+	TypedChannel<int> cascade;
+
+	DEF_SHARED (Sender)
+};
+
+class Receiver : public NlModule {
+public:
+	Receiver (NlModFlow *modFlow, const std::string &name, bool arities):
+		  NlModule (modFlow, name),
+		  _arities(arities)
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("fan", &Receiver::onOne);
+
+		if (!_arities)
+			return;
+
+		requestConnection ("arity_0", &Receiver::onZero);
+		requestConnection ("arity_1", &Receiver::onOne);
+		requestConnection ("arity_2", &Receiver::onTwo);
+		requestConnection ("arity_3", &Receiver::onThree);
+	}
+
+	void onZero () { sum++; }
+	void onOne (int a) { sum += a; }
+	void onTwo (int a, int b) { sum += a + b; }
+	void onThree (int a, int b, int c) { sum += a + b + c; }
+
+	long sum = 0;
+
+	DEF_SHARED (Receiver)
+
+private:
+	const bool _arities;
+};
+
+// Forwards cascade_<i> to cascade_<i + 1>
+class Relay : public NlModule {
+public:
+	Relay (NlModFlow *modFlow, int index):
+		  NlModule (modFlow, "relay_" + std::to_string (index)),
+		  _index(index)
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("cascade_" + std::to_string (_index), &Relay::onInput);
+		_next = createChannel<int> ("cascade_" + std::to_string (_index + 1));
+	}
+
+	void onInput (int value) {
+		emit (_next, value + 1);
+	}
+
+	DEF_SHARED (Relay)
+
+private:
+	const int _index;
+	TypedChannel<int> _next;
+};
+
+class BenchModFlow : public NlModFlow {
+public:
+	BenchModFlow (int fanOut, int depth):
+		  _fanOut(fanOut),
+		  _depth(depth)
+	{}
+
+	void loadModules () override {
+		sender = loadModule<Sender> ();
+
+		for (int i = 0; i < _fanOut; i++)
+			loadModule<Receiver> ("receiver_" + std::to_string (i), i == 0);
+
+		for (int i = 0; i < _depth; i++)
+			loadModule<Relay> (i);
+	}
+
+	Sender::Ptr sender;
+
+private:
+	const int _fanOut;
+	const int _depth;
+};
+
+static std::shared_ptr<BenchModFlow> makeModFlow (bool debug, int fanOut = 1, int depth = 0)
+{
+	XmlRpc::XmlRpcValue value;
+
+	value["mod_flow"]["debug"]["enable"] = debug;
+	value["mod_flow"]["debug"]["exclude_modules"].setSize (1);
+	value["mod_flow"]["debug"]["exclude_modules"][0] = std::string ("sender");
+
+	auto modFlow = std::make_shared<BenchModFlow> (fanOut, depth);
+
+	modFlow->init (NlParams (value));
+	modFlow->finalize ();
+
+	return modFlow;
+}
+
+static void emitArity0 (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (0));
+
+	for (auto _ : state)
+		modFlow->sender->send (modFlow->sender->arity0);
+}
+BENCHMARK (emitArity0)->ArgName ("debug")->Arg (0)->Arg (1);
+
+static void emitArity1 (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (0));
+
+	for (auto _ : state)
+		modFlow->sender->send (modFlow->sender->arity1, 1);
+}
+BENCHMARK (emitArity1)->ArgName ("debug")->Arg (0)->Arg (1);
+
+static void emitArity2 (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (0));
+
+	for (auto _ : state)
+		modFlow->sender->send (modFlow->sender->arity2, 1, 2);
+}
+BENCHMARK (emitArity2)->ArgName ("debug")->Arg (0)->Arg (1);
+
+static void emitArity3 (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (0));
+
+	for (auto _ : state)
+		modFlow->sender->send (modFlow->sender->arity3, 1, 2, 3);
+}
+BENCHMARK (emitArity3)->ArgName ("debug")->Arg (0)->Arg (1);
+
+static void emitFanOut (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (1), state.range (0));
+
+	for (auto _ : state)
+		modFlow->sender->send (modFlow->sender->fan, 1);
+
+	state.SetItemsProcessed (state.iterations () * state.range (0));
+}
+BENCHMARK (emitFanOut)->ArgNames ({"slots", "debug"})->ArgsProduct ({{1, 4, 16, 64}, {0, 1}});
+
+static void emitByTypedChannel (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (0));
+
+	for (auto _ : state)
+		modFlow->sender->send (modFlow->sender->fan, 1);
+}
+BENCHMARK (emitByTypedChannel)->ArgName ("debug")->Arg (0)->Arg (1);
+
+static void emitByChannel (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (0));
+	const Channel channel = modFlow->sender->fan;
+
+	for (auto _ : state)
+		modFlow->sender->sendUntyped (channel, 1);
+}
+BENCHMARK (emitByChannel)->ArgName ("debug")->Arg (0)->Arg (1);
+
+static void emitByName (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (0));
+	const std::string name = "fan";
+
+	for (auto _ : state)
+		modFlow->sender->sendByName (name, 1);
+}
+BENCHMARK (emitByName)->ArgName ("debug")->Arg (0)->Arg (1);
+
+// One emit running through depth relays
+static void cascade (benchmark::State &state)
+{
+	auto modFlow = makeModFlow (state.range (1), 1, state.range (0));
+
+	for (auto _ : state)
+		modFlow->sender->send (modFlow->sender->cascade, 0);
+
+	state.SetItemsProcessed (state.iterations () * state.range (0));
+}
+BENCHMARK (cascade)->ArgNames ({"depth", "debug"})->ArgsProduct ({{1, 4, 16, NLIB_MODFLOW_MAX_DEPTH - 2}, {0, 1}});
+
+BENCHMARK_MAIN ();
@@ -0,0 +1,106 @@
+#define INCLUDE_EIGEN
+#include "../include/nlib/nl_ros_conversions.h"
+#include <benchmark/benchmark.h>
+#include <boost/make_shared.hpp>
+
+using namespace nlib;
+
+// Square {size, size} arrays
+static void multiArrayGet (benchmark::State &state)
+{
+	const int size = state.range (0);
+	MultiArray32Manager manager({size, size});
+	std::vector<int> indexes{0, 0};
+
+	for (auto _ : state) {
+		for (int i = 0; i < size; i++) {
+			indexes[0] = i;
+
+			for (int j = 0; j < size; j++) {
+				indexes[1] = j;
+				benchmark::DoNotOptimize (manager.get (indexes));
+			}
+		}
+	}
+
+	state.SetItemsProcessed (state.iterations () * size * size);
+}
+BENCHMARK (multiArrayGet)->RangeMultiplier (4)->Range (16, 1024);
+
+static void multiArraySet (benchmark::State &state)
+{
+	const int size = state.range (0);
+	MultiArray32Manager manager({size, size});
+	std::vector<int> indexes{0, 0};
+
+	for (auto _ : state) {
+		for (int i = 0; i < size; i++) {
+			indexes[0] = i;
+
+			for (int j = 0; j < size; j++) {
+				indexes[1] = j;
+				manager.set (indexes, i + j);
+			}
+		}
+
+		benchmark::ClobberMemory ();
+	}
+
+	state.SetItemsProcessed (state.iterations () * size * size);
+}
+BENCHMARK (multiArraySet)->RangeMultiplier (4)->Range (16, 1024);
+
+// Compile-time rank, with cached strides
+static void multiArrayRankedAccess (benchmark::State &state)
+{
+	const int size = state.range (0);
+	MultiArrayManager<std_msgs::Float32MultiArray, 2> manager({size, size});
+
+	for (auto _ : state) {
+		for (int i = 0; i < size; i++)
+			for (int j = 0; j < size; j++)
+				manager(i, j) += 1;
+
+		benchmark::ClobberMemory ();
+	}
+
+	state.SetItemsProcessed (state.iterations () * size * size);
+}
+BENCHMARK (multiArrayRankedAccess)->RangeMultiplier (4)->Range (16, 1024);
+
+// The same message is refilled at every iteration, as for each publish
+static void eigenToMsgThroughput (benchmark::State &state)
+{
+	const int size = state.range (0);
+	const Eigen::MatrixXf matrix = Eigen::MatrixXf::Random (size, size);
+	std_msgs::Float32MultiArray msg;
+
+	for (auto _ : state) {
+		eigenToMsg (matrix, {}, msg);
+		benchmark::DoNotOptimize (msg.data.data ());
+	}
+
+	state.SetBytesProcessed (state.iterations () * size * size * sizeof (float));
+}
+BENCHMARK (eigenToMsgThroughput)->RangeMultiplier (4)->Range (16, 1024);
+
+static void msgToEigenThroughput (benchmark::State &state)
+{
+	const int size = state.range (0);
+	const Eigen::MatrixXf matrix = Eigen::MatrixXf::Random (size, size);
+	auto msg = boost::make_shared<std_msgs::Float32MultiArray> ();
+
+	eigenToMsg (matrix, {}, *msg);
+
+	const std_msgs::Float32MultiArray::ConstPtr received = msg;
+
+	for (auto _ : state) {
+		const auto view = msgToEigen (received);
+		benchmark::DoNotOptimize (view.matrix ().sum ());
+	}
+
+	state.SetBytesProcessed (state.iterations () * size * size * sizeof (float));
+}
+BENCHMARK (msgToEigenThroughput)->RangeMultiplier (4)->Range (16, 1024);
+
+BENCHMARK_MAIN ();
@@ -0,0 +1,126 @@
+#include "../include/nlib/nl_params.h"
+#include <benchmark/benchmark.h>
+
+using namespace nlib;
+
+// Tree of 8 keys per level, 4 levels deep
+static NlParams makeParams ()
+{
+	XmlRpc::XmlRpcValue value;
+
+	for (int a = 0; a < 8; a++) {
+		for (int b = 0; b < 8; b++) {
+			for (int c = 0; c < 8; c++) {
+				XmlRpc::XmlRpcValue &leaf = value["a" + std::to_string (a)]["b" + std::to_string (b)]["c" + std::to_string (c)];
+
+				leaf["int"] = a + b + c;
+				leaf["double"] = 0.5 * (a + b + c);
+				leaf["name"] = std::string ("name");
+			}
+		}
+	}
+
+	value["top"] = 1;
+	value["list"].setSize (16);
+
+	for (int i = 0; i < 16; i++)
+		value["list"][i] = 0.1 * i;
+
+	return NlParams (value);
+}
+
+static void paramsGetTop (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (params.get<int> ("top"));
+}
+BENCHMARK (paramsGetTop);
+
+static void paramsGetNested (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (params.get<int> ("a7/b7/c7/int"));
+}
+BENCHMARK (paramsGetNested);
+
+static void paramsGetString (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (params.get<std::string> ("a7/b7/c7/name"));
+}
+BENCHMARK (paramsGetString);
+
+static void paramsGetDefault (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (params.get<int> ("a7/b7/missing", 0));
+}
+BENCHMARK (paramsGetDefault);
+
+static void paramsTryGetMissing (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (params.tryGet<int> ("a7/b7/c7/missing"));
+}
+BENCHMARK (paramsTryGetMissing);
+
+static void paramsGetVector (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (params.get<double, std::vector> ("list"));
+}
+BENCHMARK (paramsGetVector);
+
+// Subtree lookup then relative get, as modules do
+static void paramsGetSubtree (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+	const NlParams subtree = params["a7/b7/c7"];
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (subtree.get<double> ("double"));
+}
+BENCHMARK (paramsGetSubtree);
+
+struct BoundParams {
+	int value;
+	double gain;
+	std::string name;
+
+	static auto fields () {
+		return std::make_tuple (paramField ("int", &BoundParams::value),
+							paramField ("double", &BoundParams::gain),
+							paramField ("name", &BoundParams::name));
+	}
+};
+
+static void paramsBindingFill (benchmark::State &state)
+{
+	const NlParams params = makeParams ();
+	const NlParams subtree = params["a7/b7/c7"];
+	BoundParams bound;
+	ParamsBinding binding;
+	std::vector<std::string> errors;
+
+	binding.bind (bound);
+
+	for (auto _ : state) {
+		binding.fill (subtree, errors);
+		benchmark::DoNotOptimize (bound);
+	}
+}
+BENCHMARK (paramsBindingFill);
+
+BENCHMARK_MAIN ();
@@ -0,0 +1,76 @@
+#include "../include/nlib/nl_timeseries.h"
+#include <benchmark/benchmark.h>
+#include <random>
+
+using namespace std::chrono;
+
+using Timeseries = nlib::Timeseries<float, microseconds>;
+using Sample = Timeseries::Sample;
+
+static Timeseries makeTimeseries (int size)
+{
+	Timeseries timeseries;
+
+	for (int i = 0; i < size; i++)
+		timeseries.add (Sample (microseconds (10 * i), i));
+
+	return timeseries;
+}
+
+// Random query times, so that every lookup is a search
+static std::vector<microseconds> randomTimes (int size, int count)
+{
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<long> distribution(0, 10L * (size - 1));
+	std::vector<microseconds> times(count);
+
+	for (microseconds &time : times)
+		time = microseconds (distribution (generator));
+
+	return times;
+}
+
+static void timeseriesAt (benchmark::State &state)
+{
+	const Timeseries timeseries = makeTimeseries (state.range (0));
+	const std::vector<microseconds> times = randomTimes (state.range (0), 1024);
+	std::size_t i = 0;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (timeseries.at (times[i++ % times.size ()]));
+
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (timeseriesAt)->RangeMultiplier (8)->Range (8, 1 << 18);
+
+// Increasing queries, the cursor makes each lookup amortized constant
+static void timeseriesAtCursor (benchmark::State &state)
+{
+	const Timeseries timeseries = makeTimeseries (state.range (0));
+	const long span = 10L * (state.range (0) - 1);
+	Timeseries::Cursor cursor;
+	long t = 0;
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize (timeseries.at (microseconds (t), cursor));
+		t = t + 7 <= span ? t + 7 : 0;
+	}
+
+	state.SetItemsProcessed (state.iterations ());
+}
+BENCHMARK (timeseriesAtCursor)->RangeMultiplier (8)->Range (8, 1 << 18);
+
+static void timeseriesAtBatch (benchmark::State &state)
+{
+	const Timeseries timeseries = makeTimeseries (state.range (0));
+	const std::vector<microseconds> times = randomTimes (state.range (0), 1024);
+	std::vector<Timeseries::ResultStatus> status;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize (timeseries.at (times, status));
+
+	state.SetItemsProcessed (state.iterations () * times.size ());
+}
+BENCHMARK (timeseriesAtBatch)->RangeMultiplier (8)->Range (8, 1 << 18);
+
+BENCHMARK_MAIN ();
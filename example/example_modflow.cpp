@@ -29,14 +29,6 @@ void Module3::setupNetwork()
 	requestConnection ("processed_string", &Module3::updateString);
 }
 
-void Module1::initParams(const NlParams &nlParams)
-{
-	_params = {
-		.integer = nlParams.get<int> ("integer"),
-		.boolean = nlParams.get<bool> ("boolean")
-	};
-}
-
 void Module2::initParams(const NlParams &nlParams)
 {
 	_params = {
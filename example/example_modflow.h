@@ -20,14 +20,20 @@ class Module1 : public nlib::NlModule
 	struct Params {
 		int integer;
 		bool boolean;
+
+		static auto fields () {
+			return std::make_tuple (nlib::paramField ("integer", &Params::integer),
+							    nlib::paramField ("boolean", &Params::boolean));
+		}
 	};
 
 public:
 	Module1 (nlib::NlModFlow *modFlow):
 		 nlib::NlModule (modFlow, "module_1")
-	{}
+	{
+		bindParams (_params);
+	}
 
-	void initParams (const nlib::NlParams &nlParams) override;
 	void setupNetwork () override;
 
 	void processInteger (int value);
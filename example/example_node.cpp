@@ -8,8 +8,8 @@ ExampleNode::ExampleNode (int &argc, char **argv, const std::string &name, uint3
 {
 	init<ModFlow> ();
 
-	sources()->declareSource<int> ("integer_source");
-	sources()->declareSource<string> ("string_source");
+	_integerSource = sources()->declareSource<int> ("integer_source");
+	_stringSource = sources()->declareSource<string> ("string_source");
 	sinks()->declareSink ("publish_string", &ExampleNode::publishString, this);
 
 	finalizeModFlow ();
@@ -28,11 +28,11 @@ void ExampleNode::stringCallback (const std_msgs::String &stringMsg)
 {
 	string value = stringMsg.data;
 
-	sources()->callSource ("string_source", value);
+	sources()->callSource (_stringSource, value);
 }
 
 void ExampleNode::onSynchronousClock (const ros::TimerEvent &timerEvent) {
-	sources()->callSource ("integer_source", 1234);
+	sources()->callSource (_integerSource, 1234);
 }
 
 void ExampleNode::publishString(const std::string &value)
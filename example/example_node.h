@@ -26,6 +26,11 @@ public:
 
 protected:
 	void onSynchronousClock (const ros::TimerEvent &timerEvent);
+
+private:
+	// Resolved once, emitting on them does not look up names
+	nlib::TypedChannel<int> _integerSource;
+	nlib::TypedChannel<std::string> _stringSource;
 };
 
 
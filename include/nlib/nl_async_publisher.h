@@ -0,0 +1,333 @@
+#ifndef NL_ASYNC_PUBLISHER_H
+#define NL_ASYNC_PUBLISHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <ros/ros.h>
+#include "nl_utils.h"
+
+/**
+ * @file nl_async_publisher.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/**
+ * @brief Bounded lock-free queue for any number of producers and consumers.
+ * Each cell has a sequence number telling whether it is ready to be written or read in the current lap.
+ */
+template<typename T>
+class BoundedQueue
+{
+	struct Cell {
+		std::atomic<std::size_t> sequence;
+		T value;
+	};
+
+public:
+	/// @param capacity Rounded up to a power of two
+	explicit BoundedQueue (std::size_t capacity);
+	BoundedQueue (const BoundedQueue &) = delete;
+	BoundedQueue &operator = (const BoundedQueue &) = delete;
+
+	/// @return false if the queue is full
+	bool push (T &&value);
+	/// @return false if the queue is empty
+	bool pop (T &value);
+
+	bool empty () const;
+
+private:
+	std::unique_ptr<Cell[]> _cells;
+	const std::size_t _mask;
+	alignas(64) std::atomic<std::size_t> _enqueue;
+	alignas(64) std::atomic<std::size_t> _dequeue;
+};
+
+/**
+ * @brief Preallocated messages of an output, reused once published so that conversions keep their capacity
+ */
+template<class RosMsg>
+class MessagePool
+{
+public:
+	MessagePool (std::size_t size);
+
+	/// @brief A pooled message, or a new one if all are in use
+	boost::shared_ptr<RosMsg> acquire ();
+	/// @brief Give back @p msg, if nobody else holds it, e.g. an intraprocess subscriber
+	void release (boost::shared_ptr<RosMsg> &&msg);
+
+	DEF_SHARED (MessagePool)
+
+private:
+	BoundedQueue<boost::shared_ptr<RosMsg>> _free;
+};
+
+/**
+ * @brief Thread publishing the messages queued by any thread, so that callers never block on serialization
+ * or socket writes. Messages of the same publisher are published in order.
+ */
+class AsyncPublisher
+{
+	struct Entry {
+		std::shared_ptr<ros::Publisher> publisher;
+		boost::shared_ptr<void> msg;
+		std::shared_ptr<void> pool;
+		void (*publish) (Entry &entry);
+	};
+
+public:
+	/// @param capacity Maximum number of queued messages, further ones are dropped
+	AsyncPublisher (std::size_t capacity = 1024);
+	AsyncPublisher (const AsyncPublisher &) = delete;
+	AsyncPublisher &operator = (const AsyncPublisher &) = delete;
+	/// @brief Publish the queued messages, then stop
+	~AsyncPublisher ();
+
+	/**
+	 * @brief Queue @p msg, which must not be modified afterwards. Lock-free.
+	 * Move @p msg in: it goes back to @p pool only if the publisher thread is its last holder.
+	 * @param pool Pool @p msg is given back to once published, if any
+	 * @return false if the queue is full and @p msg has been dropped
+	 */
+	template<class RosMsg>
+	bool publish (const std::shared_ptr<ros::Publisher> &publisher,
+				 boost::shared_ptr<RosMsg> msg,
+				 const std::shared_ptr<MessagePool<RosMsg>> &pool = nullptr);
+
+	/// @brief Block until the messages queued so far are published
+	void flush () const;
+
+	uint64_t dropped () const {
+		return _dropped.load (std::memory_order_relaxed);
+	}
+
+	DEF_SHARED (AsyncPublisher)
+
+private:
+	template<class RosMsg>
+	static void publishEntry (Entry &entry);
+
+	void run ();
+
+private:
+	BoundedQueue<Entry> _queue;
+	// Queued and not yet published
+	std::atomic<std::size_t> _pending;
+	std::atomic<uint64_t> _dropped;
+	std::atomic<bool> _sleeping;
+	bool _stop;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::thread _thread;
+};
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue (std::size_t capacity):
+	 _mask([capacity] {
+		std::size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		return size - 1;
+	} ()),
+	 _enqueue(0),
+	 _dequeue(0)
+{
+	_cells.reset (new Cell[_mask + 1]);
+
+	for (std::size_t i = 0; i <= _mask; i++)
+		_cells[i].sequence.store (i, std::memory_order_relaxed);
+}
+
+template<typename T>
+bool BoundedQueue<T>::push (T &&value)
+{
+	std::size_t position = _enqueue.load (std::memory_order_relaxed);
+	Cell *cell;
+
+	while (true) {
+		cell = &_cells[position & _mask];
+
+		const std::size_t sequence = cell->sequence.load (std::memory_order_acquire);
+		const intptr_t lap = intptr_t (sequence) - intptr_t (position);
+
+		if (lap == 0) {
+			if (_enqueue.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+				break;
+		} else if (lap < 0)
+			return false;
+		else
+			position = _enqueue.load (std::memory_order_relaxed);
+	}
+
+	cell->value = std::move (value);
+	cell->sequence.store (position + 1, std::memory_order_release);
+
+	return true;
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop (T &value)
+{
+	std::size_t position = _dequeue.load (std::memory_order_relaxed);
+	Cell *cell;
+
+	while (true) {
+		cell = &_cells[position & _mask];
+
+		const std::size_t sequence = cell->sequence.load (std::memory_order_acquire);
+		const intptr_t lap = intptr_t (sequence) - intptr_t (position + 1);
+
+		if (lap == 0) {
+			if (_dequeue.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+				break;
+		} else if (lap < 0)
+			return false;
+		else
+			position = _dequeue.load (std::memory_order_relaxed);
+	}
+
+	value = std::move (cell->value);
+	// Ready to be written in the next lap
+	cell->sequence.store (position + _mask + 1, std::memory_order_release);
+
+	return true;
+}
+
+template<typename T>
+bool BoundedQueue<T>::empty () const
+{
+	const std::size_t position = _dequeue.load (std::memory_order_seq_cst);
+
+	return _cells[position & _mask].sequence.load (std::memory_order_seq_cst) != position + 1;
+}
+
+template<class RosMsg>
+MessagePool<RosMsg>::MessagePool (std::size_t size):
+	 _free(size)
+{
+	for (std::size_t i = 0; i < size; i++)
+		_free.push (boost::make_shared<RosMsg> ());
+}
+
+template<class RosMsg>
+boost::shared_ptr<RosMsg> MessagePool<RosMsg>::acquire ()
+{
+	boost::shared_ptr<RosMsg> msg;
+
+	if (!_free.pop (msg))
+		msg = boost::make_shared<RosMsg> ();
+
+	return msg;
+}
+
+template<class RosMsg>
+void MessagePool<RosMsg>::release (boost::shared_ptr<RosMsg> &&msg)
+{
+	// Messages still referenced are left to their holders, the pool refills on the next acquire
+	if (msg.use_count () == 1)
+		_free.push (std::move (msg));
+}
+
+inline AsyncPublisher::AsyncPublisher (std::size_t capacity):
+	 _queue(capacity),
+	 _pending(0),
+	 _dropped(0),
+	 _sleeping(false),
+	 _stop(false)
+{
+	_thread = std::thread (&AsyncPublisher::run, this);
+}
+
+inline AsyncPublisher::~AsyncPublisher ()
+{
+	flush ();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+
+	_wake.notify_one ();
+	_thread.join ();
+}
+
+template<class RosMsg>
+bool AsyncPublisher::publish (const std::shared_ptr<ros::Publisher> &publisher,
+						 boost::shared_ptr<RosMsg> msg,
+						 const std::shared_ptr<MessagePool<RosMsg>> &pool)
+{
+	_pending.fetch_add (1, std::memory_order_relaxed);
+
+	if (!_queue.push (Entry{publisher, std::move (msg), pool, &AsyncPublisher::publishEntry<RosMsg>})) {
+		_pending.fetch_sub (1, std::memory_order_relaxed);
+		_dropped.fetch_add (1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// The publisher thread announces it sleeps before checking the queue a last time
+	if (_sleeping.exchange (false, std::memory_order_seq_cst)) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_wake.notify_one ();
+	}
+
+	return true;
+}
+
+template<class RosMsg>
+void AsyncPublisher::publishEntry (Entry &entry)
+{
+	boost::shared_ptr<RosMsg> msg = boost::static_pointer_cast<RosMsg> (entry.msg);
+
+	entry.msg.reset ();
+	entry.publisher->publish (msg);
+
+	if (entry.pool != nullptr)
+		std::static_pointer_cast<MessagePool<RosMsg>> (entry.pool)->release (std::move (msg));
+}
+
+inline void AsyncPublisher::run ()
+{
+	Entry entry;
+
+	while (true) {
+		if (_queue.pop (entry)) {
+			entry.publish (entry);
+			entry = Entry ();
+			_pending.fetch_sub (1, std::memory_order_release);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		if (_stop)
+			return;
+
+		_sleeping.store (true, std::memory_order_seq_cst);
+
+		if (!_queue.empty ()) {
+			_sleeping.store (false, std::memory_order_relaxed);
+			continue;
+		}
+
+		_wake.wait (lock, [this] { return _stop || !_sleeping.load (std::memory_order_relaxed); });
+	}
+}
+
+inline void AsyncPublisher::flush () const
+{
+	while (_pending.load (std::memory_order_acquire) != 0)
+		std::this_thread::yield ();
+}
+
+}
+
+#endif // NL_ASYNC_PUBLISHER_H
@@ -0,0 +1,360 @@
+#ifndef NL_CONCURRENT_TIMESERIES_H
+#define NL_CONCURRENT_TIMESERIES_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "nl_timeseries.h"
+
+/**
+ * @file nl_concurrent_timeseries.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/**
+ * @brief Timeseries appended by one thread and queried concurrently by any number of threads without locking.
+ *
+ * Samples are stored in fixed size chunks. A published sample is never modified, so readers take a
+ * @ref Snapshot of the published range and query it with the usual @ref TimeseriesBase interface.
+ * Eviction by size and age only moves the start of the published range: a chunk is unlinked once all its samples
+ * are evicted, and reused or freed only after all the snapshots that could reach it are destroyed.
+ * Reclamation is epoch based and never blocks the producer: while old snapshots are alive, chunks are kept.
+ *
+ * add () and setStartTime () must be called from a single thread, the start time before the readers start.
+ * Samples must be appended in order, since published samples cannot be moved: older ones are rejected.
+ */
+template<typename T, typename Duration = std::chrono::microseconds, typename Clock = std::chrono::system_clock,
+		 typename Interpolation = LinearInterpolation>
+class ConcurrentTimeseries
+{
+	static constexpr std::size_t CHUNK_BITS = 8;
+	static constexpr std::size_t CHUNK_SIZE = std::size_t (1) << CHUNK_BITS;
+
+public:
+	using Sample = DelayedObject<T, Duration>;
+	using Time = std::chrono::time_point<Clock, Duration>;
+
+private:
+	struct Chunk {
+		std::array<Sample, CHUNK_SIZE> samples;
+	};
+
+	// Immutable once published
+	struct View {
+		std::vector<Chunk *> chunks;
+		// Index of the first sample of the first chunk
+		uint64_t first;
+	};
+
+	struct Retired {
+		std::vector<View *> views;
+		std::vector<Chunk *> chunks;
+	};
+
+public:
+	/**
+	 * @brief Consistent view of the samples published when it was taken.
+	 * Keeps the samples alive: it should be short lived, or the producer memory grows.
+	 */
+	class Snapshot : public TimeseriesBase<Snapshot, T, Duration, Clock, Interpolation>
+	{
+		using Base = TimeseriesBase<Snapshot, T, Duration, Clock, Interpolation>;
+		friend Base;
+
+	public:
+		using typename Base::Result;
+		using typename Base::ResultStatus;
+		using typename Base::Cursor;
+
+		explicit Snapshot (const ConcurrentTimeseries &timeseries);
+		Snapshot (const Snapshot &) = delete;
+		Snapshot &operator = (const Snapshot &) = delete;
+		~Snapshot ();
+
+		const Sample &operator[] (int i) const {
+			return slot (i >= 0 ? i : _size + i);
+		}
+
+		int size () const {
+			return _size;
+		}
+
+	private:
+		const Sample &slot (std::size_t i) const {
+			const uint64_t index = _begin + i - _view->first;
+
+			return _view->chunks[index >> CHUNK_BITS]->samples[index & (CHUNK_SIZE - 1)];
+		}
+
+		const Duration &delayAt (std::size_t i) const { return slot (i).delay (); }
+		const T &valueAt (std::size_t i) const { return slot (i).obj (); }
+
+	private:
+		const ConcurrentTimeseries &_timeseries;
+		uint64_t _epoch;
+		const View *_view;
+		uint64_t _begin;
+		std::size_t _size;
+	};
+
+	/**
+	 * @param maxSize Maximum number of samples, 0 for no limit
+	 * @param maxAge Maximum delay of the oldest sample before the newest one, zero for no limit
+	 */
+	ConcurrentTimeseries (std::size_t maxSize = 0, const Duration &maxAge = Duration::zero ());
+	ConcurrentTimeseries (const ConcurrentTimeseries &) = delete;
+	ConcurrentTimeseries &operator = (const ConcurrentTimeseries &) = delete;
+	~ConcurrentTimeseries ();
+
+	/**
+	 * @brief Publish @p x and evict the samples out of the limits. Producer thread only.
+	 * @return false if @p x is older than the newest sample and has been rejected
+	 */
+	bool add (const Sample &x);
+
+	template<typename OtherTime>
+	void setStartTime (const OtherTime &startTime) {
+		_startTime = std::chrono::time_point_cast<Duration> (startTime);
+	}
+
+	Snapshot snapshot () const {
+		return Snapshot (*this);
+	}
+
+	/// @brief Interpolate at @p t on a snapshot taken for the query
+	template<typename OtherTime>
+	typename Snapshot::Result at (const OtherTime &t) const {
+		return snapshot ().at (t);
+	}
+
+	/// @brief Number of published samples, approximate while appending
+	int size () const {
+		// The begin is loaded first: it is never after the end published before
+		const uint64_t begin = _begin.load (std::memory_order_acquire);
+
+		return _end.load (std::memory_order_acquire) - begin;
+	}
+
+	/// @brief Number of samples rejected as out of order. Producer thread only.
+	std::size_t rejected () const {
+		return _rejected;
+	}
+
+private:
+	const Sample &producerSample (uint64_t index) const {
+		const View *view = _view.load (std::memory_order_relaxed);
+		const uint64_t offset = index - view->first;
+
+		return view->chunks[offset >> CHUNK_BITS]->samples[offset & (CHUNK_SIZE - 1)];
+	}
+
+	void publish (View *view);
+	Chunk *allocate ();
+	void reclaim ();
+
+	// Readers enter the current epoch, retry if it changed meanwhile, and leave on snapshot destruction
+	uint64_t enter () const;
+	void leave (uint64_t epoch) const;
+
+private:
+	const std::size_t _maxSize;
+	const Duration _maxAge;
+	std::optional<Time> _startTime;
+
+	std::atomic<View *> _view;
+	// Published samples: [_begin, _end)
+	std::atomic<uint64_t> _begin;
+	std::atomic<uint64_t> _end;
+
+	mutable std::atomic<uint64_t> _epoch;
+	mutable std::array<std::atomic<uint64_t>, 2> _readers;
+
+	// Producer state
+	std::array<Retired, 2> _retired;
+	std::vector<Chunk *> _pool;
+	std::size_t _rejected;
+};
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+ConcurrentTimeseries<T, Duration, Clock, Interpolation>::Snapshot::Snapshot (const ConcurrentTimeseries &timeseries):
+	 _timeseries(timeseries),
+	 _epoch(timeseries.enter ())
+{
+	uint64_t end;
+
+	this->_startTime = timeseries._startTime;
+
+	// The begin stored before publishing a view is never before its first sample, and the end is never before the begin.
+	// Retry if the producer added a chunk after the view was loaded
+	do {
+		_view = timeseries._view.load (std::memory_order_acquire);
+		_begin = timeseries._begin.load (std::memory_order_acquire);
+		end = timeseries._end.load (std::memory_order_acquire);
+	} while (end > _view->first + _view->chunks.size () * CHUNK_SIZE);
+
+	_size = end - _begin;
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+ConcurrentTimeseries<T, Duration, Clock, Interpolation>::Snapshot::~Snapshot () {
+	_timeseries.leave (_epoch);
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+ConcurrentTimeseries<T, Duration, Clock, Interpolation>::ConcurrentTimeseries (std::size_t maxSize, const Duration &maxAge):
+	 _maxSize(maxSize),
+	 _maxAge(maxAge),
+	 _view(new View{{}, 0}),
+	 _begin(0),
+	 _end(0),
+	 _epoch(0),
+	 _rejected(0)
+{
+	for (std::atomic<uint64_t> &readers : _readers)
+		readers.store (0, std::memory_order_relaxed);
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+ConcurrentTimeseries<T, Duration, Clock, Interpolation>::~ConcurrentTimeseries ()
+{
+	View *view = _view.load (std::memory_order_relaxed);
+
+	for (Chunk *chunk : view->chunks)
+		delete chunk;
+	delete view;
+
+	for (Retired &retired : _retired) {
+		for (View *retiredView : retired.views)
+			delete retiredView;
+		for (Chunk *chunk : retired.chunks)
+			delete chunk;
+	}
+
+	for (Chunk *chunk : _pool)
+		delete chunk;
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+bool ConcurrentTimeseries<T, Duration, Clock, Interpolation>::add (const Sample &x)
+{
+	const uint64_t end = _end.load (std::memory_order_relaxed);
+	uint64_t begin = _begin.load (std::memory_order_relaxed);
+
+	if (end > begin && x.delay () < producerSample (end - 1).delay ()) {
+		_rejected++;
+		return false;
+	}
+
+	View *view = _view.load (std::memory_order_relaxed);
+
+	if (end == view->first + view->chunks.size () * CHUNK_SIZE) {
+		View *grown = new View (*view);
+
+		grown->chunks.push_back (allocate ());
+		publish (grown);
+		view = grown;
+	}
+
+	const uint64_t offset = end - view->first;
+
+	view->chunks[offset >> CHUNK_BITS]->samples[offset & (CHUNK_SIZE - 1)] = x;
+
+	if (_maxSize > 0 && end + 1 - begin > _maxSize)
+		begin = end + 1 - _maxSize;
+
+	if (_maxAge != Duration::zero ()) {
+		while (x.delay () - producerSample (begin).delay () > _maxAge)
+			begin++;
+	}
+
+	// The begin is published first, so that snapshots never exceed the limits, and before the view without the
+	// evicted chunks
+	_begin.store (begin, std::memory_order_release);
+	_end.store (end + 1, std::memory_order_release);
+
+	const std::size_t evicted = (begin - view->first) >> CHUNK_BITS;
+
+	if (evicted > 0) {
+		Retired &retired = _retired[_epoch.load (std::memory_order_relaxed) & 1];
+
+		retired.chunks.insert (retired.chunks.end (), view->chunks.begin (), view->chunks.begin () + evicted);
+		publish (new View{{view->chunks.begin () + evicted, view->chunks.end ()}, view->first + evicted * CHUNK_SIZE});
+	}
+
+	reclaim ();
+
+	return true;
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+void ConcurrentTimeseries<T, Duration, Clock, Interpolation>::publish (View *view)
+{
+	View *old = _view.exchange (view, std::memory_order_acq_rel);
+
+	_retired[_epoch.load (std::memory_order_relaxed) & 1].views.push_back (old);
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+typename ConcurrentTimeseries<T, Duration, Clock, Interpolation>::Chunk *ConcurrentTimeseries<T, Duration, Clock, Interpolation>::allocate ()
+{
+	if (_pool.empty ())
+		return new Chunk;
+
+	Chunk *chunk = _pool.back ();
+
+	_pool.pop_back ();
+
+	return chunk;
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+void ConcurrentTimeseries<T, Duration, Clock, Interpolation>::reclaim ()
+{
+	const uint64_t epoch = _epoch.load (std::memory_order_relaxed);
+	Retired &previous = _retired[(epoch + 1) & 1];
+	Retired &current = _retired[epoch & 1];
+
+	if (previous.views.empty () && previous.chunks.empty () && current.views.empty () && current.chunks.empty ())
+		return;
+
+	// Objects retired in the previous epoch are reachable only by its readers
+	if (_readers[(epoch + 1) & 1].load (std::memory_order_seq_cst) != 0)
+		return;
+
+	for (View *view : previous.views)
+		delete view;
+	_pool.insert (_pool.end (), previous.chunks.begin (), previous.chunks.end ());
+	previous.views.clear ();
+	previous.chunks.clear ();
+
+	_epoch.store (epoch + 1, std::memory_order_seq_cst);
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+uint64_t ConcurrentTimeseries<T, Duration, Clock, Interpolation>::enter () const
+{
+	while (true) {
+		const uint64_t epoch = _epoch.load (std::memory_order_seq_cst);
+
+		_readers[epoch & 1].fetch_add (1, std::memory_order_seq_cst);
+
+		if (_epoch.load (std::memory_order_seq_cst) == epoch)
+			return epoch;
+
+		_readers[epoch & 1].fetch_sub (1, std::memory_order_release);
+	}
+}
+
+template<typename T, typename Duration, typename Clock, typename Interpolation>
+void ConcurrentTimeseries<T, Duration, Clock, Interpolation>::leave (uint64_t epoch) const {
+	_readers[epoch & 1].fetch_sub (1, std::memory_order_release);
+}
+
+}
+
+#endif // NL_CONCURRENT_TIMESERIES_H
@@ -0,0 +1,682 @@
+#ifndef NL_EXECUTOR_H
+#define NL_EXECUTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "nl_utils.h"
+
+/**
+ * @file nl_executor.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/**
+ * @brief Unit of work run by an @ref NlExecutor or queued in a @ref Strand mailbox.
+ * Tasks are intrusive nodes, so queueing them does not allocate.
+ * @ingroup modflow
+ */
+class ExecutorTask
+{
+public:
+	virtual ~ExecutorTask () = default;
+	virtual void run () = 0;
+	/// @brief Dispose of a task owned by a @ref Strand, once run or if never run. Deletes it by default.
+	virtual void release () { delete this; }
+
+private:
+	friend class Mailbox;
+
+	std::atomic<ExecutorTask *> _next{nullptr};
+};
+
+/**
+ * @brief Task calling a function object
+ * @ingroup modflow
+ */
+template<typename F>
+class FunctionTask final : public ExecutorTask
+{
+public:
+	template<typename G>
+	FunctionTask (G &&function):
+		 _function(std::forward<G> (function))
+	{}
+
+	void run () override {
+		_function ();
+	}
+
+private:
+	F _function;
+};
+
+/**
+ * @brief Intrusive lock-free multiple producers, single consumer queue of tasks.
+ * Pushing is wait-free, popping is only allowed from one consumer at a time.
+ * @ingroup modflow
+ */
+class Mailbox
+{
+public:
+	Mailbox ();
+	Mailbox (const Mailbox &) = delete;
+	Mailbox &operator = (const Mailbox &) = delete;
+
+	/// @brief Append @p task, from any thread
+	void push (ExecutorTask *task);
+
+	/**
+	 * @brief Take the oldest task. Only one thread at a time can be the consumer.
+	 * @return The task or nullptr if the queue is empty or the oldest push is still in progress
+	 */
+	ExecutorTask *pop ();
+
+private:
+	class Stub final : public ExecutorTask {
+		void run () override {}
+	};
+
+	std::atomic<ExecutorTask *> _head;
+	ExecutorTask *_tail;
+	Stub _stub;
+};
+
+class TaskPool;
+
+/**
+ * @brief Task of a @ref TaskPool, calling a function object stored in place.
+ * Released tasks destroy the function and go back to their pool.
+ * @ingroup modflow
+ */
+class PooledTask final : public ExecutorTask
+{
+public:
+	/// @brief Maximum size of the stored function objects
+	static constexpr std::size_t CAPACITY = 96;
+
+	PooledTask (TaskPool *pool):
+		 _pool(pool),
+		 _invoke(nullptr),
+		 _destroy(nullptr)
+	{}
+
+	template<typename F>
+	void assign (F &&function);
+
+	void run () override {
+		_invoke (_storage);
+	}
+
+	void release () override;
+
+private:
+	TaskPool *const _pool;
+	void (*_invoke) (void *);
+	void (*_destroy) (void *);
+	alignas(std::max_align_t) unsigned char _storage[CAPACITY];
+};
+
+/**
+ * @brief Recycled tasks posted by a thread. Any thread returns a task to its pool through a lock-free @ref Mailbox,
+ * so that, after warm up, posting a function object that fits in a @ref PooledTask does not allocate.
+ * Pools outlive their threads: a new thread adopts the pool of a finished one, with the tasks still in flight.
+ * @ingroup modflow
+ */
+class TaskPool
+{
+public:
+	TaskPool (const TaskPool &) = delete;
+	TaskPool &operator = (const TaskPool &) = delete;
+
+	/// @brief Pool of the calling thread
+	static TaskPool &local ();
+
+	/// @brief Task calling @p function, pooled if it fits, allocated otherwise. Tasks are disposed with ExecutorTask::release.
+	template<typename F>
+	ExecutorTask *make (F &&function);
+
+private:
+	friend class PooledTask;
+
+	TaskPool () = default;
+
+	PooledTask *acquire ();
+	void recycle (PooledTask *task);
+
+private:
+	// deque does not move the tasks while growing
+	std::deque<PooledTask> _tasks;
+	// Released tasks, only taken by the thread owning the pool
+	Mailbox _free;
+};
+
+/**
+ * @brief Work-stealing thread pool. Each worker runs tasks from its own queue in LIFO order, for locality,
+ * and when it is empty steals the oldest tasks from the other workers. Tasks posted from outside the pool
+ * are distributed round robin.
+ * @ingroup modflow
+ */
+class NlExecutor
+{
+public:
+	/**
+	 * @brief Start the pool
+	 * @param threads Number of workers, at least one
+	 */
+	NlExecutor (int threads);
+	NlExecutor (const NlExecutor &) = delete;
+	NlExecutor &operator = (const NlExecutor &) = delete;
+
+	/// @brief Wait for all tasks to complete and join workers
+	~NlExecutor ();
+
+	/**
+	 * @brief Schedule @p task for execution. The task is not owned by the executor
+	 * and must be valid until completion.
+	 */
+	void post (ExecutorTask *task);
+
+	/**
+	 * @brief Schedule @p task after the tasks already queued, e.g. a strand yielding the worker. From a worker
+	 * it is queued at the front of its own queue, so that the worker runs it last and the others steal it first.
+	 */
+	void requeue (ExecutorTask *task);
+
+	/// @brief Block until no task is queued or running
+	void waitIdle ();
+
+	int threads () const;
+
+	/// @brief Whether the calling thread is a worker of this pool
+	bool onWorker () const;
+
+	DEF_SHARED (NlExecutor)
+
+private:
+	// Growable ring of tasks: once grown to the peak depth, queueing does not allocate
+	class TaskRing {
+	public:
+		bool empty () const { return _size == 0; }
+
+		void push_back (ExecutorTask *task) {
+			grow ();
+			_tasks[(_head + _size++) & (_tasks.size () - 1)] = task;
+		}
+
+		void push_front (ExecutorTask *task) {
+			grow ();
+			_head = (_head - 1) & (_tasks.size () - 1);
+			_tasks[_head] = task;
+			_size++;
+		}
+
+		ExecutorTask *pop_back () {
+			_size--;
+			return _tasks[(_head + _size) & (_tasks.size () - 1)];
+		}
+
+		ExecutorTask *pop_front () {
+			ExecutorTask *task = _tasks[_head];
+
+			_head = (_head + 1) & (_tasks.size () - 1);
+			_size--;
+			return task;
+		}
+
+	private:
+		void grow ();
+
+	private:
+		// Power of two size
+		std::vector<ExecutorTask *> _tasks;
+		std::size_t _head = 0;
+		std::size_t _size = 0;
+	};
+
+	struct WorkerQueue {
+		std::mutex mutex;
+		TaskRing tasks;
+	};
+
+	void schedule (ExecutorTask *task, bool front);
+	void work (int index);
+	ExecutorTask *take (int index);
+	void finished ();
+
+	struct WorkerContext {
+		const NlExecutor *executor = nullptr;
+		int index = -1;
+	};
+
+	static WorkerContext &currentWorker ();
+
+private:
+	std::vector<std::unique_ptr<WorkerQueue>> _queues;
+	std::vector<std::thread> _workers;
+	std::atomic<unsigned> _nextQueue;
+
+	// Queued tasks wake up sleeping workers
+	std::atomic<int> _queued;
+	std::atomic<int> _sleeping;
+	std::mutex _sleepMutex;
+	std::condition_variable _wake;
+
+	// Queued or running tasks
+	std::atomic<int> _unfinished;
+	std::mutex _idleMutex;
+	std::condition_variable _idle;
+
+	std::atomic<bool> _stop;
+};
+
+/**
+ * @brief Serialized execution context on an @ref NlExecutor, like an actor. Tasks posted to the strand
+ * are queued in a lock-free @ref Mailbox and run one at a time in posting order, while different strands
+ * run in parallel on the pool.
+ * @ingroup modflow
+ */
+class Strand : private ExecutorTask
+{
+public:
+	/**
+	 * @param executor Pool the strand runs on
+	 * @param batch Maximum number of tasks run before yielding the worker to other strands
+	 */
+	Strand (NlExecutor &executor, int batch);
+	Strand (const Strand &) = delete;
+	Strand &operator = (const Strand &) = delete;
+
+	/// @brief Release tasks that have not been run
+	~Strand ();
+
+	/// @brief Queue @p task, taking ownership: it is released (see @ref ExecutorTask::release) once run. Lock-free.
+	void post (ExecutorTask *task);
+
+	/// @brief Queue a task calling @p function, from the @ref TaskPool of the calling thread
+	template<typename F>
+	void post (F &&function);
+
+	/**
+	 * @brief Run @p function on the calling thread, excluding tasks of this strand while it runs.
+	 * It is reentrant, so the strand can synchronously call itself, but two strands calling each other
+	 * synchronously from different threads deadlock.
+	 * @return The return value of @p function
+	 */
+	template<typename F>
+	std::invoke_result_t<F &> runExclusive (F &&function);
+
+	DEF_SHARED (Strand)
+
+private:
+	void run () override;
+
+private:
+	NlExecutor &_executor;
+	const int _batch;
+	Mailbox _mailbox;
+	std::atomic<std::size_t> _pending;
+	std::recursive_mutex _running;
+};
+
+inline Mailbox::Mailbox ():
+	 _head(&_stub),
+	 _tail(&_stub)
+{}
+
+inline void Mailbox::push (ExecutorTask *task)
+{
+	task->_next.store (nullptr, std::memory_order_relaxed);
+	ExecutorTask *previous = _head.exchange (task, std::memory_order_acq_rel);
+	previous->_next.store (task, std::memory_order_release);
+}
+
+inline ExecutorTask *Mailbox::pop ()
+{
+	ExecutorTask *tail = _tail;
+	ExecutorTask *next = tail->_next.load (std::memory_order_acquire);
+
+	if (tail == &_stub) {
+		if (next == nullptr)
+			return nullptr;
+
+		_tail = next;
+		tail = next;
+		next = next->_next.load (std::memory_order_acquire);
+	}
+
+	if (next != nullptr) {
+		_tail = next;
+		return tail;
+	}
+
+	// A producer has swapped the head but has not linked it yet
+	if (tail != _head.load (std::memory_order_acquire))
+		return nullptr;
+
+	// Last task: put the stub back behind it so that it can be detached
+	push (&_stub);
+	next = tail->_next.load (std::memory_order_acquire);
+
+	if (next != nullptr) {
+		_tail = next;
+		return tail;
+	}
+
+	return nullptr;
+}
+
+template<typename F>
+void PooledTask::assign (F &&function)
+{
+	using Function = std::decay_t<F>;
+
+	new (_storage) Function (std::forward<F> (function));
+	_invoke = [] (void *storage) { (*static_cast<Function *> (storage)) (); };
+	_destroy = [] (void *storage) { static_cast<Function *> (storage)->~Function (); };
+}
+
+inline void PooledTask::release ()
+{
+	_destroy (_storage);
+	_pool->recycle (this);
+}
+
+inline TaskPool &TaskPool::local ()
+{
+	struct Registry {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<TaskPool>> pools;
+		std::vector<TaskPool *> idle;
+	};
+
+	// Never destroyed: tasks can be released until the process exits
+	static Registry *registry = new Registry;
+
+	struct Lease {
+		Lease () {
+			std::lock_guard<std::mutex> lock(registry->mutex);
+
+			if (registry->idle.empty ()) {
+				registry->pools.push_back (std::unique_ptr<TaskPool> (new TaskPool));
+				pool = registry->pools.back ().get ();
+			} else {
+				pool = registry->idle.back ();
+				registry->idle.pop_back ();
+			}
+		}
+
+		~Lease () {
+			std::lock_guard<std::mutex> lock(registry->mutex);
+			registry->idle.push_back (pool);
+		}
+
+		TaskPool *pool;
+	};
+
+	thread_local Lease lease;
+
+	return *lease.pool;
+}
+
+template<typename F>
+ExecutorTask *TaskPool::make (F &&function)
+{
+	using Function = std::decay_t<F>;
+
+	if constexpr (sizeof (Function) <= PooledTask::CAPACITY && alignof (Function) <= alignof (std::max_align_t)) {
+		PooledTask *task = acquire ();
+
+		task->assign (std::forward<F> (function));
+		return task;
+	} else
+		return new FunctionTask<Function> (std::forward<F> (function));
+}
+
+inline PooledTask *TaskPool::acquire ()
+{
+	// Null also while a release is being linked: a new task is created meanwhile
+	ExecutorTask *task = _free.pop ();
+
+	if (task != nullptr)
+		return static_cast<PooledTask *> (task);
+
+	_tasks.emplace_back (this);
+
+	return &_tasks.back ();
+}
+
+inline void TaskPool::recycle (PooledTask *task) {
+	_free.push (task);
+}
+
+inline void NlExecutor::TaskRing::grow ()
+{
+	if (_size < _tasks.size ())
+		return;
+
+	std::vector<ExecutorTask *> tasks(std::max<std::size_t> (16, 2 * _tasks.size ()));
+
+	for (std::size_t i = 0; i < _size; i++)
+		tasks[i] = _tasks[(_head + i) & (_tasks.size () - 1)];
+
+	_tasks.swap (tasks);
+	_head = 0;
+}
+
+inline NlExecutor::NlExecutor (int threads):
+	 _nextQueue(0),
+	 _queued(0),
+	 _sleeping(0),
+	 _unfinished(0),
+	 _stop(false)
+{
+	assert (threads > 0 && "Executor needs at least one thread");
+
+	for (int i = 0; i < threads; i++)
+		_queues.push_back (std::make_unique<WorkerQueue> ());
+
+	for (int i = 0; i < threads; i++)
+		_workers.emplace_back (&NlExecutor::work, this, i);
+}
+
+inline NlExecutor::~NlExecutor ()
+{
+	waitIdle ();
+
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_stop = true;
+	}
+	_wake.notify_all ();
+
+	for (std::thread &worker : _workers)
+		worker.join ();
+}
+
+inline NlExecutor::WorkerContext &NlExecutor::currentWorker () {
+	thread_local WorkerContext context;
+	return context;
+}
+
+inline int NlExecutor::threads () const {
+	return _workers.size ();
+}
+
+inline bool NlExecutor::onWorker () const {
+	return currentWorker ().executor == this;
+}
+
+inline void NlExecutor::post (ExecutorTask *task) {
+	schedule (task, false);
+}
+
+inline void NlExecutor::requeue (ExecutorTask *task) {
+	schedule (task, true);
+}
+
+inline void NlExecutor::schedule (ExecutorTask *task, bool front)
+{
+	const WorkerContext &worker = currentWorker ();
+	int index;
+
+	// Tasks posted from outside this pool are distributed round robin
+	if (worker.executor == this)
+		index = worker.index;
+	else
+		index = _nextQueue.fetch_add (1, std::memory_order_relaxed) % _queues.size ();
+
+	_unfinished.fetch_add (1);
+
+	{
+		std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+
+		if (front)
+			_queues[index]->tasks.push_front (task);
+		else
+			_queues[index]->tasks.push_back (task);
+	}
+
+	_queued.fetch_add (1);
+
+	if (_sleeping.load () > 0) {
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_wake.notify_one ();
+	}
+}
+
+inline ExecutorTask *NlExecutor::take (int index)
+{
+	const int count = _queues.size ();
+
+	for (int i = 0; i < count; i++) {
+		WorkerQueue &queue = *_queues[(index + i) % count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.tasks.empty ())
+			continue;
+
+		// Own queue from the back, stolen ones from the front
+		ExecutorTask *task = i == 0 ? queue.tasks.pop_back () : queue.tasks.pop_front ();
+
+		_queued.fetch_sub (1);
+		return task;
+	}
+
+	return nullptr;
+}
+
+inline void NlExecutor::work (int index)
+{
+	currentWorker () = {this, index};
+
+	while (true) {
+		ExecutorTask *task = take (index);
+
+		if (task != nullptr) {
+			task->run ();
+			finished ();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+
+		_sleeping.fetch_add (1);
+		_wake.wait (lock, [this] { return _queued.load () > 0 || _stop; });
+		_sleeping.fetch_sub (1);
+
+		if (_stop && _queued.load () == 0)
+			return;
+	}
+}
+
+inline void NlExecutor::finished ()
+{
+	if (_unfinished.fetch_sub (1) == 1) {
+		std::lock_guard<std::mutex> lock(_idleMutex);
+		_idle.notify_all ();
+	}
+}
+
+inline void NlExecutor::waitIdle ()
+{
+	std::unique_lock<std::mutex> lock(_idleMutex);
+
+	_idle.wait (lock, [this] { return _unfinished.load () == 0; });
+}
+
+inline Strand::Strand (NlExecutor &executor, int batch):
+	 _executor(executor),
+	 _batch(batch),
+	 _pending(0)
+{}
+
+inline Strand::~Strand ()
+{
+	ExecutorTask *task;
+
+	while ((task = _mailbox.pop ()) != nullptr)
+		task->release ();
+}
+
+inline void Strand::post (ExecutorTask *task)
+{
+	_mailbox.push (task);
+
+	// Only the post that finds the strand idle schedules it
+	if (_pending.fetch_add (1, std::memory_order_acq_rel) == 0)
+		_executor.post (this);
+}
+
+template<typename F>
+void Strand::post (F &&function) {
+	post (TaskPool::local ().make (std::forward<F> (function)));
+}
+
+template<typename F>
+std::invoke_result_t<F &> Strand::runExclusive (F &&function)
+{
+	std::lock_guard<std::recursive_mutex> lock(_running);
+
+	return function ();
+}
+
+inline void Strand::run ()
+{
+	for (int done = 1; ; done++) {
+		ExecutorTask *task;
+
+		// Pending tasks are counted before being linked, wait for the producer to complete the push
+		while ((task = _mailbox.pop ()) == nullptr)
+			std::this_thread::yield ();
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(_running);
+			task->run ();
+		}
+
+		task->release ();
+
+		if (_pending.fetch_sub (1, std::memory_order_acq_rel) == 1)
+			return;
+
+		// Behind the other strands of this worker, that take it LIFO
+		if (done == _batch) {
+			_executor.requeue (this);
+			return;
+		}
+	}
+}
+
+}
+
+#endif // NL_EXECUTOR_H
@@ -0,0 +1,570 @@
+#ifndef NL_FLAT_TREE_H
+#define NL_FLAT_TREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+/**
+ * @file nl_flat_tree.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+// Binary format: header, then the nodes in index order, each with its parent index, data and label
+constexpr char FLAT_TREE_MAGIC[4] = {'N', 'L', 'F', 'T'};
+constexpr uint32_t FLAT_TREE_VERSION = 1;
+
+struct FlatTreeHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t dataSize;
+	uint32_t labelSize;
+	uint64_t count;
+};
+
+/**
+ * @brief Tree whose nodes are stored contiguously and linked by index, for trees of many nodes.
+ * Compared to @ref Tree, adding a node does not allocate once the storage is reserved, the tree is cleared
+ * in a single step, keeping its storage for reuse, and all the traversals are iterative.
+ * Nodes are identified by their index, which is stable: nodes are never moved relative to each other nor removed.
+ * Since a node is always created after its parent, the reverse index order visits children before parents.
+ */
+template<typename DataType, typename LabelType = std::monostate, typename ExtraDataType = std::monostate>
+class FlatTree
+{
+public:
+	using Index = uint32_t;
+	static constexpr Index NONE = UINT32_MAX;
+
+	struct Node {
+		DataType data;
+		LabelType label;
+		Index parent;
+		Index firstChild;
+		Index lastChild;
+		Index nextSibling;
+		int childrenCount;
+		int depth;
+	};
+
+	enum Algorithm {
+		DEPTH_FIRST_PREORDER,
+		DEPTH_FIRST_POSTORDER,
+		BREADTH_FIRST
+	};
+
+	/// @brief Range of the children of a node, in insertion order
+	class Children
+	{
+	public:
+		class iterator {
+		public:
+			iterator (const FlatTree *tree, Index index): _tree(tree), _index(index) {}
+
+			Index operator * () const { return _index; }
+			iterator &operator ++ () { _index = (*_tree)[_index].nextSibling; return *this; }
+			bool operator != (const iterator &other) const { return _index != other._index; }
+			bool operator == (const iterator &other) const { return _index == other._index; }
+
+		private:
+			const FlatTree *_tree;
+			Index _index;
+		};
+
+		Children (const FlatTree *tree, Index first): _tree(tree), _first(first) {}
+
+		iterator begin () const { return iterator (_tree, _first); }
+		iterator end () const { return iterator (_tree, NONE); }
+
+	private:
+		const FlatTree *_tree;
+		Index _first;
+	};
+
+	FlatTree (DataType &&rootValue, const LabelType &label = LabelType());
+	FlatTree (const DataType &rootValue, const LabelType &label = LabelType()):
+		  FlatTree (DataType {rootValue}, label)
+	{}
+
+	Index root () const { return 0; }
+
+	Index addChild (Index parent, DataType &&data, const LabelType &label = LabelType());
+	// This performs a deep copy
+	Index addChild (Index parent, const DataType &data, const LabelType &label = LabelType()) {
+		return addChild (parent, DataType {data}, label);
+	}
+
+	Node &operator [] (Index index) { return _nodes[index]; }
+	const Node &operator [] (Index index) const { return _nodes[index]; }
+
+	DataType &data (Index index) { return _nodes[index].data; }
+	const DataType &data (Index index) const { return _nodes[index].data; }
+	LabelType &label (Index index) { return _nodes[index].label; }
+	const LabelType &label (Index index) const { return _nodes[index].label; }
+	Index parent (Index index) const { return _nodes[index].parent; }
+	int childrenCount (Index index) const { return _nodes[index].childrenCount; }
+	int depth (Index index) const { return _nodes[index].depth; }
+	bool isRoot (Index index) const { return index == root (); }
+	bool isLeaf (Index index) const { return _nodes[index].childrenCount == 0; }
+	Children children (Index index) const { return Children (this, _nodes[index].firstChild); }
+
+	/// @return NONE if the tree is not deep enough
+	Index nthAncestor (Index index, int n) const;
+	// Find descendant for nodes that only have 1 child in the whole descendant line
+	Index nthDescendant (Index index, int n) const;
+
+	std::size_t size () const { return _nodes.size (); }
+	void reserve (std::size_t count) { _nodes.reserve (count); }
+
+	/**
+	 * @brief Remove all the nodes and restart from a new root, keeping the storage.
+	 * Constant time if DataType and LabelType are trivially destructible.
+	 */
+	void clear (DataType &&rootValue, const LabelType &label = LabelType());
+
+	/**
+	 * @brief Visit the subtree of @p from with @p algorithm, iteratively
+	 * @param visit Callable as visit (Index)
+	 */
+	template<typename Visit>
+	void traverse (Algorithm algorithm, const Visit &visit, Index from = 0) const;
+
+	/**
+	 * @brief Visit each node of the subtree of @p from after all its children, visiting separate subtrees in parallel.
+	 * Nodes are not visited in depth first order: @p visit shall only access the node and its children.
+	 * @param visit Callable as visit (Index), concurrently from @p threads threads
+	 * @param threads Number of threads, including the calling one
+	 */
+	template<typename Visit>
+	void parallelPostorder (const Visit &visit, int threads, Index from = 0) const;
+
+	/**
+	 * @brief Write the subtree of @p from as JSON to @p out in a single pass, in the format of @ref Tree::toJson
+	 * @param printData Callable as printData (Index), returning a value that can be written to @p out
+	 */
+	template<typename Fcn>
+	void writeJson (std::ostream &out, const Fcn &printData, Index from = 0) const;
+	void writeJson (std::ostream &out, Index from = 0) const {
+		writeJson (out, [this] (Index node) -> const DataType & { return data (node); }, from);
+	}
+
+	/**
+	 * @brief Write the tree as a Graphviz digraph to @p out in a single pass
+	 * @param printNode Callable as printNode (Index), returning a value that can be written to @p out
+	 */
+	template<typename Fcn>
+	void writeGraphviz (std::ostream &out, const Fcn &printNode) const;
+	void writeGraphviz (std::ostream &out) const {
+		writeGraphviz (out, [this] (Index node) -> const DataType & { return data (node); });
+	}
+
+	/**
+	 * @brief Write the nodes in the compact binary format read by @ref readBinary.
+	 * Data and labels are written as they are in memory, so they must be trivially copyable.
+	 */
+	void writeBinary (std::ostream &out) const;
+	/// @brief Append the binary format to @p buffer
+	void writeBinary (std::vector<char> &buffer) const;
+
+	/// @return The tree written by @ref writeBinary, std::nullopt if the stream is not a valid tree of this type
+	static std::optional<FlatTree> readBinary (std::istream &in);
+
+	/**
+	 * @brief Run @p write on a copy of the tree on another thread, so that the tree can be modified meanwhile.
+	 * The copy is a single contiguous copy of the nodes.
+	 * @param write Callable as write (const FlatTree &), e.g. writing the snapshot to a file
+	 * @return Future that is ready when @p write returns
+	 */
+	template<typename Write>
+	std::future<void> writeAsync (Write write) const;
+
+	template<typename U = ExtraDataType>
+	std::enable_if_t<!std::is_same_v<U, std::monostate>, const ExtraDataType &>
+	extraData () const {
+		return _extraData;
+	}
+
+	template<typename U = ExtraDataType>
+	std::enable_if_t<!std::is_same_v<U, std::monostate>, ExtraDataType &>
+	extraData () {
+		return _extraData;
+	}
+
+private:
+	template<typename Visit>
+	void depthFirstPreorder (Index from, const Visit &visit) const;
+	template<typename Visit>
+	void depthFirstPostorder (Index from, const Visit &visit) const;
+	template<typename Visit>
+	void breadthFirst (Index from, const Visit &visit) const;
+
+	static constexpr std::size_t RECORD_SIZE = sizeof (Index) + sizeof (DataType) + sizeof (LabelType);
+
+	void writeRecord (Index index, char *record) const;
+
+private:
+	ExtraDataType _extraData;
+	std::vector<Node> _nodes;
+};
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+FlatTree<DataType, LabelType, ExtraDataType>::FlatTree (DataType &&rootValue, const LabelType &label)
+{
+	_nodes.push_back (Node{std::move (rootValue), label, NONE, NONE, NONE, NONE, 0, 0});
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+typename FlatTree<DataType, LabelType, ExtraDataType>::Index
+FlatTree<DataType, LabelType, ExtraDataType>::addChild (Index parent, DataType &&data, const LabelType &label)
+{
+	const Index index = _nodes.size ();
+
+	_nodes.push_back (Node{std::move (data), label, parent, NONE, NONE, NONE, 0, _nodes[parent].depth + 1});
+
+	Node &parentNode = _nodes[parent];
+
+	if (parentNode.lastChild == NONE)
+		parentNode.firstChild = index;
+	else
+		_nodes[parentNode.lastChild].nextSibling = index;
+
+	parentNode.lastChild = index;
+	parentNode.childrenCount++;
+
+	return index;
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+typename FlatTree<DataType, LabelType, ExtraDataType>::Index
+FlatTree<DataType, LabelType, ExtraDataType>::nthAncestor (Index index, int n) const
+{
+	while (n > 0 && index != NONE) {
+		index = _nodes[index].parent;
+		n--;
+	}
+
+	return index;
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+typename FlatTree<DataType, LabelType, ExtraDataType>::Index
+FlatTree<DataType, LabelType, ExtraDataType>::nthDescendant (Index index, int n) const
+{
+	while (n > 0) {
+		if (_nodes[index].childrenCount != 1)
+			return NONE;
+		index = _nodes[index].firstChild;
+		n--;
+	}
+
+	return index;
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+void FlatTree<DataType, LabelType, ExtraDataType>::clear (DataType &&rootValue, const LabelType &label)
+{
+	_nodes.clear ();
+	_nodes.push_back (Node{std::move (rootValue), label, NONE, NONE, NONE, NONE, 0, 0});
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Visit>
+void FlatTree<DataType, LabelType, ExtraDataType>::traverse (Algorithm algorithm, const Visit &visit, Index from) const
+{
+	switch (algorithm) {
+	case DEPTH_FIRST_PREORDER:
+		depthFirstPreorder (from, visit);
+		break;
+	case DEPTH_FIRST_POSTORDER:
+		depthFirstPostorder (from, visit);
+		break;
+	case BREADTH_FIRST:
+		breadthFirst (from, visit);
+		break;
+	default:
+		break;
+	}
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Visit>
+void FlatTree<DataType, LabelType, ExtraDataType>::depthFirstPreorder (Index from, const Visit &visit) const
+{
+	Index node = from;
+
+	// Siblings are linked: move down first, then to the next sibling of the closest ancestor that has one
+	while (node != NONE) {
+		visit (node);
+
+		if (_nodes[node].firstChild != NONE) {
+			node = _nodes[node].firstChild;
+			continue;
+		}
+
+		while (node != from && _nodes[node].nextSibling == NONE)
+			node = _nodes[node].parent;
+
+		node = node == from ? NONE : _nodes[node].nextSibling;
+	}
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Visit>
+void FlatTree<DataType, LabelType, ExtraDataType>::depthFirstPostorder (Index from, const Visit &visit) const
+{
+	Index node = from;
+
+	while (_nodes[node].firstChild != NONE)
+		node = _nodes[node].firstChild;
+
+	// Leftmost leaf first, then after each node the leftmost leaf of its next sibling, or its parent
+	while (true) {
+		visit (node);
+
+		if (node == from)
+			break;
+
+		if (_nodes[node].nextSibling == NONE) {
+			node = _nodes[node].parent;
+			continue;
+		}
+
+		node = _nodes[node].nextSibling;
+
+		while (_nodes[node].firstChild != NONE)
+			node = _nodes[node].firstChild;
+	}
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Visit>
+void FlatTree<DataType, LabelType, ExtraDataType>::breadthFirst (Index from, const Visit &visit) const
+{
+	std::vector<Index> queue{from};
+
+	for (std::size_t i = 0; i < queue.size (); i++) {
+		visit (queue[i]);
+
+		for (Index child = _nodes[queue[i]].firstChild; child != NONE; child = _nodes[child].nextSibling)
+			queue.push_back (child);
+	}
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Visit>
+void FlatTree<DataType, LabelType, ExtraDataType>::parallelPostorder (const Visit &visit, int threads, Index from) const
+{
+	if (threads <= 1) {
+		depthFirstPostorder (from, visit);
+		return;
+	}
+
+	// Expand the top of the tree breadth first until there are enough subtrees to balance the threads
+	const std::size_t subtreesCount = 8 * threads;
+	std::vector<Index> top, subtrees{from};
+
+	while (!subtrees.empty () && subtrees.size () < subtreesCount) {
+		std::vector<Index> next;
+
+		for (Index node : subtrees) {
+			top.push_back (node);
+
+			for (Index child = _nodes[node].firstChild; child != NONE; child = _nodes[child].nextSibling)
+				next.push_back (child);
+		}
+
+		subtrees.swap (next);
+	}
+
+	std::atomic<std::size_t> nextSubtree(0);
+	auto work = [&] {
+		for (std::size_t i = nextSubtree++; i < subtrees.size (); i = nextSubtree++)
+			depthFirstPostorder (subtrees[i], visit);
+	};
+
+	std::vector<std::thread> workers;
+
+	for (int i = 1; i < threads; i++)
+		workers.emplace_back (work);
+
+	work ();
+
+	for (std::thread &worker : workers)
+		worker.join ();
+
+	// Top nodes are in breadth first order: reversed, children come before parents
+	for (auto it = top.rbegin (); it != top.rend (); it++)
+		visit (*it);
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Fcn>
+void FlatTree<DataType, LabelType, ExtraDataType>::writeJson (std::ostream &out, const Fcn &printData, Index from) const
+{
+	Index node = from;
+
+	// Same walk as the preorder traversal, closing the nodes when moving up
+	while (true) {
+		out << "{";
+
+		if constexpr (!std::is_same_v<LabelType, std::monostate>)
+			out << "\"label\": " << label (node) << ", ";
+
+		out << "\"data\": " << printData (node);
+
+		if (_nodes[node].firstChild != NONE) {
+			out << ", \"children\": [";
+			node = _nodes[node].firstChild;
+			continue;
+		}
+
+		out << "}";
+
+		while (node != from && _nodes[node].nextSibling == NONE) {
+			node = _nodes[node].parent;
+			out << "]}";
+		}
+
+		if (node == from)
+			break;
+
+		out << ", ";
+		node = _nodes[node].nextSibling;
+	}
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Fcn>
+void FlatTree<DataType, LabelType, ExtraDataType>::writeGraphviz (std::ostream &out, const Fcn &printNode) const
+{
+	out << "digraph Tree {\n";
+
+	depthFirstPreorder (root (), [&] (Index node) {
+		if (!isRoot (node))
+			out << printNode (_nodes[node].parent) << " -> " << printNode (node) << "; \n";
+	});
+
+	out << "}";
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+void FlatTree<DataType, LabelType, ExtraDataType>::writeRecord (Index index, char *record) const
+{
+	const Node &node = _nodes[index];
+
+	memcpy (record, &node.parent, sizeof (Index));
+	memcpy (record + sizeof (Index), &node.data, sizeof (DataType));
+	memcpy (record + sizeof (Index) + sizeof (DataType), &node.label, sizeof (LabelType));
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+void FlatTree<DataType, LabelType, ExtraDataType>::writeBinary (std::ostream &out) const
+{
+	static_assert (std::is_trivially_copyable_v<DataType> && std::is_trivially_copyable_v<LabelType>,
+				"Binary format requires trivially copyable data and labels");
+
+	const FlatTreeHeader header{{FLAT_TREE_MAGIC[0], FLAT_TREE_MAGIC[1], FLAT_TREE_MAGIC[2], FLAT_TREE_MAGIC[3]},
+								FLAT_TREE_VERSION, sizeof (DataType), sizeof (LabelType), _nodes.size ()};
+	// Records are written in blocks, to keep the stream calls few
+	constexpr std::size_t BLOCK_RECORDS = std::max<std::size_t> (1, 65536 / RECORD_SIZE);
+	std::vector<char> block(BLOCK_RECORDS * RECORD_SIZE);
+
+	out.write (reinterpret_cast<const char *> (&header), sizeof (header));
+
+	for (std::size_t first = 0; first < _nodes.size (); first += BLOCK_RECORDS) {
+		const std::size_t count = std::min (BLOCK_RECORDS, _nodes.size () - first);
+
+		for (std::size_t i = 0; i < count; i++)
+			writeRecord (first + i, block.data () + i * RECORD_SIZE);
+
+		out.write (block.data (), count * RECORD_SIZE);
+	}
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+void FlatTree<DataType, LabelType, ExtraDataType>::writeBinary (std::vector<char> &buffer) const
+{
+	static_assert (std::is_trivially_copyable_v<DataType> && std::is_trivially_copyable_v<LabelType>,
+				"Binary format requires trivially copyable data and labels");
+
+	const FlatTreeHeader header{{FLAT_TREE_MAGIC[0], FLAT_TREE_MAGIC[1], FLAT_TREE_MAGIC[2], FLAT_TREE_MAGIC[3]},
+								FLAT_TREE_VERSION, sizeof (DataType), sizeof (LabelType), _nodes.size ()};
+	const std::size_t offset = buffer.size ();
+
+	buffer.resize (offset + sizeof (header) + _nodes.size () * RECORD_SIZE);
+	memcpy (buffer.data () + offset, &header, sizeof (header));
+
+	for (std::size_t i = 0; i < _nodes.size (); i++)
+		writeRecord (i, buffer.data () + offset + sizeof (header) + i * RECORD_SIZE);
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+std::optional<FlatTree<DataType, LabelType, ExtraDataType>> FlatTree<DataType, LabelType, ExtraDataType>::readBinary (std::istream &in)
+{
+	FlatTreeHeader header;
+
+	if (!in.read (reinterpret_cast<char *> (&header), sizeof (header)) ||
+		memcmp (header.magic, FLAT_TREE_MAGIC, sizeof (FLAT_TREE_MAGIC)) != 0 || header.version != FLAT_TREE_VERSION ||
+		header.dataSize != sizeof (DataType) || header.labelSize != sizeof (LabelType) || header.count == 0)
+		return std::nullopt;
+
+	char record[RECORD_SIZE];
+	Index parent;
+	DataType data;
+	LabelType label;
+
+	auto read = [&] () {
+		if (!in.read (record, RECORD_SIZE))
+			return false;
+
+		memcpy (&parent, record, sizeof (Index));
+		memcpy (&data, record + sizeof (Index), sizeof (DataType));
+		memcpy (&label, record + sizeof (Index) + sizeof (DataType), sizeof (LabelType));
+
+		return true;
+	};
+
+	if (!read () || parent != NONE)
+		return std::nullopt;
+
+	FlatTree tree(std::move (data), label);
+
+	tree.reserve (header.count);
+
+	for (uint64_t i = 1; i < header.count; i++) {
+		// Parents always come before their children
+		if (!read () || parent >= i)
+			return std::nullopt;
+
+		tree.addChild (parent, std::move (data), label);
+	}
+
+	return tree;
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Write>
+std::future<void> FlatTree<DataType, LabelType, ExtraDataType>::writeAsync (Write write) const
+{
+	std::shared_ptr<const FlatTree> snapshot = std::make_shared<const FlatTree> (*this);
+
+	return std::async (std::launch::async, [snapshot, write = std::move (write)] () {
+		write (*snapshot);
+	});
+}
+
+}
+
+#endif // NL_FLAT_TREE_H
@@ -6,8 +6,15 @@
 #include <type_traits>
 #include <typeindex>
 #include <set>
+#include <unordered_map>
+#include <array>
+#include <deque>
+#include <tuple>
 #include "nl_params.h"
 #include "nl_utils.h"
+#include "nl_executor.h"
+#include "nl_trace.h"
+#include "nl_stats.h"
 #include <cxxabi.h>
 
 /**
@@ -24,33 +31,60 @@ class NlModule;
 class NlSources;
 class NlSinks;
 class Channel;
+struct ChannelInfo;
 
+/**
+ * @brief Maximum depth of a cascade of events, i.e. the length of the
+ * ancestor path stored inline in each @ref Event. Define it before including
+ * this header to override it.
+ * @ingroup modflow
+ */
+#ifndef NLIB_MODFLOW_MAX_DEPTH
+#define NLIB_MODFLOW_MAX_DEPTH 32
+#endif
+
+/**
+ * @def NLIB_MODFLOW_UNCHECKED
+ * @brief Define it before including this header to skip the run-time checks of every emit, i.e. the ownership of the channel
+ * and the type of the values emitted on untyped channels. Connections are still validated once by @ref NlModFlow::finalize.
+ * @ingroup modflow
+ */
+
+/**
+ * @brief Information on an emitted event and on the chain of emits that caused it.
+ * The ancestor path is stored inline with fixed capacity, so an event does not
+ * refer to its parent and can be recycled as soon as its emit returns.
+ * Events are only handled through non-owning pointers acquired via @ref ScopedEvent.
+ * @ingroup modflow
+ */
 class Event
 {
 public:
-	DEF_SHARED (Event)
-
-	Event (const NlModule *module,
-		  const Channel *channel):
-		 _parent(nullptr),
-		 _module(module),
-		 _channel(channel),
-		 _depth(0)
-	{}
+	/// @brief Non-owning pointer, valid as long as the emit that created the event is running
+	using Ptr = const Event *;
 
-	Event (const std::shared_ptr<Event> &parent,
-		  const NlModule *module,
-		  const Channel *channel):
-		 _parent(parent),
-		 _module(module),
-		 _channel(channel),
-		 _depth(parent->depth () + 1)
-	{}
+	struct Hop {
+		const NlModule *module;
+		const ChannelInfo *channel;
+	};
 
-	std::shared_ptr<Event> branch (const NlModule *module,
-							 const Channel *channel) {
-		return std::make_shared<Event> (_parent, module, channel);
-	}
+	Event () = default;
+
+	/// @brief Copy only the used part of the ancestor path, e.g. when an event is queued on an executor
+	Event (const Event &other);
+	Event &operator = (const Event &other);
+
+	/// @brief Initialize a root event, i.e. the first emit of a cascade
+	/// @param mask Debug filter entries matching @p module and @p channel
+	void reset (const NlModule *module,
+			  const Channel &channel,
+			  uint64_t mask);
+
+	/// @brief Initialize an event caused by @p parent, inheriting its mask
+	void reset (const Event &parent,
+			  const NlModule *module,
+			  const Channel &channel,
+			  uint64_t mask);
 
 	bool channelInAncestors (const std::string &name) const;
 	bool moduleInAncestors (const std::string &name) const;
@@ -59,13 +93,106 @@ public:
 	int depth () const {
 		return _depth;
 	}
+	bool isRoot () const {
+		return _depth == 0;
+	}
+
+	/// @brief Bitmask of the debug filter entries matching any module or channel in the ancestor path
+	uint64_t ancestorsMask () const {
+		return _mask;
+	}
+
+	/// @brief Whether the event is printed in debug mode. The filters are evaluated once, when the event is emitted.
+	bool traced () const {
+		return _traced;
+	}
+
+	void setTraced (bool traced) {
+		_traced = traced;
+	}
+
+	/// @brief Channel of the emit at the root of the cascade
+	Channel rootChannel () const;
+
+	/// @brief Time of the emit at the root of the cascade in nanoseconds, 0 if statistics are disabled
+	uint64_t rootTime () const {
+		return _rootTime;
+	}
+
+	void setRootTime (uint64_t time) {
+		_rootTime = time;
+	}
+
+private:
+	std::array<Hop, NLIB_MODFLOW_MAX_DEPTH> _path;
+	int _depth;
+	uint64_t _mask;
+	uint64_t _rootTime;
+	bool _traced;
+};
+
+/**
+ * @brief Thread-local stack of recycled @ref Event nodes. Emits are nested, so events are
+ * acquired and released in LIFO order: once a source-triggered cascade is over all its nodes
+ * are available again and, after warm up, propagating events does not allocate.
+ * @ingroup modflow
+ */
+class EventArena
+{
+public:
+	static EventArena &local ();
+
+	Event *acquire ();
+	void release (const Event *event);
+
+private:
+	EventArena ():
+		 _top(0)
+	{}
+
+	// deque does not invalidate references to nodes in use while growing
+	std::deque<Event> _events;
+	std::size_t _top;
+};
+
+/**
+ * @brief RAII handle of an event acquired from the thread-local @ref EventArena.
+ * The event lives until the handle goes out of scope at the end of the emit.
+ * @ingroup modflow
+ */
+class ScopedEvent
+{
+public:
+	/**
+	 * @brief Acquire a new event
+	 * @param parent Event that caused this one or nullptr if this is the root of a cascade
+	 * @param module Emitting module
+	 * @param channel Channel the event is emitted on
+	 * @param mask Debug filter entries matching @p module and @p channel
+	 */
+	ScopedEvent (Event::Ptr parent,
+			   const NlModule *module,
+			   const Channel &channel,
+			   uint64_t mask = 0);
+	ScopedEvent (const ScopedEvent &) = delete;
+	ScopedEvent &operator = (const ScopedEvent &) = delete;
+	~ScopedEvent ();
+
+	Event::Ptr get () const {
+		return _event;
+	}
+
+	Event *get () {
+		return _event;
+	}
+
+	const Event *operator -> () const {
+		return _event;
+	}
 
 private:
-	std::map<std::string, void * const> _resources;
-	const Event::Ptr _parent;
-	const NlModule *_module;
-	const Channel *_channel;
-	const int _depth;
+	EventArena &_arena;
+	Event *_event;
 };
 
 template<typename R, typename ...T>
@@ -78,35 +205,43 @@ using Slot = std::function<R(const Event::Ptr &, const T &...)>;
 
 
 /**
- * @brief Defines a channel that each module can create and to which other modules can connect
+ * @brief Immutable information of a channel, created and owned by @ref NlModFlow
  * @ingroup modflow
  */
-class Channel
+struct ChannelInfo
 {
-	template<typename ...typeids>
-	static std::vector<std::type_index> stackTypes (const typeids *...ids);
+	/// @brief Unique identifier of the channel
+	ChannelId id;
+	/// @brief Unique name that can resolve to the id from a ModFlow handler
+	std::string name;
+	/// @brief Sink channels are connected to Parent methods, external to modflow
+	bool isSink;
+	/// @brief Channel type(s) identifier: only slots with same type(s) as channel can be connected
+	std::vector<std::type_index> types;
+	/// @brief Pointer to owner module: only owner can emit events on channels has itself created
+	const NlModule *owner;
+};
 
+/**
+ * @brief Defines a channel that each module can create and to which other modules can connect.
+ * It is a handle to the @ref ChannelInfo stored in @ref NlModFlow, so it is as cheap to copy as a pointer.
+ * @ingroup modflow
+ */
+class Channel
+{
 public:
 	/**
-	 * @brief Create a new channel given:
-	 * @param id  Unique identifier of the channel
-	 * @param name Unique name that can resolve to the id from a ModFlow handler
-	 * @param ids Channel type(s) identifier: only slots with same type(s) as channel can be connected
-	 * @param owner Pointer to owner module: only owner can emit events on channels has itself created
-	 * @param isSink Sink channels are connected to Parent methods, external to modflow
+	 * @brief Create a handle of a channel
+	 * @param info Channel information, that must outlive the handle
 	 */
-	template<typename ...typeids>
-	Channel (ChannelId id,
-		    const std::string &name,
-		    const NlModule *owner,
-		    bool isSink,
-		    const typeids *...ids);
+	explicit Channel (const ChannelInfo *info);
 
 	/**
 	 * @brief Copy constructor
 	 */
 	Channel (const Channel &) = default;
-	Channel () = default;
+	Channel &operator = (const Channel &) = default;
+	Channel ();
 
 	    /// @brief Get unique identifier of the channel
 	ChannelId id () const;
@@ -118,20 +253,90 @@ public:
 	    /// @tparam T Type(s) to check Channel-type with
 	template<typename ...T>
 	bool checkType () const;
-	std::vector<std::type_index> types () const;
+	const std::vector<std::type_index> &types () const;
 	std::string ownerName () const;
 
 	    /// @brief Check whether caller is actually the owner of the channel
 	bool checkOwnership (const NlModule *caller) const;
 
+	    /// @brief Whether the channel is connected to a slot external to modflow
+	bool isSink () const;
+
+	    /// @brief Information the handle refers to
+	const ChannelInfo *info () const;
+
 	DEF_SHARED(Channel)
 
 private:
-	ChannelId _id;
-	bool _isSink;
-	std::string _name;
-	std::vector<std::type_index> _types;
-	const NlModule *_owner;
+	const ChannelInfo *_info;
+};
+
+/**
+ * @brief Channel whose type(s) @p T are known at compile time. It is returned when a channel is created
+ * or declared, so that its type is checked only once when connecting slots. Emitting on a TypedChannel
+ * skips the run-time type check and directly calls the typed slots stored in the connections array.
+ * It converts implicitly to @ref Channel, which can still be used as slower, type-checked path.
+ * @tparam T Channel type(s)
+ * @ingroup modflow
+ */
+template<typename ...T>
+class TypedChannel : public Channel
+{
+public:
+	TypedChannel () = default;
+
+	/**
+	 * @brief Get a typed handle of @p channel, checking once that its type matches @p T
+	 * @param channel Channel information, e.g. as resolved by name
+	 */
+	explicit TypedChannel (const Channel &channel);
+};
+
+/**
+ * @brief What to do when an event is emitted on a queued channel whose queue is full
+ * @ingroup modflow
+ */
+enum class OverflowPolicy {
+	/// Only the latest event is queued: pending events are discarded on every emit
+	KeepLatest,
+	/// Discard the oldest pending event
+	DropOldest,
+	/// Wait until there is space in the queue. Only for channels emitted from source threads: a slot emitting would hold
+	/// its worker while the consumer may need it, so emitting from the executor is an error
+	Block,
+	/// A pending event with the same key as the emitted one is replaced in place, otherwise discard the oldest pending event
+	CoalesceByKey
+};
+
+/**
+ * @brief Options of a queued channel (see @ref NlModule::createChannel)
+ * @tparam T Channel type(s)
+ * @ingroup modflow
+ */
+template<typename ...T>
+struct QueueOptions
+{
+	/// @brief Maximum number of pending events, excluding the one being processed
+	std::size_t capacity;
+	OverflowPolicy overflow;
+	/// @brief Key of an event, used only by @ref OverflowPolicy::CoalesceByKey
+	std::function<std::size_t (const T &...)> key;
+};
+
+/**
+ * @brief Counters of a queued channel
+ * @ingroup modflow
+ */
+struct QueueStats
+{
+	/// @brief Number of pending events
+	std::size_t depth;
+	/// @brief Capacity of the queue, 0 if the channel is not queued
+	std::size_t capacity;
+	/// @brief Events emitted on the channel
+	uint64_t enqueued;
+	/// @brief Events discarded or replaced due to the overflow policy
+	uint64_t dropped;
 };
 
 
@@ -157,6 +362,10 @@ public:
 	 */
 	const std::string &name () const;
 
+	/**
+	 * @brief Get the event that triggered the slot of the module currently running
+	 * @return Pointer to the event, nullptr if no slot of the module is running
+	 */
 	Event::Ptr lastEvent () const;
 
 	/**
@@ -164,11 +373,27 @@ public:
 	 * @param params NlParams value that is supplied as nlParams[module->name ()] from parent
 	 */
 	virtual void initParams (const NlParams &params) {};
+	/**
+	 * @brief Called on @ref NlModFlow::reloadParams if the params of the module changed, serialized with its slots.
+	 * Bound params (see @ref bindParams) are already updated.
+	 * @param params New value of nlParams[module->name ()]
+	 */
+	virtual void onParamsChanged (const NlParams &/*params*/) {}
 	/**
 	 * @brief Implement this function to create channels
 	 *  (see @ref NlModule::createChannel) and configure connections to parent channels @see NlModule::requestConnection
 	 */
 	virtual void setupNetwork () = 0;
+	/**
+	 * @brief Called by @ref NlModFlow::finalize once the network is compiled, e.g. to start the threads of modules
+	 * emitting on their own
+	 */
+	virtual void onNetworkReady () {}
+	/**
+	 * @brief Called by the destructor of @ref NlModFlow before any module is destroyed, e.g. to stop the threads
+	 * started by @ref onNetworkReady
+	 */
+	virtual void onNetworkStop () {}
 	bool isEnabled () const;
 
 	DEF_SHARED (NlModule)
@@ -203,7 +428,20 @@ protected:
 	 * @return New channel data
 	 */
 	template<typename ...T>
-	Channel createChannel (const std::string &name);
+	TypedChannel<T...> createChannel (const std::string &name);
+
+	/**
+	 * @brief Create a queued channel: events emitted on it are stored in a bounded queue and delivered to the
+	 * connected slots one at a time, so that emitting does not wait for slow consumers.
+	 * When the queue is full the @ref OverflowPolicy in @p queue applies.
+	 * @note Queues require the executor (see @ref NlModFlow): when it is disabled the channel is synchronous
+	 * @tparam T Channel type
+	 * @param name Channel name
+	 * @param queue Capacity and overflow policy of the queue
+	 * @return New channel data
+	 */
+	template<typename ...T>
+	TypedChannel<T...> createChannel (const std::string &name, const QueueOptions<T...> &queue);
 
 	/**
 	 * @brief Ensure at start up that the parent has declared a sink named @p sinkName with type @p T.
@@ -211,7 +449,7 @@ protected:
 	 * @param sinkName Name of sink to be declared by parent
 	 */
 	template<typename ...T>
-	Channel requireSink (const std::string &sinkName);
+	TypedChannel<T...> requireSink (const std::string &sinkName);
 
 	/**
 	 * @brief Emit data on channel. All slots connected to the supplied channel will be called in order. @par Complexity
@@ -227,6 +465,26 @@ protected:
 	template<typename R, typename ...T>
 	R callService (const Channel &channel, const T &...value);
 
+	/**
+	 * @brief Emit data on a typed channel, as returned by @ref createChannel or @ref requireSink.
+	 * The type is checked at compile time and slots are called directly. @par Complexity
+	 * Constant
+	 * @tparam T Channel type
+	 */
+	template<typename ...T>
+	void emit (const TypedChannel<T...> &channel, const T &...value);
+
+	template<typename R, typename ...T>
+	R callService (const TypedChannel<T...> &channel, const T &...value);
+
+	/**
+	 * @brief Emit data on a typed channel moving @p value into the connected slots
+	 * @see NlModFlow::emitMove
+	 * @tparam T Channel type
+	 */
+	template<typename ...T>
+	void emitMove (const TypedChannel<T...> &channel, T &&...value);
+
 	/**
 	 *  @brief Emit data on named channel. All slots connected to the supplied channel will be called in order. @par Complexity
 	 *  Logarithmic in the number of channels.
@@ -243,17 +501,63 @@ protected:
 	const ResourceManager &resources () const;
 	ResourceManager &resources ();
 
+	/// @brief Whether the slots of the module run on the executor (see @ref NlModFlow) rather than synchronously
+	bool executorEnabled () const;
+
+	/**
+	 * @brief Bind the fields of @p params (see @ref paramField) to the module params.
+	 * Bound params of all the modules are filled by @ref NlModFlow::finalize before any @ref initParams,
+	 * reporting all the missing or mistyped params at once.
+	 * @param params Params struct with a static fields () function, member of the module
+	 */
+	template<class Params>
+	void bindParams (Params &params) {
+		_paramsBinding.bind (params);
+	}
+
 private:
 	void setEnabled (ChannelId enablingChannelId);
 
+	/// @brief Expose @p event as last event while a slot of the module is running,
+	/// restoring the previous one on exit so that no pointer to a recycled event is kept
+	class LastEventScope
+	{
+	public:
+		LastEventScope (NlModule *module, Event::Ptr event):
+			 _module(module),
+			 _previous(module->_lastEvent)
+		{
+			_module->_lastEvent = event;
+		}
+
+		~LastEventScope () {
+			_module->_lastEvent = _previous;
+		}
+
+	private:
+		NlModule *const _module;
+		const Event::Ptr _previous;
+	};
+
 protected:
 	/// @brief Pointer to NlModFlow handler
 	NlModFlow *const _modFlow;
 	Event::Ptr _lastEvent;
 
 private:
+	friend class NlModFlow;
+
+	// Only modified by enabling slots, that are serialized with the other slots of the module
 	std::set<ChannelId> _disablingChannels;
+	std::atomic<bool> _enabled;
+	// Debug filter entries matching the module name
+	uint64_t _debugMask;
+	// Index in the loaded modules, identifies the module in traces
+	int _id;
 	std::string _name;
+	// Slots of the module run serialized on this strand when the executor is enabled
+	std::unique_ptr<Strand> _strand;
+	ParamsBinding _paramsBinding;
 };
 
 
@@ -291,7 +595,7 @@ public:
 	 * @return Channel identifier data to call sources with constant execution time.
 	 */
 	template<typename ...T>
-	Channel declareSource (const std::string &name);
+	TypedChannel<T...> declareSource (const std::string &name);
 
 	/**
 	 * @brief Emit event on channel named @p name.
@@ -313,6 +617,16 @@ public:
 	void callSource (const Channel &channel,
 				  const T &...value);
 
+	/**
+	 * @brief Emit event on typed channel @p channel, type checked at compile time
+	 * @tparam T Event type
+	 * @param channel Typed channel, as returned by @ref declareSource
+	 * @param value Event value to be transmitted
+	 */
+	template<typename ...T>
+	void callSource (const TypedChannel<T...> &channel,
+				  const T &...value);
+
 	DEF_SHARED (NlSources)
 
 private:
@@ -362,89 +676,95 @@ private:
 };
 
 /**
- * @brief Serialize a callback function from type void(T) to type
- * void (void *) to be stored in the connections array. For internal use
+ * @brief Type-erased slot stored in the connections array. For internal use.
+ * The bound callable is stored inline together with typed invoker function pointers,
+ * that are cast back to their original signature when the channel type is known,
+ * so that arguments are passed to the slot by reference, without copies nor allocations.
  * @ingroup modflow
  */
 class SerializedSlot
 {
-	using SerializedFcn = std::function<void *(const Event::Ptr &, const void *)>;
+	// Small trivially copyable callables, such as an object and a member function pointer, are stored
+	// inline. Larger ones are allocated once on connection and only a pointer to them is stored inline.
+	using CallableStorage = std::aligned_storage_t<4 * sizeof (void *), alignof (void *)>;
+	using ErasedInvoker = void (*) ();
 
 	template<typename R, typename ...T>
-	std::enable_if_t<(sizeof... (T) <= 1) &&
-					 !std::is_same<R, void>::value>
-		serialize (const Slot<R, T...> &slot);
+	using Invoker = R (*) (const void *callable, Event::Ptr event, const T &...arg);
 
-	template<typename R, typename ...T,  std::size_t ...is>
-	std::enable_if_t<(sizeof... (T) > 1) &&
-					 !std::is_same<R, void>::value>
-		serialize (const Slot<R, T...> &slot,
-				std::index_sequence<is...>);
+	template<typename R, typename ...T>
+	using MoveInvoker = R (*) (const void *callable, Event::Ptr event, T &&...arg);
 
-	template<typename ...T>
-	std::enable_if_t<(sizeof... (T) <= 1)>
-		serialize (const Slot<void, T...> &slot);
+	template<typename F>
+	static constexpr bool storedInline = sizeof (F) <= sizeof (CallableStorage) &&
+									 alignof (F) <= alignof (CallableStorage) &&
+									 std::is_trivially_copyable<F>::value;
+
+	template<typename F>
+	static const F &callable (const void *storage);
+
+	template<typename F, typename R, typename ...T>
+	static R callConst (const void *storage, Event::Ptr event, const T &...arg);
+
+	template<typename F, typename R, typename ...T>
+	static R callMove (const void *storage, Event::Ptr event, T &&...arg);
+
+	template<typename R, typename ...T, typename F>
+	void storeCallable (const F &callable);
+
+	SerializedSlot (const Channel &channel,
+				 const std::string &slotName,
+				 const NlModule *receiver);
 
-	template<typename ...T,  std::size_t ...is>
-	std::enable_if_t<(sizeof... (T) > 1)>
-		serialize (const Slot<void, T...> &slot,
-				std::index_sequence<is...>);
 public:
 	/**
-	 * @brief Create a generic serialized void(void *) function object
-	 * from a void(T) slot that calls the slot by converting
-	 * back the void * to T *
-	 * @tparam T Function object argument type(s)
-	 * @param slot Generic function object of type void(T)
+	 * @brief Create a serialized slot from any callable with signature R(const Event::Ptr &, const T &...).
+	 * If the callable also accepts rvalues, e.g. a generic lambda taking auto &&..., it can be called via
+	 * @ref dispatchMove to move arguments into the slot.
+	 * @tparam R Return type of the slot
+	 * @tparam T Channel type(s)
+	 * @param callable Function object to be called
+	 * @param channel Channel the slot is connected to
+	 * @param slotName Name of the slot, for debugging
+	 * @param receiver Module the slot belongs to
 	 */
-	template<typename R, typename ...T>
-	SerializedSlot (const Slot<R, T...> &slt,
-				 const Channel &channel,
-				 const std::string &slotName,
-				 std::enable_if_t<(sizeof...(T) <= 1)> * = 0);
-
-	template<typename R, typename ...T>
-	SerializedSlot (const Slot<R, T...> &slt,
-				 const Channel &channel,
-				 const std::string &slotName,
-				 std::enable_if_t<(sizeof...(T) > 1)> * = 0);
+	template<typename R, typename ...T, typename F>
+	static SerializedSlot create (const F &callable,
+							const Channel &channel,
+							const std::string &slotName,
+							const NlModule *receiver);
 
 	/**
-	 * @brief Invoke the function by casting T&... to a void *
-	 * If multiple parameters are given, they are packed into a tuple
-	 * @tparam T Function object argument type
-	 * @param arg Argument to be supplied to the slot
+	 * @brief Call the slot passing arguments by const reference. @p T must be exactly the channel type(s),
+	 * as guaranteed by emitting on a @ref TypedChannel or after the run-time type check.
+	 * @tparam R Return type, void to discard the slot return value.
+	 * The slot return value is constructed directly in the returned object.
+	 * @tparam T Channel type(s)
 	 */
 	template<typename R, typename ...T>
-	std::enable_if_t<(sizeof... (T) <= 1) &&
-					 std::is_same<R, void>::value, R>
-	    invoke (const Event::Ptr &event, const T &...arg) const;
+	R dispatch (Event::Ptr event, const T &...arg) const;
 
+	/**
+	 * @brief Call the slot moving arguments into it
+	 * @see dispatch
+	 */
 	template<typename R, typename ...T>
-	std::enable_if_t<(sizeof... (T) > 1) &&
-					 std::is_same<R, void>::value, R>
-	    invoke (const Event::Ptr &event, const T &...arg) const;
-
-	template<typename R>
-	std::enable_if_t<std::is_same<R, void>::value, R>
-		invoke (const Event::Ptr &event) const;
+	R dispatchMove (Event::Ptr event, T &&...arg) const;
 
-	template<typename R, typename ...T>
-	std::enable_if_t<(sizeof... (T) <= 1) &&
-					 !std::is_same<R, void>::value, R>
-		invoke (const Event::Ptr &event, const T &...arg) const;
+	std::string name () const {
+		return _name;
+	}
 
-	template<typename R, typename ...T>
-	std::enable_if_t<(sizeof... (T) > 1) &&
-					 !std::is_same<R, void>::value, R>
-		invoke (const Event::Ptr &event, const T &...arg) const;
+	const NlModule *receiver () const {
+		return _receiver;
+	}
 
-	template<typename R>
-	std::enable_if_t<!std::is_same<R, void>::value, R>
-		invoke (const Event::Ptr &event) const;
+	const Channel &channel () const {
+		return _channel;
+	}
 
-	std::string name () const {
-		return _name;
+	std::type_index returnType () const {
+		return _returnType;
 	}
 
 	DEF_SHARED (SerializedSlot)
@@ -452,7 +772,166 @@ public:
 private:
 	std::string _name;
 	Channel _channel;
-	SerializedFcn serialized;
+	const NlModule *_receiver;
+
+	CallableStorage _callable;
+	std::shared_ptr<const void> _allocatedCallable;
+	ErasedInvoker _invoker;
+	ErasedInvoker _voidInvoker;
+	ErasedInvoker _moveInvoker;
+	std::type_index _returnType;
+};
+
+/**
+ * @brief Copy of an event and of its values queued on the executor, shared by all the slots it is delivered to.
+ * For internal use.
+ * @ingroup modflow
+ */
+template<typename ...T>
+struct Delivery
+{
+	template<typename ...V>
+	Delivery (const Event &event, V &&...value):
+		 event(event),
+		 values(std::forward<V> (value)...)
+	{}
+
+	Event event;
+	std::tuple<T...> values;
+};
+
+/**
+ * @brief Bounded queue of the events emitted on a queued channel. For internal use.
+ * Events of a queued channel are delivered one at a time: the next one is dispatched to the connected slots only when
+ * all of them have processed the previous one, so a slow consumer fills the queue instead of the mailboxes of the executor.
+ * @ingroup modflow
+ */
+class EventQueueBase
+{
+public:
+	virtual ~EventQueueBase () = default;
+
+	QueueStats stats () const;
+
+	ChannelId channelId () const {
+		return _channelId;
+	}
+
+	OverflowPolicy overflow () const {
+		return _overflow;
+	}
+
+	/// @brief Set the number of slots the current event is dispatched to
+	void setInFlight (int count);
+
+	/// @brief Mark one slot of the current event as done
+	/// @return true if it was the last one
+	bool slotDone ();
+
+protected:
+	EventQueueBase (ChannelId channelId, std::size_t capacity, OverflowPolicy overflow):
+		 _channelId(channelId),
+		 _capacity(capacity),
+		 _overflow(overflow),
+		 _busy(false),
+		 _depth(0),
+		 _enqueued(0),
+		 _dropped(0),
+		 _inFlight(0)
+	{}
+
+protected:
+	const ChannelId _channelId;
+	const std::size_t _capacity;
+	const OverflowPolicy _overflow;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _space;
+	// Whether an event is being processed
+	bool _busy;
+	std::size_t _depth;
+	uint64_t _enqueued;
+	uint64_t _dropped;
+
+private:
+	std::atomic<int> _inFlight;
+};
+
+/**
+ * @brief Typed ring buffer of a queued channel. For internal use.
+ * @tparam T Channel type(s)
+ * @ingroup modflow
+ */
+template<typename ...T>
+class EventQueue : public EventQueueBase
+{
+public:
+	struct Entry {
+		std::shared_ptr<const Delivery<T...>> delivery;
+		const NlModule *caller;
+		std::size_t key;
+	};
+
+	EventQueue (ChannelId channelId, const QueueOptions<T...> &options);
+
+	/// @brief Compute the key of @p delivery, used only by @ref OverflowPolicy::CoalesceByKey
+	std::size_t key (const Delivery<T...> &delivery) const;
+
+	/**
+	 * @brief Queue @p entry applying the overflow policy
+	 * @param next Set to @p entry if the queue is idle
+	 * @return true if @p next must be dispatched now
+	 */
+	bool push (Entry &&entry, Entry &next);
+
+	/**
+	 * @brief Called when the current event has been processed
+	 * @param next Set to the oldest pending entry, if any
+	 * @return true if @p next must be dispatched now, false if the queue is idle
+	 */
+	bool pop (Entry &next);
+
+private:
+	void dropOldest ();
+	Entry &at (std::size_t index);
+
+private:
+	std::function<std::size_t (const T &...)> _key;
+	std::vector<Entry> _ring;
+	std::size_t _head;
+};
+
+/**
+ * @brief Index of the channels by name. For internal use.
+ * Channels are inserted in a map while the graph is set up. When it is frozen, at @ref NlModFlow::finalize,
+ * the names are moved to an open addressing table with precomputed hashes and at most half full,
+ * so that resolving a name costs one hash and usually a single string comparison.
+ * @ingroup modflow
+ */
+class ChannelIndex
+{
+public:
+	ChannelIndex ();
+
+	/// @brief Add @p info, whose name must be unique. Channels added after freezing are indexed too, but slowly.
+	void insert (const ChannelInfo *info);
+
+	/// @return The channel named @p name, nullptr if it does not exist
+	const ChannelInfo *find (const std::string &name) const;
+
+	/// @brief Build the lookup table
+	void freeze ();
+
+private:
+	struct Entry {
+		std::size_t hash;
+		const ChannelInfo *info;
+	};
+
+	std::unordered_map<std::string, const ChannelInfo *> _names;
+	std::vector<Entry> _table;
+	std::size_t _mask;
+	bool _frozen;
 };
 
 /**
@@ -474,14 +953,54 @@ private:
  * a @ref NlSinks -derived  class, as specified via @ref NlSinks::connectToSink in the overridden @ref NlSinks::setupNetwork.
  * As an event an a sink-channel is emitted, the callback @p parentSlot defined in the declaration @ref NlSinks::declareSink is called
  * forwarding the regular channel data to the parent object slot.
+ *
+ * By default events are dispatched synchronously on the emitting thread. Setting the param
+ * @c mod_flow/executor/threads to a positive number enables the executor: each module becomes a strand
+ * on a work-stealing pool with that many workers, so that slots of the same module never run concurrently while
+ * the connections of different modules run in parallel. Emits queue the event and return immediately, services
+ * are still called synchronously. Sources can then be called from multiple threads, e.g. from an asynchronous spinner.
+ * The param @c mod_flow/executor/batch limits the events processed by a module before yielding the worker (default 32).
+ *
+ * Setting @c mod_flow/trace/enable records every emit and slot call in a binary trace (see @ref trace), written to
+ * @c mod_flow/trace/file (default @c modflow.trace). The per-thread buffer size in records and the flush period can be set with
+ * @c mod_flow/trace/buffer_size and @c mod_flow/trace/flush_period_ms.
+ *
+ * Setting @c mod_flow/stats/enable keeps emit counters and latency histograms of every channel and connection,
+ * available through @ref stats.
  * @ingroup modflow
  */
 class NlModFlow
 {
-	using Connection = std::vector<SerializedSlot>;
+	// Slots connected to a channel, contiguous in the dispatch table
+	class Connection {
+	public:
+		Connection ():
+			 _begin(nullptr),
+			 _size(0)
+		{}
+
+		Connection (const SerializedSlot *begin, std::size_t size):
+			 _begin(begin),
+			 _size(size)
+		{}
+
+		const SerializedSlot &operator [] (std::size_t index) const { return _begin[index]; }
+		const SerializedSlot &front () const { return *_begin; }
+		std::size_t size () const { return _size; }
+		bool empty () const { return _size == 0; }
+
+	private:
+		const SerializedSlot *_begin;
+		std::size_t _size;
+	};
 
 public:
 	NlModFlow ();
+	/**
+	 * @brief Stop the modules (see @ref NlModule::onNetworkStop), process the pending events and stop the executor
+	 * before params, resources and modules are destroyed
+	 */
+	virtual ~NlModFlow ();
 
 	/**
 	 * @brief Load sources and sink modules (see @ref loadModule). It calls @ref loadModules that shall be implemented
@@ -492,11 +1011,32 @@ public:
 	 */
 	void init (const NlParams &nlParams);
 	/**
-	 * @brief To be called after declaring sources and sinks. For each loaded module, in order, call @ref NlModule::initParams "initParams" and @ref NlModule::setupNetwork "setupNetwork",
+	 * @brief To be called after declaring sources and sinks. The params bound by the modules (see @ref NlModule::bindParams) are filled
+	 * in a single pass, throwing one XmlRpc::XmlRpcException listing all the missing or mistyped ones.
+	 * Then for each loaded module, in order, call @ref NlModule::initParams "initParams" and @ref NlModule::setupNetwork "setupNetwork",
 	 * intializing each module with parameters and the channels configuration.
+	 * The graph is then compiled: connections are validated once and flattened in a contiguous dispatch table.
+	 * No channel nor connection can be created afterwards.
 	 */
 	void finalize ();
 
+	/**
+	 * @brief Apply new params to the running graph, keeping the state of the modules.
+	 * Only the modules whose subtree changed are updated: their bound params are filled and
+	 * @ref NlModule::onParamsChanged is called, serialized with their slots when the executor is enabled,
+	 * synchronously otherwise. The @c mod_flow configuration is not reloaded.
+	 * To be called from a single thread after @ref finalize, off the latency critical paths.
+	 * Without the executor the modules are updated on the calling thread, with no exclusion from their slots:
+	 * it must be the only thread calling the sources, e.g. the thread of a single-threaded spinner.
+	 * @throw XmlRpc::XmlRpcException listing all the missing or mistyped bound params. No module is updated.
+	 */
+	void reloadParams (const NlParams &nlParams);
+
+	/**
+	 * @brief Params currently applied, from @ref init or the last @ref reloadParams. Never blocks, can be called from any thread.
+	 */
+	std::shared_ptr<const NlParams> params () const;
+
 	/**
 	 * @brief Get sources object
 	 * @return Pointer to the sources module
@@ -509,6 +1049,31 @@ public:
 	 */
 	NlSinks::Ptr sinks ();
 
+	/**
+	 * @brief Block until all the events queued on the executor have been processed.
+	 * Returns immediately when the executor is disabled, since emits are synchronous.
+	 */
+	void waitIdle ();
+
+	/**
+	 * @brief Get depth and counters of the queue of @p channel
+	 * @return Counters of the queue, all zero if the channel is not queued
+	 */
+	QueueStats queueStats (const Channel &channel) const;
+
+	/// @brief Whether @ref stats are collected
+	bool statsEnabled () const;
+
+	/// @brief Whether slots run on the executor, enabled by @c mod_flow/executor/threads
+	bool executorEnabled () const;
+
+	/**
+	 * @brief Get a snapshot of the statistics collected since initialization: emit counts and source to sink latency of each channel,
+	 * duration of the calls of each connection. It can be called from any thread while events are processed.
+	 * @return Statistics of all channels and connections, empty if @c mod_flow/stats/enable is not set
+	 */
+	ModFlowStats stats () const;
+
 	DEF_SHARED (NlModFlow)
 
 protected:
@@ -541,14 +1106,22 @@ protected:
 	 * @return New @ref Channel object with the created channel information
 	 */
 	template<typename ...T>
-	Channel createChannel (const std::string &name, const NlModule *owner, bool isSink = false);
+	TypedChannel<T...> createChannel (const std::string &name, const NlModule *owner, bool isSink = false);
 
 	/**
-	 * @brief Get full channel information given its name @par Complexity Logarithmic in the number of channels.
-	 * @param name Channel name
+	 * @brief Declare a new queued channel of type @p T, owned by module @p owner
+	 * @see NlModule::createChannel
+	 * @param queue Capacity and overflow policy of the queue
+	 */
+	template<typename ...T>
+	TypedChannel<T...> createChannel (const std::string &name, const NlModule *owner, const QueueOptions<T...> &queue);
+
+	/**
+	 * @brief Get full channel information given its name @par Complexity Constant: one hash of @p name
+	 * @param name Channel name
 	 * @return Channel information
 	 */
-	Channel resolveChannel (const std::string &name);
+	Channel resolveChannel (const std::string &name) const;
 
 	/**
 	 * @brief Add @p slot to the connections of the supplied channel.
@@ -560,9 +1133,21 @@ protected:
 	 * @param channel Channel data
 	 * @param name Connection name
 	 * @param slot Function object of type void(T)
+	 * @param receiver Module the slot belongs to, whose strand runs it when the executor is enabled
 	 */
 	template<typename ...T, typename R>
-	void createConnection (const Channel &channel, const Slot<R, T...> &slot, const std::string &name);
+	void createConnection (const Channel &channel, const Slot<R, T...> &slot, const std::string &name, const NlModule *receiver);
+
+	/**
+	 * @brief Add @p callable to the connections of the supplied channel.
+	 * Small trivially copyable callables are stored inline in the connections array.
+	 * @see createConnection
+	 * @tparam R Return type of the callable
+	 * @tparam T Channel type(s)
+	 * @param callable Function object of signature R(const Event::Ptr &, const T &...)
+	 */
+	template<typename R, typename ...T, typename F>
+	void createConnection (const Channel &channel, const F &callable, const std::string &name, const NlModule *receiver);
 
 	/**
 	 * @brief Emit an event on @p channel. This will call the corresponding
@@ -576,12 +1161,7 @@ protected:
 	 * @param caller NlModule that is emitting event
 	 */
 	template<typename R, typename ...T>
-	std::enable_if_t<std::is_same<R, void>::value, R>
-		emit (const Channel &channel, const NlModule *caller, const T &...value);
-
-	template<typename R, typename ...T>
-	std::enable_if_t<!std::is_same<R, void>::value, R>
-		emit (const Channel &channel, const NlModule *caller, const T &...value);
+	R emit (const Channel &channel, const NlModule *caller, const T &...value);
 
 	/**
 	 * @brief Emit an event on a channel itentified by its name via @ref resolveChannel
@@ -590,12 +1170,47 @@ protected:
 	template<typename R, typename ...T>
 	R emit (const std::string &channelName, const NlModule *caller, const T &...value);
 
+	/**
+	 * @brief Emit an event on a @ref TypedChannel. Value types are checked at compile time,
+	 * so only ownership is verified run-time before calling the typed slots
+	 * @see emit
+	 */
+	template<typename R, typename ...T>
+	R emit (const TypedChannel<T...> &channel, const NlModule *caller, const T &...value);
+
+	/**
+	 * @brief Emit an event on a @ref TypedChannel moving @p value into the slots instead of
+	 * passing it by const reference. Every slot but the last receives a const reference, the value is
+	 * moved into the last one: on single-consumer channels a by-value slot receives @p value without copies.
+	 * @see emit
+	 */
+	template<typename ...T>
+	void emitMove (const TypedChannel<T...> &channel, const NlModule *caller, T &&...value);
 
 private:
+	template<typename ...T>
+	void checkEmitType (const Channel &channel, const NlModule *caller);
 	template<typename R, typename ...T>
-	Event::Ptr prepareEmit (const Channel &channel, const NlModule *caller);
+	R dispatchEmit (const Channel &channel, const NlModule *caller, const T &...value);
+	template<typename ...T, typename ...V>
+	void postEmit (const Connection &connection, const NlModule *caller, Event::Ptr event, V &&...value);
+	template<typename ...T, typename ...V>
+	void enqueueEmit (EventQueue<T...> &queue, const NlModule *caller, Event::Ptr event, V &&...value);
+	template<typename ...T>
+	void deliverQueued (EventQueue<T...> &queue, const typename EventQueue<T...>::Entry &entry);
+	template<typename ...T>
+	void completeQueued (EventQueue<T...> &queue);
+	void prepareEmit (const Channel &channel, const NlModule *caller, Event &event);
+	void compile ();
+	static XmlRpc::XmlRpcException paramsError (const std::vector<std::string> &errors);
+	void validateConnection (const Channel &channel) const;
 	void initDebugConfiguration ();
-	bool debugFilters (const Event::Ptr &event);
+	void initExecutorConfiguration ();
+	void initTraceConfiguration ();
+	LatencyHistogram *slotLatency (ChannelId channelId, std::size_t index);
+	void countEmit (const Channel &channel, Event &event);
+	uint64_t debugMask (const Channel &channel, const NlModule *caller) const;
+	bool debugFilters (const Event &event) const;
 
 private:
 	struct DebugConfiguration {
@@ -605,14 +1220,50 @@ private:
 		std::vector<std::string> filterExcludeChannels;
 		std::vector<std::string> filterOnlyModules;
 		std::vector<std::string> filterExcludeModules;
+
+		// Each filter entry is a bit: events inherit the bits of the modules and channels in their path
+		std::map<std::string, uint64_t> channelBits;
+		std::map<std::string, uint64_t> moduleBits;
+		uint64_t onlyMask;
+		uint64_t excludeMask;
+
+		void assignBits (const std::vector<std::string> &names, std::map<std::string, uint64_t> &bits, uint64_t &filterMask);
+		uint64_t bits (const std::map<std::string, uint64_t> &bits, const std::string &name) const;
+
+		int bitsCount;
 	} _debug;
 
+	struct ExecutorConfiguration {
+		int threads;
+		int batch;
+	} _executorConfig;
+
 	ChannelId _channelsSeq;
 	NlSources::Ptr _sources;
 	NlSinks::Ptr _sinks;
 	std::vector<NlModule::Ptr> _modules;
-	std::map<std::string, Channel> _channelNames;
-	std::vector<Connection> _connections;
+	// Channel information, indexed by id. deque does not move it while channels are created.
+	std::deque<ChannelInfo> _channels;
+	ChannelIndex _channelNames;
+	std::vector<uint64_t> _channelDebugMasks;
+	// Connections as created, by channel id
+	std::vector<std::vector<SerializedSlot>> _connections;
+	// Contiguous copy of all the connections, built by compile, and the slots of each channel in it
+	std::vector<SerializedSlot> _dispatchTable;
+	std::vector<Connection> _dispatch;
+	bool _compiled;
+	// Queues of queued channels, null for synchronous ones
+	std::vector<std::unique_ptr<EventQueueBase>> _queues;
+	// Null if tracing is disabled
+	std::unique_ptr<TraceRecorder> _trace;
+	// Indexed by channel id, empty if statistics are disabled
+	bool _statsEnabled;
+	std::deque<ChannelCounters> _counters;
+	// Reset first by the destructor, so that pending events are processed before anything they use is destroyed
+	std::unique_ptr<NlExecutor> _executor;
+
+	// Published by reloadParams
+	SnapshotCell<NlParams> _liveParams;
 
 protected:
 	NlParams _nlParams;
@@ -620,17 +1271,101 @@ protected:
 };
 
 inline bool Event::moduleInAncestors  (const std::string &name) const {
-	if (_parent == nullptr)
-		return _module->name () == name;
+	for (int i = 0; i <= _depth; i++) {
+		if (_path[i].module->name () == name)
+			return true;
+	}
 
-	return _module->name () == name || _parent->moduleInAncestors (name);
+	return false;
 }
 
 inline bool Event::channelInAncestors  (const std::string &name) const {
-	if (_parent == nullptr)
-		return _channel->name () == name;
+	for (int i = 0; i <= _depth; i++) {
+		if (_path[i].channel->name == name)
+			return true;
+	}
+
+	return false;
+}
+
+inline Event::Event (const Event &other):
+	 _depth(other._depth),
+	 _mask(other._mask),
+	 _rootTime(other._rootTime),
+	 _traced(other._traced)
+{
+	std::copy_n (other._path.begin (), _depth + 1, _path.begin ());
+}
+
+inline Event &Event::operator = (const Event &other)
+{
+	_depth = other._depth;
+	_mask = other._mask;
+	_rootTime = other._rootTime;
+	_traced = other._traced;
+	std::copy_n (other._path.begin (), _depth + 1, _path.begin ());
+
+	return *this;
+}
+
+inline Channel Event::rootChannel () const {
+	return Channel (_path[0].channel);
+}
+
+inline void Event::reset (const NlModule *module, const Channel &channel, uint64_t mask) {
+	_depth = 0;
+	_path[0] = {module, channel.info ()};
+	_mask = mask;
+	_rootTime = 0;
+	_traced = false;
+}
+
+inline void Event::reset (const Event &parent, const NlModule *module, const Channel &channel, uint64_t mask)
+{
+	if (parent._depth + 1 >= NLIB_MODFLOW_MAX_DEPTH) {
+		std::cout << "Error: cascade deeper than " << NLIB_MODFLOW_MAX_DEPTH << " emitting on channel "
+				<< channel.name () << ". Check for loops or increase NLIB_MODFLOW_MAX_DEPTH\nAborting" << std::endl;
+		std::abort ();
+	}
+
+	_depth = parent._depth + 1;
+	std::copy_n (parent._path.begin (), _depth, _path.begin ());
+	_path[_depth] = {module, channel.info ()};
+	_mask = parent._mask | mask;
+	_rootTime = parent._rootTime;
+	_traced = false;
+}
 
-	return _channel->name () == name || _parent->channelInAncestors (name);
+inline EventArena &EventArena::local () {
+	thread_local EventArena arena;
+	return arena;
+}
+
+inline Event *EventArena::acquire ()
+{
+	if (_top == _events.size ())
+		_events.emplace_back ();
+
+	return &_events[_top++];
+}
+
+inline void EventArena::release (const Event *event) {
+	assert (_top > 0 && &_events[_top - 1] == event && "Events must be released in reverse order of acquisition");
+	_top--;
+}
+
+inline ScopedEvent::ScopedEvent (Event::Ptr parent, const NlModule *module, const Channel &channel, uint64_t mask):
+	 _arena(EventArena::local ()),
+	 _event(_arena.acquire ())
+{
+	if (parent == nullptr)
+		_event->reset (module, channel, mask);
+	else
+		_event->reset (*parent, module, channel, mask);
+}
+
+inline ScopedEvent::~ScopedEvent () {
+	_arena.release (_event);
 }
 
 inline NlSources::Ptr NlModFlow::sources () {
@@ -641,212 +1376,440 @@ inline NlSinks::Ptr NlModFlow::sinks () {
 	return _sinks;
 }
 
+inline void NlModFlow::waitIdle () {
+	if (_executor != nullptr)
+		_executor->waitIdle ();
+}
+
 template<class DerivedModule, typename ...Args>
 typename DerivedModule::Ptr NlModFlow::loadModule(Args &&...args) {
     auto newModule = std::make_shared<DerivedModule> (this, args...);
     _modules.push_back (std::dynamic_pointer_cast<NlModule> (newModule));
+
+	_modules.back ()->_debugMask = _debug.bits (_debug.moduleBits, _modules.back ()->name ());
+	_modules.back ()->_id = _modules.size () - 1;
+
+	if (_trace != nullptr)
+		_trace->nameModule (_modules.back ()->_id, _modules.back ()->name ());
+
+	if (_executor != nullptr)
+		_modules.back ()->_strand = std::make_unique<Strand> (*_executor, _executorConfig.batch);
+
 	return newModule;
 }
 
-template<typename ...typeids>
-Channel::Channel (ChannelId id,
-			   const std::string &name,
-			   const NlModule *owner,
-			   bool isSink,
-			   const typeids *...ids):
-	 _id(id),
-	 _name(name),
-	 _isSink(isSink),
-	 _types(stackTypes (ids...)),
-	 _owner(owner)
+inline Channel::Channel (const ChannelInfo *info):
+	 _info(info)
 {}
 
-template<typename ...typeids>
-std::vector<std::type_index> Channel::stackTypes (const typeids *...ids) {
-	return {std::type_index(*ids) ...};
-}
+inline Channel::Channel ():
+	 _info(nullptr)
+{}
 
 inline ChannelId Channel::id() const {
-	return _id;
+	return _info->id;
 }
 
 inline const std::string &Channel::name() const {
-	return _name;
+	return _info->name;
 }
 
-inline std::vector<std::type_index> Channel::types() const {
-	return _types;
+inline const std::vector<std::type_index> &Channel::types() const {
+	return _info->types;
 }
 
 inline std::string Channel::ownerName() const {
-	return _owner->name ();
+	return _info->owner->name ();
+}
+
+inline bool Channel::isSink () const {
+	return _info->isSink;
+}
+
+inline const ChannelInfo *Channel::info () const {
+	return _info;
 }
 
 inline bool Channel::checkOwnership(const NlModule *caller) const {
-	if (_isSink)
+	if (_info->isSink)
 		return true; // any module can emit on a sink
-	return caller == _owner;
+	return caller == _info->owner;
 }
 
 template<typename ...T>
 bool Channel::checkType () const {
-	return stackTypes(&typeid(T)...) == _types;
+	const std::array<std::type_index, sizeof... (T)> types{std::type_index(typeid(T))...};
+
+	return std::equal (types.begin (), types.end (), _info->types.begin (), _info->types.end ());
 }
 
-template<typename R, typename ...T>
-SerializedSlot::SerializedSlot (const Slot<R, T...> &slt,
-						  const Channel &channel,
-						  const std::string &slotName,
-						  std::enable_if_t<(sizeof...(T) <= 1)> *):
-	 _channel(channel)
+template<typename ...T>
+TypedChannel<T...>::TypedChannel (const Channel &channel):
+	 Channel(channel)
 {
-	_name = slotName;
-	serialize (slt);
+	assert (checkType<T...> () && "Channel type mismatch");
 }
 
-template<typename R, typename ...T>
-SerializedSlot::SerializedSlot (const Slot<R, T...> &slt,
-						  const Channel &channel,
-						  const std::string &slotName,
-						  std::enable_if_t<(sizeof...(T) > 1)> *):
-	 _channel(channel)
+inline SerializedSlot::SerializedSlot (const Channel &channel,
+								const std::string &slotName,
+								const NlModule *receiver):
+	 _name(slotName),
+	 _channel(channel),
+	 _receiver(receiver),
+	 _returnType(typeid (void))
+{}
+
+template<typename F>
+const F &SerializedSlot::callable (const void *storage)
 {
-	_name = slotName;
-	serialize (slt, std::make_index_sequence<sizeof...(T)> ());
+	if constexpr (storedInline<F>)
+		return *static_cast<const F *> (storage);
+	else
+		return **static_cast<const F *const *> (storage);
 }
 
-template<typename ...T>
-std::enable_if_t<(sizeof...(T) <= 1)>
-	SerializedSlot::serialize (const Slot<void, T...> &slt)
+template<typename F, typename R, typename ...T>
+R SerializedSlot::callConst (const void *storage, Event::Ptr event, const T &...arg)
 {
-	serialized = [slt] (const Event::Ptr &event, const void *arg) -> void * {
-		slt(event, *reinterpret_cast<const T *> (arg) ...);
+	if constexpr (std::is_same<R, void>::value)
+		callable<F> (storage) (event, arg...);
+	else
+		return callable<F> (storage) (event, arg...);
+}
 
-		return nullptr;
-	};
+template<typename F, typename R, typename ...T>
+R SerializedSlot::callMove (const void *storage, Event::Ptr event, T &&...arg)
+{
+	// Only callables that accept rvalues can be moved into
+	if constexpr (!std::is_invocable<const F &, Event::Ptr, T &&...>::value)
+		return callConst<F, R, T...> (storage, event, arg...);
+	else if constexpr (std::is_same<R, void>::value)
+		callable<F> (storage) (event, std::move (arg)...);
+	else
+		return callable<F> (storage) (event, std::move (arg)...);
 }
 
-template<typename ...T, size_t ...is>
-std::enable_if_t<(sizeof...(T) > 1)>
-	SerializedSlot::serialize (const Slot<void, T...> &slt, std::index_sequence<is...>)
+template<typename R, typename ...T, typename F>
+void SerializedSlot::storeCallable (const F &function)
 {
-	serialized = [slt] (const Event::Ptr &event, const void *arg) -> void * {
-		auto argTuple = *reinterpret_cast<const std::tuple<T...> *> (arg);
-		slt(event, std::get<is> (argTuple) ...);
+	if constexpr (storedInline<F>) {
+		new (&_callable) F (function);
+	} else {
+		std::shared_ptr<const F> allocated = std::make_shared<const F> (function);
 
-		return nullptr;
-	};
-}
+		new (&_callable) (const F *) (allocated.get ());
+		_allocatedCallable = allocated;
+	}
 
-template<typename R, typename ...T>
-std::enable_if_t<(sizeof... (T) <= 1) &&
-				 !std::is_same<R, void>::value>
-	SerializedSlot::serialize (const Slot<R, T...> &slt)
-{
-	serialized = [slt] (const Event::Ptr &event, const void *arg) -> void * {
-		R *objData = new R; // will be deleted in invoke ()
-		*objData = slt(event, *reinterpret_cast<const T *> (arg) ...);
-		return reinterpret_cast<void *> (objData);
-	};
+	_invoker = reinterpret_cast<ErasedInvoker> (&callConst<F, R, T...>);
+	_voidInvoker = reinterpret_cast<ErasedInvoker> (&callConst<F, void, T...>);
+	_moveInvoker = reinterpret_cast<ErasedInvoker> (&callMove<F, void, T...>);
+
+	_returnType = typeid (R);
 }
 
-template<typename R, typename ...T, size_t ...is>
-std::enable_if_t<(sizeof... (T) > 1) &&
-				 !std::is_same<R, void>::value>
-	SerializedSlot::serialize (const Slot<R, T...> &slt, std::index_sequence<is...>)
+template<typename R, typename ...T, typename F>
+SerializedSlot SerializedSlot::create (const F &callable,
+								const Channel &channel,
+								const std::string &slotName,
+								const NlModule *receiver)
 {
-	serialized = [slt] (const Event::Ptr &event, const void *arg) -> R {
-		R *objData = new R; // will be deleted in invoke ()
-		auto argTuple = *reinterpret_cast<const std::tuple<T...> *> (arg);
-		*objData = slt(event, std::get<is> (argTuple) ...);
+	SerializedSlot serializedSlot(channel, slotName, receiver);
 
-		return reinterpret_cast<void *> (objData);
-	};
+	serializedSlot.storeCallable<R, T...> (callable);
+
+	return serializedSlot;
 }
 
 template<typename R, typename ...T>
-std::enable_if_t<(sizeof... (T) <= 1) &&
-				 std::is_same<R, void>::value, R>
-	SerializedSlot::invoke (const Event::Ptr &event, const T &...arg) const
+R SerializedSlot::dispatch (Event::Ptr event, const T &...arg) const
 {
-	serialized (event, reinterpret_cast<const void *> (&arg) ...);
+	if constexpr (std::is_same<R, void>::value) {
+		reinterpret_cast<Invoker<void, T...>> (_voidInvoker) (&_callable, event, arg...);
+	} else {
+		assert (_returnType == std::type_index (typeid (R)) && "Slot return type mismatch");
+
+		return reinterpret_cast<Invoker<R, T...>> (_invoker) (&_callable, event, arg...);
+	}
 }
 
 template<typename R, typename ...T>
-std::enable_if_t<(sizeof... (T) > 1) &&
-				 std::is_same<R, void>::value, R>
-	SerializedSlot::invoke (const Event::Ptr &event, const T &...arg) const
+R SerializedSlot::dispatchMove (Event::Ptr event, T &&...arg) const
 {
-	auto data = std::tuple<T...> (arg...);
-	serialized (event, reinterpret_cast<const void *> (&data));
+	static_assert (std::is_same<R, void>::value, "Only events without return value can be moved into slots");
+
+	reinterpret_cast<MoveInvoker<void, T...>> (_moveInvoker) (&_callable, event, std::move (arg)...);
 }
 
-template<typename R>
-std::enable_if_t<std::is_same<R, void>::value, R>
-	SerializedSlot::invoke (const Event::Ptr &event) const
+inline QueueStats EventQueueBase::stats () const
 {
-	serialized (event, nullptr);
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return QueueStats{_depth, _capacity, _enqueued, _dropped};
 }
 
-template<typename R, typename ...T>
-std::enable_if_t<(sizeof... (T) <= 1) &&
-				 !std::is_same<R, void>::value, R>
-	SerializedSlot::invoke (const Event::Ptr &event, const T &...arg) const
+inline void EventQueueBase::setInFlight (int count) {
+	_inFlight.store (count, std::memory_order_relaxed);
+}
+
+inline bool EventQueueBase::slotDone () {
+	return _inFlight.fetch_sub (1, std::memory_order_acq_rel) == 1;
+}
+
+template<typename ...T>
+EventQueue<T...>::EventQueue (ChannelId channelId, const QueueOptions<T...> &options):
+	 EventQueueBase(channelId, std::max<std::size_t> (options.capacity, 1), options.overflow),
+	 _key(options.key),
+	 _ring(_capacity),
+	 _head(0)
+{}
+
+template<typename ...T>
+std::size_t EventQueue<T...>::key (const Delivery<T...> &delivery) const
 {
-	void *objDataVoid = serialized (event, reinterpret_cast<const void *> (&arg) ...);
-	R *objDataR = reinterpret_cast<R *> (objDataVoid);
-	R objDataCopy = *objDataR; // allow deletion of temporary allocation
+	if (_overflow != OverflowPolicy::CoalesceByKey)
+		return 0;
 
-	delete objDataR;
+	return std::apply (_key, delivery.values);
+}
 
-	return objDataCopy;
+template<typename ...T>
+typename EventQueue<T...>::Entry &EventQueue<T...>::at (std::size_t index) {
+	return _ring[(_head + index) % _capacity];
 }
 
-template<typename R, typename ...T>
-std::enable_if_t<(sizeof... (T) > 1) &&
-				 !std::is_same<R, void>::value, R>
-	SerializedSlot::invoke (const Event::Ptr &event, const T &...arg) const
+template<typename ...T>
+void EventQueue<T...>::dropOldest ()
 {
-	auto data = std::tuple<T...> (arg...);
-	void *objDataVoid = serialized (event, reinterpret_cast<const void *> (&data));
-	R *objDataR = reinterpret_cast<R *> (objDataVoid);
-	R objDataCopy = *objDataR; // allow deletion of temporary allocation
+	at (0) = Entry{};
+	_head = (_head + 1) % _capacity;
+	_depth--;
+	_dropped++;
+}
+
+template<typename ...T>
+bool EventQueue<T...>::push (Entry &&entry, Entry &next)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	_enqueued++;
+
+	// Nothing is being processed: the event does not need to wait
+	if (!_busy) {
+		_busy = true;
+		next = std::move (entry);
+		return true;
+	}
+
+	switch (_overflow) {
+	case OverflowPolicy::KeepLatest:
+		while (_depth > 0)
+			dropOldest ();
+		break;
+
+	case OverflowPolicy::CoalesceByKey:
+		for (std::size_t i = 0; i < _depth; i++) {
+			if (at (i).key == entry.key) {
+				at (i) = std::move (entry);
+				_dropped++;
+				return false;
+			}
+		}
+		[[fallthrough]];
+
+	case OverflowPolicy::DropOldest:
+		if (_depth == _capacity)
+			dropOldest ();
+		break;
+
+	case OverflowPolicy::Block:
+		_space.wait (lock, [this] { return _depth < _capacity; });
+
+		// The queue may have been drained while waiting
+		if (!_busy) {
+			_busy = true;
+			next = std::move (entry);
+			return true;
+		}
+		break;
+	}
 
-	delete objDataR;
+	at (_depth) = std::move (entry);
+	_depth++;
 
-	return objDataCopy;
+	return false;
 }
 
-template<typename R>
-std::enable_if_t<!std::is_same<R, void>::value, R>
-	SerializedSlot::invoke (const Event::Ptr &event) const
+template<typename ...T>
+bool EventQueue<T...>::pop (Entry &next)
 {
-	void *objDataVoid = serialized (event, nullptr);
-	R *objDataR = reinterpret_cast<R *> (objDataVoid);
-	R objDataCopy = *objDataR; // allow deletion of temporary allocation
+	std::unique_lock<std::mutex> lock(_mutex);
 
-	delete objDataR;
+	if (_depth == 0) {
+		_busy = false;
+		return false;
+	}
 
-	return objDataCopy;
+	next = std::move (at (0));
+	at (0) = Entry{};
+	_head = (_head + 1) % _capacity;
+	_depth--;
+
+	lock.unlock ();
+	_space.notify_one ();
+
+	return true;
 }
 
 inline NlModFlow::NlModFlow ():
-	 _channelsSeq(0)
+	 _debug{},
+	 _executorConfig{0, 0},
+	 _channelsSeq(0),
+	 _compiled(false),
+	 _statsEnabled(false)
 {}
 
+inline NlModFlow::~NlModFlow ()
+{
+	if (_compiled) {
+		for (const NlModule::Ptr &module : _modules)
+			module->onNetworkStop ();
+	}
+
+	waitIdle ();
+	_executor.reset ();
+}
+
 inline void NlModFlow::finalize()
 {
+	std::vector<std::string> errors;
+
+	for (const NlModule::Ptr &module : _modules)
+		module->_paramsBinding.fill (_nlParams[module->name ()], errors);
+
+	if (!errors.empty ())
+		throw paramsError (errors);
+
 	for (const NlModule::Ptr &module : _modules) {
 		module->initParams (_nlParams[module->name ()]);
 		module->setupNetwork ();
 	}
+
+	// All channels are created: emits by name resolve through the frozen table from now on
+	_channelNames.freeze ();
+	compile ();
+
+	for (const NlModule::Ptr &module : _modules)
+		module->onNetworkReady ();
+}
+
+inline void NlModFlow::compile ()
+{
+	std::size_t total = 0;
+
+	for (std::size_t id = 0; id < _connections.size (); id++) {
+		validateConnection (Channel (&_channels[id]));
+		total += _connections[id].size ();
+	}
+
+	_dispatchTable.clear ();
+	_dispatchTable.reserve (total);
+
+	for (std::size_t id = 0; id < _connections.size (); id++) {
+		const std::size_t begin = _dispatchTable.size ();
+
+		_dispatchTable.insert (_dispatchTable.end (), _connections[id].begin (), _connections[id].end ());
+		_dispatch[id] = Connection (_dispatchTable.data () + begin, _connections[id].size ());
+	}
+
+	_compiled = true;
+}
+
+inline void NlModFlow::validateConnection (const Channel &channel) const
+{
+	const std::vector<SerializedSlot> &connection = _connections[channel.id ()];
+
+	for (const SerializedSlot &slot : connection) {
+		if (slot.returnType () == std::type_index (typeid (void)))
+			continue;
+
+		if (connection.size () > 1) {
+			std::cout << "Channel " << channel.name () << " has " << connection.size ()
+					<< " connections, but slot " << slot.name () << " returns a value: services must have a single connection" << std::endl;
+			assert (false && "Non-void return type only allowed to channels with single connections");
+		}
+
+		if (_queues[channel.id ()] != nullptr) {
+			std::cout << "Slot " << slot.name () << " returns a value, but channel " << channel.name () << " is queued" << std::endl;
+			assert (false && "Services cannot be called on queued channels");
+		}
+	}
+}
+
+inline XmlRpc::XmlRpcException NlModFlow::paramsError (const std::vector<std::string> &errors)
+{
+	std::stringstream msg;
+
+	msg << errors.size () << " invalid module params:";
+	for (const std::string &error : errors)
+		msg << "\n  " << error;
+
+	return XmlRpc::XmlRpcException (msg.str ());
+}
+
+inline void NlModFlow::reloadParams (const NlParams &nlParams)
+{
+	const std::shared_ptr<const NlParams> previous = _liveParams.load ();
+	const std::shared_ptr<const NlParams> next = std::make_shared<const NlParams> (nlParams);
+	std::vector<NlModule *> changed;
+	std::vector<std::string> errors;
+
+	for (const NlModule::Ptr &module : _modules) {
+		const NlParams moduleParams = (*next)[module->name ()];
+
+		if (moduleParams == (*previous)[module->name ()])
+			continue;
+
+		module->_paramsBinding.validate (moduleParams, errors);
+		changed.push_back (module.get ());
+	}
+
+	if (!errors.empty ())
+		throw paramsError (errors);
+
+	_liveParams.store (next);
+
+	for (NlModule *module : changed) {
+		// The task keeps the new params alive: module params refer to them
+		auto update = [module, next] {
+			const NlParams moduleParams = (*next)[module->name ()];
+			std::vector<std::string> errors;
+
+			module->_paramsBinding.fill (moduleParams, errors);
+			module->onParamsChanged (moduleParams);
+		};
+
+		if (_executor != nullptr)
+			module->_strand->post (std::move (update));
+		else
+			update ();
+	}
+}
+
+inline std::shared_ptr<const NlParams> NlModFlow::params () const {
+	return _liveParams.load ();
 }
 
 inline void NlModFlow::init (const NlParams &nlParams)
 {
 	_nlParams = nlParams;
+	_liveParams.store (std::make_shared<const NlParams> (nlParams));
 
 	initDebugConfiguration ();
+	initTraceConfiguration ();
+	initExecutorConfiguration ();
+
+	_statsEnabled = _nlParams.get<bool> ("mod_flow/stats/enable", false);
 
 	_sources = loadModule<NlSources> ();
 	_sinks = loadModule<NlSinks> ();
@@ -855,34 +1818,139 @@ inline void NlModFlow::init (const NlParams &nlParams)
 }
 
 template<typename ...T>
-Channel NlModFlow::createChannel (const std::string &name,
+TypedChannel<T...> NlModFlow::createChannel (const std::string &name,
 						    const NlModule *owner,
 						    bool isSink)
 {
-	Channel newChannel(_channelsSeq, name, owner, isSink, &typeid(T)...);
+	// Emits running on the executor index the channel tables: they never grow after compile
+	if (_compiled) {
+		std::cout << "Module " << owner->name () << " creating channel "
+				  << name << ": channels are fixed after finalize" << std::endl;
+		assert (false && "Channels are fixed after finalize");
+		return TypedChannel<T...> ();
+	}
 
-	if (_channelNames.find (name) != _channelNames.end ()) {
+	if (_channelNames.find (name) != nullptr) {
 		std::cout << "Module " << owner->name () << " creating channel "
 				  << name << ": already exists" << std::endl;
 		assert (false && "Channel name conflict");
 	}
 
-	_channelNames[name] = newChannel;
+	_channels.push_back ({_channelsSeq, name, isSink, {std::type_index(typeid(T))...}, owner});
+	_channelNames.insert (&_channels.back ());
+
+	Channel newChannel(&_channels.back ());
+	_channelDebugMasks.push_back (_debug.bits (_debug.channelBits, name));
+
+	if (_trace != nullptr)
+		_trace->nameChannel (newChannel.id (), name);
+	if (_statsEnabled)
+		_counters.emplace_back ();
 	_connections.push_back ({});
+	_dispatch.push_back ({});
+	_queues.push_back (nullptr);
 	_channelsSeq++;
 
+	return TypedChannel<T...> (newChannel);
+}
+
+template<typename ...T>
+TypedChannel<T...> NlModFlow::createChannel (const std::string &name,
+						    const NlModule *owner,
+						    const QueueOptions<T...> &queue)
+{
+	TypedChannel<T...> newChannel = createChannel<T...> (name, owner);
+
+	assert ((queue.capacity > 0 || queue.overflow == OverflowPolicy::KeepLatest) && "Queue capacity must be positive");
+	assert ((queue.overflow != OverflowPolicy::CoalesceByKey || queue.key) && "Coalescing queue requires a key");
+
+	if (_executor == nullptr) {
+		std::cout << "Module " << owner->name () << " creating queued channel " << name
+				<< ": executor disabled, the channel is synchronous" << std::endl;
+
+		return newChannel;
+	}
+
+	_queues[newChannel.id ()] = std::make_unique<EventQueue<T...>> (newChannel.id (), queue);
+
 	return newChannel;
 }
 
-inline Channel NlModFlow::resolveChannel (const std::string &name) {
-	if (_channelNames.find (name) == _channelNames.end ()) {
+inline QueueStats NlModFlow::queueStats (const Channel &channel) const
+{
+	if (_queues[channel.id ()] == nullptr)
+		return QueueStats{0, 0, 0, 0};
+
+	return _queues[channel.id ()]->stats ();
+}
+
+inline Channel NlModFlow::resolveChannel (const std::string &name) const
+{
+	const ChannelInfo *info = _channelNames.find (name);
+
+	if (info == nullptr) {
 		if (_debug.enabled)
 			std::cout << "Channel " << name << " does not exist" << std::endl;
 
 		assert (false && "Channel name does not exist");
 	}
 
-	return _channelNames[name];
+	return Channel (info);
+}
+
+inline ChannelIndex::ChannelIndex ():
+	 _mask(0),
+	 _frozen(false)
+{}
+
+inline void ChannelIndex::insert (const ChannelInfo *info)
+{
+	_names[info->name] = info;
+
+	if (_frozen)
+		freeze ();
+}
+
+inline const ChannelInfo *ChannelIndex::find (const std::string &name) const
+{
+	if (!_frozen) {
+		auto found = _names.find (name);
+
+		return found == _names.end () ? nullptr : found->second;
+	}
+
+	const std::size_t hash = std::hash<std::string> () (name);
+
+	// The table is never full, so the probe ends on an empty entry
+	for (std::size_t i = hash & _mask; _table[i].info != nullptr; i = (i + 1) & _mask) {
+		if (_table[i].hash == hash && _table[i].info->name == name)
+			return _table[i].info;
+	}
+
+	return nullptr;
+}
+
+inline void ChannelIndex::freeze ()
+{
+	std::size_t size = 2;
+
+	while (size < 2 * _names.size ())
+		size <<= 1;
+
+	_table.assign (size, Entry{0, nullptr});
+	_mask = size - 1;
+
+	for (const auto &name : _names) {
+		const std::size_t hash = std::hash<std::string> () (name.first);
+		std::size_t i = hash & _mask;
+
+		while (_table[i].info != nullptr)
+			i = (i + 1) & _mask;
+
+		_table[i] = {hash, name.second};
+	}
+
+	_frozen = true;
 }
 
 inline void NlModFlow::initDebugConfiguration () {
@@ -897,28 +1965,170 @@ inline void NlModFlow::initDebugConfiguration () {
 	_debug.filterExcludeChannels = _nlParams.get<std::string, std::vector> ("mod_flow/debug/exclude_channels", std::vector<std::string> ());
 	_debug.filterExcludeModules = _nlParams.get<std::string, std::vector> ("mod_flow/debug/exclude_modules", std::vector<std::string> ());
 
+	// Resolved to bits here, so modules and channels get their mask once when they are created
+	_debug.assignBits (_debug.filterOnlyChannels, _debug.channelBits, _debug.onlyMask);
+	_debug.assignBits (_debug.filterOnlyModules, _debug.moduleBits, _debug.onlyMask);
+	_debug.assignBits (_debug.filterExcludeChannels, _debug.channelBits, _debug.excludeMask);
+	_debug.assignBits (_debug.filterExcludeModules, _debug.moduleBits, _debug.excludeMask);
+}
+
+inline void NlModFlow::DebugConfiguration::assignBits (const std::vector<std::string> &names,
+												std::map<std::string, uint64_t> &bits,
+												uint64_t &filterMask)
+{
+	for (const std::string &name : names) {
+		if (bitsCount == 64) {
+			std::cout << "Debug filter " << name << " ignored: at most 64 filter entries are supported" << std::endl;
+			continue;
+		}
+
+		const uint64_t bit = uint64_t (1) << bitsCount++;
+
+		bits[name] |= bit;
+		filterMask |= bit;
+	}
+}
+
+inline uint64_t NlModFlow::DebugConfiguration::bits (const std::map<std::string, uint64_t> &bits, const std::string &name) const
+{
+	auto found = bits.find (name);
+
+	return found == bits.end () ? 0 : found->second;
+}
+
+inline void NlModFlow::initExecutorConfiguration ()
+{
+	// With no threads events are dispatched synchronously on the emitting thread
+	_executorConfig.threads = _nlParams.get<int> ("mod_flow/executor/threads", 0);
+	_executorConfig.batch = _nlParams.get<int> ("mod_flow/executor/batch", 32);
+
+	if (_executorConfig.threads <= 0)
+		return;
+
+	assert (_executorConfig.batch > 0 && "Executor batch must be positive");
+
+	_executor = std::make_unique<NlExecutor> (_executorConfig.threads);
+}
+
+inline void NlModFlow::initTraceConfiguration ()
+{
+	if (!_nlParams.get<bool> ("mod_flow/trace/enable", false))
+		return;
+
+	const std::string path = _nlParams.get<std::string> ("mod_flow/trace/file", std::string ("modflow.trace"));
+	const int bufferSize = _nlParams.get<int> ("mod_flow/trace/buffer_size", 65536);
+	const int flushPeriod = _nlParams.get<int> ("mod_flow/trace/flush_period_ms", 100);
+
+	_trace = std::make_unique<TraceRecorder> (path, bufferSize, std::chrono::milliseconds (flushPeriod));
+}
+
+inline bool NlModFlow::statsEnabled () const {
+	return _statsEnabled;
+}
+
+inline bool NlModFlow::executorEnabled () const {
+	return _executor != nullptr;
+}
+
+inline ModFlowStats NlModFlow::stats () const
+{
+	ModFlowStats stats;
+
+	if (!_statsEnabled)
+		return stats;
+
+	for (std::size_t id = 0; id < _counters.size (); id++) {
+		const ChannelCounters &counters = _counters[id];
+		const std::string &channel = _channels[id].name;
+
+		stats.channels.push_back ({channel, counters.emits.load (std::memory_order_relaxed), counters.endToEnd.summary ()});
+
+		for (std::size_t i = 0; i < counters.slots.size (); i++) {
+			const SerializedSlot &slot = _dispatch[id][i];
+
+			stats.slots.push_back ({channel, slot.name (), slot.receiver ()->name (), counters.slots[i].summary ()});
+		}
+	}
+
+	return stats;
+}
+
+inline LatencyHistogram *NlModFlow::slotLatency (ChannelId channelId, std::size_t index) {
+	return _statsEnabled ? &_counters[channelId].slots[index] : nullptr;
+}
+
+inline void NlModFlow::countEmit (const Channel &channel, Event &event)
+{
+	_counters[channel.id ()].emits.fetch_add (1, std::memory_order_relaxed);
+
+	if (event.isRoot ()) {
+		event.setRootTime (LatencySpan::now ());
+		return;
+	}
+
+	// Events leaving the graph close the latency of the cascade, accounted to its root channel
+	if (channel.isSink ())
+		_counters[event.rootChannel ().id ()].endToEnd.record (LatencySpan::now () - event.rootTime ());
 }
 
 inline const ResourceManager &NlModule::resources () const  { return _modFlow->_resources; }
 inline ResourceManager &NlModule::resources ()  { return _modFlow->_resources; }
+inline bool NlModule::executorEnabled () const { return _strand != nullptr; }
 
 template<typename ...T>
-Channel NlModule::requireSink (const std::string &sinkName)
+TypedChannel<T...> NlModule::requireSink (const std::string &sinkName)
 {
 	Channel sink = _modFlow->resolveChannel (sinkName);
 
 	assert (sink.checkType<T...> () && "Channel type mismatch");
 
-	return sink;
+	return TypedChannel<T...> (sink);
 }
 
 
+inline void errorConnectionAfterFinalize (const Channel &channel, const std::string &name) {
+	std::cout << "Cannot connect " << name << " to channel " << channel.name ()
+			<< ": connections are fixed after finalize" << std::endl;
+}
+
 template<typename ...T, typename R>
-void NlModFlow::createConnection (const Channel &channel, const Slot<R, T...> &slot, const std::string &name)
+void NlModFlow::createConnection (const Channel &channel, const Slot<R, T...> &slot, const std::string &name, const NlModule *receiver)
+{
+	// Pending tasks and running dispatch loops point into the dispatch table: it is never rebuilt
+	if (_compiled) {
+		errorConnectionAfterFinalize (channel, name);
+		assert (false && "Connections are fixed after finalize");
+		return;
+	}
+
+	if (_trace != nullptr)
+		_trace->nameSlot (channel.id (), _connections[channel.id ()].size (), name);
+	if (_statsEnabled)
+		_counters[channel.id ()].slots.emplace_back ();
+
+	_connections[channel.id ()].push_back (SerializedSlot::create<R, T...> (slot, channel, name, receiver));
+	// While setting up the graph its slots are used in place, until compile
+	_dispatch[channel.id ()] = Connection (_connections[channel.id ()].data (), _connections[channel.id ()].size ());
+}
+
+template<typename R, typename ...T, typename F>
+void NlModFlow::createConnection (const Channel &channel, const F &callable, const std::string &name, const NlModule *receiver)
 {
-	SerializedSlot serializedSlot(slot, channel, name);
+	// Pending tasks and running dispatch loops point into the dispatch table: it is never rebuilt
+	if (_compiled) {
+		errorConnectionAfterFinalize (channel, name);
+		assert (false && "Connections are fixed after finalize");
+		return;
+	}
+
+	if (_trace != nullptr)
+		_trace->nameSlot (channel.id (), _connections[channel.id ()].size (), name);
+	if (_statsEnabled)
+		_counters[channel.id ()].slots.emplace_back ();
 
-	_connections[channel.id ()].push_back (serializedSlot);
+	_connections[channel.id ()].push_back (SerializedSlot::create<R, T...> (callable, channel, name, receiver));
+	// While setting up the graph its slots are used in place, until compile
+	_dispatch[channel.id ()] = Connection (_connections[channel.id ()].data (), _connections[channel.id ()].size ());
 }
 
 inline void debugTrackEmit (int depth, const Channel &channel, const NlModule *caller, int connectionsCount) {
@@ -951,32 +2161,18 @@ inline bool contains (const std::vector<std::string> &list, const std::string &k
 	return std::find (list.begin (), list.end (), key) != list.end();
 }
 
-inline bool NlModFlow::debugFilters (const Event::Ptr &event) {
+inline uint64_t NlModFlow::debugMask (const Channel &channel, const NlModule *caller) const {
+	return caller->_debugMask | _channelDebugMasks[channel.id ()];
+}
+
+// Every only filter must match an ancestor and no exclude filter can
+inline bool NlModFlow::debugFilters (const Event &event) const {
 	if (!_debug.enabled)
 		return false;
 
-	for (const std::string &curr : _debug.filterOnlyChannels) {
-		if (!event->channelInAncestors (curr))
-			return false;
-	}
-
+	const uint64_t mask = event.ancestorsMask ();
 
-	for (const std::string &curr : _debug.filterOnlyModules) {
-		if (!event->moduleInAncestors (curr))
-			return false;
-	}
-
-	for (const std::string &curr : _debug.filterExcludeChannels) {
-		if (event->channelInAncestors (curr))
-			return false;
-	}
-
-	for (const std::string &curr : _debug.filterExcludeModules) {
-		if (event->moduleInAncestors (curr))
-			return false;
-	}
-
-	return true;
+	return (mask & _debug.onlyMask) == _debug.onlyMask && (mask & _debug.excludeMask) == 0;
 }
 
 template<typename ...T>
@@ -1000,80 +2196,253 @@ inline void errorOwnership (const Channel &channel, const NlModule *caller) {
 			<< channel.name () << ", owned by " << channel.ownerName () << std::endl;
 }
 
+inline void errorBlockingEmit (const Channel &channel, const NlModule *caller) {
+	std::cout << "Module " << caller->name () << " cannot emit on blocking channel "
+			<< channel.name () << " from an executor worker" << std::endl;
+}
 
-template<typename R, typename ...T>
-Event::Ptr NlModFlow::prepareEmit(const Channel &channel,
-				  const NlModule *caller)
+
+template<typename ...T>
+void NlModFlow::checkEmitType (const Channel &channel, const NlModule *caller)
 {
+#ifndef NLIB_MODFLOW_UNCHECKED
 	if (!channel.checkType<T...> ()) {
 		errorChannelTypeMismatch<T...> (channel, caller, true);
 
 		assert (false && "Channel type mismatch");
 	}
+#endif
+}
+
+inline void NlModFlow::prepareEmit(const Channel &channel,
+						     const NlModule *caller,
+						     Event &event)
+{
+#ifndef NLIB_MODFLOW_UNCHECKED
 	if (!channel.checkOwnership (caller)) {
 		errorOwnership (channel, caller);
 		assert (false && "Cannot emit on channels created by different modules");
 	}
+#endif
 
-	Event::Ptr lastEvent = caller->lastEvent ();
-	Event::Ptr event;
+	event.setTraced (debugFilters (event));
 
-		// This is the case for a source call
-	if (lastEvent == nullptr)
-		event = std::make_shared<Event> (caller, &channel);
-	else
-		event = std::make_shared<Event> (lastEvent, caller, &channel);
+	if (_statsEnabled)
+		countEmit (channel, event);
 
-	if (debugFilters (event))
-		debugTrackEmit (event->depth (), channel, caller, _connections[channel.id ()].size ());
+	if (event.traced ())
+		debugTrackEmit (event.depth (), channel, caller, _dispatch[channel.id ()].size ());
+}
+
+template<typename R, typename ...T>
+R NlModFlow::emit (const Channel &channel,
+			    const NlModule *caller,
+			    const T &...value)
+{
+	checkEmitType<T...> (channel, caller);
 
-	return event;
+	return dispatchEmit<R, T...> (channel, caller, value...);
 }
 
 template<typename R, typename ...T>
-std::enable_if_t<!std::is_same<R, void>::value, R>
- NlModFlow::emit (const Channel &channel,
+R NlModFlow::emit (const std::string &channelName,
 				  const NlModule *caller,
-				  const T &...value)
+				  const T &...value) {
+	return emit<R, T...> (resolveChannel (channelName), caller, value...);
+}
+
+template<typename R, typename ...T>
+R NlModFlow::emit (const TypedChannel<T...> &channel,
+			    const NlModule *caller,
+			    const T &...value)
+{
+	return dispatchEmit<R, T...> (channel, caller, value...);
+}
+
+template<typename R, typename ...T>
+R NlModFlow::dispatchEmit (const Channel &channel,
+					  const NlModule *caller,
+					  const T &...value)
 {
-	Event::Ptr event = prepareEmit<R, T...> (channel, caller);
+	// A null last event means this is a source call, starting a new cascade
+	ScopedEvent event(caller->lastEvent (), caller, channel, debugMask (channel, caller));
+	TraceSpan emitSpan(_trace.get (), TraceKind::Emit, channel.id (), caller->_id, event->depth ());
+
+	prepareEmit (channel, caller, *event.get ());
+
+	const Connection &connection = _dispatch[channel.id ()];
+
+	if constexpr (std::is_same<R, void>::value) {
+		if (_executor != nullptr) {
+			if (_queues[channel.id ()] != nullptr)
+				enqueueEmit (static_cast<EventQueue<T...> &> (*_queues[channel.id ()]), caller, event.get (), value...);
+			else
+				postEmit<T...> (connection, caller, event.get (), value...);
+
+			return;
+		}
+
+		for (std::size_t i = 0; i < connection.size (); i++) {
+			const SerializedSlot &currentSlot = connection[i];
+			TraceSpan slotSpan(_trace.get (), TraceKind::Slot, channel.id (), currentSlot.receiver ()->_id, event->depth (), i);
+			LatencySpan slotTimer(slotLatency (channel.id (), i));
+
+			if (event->traced ())
+				debugConnection (event->depth (), caller, currentSlot);
+
+			currentSlot.dispatch<void, T...> (event.get (), value...);
+		}
+	} else {
+		assert ((connection.size () == 1) && "Non-void return type only allowed to channels with single connections");
+		assert (_queues[channel.id ()] == nullptr && "Services cannot be called on queued channels");
 
-	assert ((_connections[channel.id ()].size () == 1) && "Non-void return type only allowed to channels with single connections");
+		const SerializedSlot &currentSlot = connection.front ();
+		TraceSpan slotSpan(_trace.get (), TraceKind::Slot, channel.id (), currentSlot.receiver ()->_id, event->depth (), 0);
+		LatencySpan slotTimer(slotLatency (channel.id (), 0));
 
-	const SerializedSlot &currentSlot = _connections[channel.id ()].front ();
+		if (event->traced ())
+			debugConnection (event->depth (), caller, currentSlot);
 
-	if (debugFilters (event))
-		debugConnection (event->depth (), caller, currentSlot);
+		// Services are called synchronously, excluding the other slots of the receiver
+		if (_executor != nullptr) {
+			return currentSlot.receiver ()->_strand->runExclusive ([&] () -> R {
+				return currentSlot.dispatch<R, T...> (event.get (), value...);
+			});
+		}
 
-	return currentSlot.invoke<R, T...> (event, value...);
+		return currentSlot.dispatch<R, T...> (event.get (), value...);
+	}
 }
 
-template<typename R, typename ...T>
-std::enable_if_t<std::is_same<R, void>::value, R>
- NlModFlow::emit (const Channel &channel,
-				  const NlModule *caller,
-				  const T &...value)
+template<typename ...T, typename ...V>
+void NlModFlow::postEmit (const Connection &connection,
+					 const NlModule *caller,
+					 Event::Ptr event,
+					 V &&...value)
 {
-	Event::Ptr event = prepareEmit<R, T...> (channel, caller);
+	if (connection.empty ())
+		return;
 
-	for (const SerializedSlot &currentSlot : _connections[channel.id ()]) {
-		if (debugFilters (event))
-			debugConnection (event->depth (), caller, currentSlot);
+	// A single copy of the event and of the values is shared by all the connected slots
+	std::shared_ptr<const Delivery<T...>> delivery = std::make_shared<Delivery<T...>> (*event, std::forward<V> (value)...);
 
-		currentSlot.invoke<R, T...> (event, value...);
+	for (std::size_t i = 0; i < connection.size (); i++) {
+		const SerializedSlot &currentSlot = connection[i];
+
+		currentSlot.receiver ()->_strand->post ([this, caller, delivery, &currentSlot, i] {
+			TraceSpan slotSpan(_trace.get (), TraceKind::Slot, currentSlot.channel ().id (), currentSlot.receiver ()->_id, delivery->event.depth (), i);
+			LatencySpan slotTimer(slotLatency (currentSlot.channel ().id (), i));
+
+			if (delivery->event.traced ())
+				debugConnection (delivery->event.depth (), caller, currentSlot);
+
+			std::apply ([&] (const T &...arg) {
+				currentSlot.dispatch<void, T...> (&delivery->event, arg...);
+			}, delivery->values);
+		});
 	}
 }
 
+template<typename ...T, typename ...V>
+void NlModFlow::enqueueEmit (EventQueue<T...> &queue,
+					    const NlModule *caller,
+					    Event::Ptr event,
+					    V &&...value)
+{
+	// Connections are fixed after finalize: nobody would process the event
+	if (_dispatch[queue.channelId ()].empty ())
+		return;
 
-template<typename R, typename ...T>
-R NlModFlow::emit (const std::string &channelName,
-				  const NlModule *caller,
-				  const T &...value) {
-	return emit<R, T...> (resolveChannel (channelName), caller, value...);
+	// Waiting for space would hold this worker, which the consumer strand may need to drain the queue
+	if (queue.overflow () == OverflowPolicy::Block && _executor->onWorker ()) {
+		errorBlockingEmit (Channel (&_channels[queue.channelId ()]), caller);
+		assert (false && "Blocking queued channels can only be emitted from source threads");
+	}
+
+	std::shared_ptr<const Delivery<T...>> delivery = std::make_shared<Delivery<T...>> (*event, std::forward<V> (value)...);
+	typename EventQueue<T...>::Entry next;
+
+	if (queue.push ({delivery, caller, queue.key (*delivery)}, next))
+		deliverQueued (queue, next);
+}
+
+template<typename ...T>
+void NlModFlow::deliverQueued (EventQueue<T...> &queue,
+						 const typename EventQueue<T...>::Entry &entry)
+{
+	const Connection &connection = _dispatch[queue.channelId ()];
+
+	queue.setInFlight (connection.size ());
+
+	for (std::size_t i = 0; i < connection.size (); i++) {
+		const SerializedSlot &currentSlot = connection[i];
+
+		currentSlot.receiver ()->_strand->post ([this, &queue, entry, &currentSlot, i] {
+			TraceSpan slotSpan(_trace.get (), TraceKind::Slot, queue.channelId (), currentSlot.receiver ()->_id, entry.delivery->event.depth (), i);
+			LatencySpan slotTimer(slotLatency (queue.channelId (), i));
+
+			if (entry.delivery->event.traced ())
+				debugConnection (entry.delivery->event.depth (), entry.caller, currentSlot);
+
+			std::apply ([&] (const T &...arg) {
+				currentSlot.dispatch<void, T...> (&entry.delivery->event, arg...);
+			}, entry.delivery->values);
+
+			// The last slot to complete dispatches the next pending event
+			if (queue.slotDone ())
+				completeQueued (queue);
+		});
+	}
+}
+
+template<typename ...T>
+void NlModFlow::completeQueued (EventQueue<T...> &queue)
+{
+	typename EventQueue<T...>::Entry next;
+
+	if (queue.pop (next))
+		deliverQueued (queue, next);
+}
+
+template<typename ...T>
+void NlModFlow::emitMove (const TypedChannel<T...> &channel,
+					 const NlModule *caller,
+					 T &&...value)
+{
+	ScopedEvent event(caller->lastEvent (), caller, channel, debugMask (channel, caller));
+	TraceSpan emitSpan(_trace.get (), TraceKind::Emit, channel.id (), caller->_id, event->depth ());
+
+	prepareEmit (channel, caller, *event.get ());
+
+	const Connection &connection = _dispatch[channel.id ()];
+
+	// Slots may run in parallel, so they all share the moved value by const reference
+	if (_executor != nullptr) {
+		if (_queues[channel.id ()] != nullptr)
+			enqueueEmit (static_cast<EventQueue<T...> &> (*_queues[channel.id ()]), caller, event.get (), std::move (value)...);
+		else
+			postEmit<T...> (connection, caller, event.get (), std::move (value)...);
+
+		return;
+	}
+
+	for (std::size_t i = 0; i < connection.size (); i++) {
+		const SerializedSlot &currentSlot = connection[i];
+		TraceSpan slotSpan(_trace.get (), TraceKind::Slot, channel.id (), currentSlot.receiver ()->_id, event->depth (), i);
+		LatencySpan slotTimer(slotLatency (channel.id (), i));
+
+		if (event->traced ())
+			debugConnection (event->depth (), caller, currentSlot);
+
+		if (i + 1 < connection.size ())
+			currentSlot.dispatch<void, T...> (event.get (), value...);
+		else
+			currentSlot.dispatchMove<void, T...> (event.get (), std::move (value)...);
+	}
 }
 
 template<typename ...T>
-Channel NlSources::declareSource (const std::string &name) {
+TypedChannel<T...> NlSources::declareSource (const std::string &name) {
 	return _modFlow->createChannel<T...> (name, this);
 }
 
@@ -1087,24 +2456,29 @@ void NlSources::callSource (const Channel &channel, const T &...value) {
 	emit<T...> (channel, value...);
 }
 
+template<typename ...T>
+void NlSources::callSource (const TypedChannel<T...> &channel, const T &...value) {
+	emit<T...> (channel, value...);
+}
+
 
 template<typename ...T, class ParentClass>
 void NlSinks::declareSink (const std::string &name, void (ParentClass::*parentSlot)(T...), ParentClass *parent)
 {
-	Channel channel = _modFlow->createChannel<T...> (name, this, true);
-	Slot<void, T...> boundSlot = [parent, parentSlot] (const Event::Ptr &, const T &... value) {
-		(parent->*parentSlot)(value...);
+	Channel channel = _modFlow->createChannel<std::decay_t<T>...> (name, this, true);
+	auto boundSlot = [parent, parentSlot] (const Event::Ptr &, auto &&...value) {
+		(parent->*parentSlot)(std::forward<decltype(value)> (value)...);
 	};
 
-	_modFlow->createConnection (channel, boundSlot, getFcnName(parentSlot));
+	_modFlow->createConnection<void, std::decay_t<T>...> (channel, boundSlot, getFcnName(parentSlot), this);
 }
 
 inline std::string Event::moduleName() const {
-	return _module->name ();
+	return _path[_depth].module->name ();
 }
 
 inline std::string Event::channelName() const {
-	return _channel->name ();
+	return _path[_depth].channel->name;
 }
 
 inline Event::Ptr NlModule::lastEvent() const {
@@ -1122,25 +2496,35 @@ std::enable_if_t<std::is_base_of<NlModule, M>::value>
 		assert (false && "Channel type mismatch");
 	}
 
-	Slot<R, T...> boundSlot = [this, slot] (const Event::Ptr &event, T ...arg) -> R {
-		M *child = dynamic_cast<M*> (this);
-		this->_lastEvent = event;
-		if (this->isEnabled ())
-			return (child->*slot) (arg...);
+	// The module is fully constructed here: cast it once instead of on every call
+	M *child = dynamic_cast<M*> (this);
+
+	assert (child != nullptr && "Slot must be a member function of the module");
+
+	// Arguments are forwarded as they are received: the only copies are those required by the slot signature
+	auto boundSlot = [this, child, slot] (const Event::Ptr &event, auto &&...arg) -> R {
+		LastEventScope lastEventScope(this, event);
+
+		if (!this->isEnabled ())
+			return R ();
+
+		return (child->*slot) (std::forward<decltype(arg)> (arg)...);
 	};
 
-	_modFlow->createConnection (channel, boundSlot, getFcnName (slot));
+	_modFlow->createConnection<R, std::decay_t<T>...> (channel, boundSlot, getFcnName (slot), this);
 }
 
 inline void NlModule::requestEnablingChannel (const Channel &channelId)
 {
-	Slot<void> boundEnableSlot = [this, channelId] (const Event::Ptr &event) {
-        this->_lastEvent = event;
-        this->setEnabled (channelId.id ());
+	ChannelId enablingChannelId = channelId.id ();
+	auto boundEnableSlot = [this, enablingChannelId] (const Event::Ptr &event) {
+        LastEventScope lastEventScope(this, event);
+        this->setEnabled (enablingChannelId);
     };
 
     _disablingChannels.insert (channelId.id ());
-    _modFlow->createConnection (channelId, boundEnableSlot, "<enabling " + channelId.name () + "> [" + name() + "]");
+    _enabled = false;
+    _modFlow->createConnection<void> (channelId, boundEnableSlot, "<enabling " + channelId.name () + "> [" + name() + "]", this);
 
 }
 
@@ -1153,22 +2537,31 @@ inline void NlModule::requestEnablingChannel (const std::string &channelName)
 inline void NlModule::setEnabled (ChannelId enablingChannelId) {
 	// If already erased simply ignore
 	_disablingChannels.erase (enablingChannelId);
+	_enabled = _disablingChannels.empty ();
 }
 
 inline bool NlModule::isEnabled () const {
-	return _disablingChannels.empty ();
+	return _enabled;
 }
 
 template<typename ...T>
-inline Channel NlModule::createChannel (const std::string &name) {
+inline TypedChannel<T...> NlModule::createChannel (const std::string &name) {
 	return _modFlow->createChannel<T...> (name, this);
 }
 
+template<typename ...T>
+inline TypedChannel<T...> NlModule::createChannel (const std::string &name, const QueueOptions<T...> &queue) {
+	return _modFlow->createChannel<T...> (name, this, queue);
+}
+
 inline NlModule::NlModule (NlModFlow *modFlow,
 					  const std::string &name):
 	 _modFlow(modFlow),
-	 _name(name),
-	 _lastEvent(nullptr)
+	 _lastEvent(nullptr),
+	 _enabled(true),
+	 _debugMask(0),
+	 _id(-1),
+	 _name(name)
 {
 }
 
@@ -1197,6 +2590,21 @@ R NlModule::callService (const std::string &channelName, const T &...value) {
 	return _modFlow->emit<R, T...> (channelName, this, value...);
 }
 
+template<typename ...T>
+void NlModule::emit (const TypedChannel<T...> &channel, const T &...value) {
+	_modFlow->emit<void, T...> (channel, this, value...);
+}
+
+template<typename R, typename ...T>
+R NlModule::callService (const TypedChannel<T...> &channel, const T &...value) {
+	return _modFlow->emit<R, T...> (channel, this, value...);
+}
+
+template<typename ...T>
+void NlModule::emitMove (const TypedChannel<T...> &channel, T &&...value) {
+	_modFlow->emitMove<T...> (channel, this, std::move (value)...);
+}
+
 
 
 }
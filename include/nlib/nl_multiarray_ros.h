@@ -3,17 +3,255 @@
 
 #include <std_msgs/Float64MultiArray.h>
 #include <std_msgs/Float32MultiArray.h>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef INCLUDE_EIGEN
+#include <eigen3/Eigen/Core>
+#endif
 
 namespace nlib {
 
-template<class MultiArray>
-class MultiArrayManager
+/**
+ * @brief Position in the data of a FloatXXMultiArray of the element at @p indexes
+ */
+template<class Layout, class Indexes>
+int multiArrayIndex (const Layout &layout, const Indexes &indexes) {
+	int numDims = layout.dim.size ();
+	int index = layout.data_offset;
+
+	for (int i = 0; i < numDims; i++) {
+		int currIndex = indexes[i];
+		if (i == numDims - 1)
+			index += currIndex;
+		else
+			index += currIndex * layout.dim[i+1].stride;
+	}
+
+	return index;
+}
+
+/**
+ * @brief Element and block access of a multi-array of compile-time @p Rank, with strides cached from its layout.
+ * @p Derived provides data (). Blocks are Eigen maps over the data, so that operations on whole rows or slices
+ * are vectorized, available with INCLUDE_EIGEN. Rank 0 is the runtime rank, indexed through get () and set () only.
+ */
+template<class Derived, int Rank>
+class MultiArrayAccess
+{
+public:
+	/**
+	 * @brief Element at the @p Rank indexes
+	 */
+	template<typename ...Indexes>
+	decltype(auto) operator () (Indexes ...indexes) {
+		return derived ().data ()[index (indexes...)];
+	}
+
+	template<typename ...Indexes>
+	decltype(auto) operator () (Indexes ...indexes) const {
+		return derived ().data ()[index (indexes...)];
+	}
+
+#ifdef INCLUDE_EIGEN
+	/**
+	 * @brief Contiguous elements of the last dimension at the Rank - 1 @p indexes
+	 */
+	template<typename ...Indexes>
+	auto row (Indexes ...indexes) {
+		return vectorMap (derived ().data () + index (indexes..., 0), _sizes[Rank - 1]);
+	}
+
+	template<typename ...Indexes>
+	auto row (Indexes ...indexes) const {
+		return vectorMap (derived ().data () + index (indexes..., 0), _sizes[Rank - 1]);
+	}
+
+	/**
+	 * @brief Row major matrix of the last two dimensions at the Rank - 2 @p indexes
+	 */
+	template<typename ...Indexes>
+	auto slice (Indexes ...indexes) {
+		static_assert (Rank >= 2, "Slices need at least two dimensions");
+		return matrixMap (derived ().data () + index (indexes..., 0, 0), _sizes[Rank - 2], _sizes[Rank - 1], _strides[Rank - 2]);
+	}
+
+	template<typename ...Indexes>
+	auto slice (Indexes ...indexes) const {
+		static_assert (Rank >= 2, "Slices need at least two dimensions");
+		return matrixMap (derived ().data () + index (indexes..., 0, 0), _sizes[Rank - 2], _sizes[Rank - 1], _strides[Rank - 2]);
+	}
+
+	/**
+	 * @brief Whole array as a row major matrix, with the leading dimensions flattened in the rows.
+	 * The leading dimensions must be dense, as in the arrays created by @ref MultiArrayManager.
+	 */
+	auto matrix () {
+		return matrixMap (derived ().data () + _offset, rows (), _sizes[Rank - 1], outerStride ());
+	}
+
+	auto matrix () const {
+		return matrixMap (derived ().data () + _offset, rows (), _sizes[Rank - 1], outerStride ());
+	}
+#endif
+
+	const std::array<int, Rank> &shape () const {
+		return _sizes;
+	}
+
+protected:
+	template<class Layout>
+	void updateStrides (const Layout &layout)
+	{
+		if (layout.dim.size () != Rank) {
+			std::cout << "Error: multi-array of rank " << layout.dim.size () << " accessed with rank " << Rank << "\nAborting" << std::endl;
+			std::abort ();
+		}
+
+		_offset = layout.data_offset;
+
+		for (int i = 0; i < Rank; i++) {
+			_sizes[i] = layout.dim[i].size;
+			_strides[i] = i < Rank - 1 ? layout.dim[i+1].stride : 1;
+		}
+	}
+
+private:
+	const Derived &derived () const { return static_cast<const Derived &> (*this); }
+	Derived &derived () { return static_cast<Derived &> (*this); }
+
+	template<typename ...Indexes>
+	int index (Indexes ...indexes) const {
+		static_assert (sizeof ...(Indexes) == Rank, "Number of indexes must match the rank");
+
+		int index = _offset;
+		int i = 0;
+
+		((index += int (indexes) * _strides[i++]), ...);
+
+		return index;
+	}
+
+	int rows () const {
+		int rows = 1;
+
+		for (int i = 0; i < Rank - 1; i++)
+			rows *= _sizes[i];
+
+		return rows;
+	}
+
+	int outerStride () const {
+		return Rank > 1 ? _strides[std::max (Rank - 2, 0)] : _sizes[0];
+	}
+
+#ifdef INCLUDE_EIGEN
+	template<typename Pointer>
+	static auto vectorMap (Pointer data, int size) {
+		using Scalar = std::remove_pointer_t<Pointer>;
+		using Plain = Eigen::Matrix<std::remove_const_t<Scalar>, Eigen::Dynamic, 1>;
+
+		return Eigen::Map<std::conditional_t<std::is_const<Scalar>::value, const Plain, Plain>> (data, size);
+	}
+
+	template<typename Pointer>
+	static auto matrixMap (Pointer data, int rows, int cols, int stride) {
+		using Scalar = std::remove_pointer_t<Pointer>;
+		using Plain = Eigen::Matrix<std::remove_const_t<Scalar>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+		return Eigen::Map<std::conditional_t<std::is_const<Scalar>::value, const Plain, Plain>, Eigen::Unaligned, Eigen::OuterStride<>>
+				(data, rows, cols, Eigen::OuterStride<> (stride));
+	}
+#endif
+
+private:
+	std::array<int, Rank> _sizes;
+	std::array<int, Rank> _strides;
+	int _offset;
+};
+
+template<class Derived>
+class MultiArrayAccess<Derived, 0>
+{
+protected:
+	template<class Layout>
+	void updateStrides (const Layout &) {}
+};
+
+/**
+ * @brief Non-owning view over the data of a FloatXXMultiArray: a received message, a message owned elsewhere
+ * or an external buffer. The data is never copied.
+ * @param Value Element type, const for read-only views
+ */
+template<class MultiArray, typename Value = const typename MultiArray::_data_type::value_type, int Rank = 0>
+class MultiArrayView : public MultiArrayAccess<MultiArrayView<MultiArray, Value, Rank>, Rank>
+{
+	using message_type = std::conditional_t<std::is_const<Value>::value, const MultiArray, MultiArray>;
+
+public:
+	using value_type = typename MultiArray::_data_type::value_type;
+	using layout_type = typename MultiArray::_layout_type;
+
+	/**
+	 * @brief View of a received message, kept alive by the view
+	 */
+	MultiArrayView (const typename MultiArray::ConstPtr &msg);
+	/**
+	 * @brief View of a message, which must outlive the view
+	 */
+	MultiArrayView (message_type &msg);
+	/**
+	 * @brief View of an external buffer with the layout of a FloatXXMultiArray, which must outlive the view
+	 * @param data Buffer of at least dataOffset + the product of sizes elements
+	 * @param sizes Sizes of the multi-array
+	 * @param dataOffset [optional] extra data size at the beginning of the buffer
+	 */
+	MultiArrayView (Value *data, const std::vector<int> &sizes, int dataOffset = 0);
+
+	/**
+	 * @brief Get value given indexes
+	 * @param indexes
+	 * @return array[indexes]
+	 */
+	value_type get (const std::vector<int> &indexes) const;
+	/**
+	 * @brief set array[indexes] = value. Mutable views only.
+	 * @param indexes
+	 * @param value
+	 */
+	void set (const std::vector<int> &indexes, value_type value) const;
+
+	/**
+	 * @brief Raw pointer to the viewed data, extra data included
+	 */
+	Value *data () const;
+
+	/**
+	 * @brief Get size at dimension i
+	 */
+	int size (int i) const;
+
+	const layout_type &layout () const;
+
+private:
+	typename MultiArray::ConstPtr _owner;
+	// Layout of the viewed message, or null for external buffers
+	const layout_type *_layout;
+	layout_type _bufferLayout;
+	Value *_data;
+};
+
+template<class MultiArray, int Rank = 0>
+class MultiArrayManager : public MultiArrayAccess<MultiArrayManager<MultiArray, Rank>, Rank>
 {
 	using value_type = typename MultiArray::_data_type::value_type;
 	using array_type = typename MultiArray::_data_type;
 
-	void create (std::vector<int> sizes, int dataOffset = 0);
-	int getIndex (std::vector<int> indexes);
+	int getIndex (const std::vector<int> &indexes);
 
 public:
 	/**
@@ -23,25 +261,39 @@ public:
 	 */
 	MultiArrayManager (std::vector<int> sizes, int dataOffset = 0);
 	MultiArrayManager (const MultiArray &other);
+	/**
+	 * @brief Take the storage of @p other without copying
+	 */
+	MultiArrayManager (MultiArray &&other);
+
+	/**
+	 * @brief Set the layout of @p msg and resize its data in place.
+	 * The data storage of @p msg is reused, so that refilling the same message for each publish does not allocate.
+	 * @param msg Message to be filled, e.g. the outgoing one
+	 * @param sizes Sizes of the multi-array
+	 * @param dataOffset [optional] extra data size
+	 */
+	static void create (MultiArray &msg, const std::vector<int> &sizes, int dataOffset = 0);
 
 	/**
 	 * @brief Get value given indexes
 	 * @param indexes
 	 * @return array[indexes]
 	 */
-	value_type get (std::vector<int> indexes);
+	value_type get (const std::vector<int> &indexes);
 	/**
 	 * @brief set array[indexes] = value
 	 * @param indexes
 	 * @param value
 	 */
-	void set (std::vector<int> indexes, value_type value);
+	void set (const std::vector<int> &indexes, value_type value);
 
 	/**
 	 * @brief Raw pointer to allocated memory storing data
 	 * @return
 	 */
 	value_type *data();
+	const value_type *data() const;
 	/**
 	 * @brief Stored data as std::vector
 	 */
@@ -58,7 +310,14 @@ public:
 	 * @brief Get FloatXXMultiArray ROS message
 	 * @return
 	 */
-	MultiArray msg ();
+	const MultiArray &msg () const;
+
+	/**
+	 * @brief Move the message out of the manager, which is left empty
+	 */
+	MultiArray release ();
+
+	MultiArrayView<MultiArray, const value_type, Rank> view () const;
 
 private:
 	MultiArray _msg;
@@ -66,81 +325,156 @@ private:
 
 using MultiArray32Manager = MultiArrayManager <std_msgs::Float32MultiArray>;
 using MultiArray64Manager = MultiArrayManager <std_msgs::Float64MultiArray>;
+using MultiArray32View = MultiArrayView <std_msgs::Float32MultiArray>;
+using MultiArray64View = MultiArrayView <std_msgs::Float64MultiArray>;
+using MultiArray32MutableView = MultiArrayView <std_msgs::Float32MultiArray, float>;
+using MultiArray64MutableView = MultiArrayView <std_msgs::Float64MultiArray, double>;
 
-template<class MultiArray>
-void MultiArrayManager<MultiArray>::create (std::vector<int> sizes, int dataOffset) {
+template<class Layout>
+void createLayout (Layout &layout, const std::vector<int> &sizes, int dataOffset) {
 	int dimensions = sizes.size ();
-	_msg.layout.dim.resize (dimensions);
-	_msg.layout.data_offset = dataOffset;
+	layout.dim.resize (dimensions);
+	layout.data_offset = dataOffset;
 
 	for (int i = dimensions-1; i >= 0; i--) {
-		_msg.layout.dim[i].size = sizes[i];
+		layout.dim[i].size = sizes[i];
 		if (i < dimensions - 1)
-			_msg.layout.dim[i].stride = sizes[i] * _msg.layout.dim[i+1].stride;
+			layout.dim[i].stride = sizes[i] * layout.dim[i+1].stride;
 		else
-			_msg.layout.dim[i].stride = sizes[i];
+			layout.dim[i].stride = sizes[i];
 	}
+}
 
-	_msg.data.resize (_msg.layout.dim[0].stride + dataOffset);
+template<class MultiArray, typename Value, int Rank>
+MultiArrayView<MultiArray, Value, Rank>::MultiArrayView (const typename MultiArray::ConstPtr &msg):
+	 _owner(msg),
+	 _layout(&msg->layout),
+	 _data(msg->data.data ())
+{
+	static_assert (std::is_const<Value>::value, "Received messages can only be viewed as const");
+	this->updateStrides (*_layout);
 }
 
-template<class MultiArray>
-int MultiArrayManager<MultiArray>::getIndex (std::vector<int> indexes) {
-	int numDims = _msg.layout.dim.size ();
-	int index = _msg.layout.data_offset;
+template<class MultiArray, typename Value, int Rank>
+MultiArrayView<MultiArray, Value, Rank>::MultiArrayView (message_type &msg):
+	 _layout(&msg.layout),
+	 _data(msg.data.data ())
+{
+	this->updateStrides (*_layout);
+}
 
-	for (int i = 0; i < numDims; i++) {
-		int currIndex = indexes[i];
-		if (i == numDims - 1)
-			index += currIndex;
-		else
-			index += currIndex * _msg.layout.dim[i+1].stride;
-	}
+template<class MultiArray, typename Value, int Rank>
+MultiArrayView<MultiArray, Value, Rank>::MultiArrayView (Value *data, const std::vector<int> &sizes, int dataOffset):
+	 _layout(nullptr),
+	 _data(data)
+{
+	createLayout (_bufferLayout, sizes, dataOffset);
+	this->updateStrides (_bufferLayout);
+}
 
-	return index;
+template<class MultiArray, typename Value, int Rank>
+typename MultiArrayView<MultiArray, Value, Rank>::value_type MultiArrayView<MultiArray, Value, Rank>::get (const std::vector<int> &indexes) const {
+	return _data[multiArrayIndex (layout (), indexes)];
+}
+
+template<class MultiArray, typename Value, int Rank>
+void MultiArrayView<MultiArray, Value, Rank>::set (const std::vector<int> &indexes, value_type value) const {
+	static_assert (!std::is_const<Value>::value, "Cannot set values of a const view");
+
+	_data[multiArrayIndex (layout (), indexes)] = value;
+}
+
+template<class MultiArray, typename Value, int Rank>
+Value *MultiArrayView<MultiArray, Value, Rank>::data () const {
+	return _data;
 }
 
-template<class MultiArray>
-MultiArrayManager<MultiArray>::MultiArrayManager(std::vector<int> sizes, int dataOffset) {
-	create (sizes, dataOffset);
+template<class MultiArray, typename Value, int Rank>
+int MultiArrayView<MultiArray, Value, Rank>::size (int i) const {
+	return layout ().dim[i].size;
 }
 
-template<class MultiArray>
-MultiArrayManager<MultiArray>::MultiArrayManager(const MultiArray &other) {
+template<class MultiArray, typename Value, int Rank>
+const typename MultiArrayView<MultiArray, Value, Rank>::layout_type &MultiArrayView<MultiArray, Value, Rank>::layout () const {
+	return _layout != nullptr ? *_layout : _bufferLayout;
+}
+
+template<class MultiArray, int Rank>
+void MultiArrayManager<MultiArray, Rank>::create (MultiArray &msg, const std::vector<int> &sizes, int dataOffset) {
+	createLayout (msg.layout, sizes, dataOffset);
+	msg.data.resize (msg.layout.dim[0].stride + dataOffset);
+}
+
+template<class MultiArray, int Rank>
+int MultiArrayManager<MultiArray, Rank>::getIndex (const std::vector<int> &indexes) {
+	return multiArrayIndex (_msg.layout, indexes);
+}
+
+template<class MultiArray, int Rank>
+MultiArrayManager<MultiArray, Rank>::MultiArrayManager(std::vector<int> sizes, int dataOffset) {
+	create (_msg, sizes, dataOffset);
+	this->updateStrides (_msg.layout);
+}
+
+template<class MultiArray, int Rank>
+MultiArrayManager<MultiArray, Rank>::MultiArrayManager(const MultiArray &other) {
 	_msg = other;
+	this->updateStrides (_msg.layout);
+}
+
+template<class MultiArray, int Rank>
+MultiArrayManager<MultiArray, Rank>::MultiArrayManager(MultiArray &&other):
+	 _msg(std::move (other))
+{
+	this->updateStrides (_msg.layout);
 }
 
-template<class MultiArray>
-typename MultiArrayManager<MultiArray>::value_type
-    MultiArrayManager<MultiArray>::get(std::vector<int> indexes) {
+template<class MultiArray, int Rank>
+typename MultiArrayManager<MultiArray, Rank>::value_type
+    MultiArrayManager<MultiArray, Rank>::get(const std::vector<int> &indexes) {
 	return _msg.data[getIndex (indexes)];
 }
 
-template<class MultiArray>
-void MultiArrayManager<MultiArray>::set(std::vector<int> indexes, value_type value) {
+template<class MultiArray, int Rank>
+void MultiArrayManager<MultiArray, Rank>::set(const std::vector<int> &indexes, value_type value) {
 	_msg.data[getIndex (indexes)] = value;
 }
 
-template<class MultiArray>
-typename MultiArrayManager<MultiArray>::value_type *MultiArrayManager<MultiArray>::data() {
+template<class MultiArray, int Rank>
+typename MultiArrayManager<MultiArray, Rank>::value_type *MultiArrayManager<MultiArray, Rank>::data() {
+	return _msg.data.data();
+}
+
+template<class MultiArray, int Rank>
+const typename MultiArrayManager<MultiArray, Rank>::value_type *MultiArrayManager<MultiArray, Rank>::data() const {
 	return _msg.data.data();
 }
 
-template<class MultiArray>
-typename MultiArrayManager<MultiArray>::array_type &MultiArrayManager<MultiArray>::array () {
+template<class MultiArray, int Rank>
+typename MultiArrayManager<MultiArray, Rank>::array_type &MultiArrayManager<MultiArray, Rank>::array () {
 	return _msg.data;
 }
 
-template<class MultiArray>
-int MultiArrayManager<MultiArray>::size(int i) {
+template<class MultiArray, int Rank>
+int MultiArrayManager<MultiArray, Rank>::size(int i) {
 	return _msg.layout.dim[i].size;
 }
 
-template<class MultiArray>
-MultiArray MultiArrayManager<MultiArray>::msg() {
+template<class MultiArray, int Rank>
+const MultiArray &MultiArrayManager<MultiArray, Rank>::msg() const {
 	return _msg;
 }
 
+template<class MultiArray, int Rank>
+MultiArray MultiArrayManager<MultiArray, Rank>::release() {
+	return std::move (_msg);
+}
+
+template<class MultiArray, int Rank>
+MultiArrayView<MultiArray, const typename MultiArrayManager<MultiArray, Rank>::value_type, Rank> MultiArrayManager<MultiArray, Rank>::view () const {
+	return MultiArrayView<MultiArray, const value_type, Rank> (_msg);
+}
+
 
 
 
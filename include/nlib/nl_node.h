@@ -3,41 +3,42 @@
 
 #include <ros/ros.h>
 #include <xmlrpcpp/XmlRpc.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <std_msgs/Empty.h>
 #include "nl_utils.h"
 #include "nl_params.h"
 #include "nl_modflow.h"
+#include "nl_async_publisher.h"
 #include <sstream>
 
 namespace nlib {
 
-
-template<class Derived>
-class NlNode
+/**
+ * @brief Topic of the subscriber or publisher @p name, from topics/<name>_sub or topics/<name>_pub,
+ * or else from topics/subs/<name> or topics/pubs/<name>
+ */
+inline std::string standardTopic (const NlParams &params, const std::string &name, bool sub)
 {
+	const std::optional<std::string> topic = params.tryGet<std::string> ("topics/" + name + (sub ? "_sub" : "_pub"));
 
-public:
-	NlNode (int &argc, char **argv, const std::string &_name, uint32_t options = 0);
+	if (topic.has_value ())
+		return *topic;
 
-	int spin ();
+	return params.get<std::string> ("topics/" + std::string (sub ? "subs/" : "pubs/") + name);
+}
 
-protected:
-	template<class DerivedModFlow>
-	void init ();
-	void finalizeModFlow ();
 
-	template<typename T>
-	void addSub (const std::string &name,
-				const std::string &topic,
-				uint32_t queueSize,
-				void (Derived::*fp)(T),
-				const ros::TransportHints &transportHints = ros::TransportHints ());
-
-	// Add subscriber with topic names from standard params
-	template<typename T>
-	void addSub (const std::string &name,
-				uint32_t queueSize,
-				void (Derived::*fp)(T),
-				const ros::TransportHints &transportHints = ros::TransportHints ());
+/**
+ * @brief Params, ModFlow, publishers, synchronous clock, diagnostics and params reload shared by NlNode and NlNodelet,
+ * which add how the node is started and how messages are received and published
+ */
+template<class Derived>
+class NlNodeBase
+{
+protected:
+	NlNodeBase (const std::string &name = ""):
+		  _name(name)
+	{}
 
 	template<typename T>
 	void addPub (const std::string &name,
@@ -58,12 +59,12 @@ protected:
 												 uint32_t queueSize,
 												 bool latch = false);
 
-	template<typename T>
-	void publish (const std::string &name,
-				 const T &msg) const;
-
 	void initParams ();
 	void initROS ();
+	void initDiagnostics ();
+	void publishDiagnostics (const ros::TimerEvent &);
+	void initReload ();
+	void onReloadParams (const std_msgs::Empty::ConstPtr &);
 
 	NlSinks::Ptr sinks ();
 	NlSources::Ptr sources ();
@@ -71,79 +72,198 @@ protected:
 	Derived &derived () { return static_cast<Derived&> (*this); }
 	const Derived &derived () const { return static_cast<const Derived &> (*this); }
 
-private:
 	std::string getStdTopic (const std::string &name, bool sub);
 
 protected:
 	std::shared_ptr<ros::NodeHandle> _nh;
 	NlParams _nlParams;
-	int _argc;
-	char **_argv;
 
 protected:
 	NlModFlow::Ptr _nlModFlow;
 	std::unordered_map<std::string, ros::Publisher> _publishers;
 	std::unordered_map<std::string, ros::Subscriber> _subscribers;
 	ros::Timer _clock;
+	// Publishes ModFlow statistics if mod_flow/stats/publish_period is set
+	ros::Timer _diagnosticsClock;
+	ros::Publisher _diagnosticsPub;
+	// Reloads the params from the parameter server if mod_flow/reload/enable is set
+	ros::Subscriber _reloadSub;
 	std::string _name;
-	bool _synchronous;
+	bool _synchronous = false;
+};
+
+
+template<class Derived>
+class NlNode : public NlNodeBase<Derived>
+{
+	using NodeBase = NlNodeBase<Derived>;
+
+public:
+	NlNode (int &argc, char **argv, const std::string &_name, uint32_t options = 0);
+
+	int spin ();
+
+protected:
+	template<class DerivedModFlow>
+	void init ();
+	void finalizeModFlow ();
+
+	template<typename T>
+	void addSub (const std::string &name,
+				const std::string &topic,
+				uint32_t queueSize,
+				void (Derived::*fp)(T),
+				const ros::TransportHints &transportHints = ros::TransportHints ());
+
+	// Add subscriber with topic names from standard params
+	template<typename T>
+	void addSub (const std::string &name,
+				uint32_t queueSize,
+				void (Derived::*fp)(T),
+				const ros::TransportHints &transportHints = ros::TransportHints ());
+
+	template<typename T>
+	void publish (const std::string &name,
+				 const T &msg) const;
+
+	using NodeBase::derived;
+	using NodeBase::getStdTopic;
+	using NodeBase::initParams;
+	using NodeBase::initROS;
+	using NodeBase::initDiagnostics;
+	using NodeBase::initReload;
+
+protected:
+	using NodeBase::_nh;
+	using NodeBase::_nlParams;
+	using NodeBase::_nlModFlow;
+	using NodeBase::_publishers;
+	using NodeBase::_subscribers;
+	using NodeBase::_clock;
+	using NodeBase::_synchronous;
+	int _argc;
+	char **_argv;
 };
 
 
+/**
+ * @brief Publishers of the outputs of a node, by id.
+ * By default messages are converted and published on the calling thread. With enableAsync they are converted into
+ * messages from a pool kept per output, so that conversions reuse the capacity of previous messages, and published by
+ * an AsyncPublisher thread, so that callers, e.g. ModFlow slots, never block on serialization or socket writes.
+ */
 template<typename OutputType>
 class OutputManager
 {
-	using PubsMap = std::map<OutputType, std::shared_ptr<ros::Publisher>>;
-	PubsMap outputPubs;
+public:
+	struct Output {
+		std::shared_ptr<ros::Publisher> publisher;
+		// MessagePool of the message type of the output, created by its first asynchronous publish
+		std::shared_ptr<void> pool;
+		std::once_flag poolCreated;
+	};
 
+	using OutputsMap = std::map<OutputType, Output>;
+
+private:
 	template<typename RosMsg, typename DataType, typename ...ExtraArgs>
 	void dataToMsg (RosMsg &outputMsg, const DataType &data, const ExtraArgs &...);
 	template<typename DataType, typename RosMsg, typename ...ExtraArgs>
 	void publish (const OutputType &id, const DataType &data, const ExtraArgs &...);
 
+	// Enum ids, scoped ones included, are printed as numbers
+	static decltype(auto) printableId (const OutputType &id) {
+		if constexpr (std::is_enum_v<OutputType>)
+			return static_cast<std::underlying_type_t<OutputType>> (id);
+		else
+			return (id);
+	}
+
 public:
-	OutputManager () {}
+	OutputManager (): _poolSize(4) {}
 
 	void addOutput (const OutputType &id, const std::shared_ptr<ros::Publisher> &publisher);
 	template<typename DataType, typename ...ExtraArgs>
 	void outputData (const OutputType &id, const DataType &data, const ExtraArgs &...extraArgs);
 
-	typename PubsMap::iterator begin ();
-	typename PubsMap::iterator end ();
+	/**
+	 * @brief Publish through @p asyncPublisher, which may be shared with other managers
+	 * @param poolSize Messages preallocated per output
+	 */
+	void enableAsync (const AsyncPublisher::Ptr &asyncPublisher, std::size_t poolSize = 4);
+
+	/// @brief Outputs by id, with their publisher
+	typename OutputsMap::iterator begin ();
+	typename OutputsMap::iterator end ();
 
 
 	DEF_SHARED (OutputManager)
+
+private:
+	OutputsMap _outputs;
+	AsyncPublisher::Ptr _asyncPublisher;
+	std::size_t _poolSize;
 };
 
 template<typename OutputType>
 template<typename DataType, typename RosMsg, typename ...ExtraArgs>
 void OutputManager<OutputType>::publish (const OutputType &id, const DataType &data, const ExtraArgs &...extraArgs)
 {
-	RosMsg outputMsg;
-	dataToMsg (outputMsg, data, extraArgs...);
-	outputPubs[id].publish (outputMsg);
+	auto found = _outputs.find (id);
+
+	if (found == _outputs.end ()) {
+		ROS_WARN_STREAM ("Publishing on output " << printableId (id) << ", not added");
+		return;
+	}
+
+	Output &output = found->second;
+
+	if (_asyncPublisher == nullptr) {
+		RosMsg outputMsg;
+		dataToMsg (outputMsg, data, extraArgs...);
+		output.publisher->publish (outputMsg);
+		return;
+	}
+
+	std::call_once (output.poolCreated, [&] {
+		output.pool = std::make_shared<MessagePool<RosMsg>> (_poolSize);
+	});
+
+	const auto pool = std::static_pointer_cast<MessagePool<RosMsg>> (output.pool);
+	boost::shared_ptr<RosMsg> outputMsg = pool->acquire ();
+
+	dataToMsg (*outputMsg, data, extraArgs...);
+	_asyncPublisher->publish (output.publisher, std::move (outputMsg), pool);
 }
 
 template<typename  OutputType>
 void OutputManager<OutputType>::addOutput (const OutputType &id, const std::shared_ptr<ros::Publisher> &publisher) {
-	outputPubs[id] = publisher;
+	_outputs.erase (id);
+	_outputs[id].publisher = publisher;
+}
+
+template<typename OutputType>
+void OutputManager<OutputType>::enableAsync (const AsyncPublisher::Ptr &asyncPublisher, std::size_t poolSize) {
+	_asyncPublisher = asyncPublisher;
+	_poolSize = poolSize;
 }
 
 template<typename OutputType>
-typename OutputManager<OutputType>::PubsMap::iterator
+typename OutputManager<OutputType>::OutputsMap::iterator
 OutputManager<OutputType>::begin () {
-	return outputPubs.begin ();
+	return _outputs.begin ();
 }
 
 template<typename OutputType>
-typename OutputManager<OutputType>::PubsMap::iterator
+typename OutputManager<OutputType>::OutputsMap::iterator
 OutputManager<OutputType>::end () {
-	return outputPubs.end ();
+	return _outputs.end ();
 }
 
 #define NL_NODE(Derived) \
 using Base = nlib::NlNode<Derived>;\
 	friend Base; \
+	friend nlib::NlNodeBase<Derived>; \
 	using Base::init; \
 	using Base::finalizeModFlow; \
 	using Base::sinks; \
@@ -155,7 +275,7 @@ using Base = nlib::NlNode<Derived>;\
 
 			  template<class Derived>
 			  NlNode<Derived>::NlNode (int &_argc, char **_argv, const std::string &_name, uint32_t options):
-	  _name(_name),
+	  NodeBase(_name),
 	  _argc(_argc),
 	  _argv(_argv)
 {
@@ -194,9 +314,95 @@ void NlNode<Derived>::addSub (const std::string &name,
 	addSub (name, getStdTopic (name, true), queueSize, fp, transportHints);
 }
 
+template<class Derived>
+template<class DerivedModFlow>
+void NlNode<Derived>::init ()
+{
+	_nlModFlow = std::make_shared<DerivedModFlow> ();
+
+	try {
+		derived().initParams ();
+		derived().initROS ();
+		
+		_nlModFlow->init (_nlParams);
+	} catch (const XmlRpc::XmlRpcException &e) {
+		ROS_ERROR_STREAM(e.getMessage ());
+		std::abort ();
+	}
+}
+
+template<class Derived>
+void NlNode<Derived>::finalizeModFlow () {
+	try {
+		_nlModFlow->finalize ();
+		initDiagnostics ();
+		initReload ();
+	} catch (const XmlRpc::XmlRpcException &e) {
+		ROS_ERROR_STREAM(e.getMessage ());
+	}
+}
+
+inline diagnostic_msgs::KeyValue diagnosticValue (const std::string &key, const std::string &value)
+{
+	diagnostic_msgs::KeyValue keyValue;
+
+	keyValue.key = key;
+	keyValue.value = value;
+
+	return keyValue;
+}
+
+// Latencies are published in microseconds
+inline void addLatencyValues (diagnostic_msgs::DiagnosticStatus &status, const std::string &prefix, const LatencySummary &latency)
+{
+	status.values.push_back (diagnosticValue (prefix + "count", std::to_string (latency.count)));
+	status.values.push_back (diagnosticValue (prefix + "mean_us", std::to_string (latency.mean / 1e3)));
+	status.values.push_back (diagnosticValue (prefix + "p50_us", std::to_string (latency.p50 / 1e3)));
+	status.values.push_back (diagnosticValue (prefix + "p90_us", std::to_string (latency.p90 / 1e3)));
+	status.values.push_back (diagnosticValue (prefix + "p99_us", std::to_string (latency.p99 / 1e3)));
+	status.values.push_back (diagnosticValue (prefix + "max_us", std::to_string (latency.max / 1e3)));
+}
+
+/// @brief One status per channel and per slot of @p stats, with @p name as hardware id
+inline diagnostic_msgs::DiagnosticArray diagnosticArray (const ModFlowStats &stats, const std::string &name)
+{
+	diagnostic_msgs::DiagnosticArray array;
+
+	array.header.stamp = ros::Time::now ();
+
+	for (const ChannelStats &channel : stats.channels) {
+		diagnostic_msgs::DiagnosticStatus status;
+
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		status.name = name + ": channel " + channel.name;
+		status.hardware_id = name;
+		status.message = std::to_string (channel.emits) + " emits";
+		status.values.push_back (diagnosticValue ("emits", std::to_string (channel.emits)));
+
+		if (channel.endToEnd.count > 0)
+			addLatencyValues (status, "end_to_end_", channel.endToEnd);
+
+		array.status.push_back (status);
+	}
+
+	for (const SlotStats &slot : stats.slots) {
+		diagnostic_msgs::DiagnosticStatus status;
+
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		status.name = name + ": slot " + slot.channel + " -> " + slot.module;
+		status.hardware_id = name;
+		status.message = slot.slot;
+		addLatencyValues (status, "", slot.latency);
+
+		array.status.push_back (status);
+	}
+
+	return array;
+}
+
 template<class Derived>
 template<typename T>
-void NlNode<Derived>::addPub (const std::string &name,
+void NlNodeBase<Derived>::addPub (const std::string &name,
 							 const std::string &topic,
 							 uint32_t queueSize,
 							 bool latch) {
@@ -205,7 +411,7 @@ void NlNode<Derived>::addPub (const std::string &name,
 
 template<class Derived>
 template<typename T>
-void NlNode<Derived>::addPub (const std::string &name,
+void NlNodeBase<Derived>::addPub (const std::string &name,
 							 uint32_t queueSize,
 							 bool latch) {
 	addPub<T> (name, getStdTopic (name, false), queueSize, latch);
@@ -213,7 +419,7 @@ void NlNode<Derived>::addPub (const std::string &name,
 
 template<class Derived>
 template<typename T>
-std::shared_ptr<ros::Publisher> NlNode<Derived>::createOutput (const std::string &topicPrefix,
+std::shared_ptr<ros::Publisher> NlNodeBase<Derived>::createOutput (const std::string &topicPrefix,
 															  const std::string &name,
 															  uint32_t queueSize,
 															  bool latch)
@@ -223,20 +429,12 @@ std::shared_ptr<ros::Publisher> NlNode<Derived>::createOutput (const std::string
 }
 
 template<class Derived>
-std::string NlNode<Derived>::getStdTopic (const std::string &name, bool sub) {
-	try {
-		std::stringstream pathSS;
-		pathSS << "topics/" << name << "_" << (sub ? "sub" : "pub");
-		return _nlParams.get<std::string> (pathSS.str ().c_str());
-	} catch (const XmlRpc::XmlRpcException &) {
-		std::stringstream pathSS;
-		pathSS << "topics/" << (sub ? "subs/" : "pubs/") << name;
-		return _nlParams.get<std::string> (pathSS.str ().c_str());
-	}
+std::string NlNodeBase<Derived>::getStdTopic (const std::string &name, bool sub) {
+	return standardTopic (_nlParams, name, sub);
 }
 
 template<class Derived>
-void NlNode<Derived>::initParams ()
+void NlNodeBase<Derived>::initParams ()
 {
 	if (_nh->hasParam (_name)) {
 		XmlRpc::XmlRpcValue xmlParams;
@@ -252,7 +450,7 @@ void NlNode<Derived>::initParams ()
 }
 
 template<class Derived>
-void NlNode<Derived>::initROS ()
+void NlNodeBase<Derived>::initROS ()
 {
 	try {
 		float clockPeriod = 1 / _nlParams.get<float> ("rate");
@@ -266,45 +464,69 @@ void NlNode<Derived>::initROS ()
 }
 
 template<class Derived>
-NlSinks::Ptr NlNode<Derived>::sinks() {
+NlSinks::Ptr NlNodeBase<Derived>::sinks() {
 	return _nlModFlow->sinks ();
 }
 
 template<class Derived>
-NlSources::Ptr NlNode<Derived>::sources() {
+NlSources::Ptr NlNodeBase<Derived>::sources() {
 	return _nlModFlow->sources ();
 }
 
 template<class Derived>
-template<class DerivedModFlow>
-void NlNode<Derived>::init ()
+void NlNodeBase<Derived>::initDiagnostics ()
 {
-	_nlModFlow = std::make_shared<DerivedModFlow> ();
+	const float period = _nlParams.get<float> ("mod_flow/stats/publish_period", 0);
 
-	try {
-		derived().initParams ();
-		derived().initROS ();
-		
-		_nlModFlow->init (_nlParams);
-	} catch (const XmlRpc::XmlRpcException &e) {
-		ROS_ERROR_STREAM(e.getMessage ());
-		std::abort ();
+	if (period <= 0 || !_nlModFlow->statsEnabled ())
+		return;
+
+	_diagnosticsPub = _nh->advertise<diagnostic_msgs::DiagnosticArray> ("/diagnostics", 1);
+	_diagnosticsClock = _nh->createTimer (ros::Duration(period), &NlNodeBase<Derived>::publishDiagnostics, this);
+}
+
+template<class Derived>
+void NlNodeBase<Derived>::initReload ()
+{
+	if (!_nlParams.get<bool> ("mod_flow/reload/enable", false))
+		return;
+
+	// Without the executor the modules would be updated by a spinner thread while the others run their slots
+	if (_nlParams.get<int> ("threads", 0) > 0 && !_nlModFlow->executorEnabled ()) {
+		ROS_ERROR_STREAM ("Params reload disabled: with threads > 0 it requires mod_flow/executor/threads > 0");
+		return;
 	}
+
+	_reloadSub = _nh->subscribe (_name + "/reload_params", 1, &NlNodeBase<Derived>::onReloadParams, this);
 }
 
 template<class Derived>
-void NlNode<Derived>::finalizeModFlow () {
+void NlNodeBase<Derived>::onReloadParams (const std_msgs::Empty::ConstPtr &)
+{
+	XmlRpc::XmlRpcValue xmlParams;
+
+	if (!_nh->getParam (_name, xmlParams)) {
+		ROS_WARN_STREAM ("Cannot reload params: " << _name << " not found");
+		return;
+	}
+
 	try {
-		_nlModFlow->finalize ();
+		// The tree is parsed here, off the ModFlow threads: modules only swap the values they use
+		_nlModFlow->reloadParams (NlParams (xmlParams, _name));
 	} catch (const XmlRpc::XmlRpcException &e) {
-		ROS_ERROR_STREAM(e.getMessage ());
+		ROS_ERROR_STREAM ("Params not reloaded: " << e.getMessage ());
 	}
 }
 
+template<class Derived>
+void NlNodeBase<Derived>::publishDiagnostics (const ros::TimerEvent &) {
+	_diagnosticsPub.publish (diagnosticArray (_nlModFlow->stats (), _name));
+}
+
 template<class Derived>
 int NlNode<Derived>::spin ()
 {
-	int threads = _nlParams.get<int> ("threads", 0);
+	int threads = _nlParams.template get<int> ("threads", 0);
 	std::unique_ptr<ros::AsyncSpinner> spinner;
 
 	if (threads > 0) {
@@ -0,0 +1,153 @@
+#ifndef NL_NODELET_H
+#define NL_NODELET_H
+
+#include <nodelet/nodelet.h>
+#include "nl_node.h"
+
+/**
+ * @file nl_nodelet.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/**
+ * @brief Counterpart of NlNode loaded in a nodelet manager.
+ * Subscribers receive ConstPtr and publishers take shared pointers, so messages between nodelets of the same manager
+ * are passed by pointer, with no serialization nor copy. Published messages must not be modified afterwards.
+ *
+ * The manager constructs the nodelet and then calls onInit, which Derived overrides to do what the constructor of
+ * an NlNode does: init, declare sources and sinks, finalizeModFlow. Derived is exported with
+ * PLUGINLIB_EXPORT_CLASS(Derived, nodelet::Nodelet).
+ *
+ * Params are read from the nodelet name. With @c threads > 0 callbacks are run by the multi-threaded
+ * node handle of the manager, which owns the threads.
+ */
+template<class Derived>
+class NlNodelet : public nodelet::Nodelet, public NlNodeBase<Derived>
+{
+	using NodeBase = NlNodeBase<Derived>;
+
+protected:
+	template<class DerivedModFlow>
+	void init ();
+	void finalizeModFlow ();
+
+	template<typename M>
+	void addSub (const std::string &name,
+				const std::string &topic,
+				uint32_t queueSize,
+				void (Derived::*fp)(const boost::shared_ptr<const M> &),
+				const ros::TransportHints &transportHints = ros::TransportHints ());
+
+	// Add subscriber with topic names from standard params
+	template<typename M>
+	void addSub (const std::string &name,
+				uint32_t queueSize,
+				void (Derived::*fp)(const boost::shared_ptr<const M> &),
+				const ros::TransportHints &transportHints = ros::TransportHints ());
+
+	template<typename M>
+	void publish (const std::string &name,
+				 const boost::shared_ptr<M> &msg) const;
+
+	using NodeBase::derived;
+	using NodeBase::getStdTopic;
+	using NodeBase::initParams;
+	using NodeBase::initROS;
+	using NodeBase::initDiagnostics;
+	using NodeBase::initReload;
+
+protected:
+	using NodeBase::_nh;
+	using NodeBase::_nlParams;
+	using NodeBase::_nlModFlow;
+	using NodeBase::_publishers;
+	using NodeBase::_subscribers;
+	using NodeBase::_clock;
+	using NodeBase::_name;
+	using NodeBase::_synchronous;
+};
+
+#define NL_NODELET(Derived) \
+using Base = nlib::NlNodelet<Derived>;\
+	friend Base; \
+	friend nlib::NlNodeBase<Derived>; \
+	using Base::init; \
+	using Base::finalizeModFlow; \
+	using Base::sinks; \
+	using Base::sources; \
+	private: \
+
+
+template<class Derived>
+template<typename M>
+void NlNodelet<Derived>::publish (const std::string &name,
+								 const boost::shared_ptr<M> &msg) const {
+	_publishers.at (name).publish (msg);
+}
+
+template<class Derived>
+template<typename M>
+void NlNodelet<Derived>::addSub (const std::string &name,
+								const std::string &topic,
+								uint32_t queueSize,
+								void (Derived::*fp)(const boost::shared_ptr<const M> &),
+								const ros::TransportHints &transportHints) {
+	_subscribers.insert ({name, _nh->subscribe (topic, queueSize, fp, &derived(), transportHints)});
+}
+
+template<class Derived>
+template<typename M>
+void NlNodelet<Derived>::addSub (const std::string &name,
+								uint32_t queueSize,
+								void (Derived::*fp)(const boost::shared_ptr<const M> &),
+								const ros::TransportHints &transportHints) {
+	addSub (name, getStdTopic (name, true), queueSize, fp, transportHints);
+}
+
+template<class Derived>
+template<class DerivedModFlow>
+void NlNodelet<Derived>::init ()
+{
+	_name = getName ();
+	_nh = std::make_shared<ros::NodeHandle> (getNodeHandle ());
+	_nlModFlow = std::make_shared<DerivedModFlow> ();
+
+	try {
+		// As the constructor of NlNode, then the ones of Derived
+		initParams ();
+
+		if (_nlParams.template get<int> ("threads", 0) > 0)
+			_nh = std::make_shared<ros::NodeHandle> (getMTNodeHandle ());
+
+		initROS ();
+		derived().initParams ();
+		derived().initROS ();
+
+		_nlModFlow->init (_nlParams);
+	} catch (const XmlRpc::XmlRpcException &e) {
+		ROS_ERROR_STREAM(e.getMessage ());
+		std::abort ();
+	}
+}
+
+template<class Derived>
+void NlNodelet<Derived>::finalizeModFlow ()
+{
+	try {
+		_nlModFlow->finalize ();
+		initDiagnostics ();
+		initReload ();
+	} catch (const XmlRpc::XmlRpcException &e) {
+		ROS_ERROR_STREAM(e.getMessage ());
+	}
+
+	// There is no spin: the clock starts once the network is ready
+	if (_synchronous)
+		_clock.start ();
+}
+
+}
+
+#endif // NL_NODELET_H
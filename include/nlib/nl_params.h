@@ -6,9 +6,17 @@
 #include <string>
 #include <sstream>
 #include <cxxabi.h>
-#include <boost/filesystem.hpp>
 #include <xmlrpcpp/XmlRpc.h>
+#include <array>
+#include <atomic>
+#include <functional>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <string_view>
+#include <unordered_map>
 
 #include "nl_utils.h"
 
@@ -76,6 +84,61 @@ std::optional<T> optional_cast (U &&u) {
 template<typename T, template<typename ...> class container = empty_container>
 struct Type;
 
+/**
+ * @brief Immutable index of a parameter tree, built once.
+ * Keys are interned and struct members are found with a single hash lookup on (parent node, key),
+ * array elements are stored contiguously. Values stay in the XmlRpcValue owned by the tree, so that reaching a
+ * subtree never copies it.
+ */
+class ParamTree
+{
+public:
+	using Node = uint32_t;
+	static constexpr Node INVALID = UINT32_MAX;
+
+	explicit ParamTree (const XmlRpc::XmlRpcValue &params);
+	ParamTree (const ParamTree &) = delete;
+	ParamTree &operator = (const ParamTree &) = delete;
+
+	Node root () const {
+		return 0;
+	}
+
+	/// @brief Member @p key of the struct @p node, INVALID if missing
+	Node child (Node node, std::string_view key) const;
+	/// @brief Element @p index of the array @p node, INVALID if missing
+	Node element (Node node, int index) const;
+	/// @brief Node at @p path, '/' separated, relative to @p node. INVALID if missing
+	Node find (Node node, std::string_view path) const;
+
+	const XmlRpc::XmlRpcValue &value (Node node) const {
+		return *_nodes[node].value;
+	}
+
+	DEF_SHARED (ParamTree)
+
+private:
+	Node add (XmlRpc::XmlRpcValue &value);
+	void expand (Node node);
+
+	static uint64_t memberKey (Node node, uint32_t key) {
+		return (uint64_t (node) << 32) | key;
+	}
+
+private:
+	struct NodeInfo {
+		XmlRpc::XmlRpcValue *value;
+		// First element of arrays
+		Node first;
+	};
+
+	XmlRpc::XmlRpcValue _root;
+	std::vector<NodeInfo> _nodes;
+	// Views of the keys stored in _root
+	std::unordered_map<std::string_view, uint32_t> _keys;
+	std::unordered_map<uint64_t, Node> _members;
+};
+
 /**
  * @brief Coveniently handle any type of parameter with error check and debugging info
  */
@@ -84,7 +147,10 @@ class NlParams
 	using c_str = const char *;
 	using XmlParamsPtr = std::shared_ptr<XmlRpc::XmlRpcValue>;
 
-	XmlRpc::XmlRpcValue resolveName(const std::optional<std::string> &name) const;
+	NlParams (const std::shared_ptr<const ParamTree> &tree, ParamTree::Node node, const std::string &name, const NlParams *parent);
+
+	// Value at name, null if missing
+	const XmlRpc::XmlRpcValue *find (const std::optional<std::string> &name) const;
 
 	void throwErrorType (XmlRpc::XmlRpcValue::Type gotType,
 					 const std::string &expected,
@@ -113,15 +179,38 @@ class NlParams
 	std::string getFullPath (const std::string &base) const;
 
 public:
-	NlParams () = default;
+	NlParams ();
 	NlParams (const XmlRpc::XmlRpcValue &params, const std::string &name = "", const NlParams *parent = nullptr);
 	NlParams (const NlParams &) = default;
 	void setParams (XmlRpc::XmlRpcValue &params);
 
 	NlParams &operator = (XmlRpc::XmlRpcValue &params);
 	NlParams &operator = (const NlParams &) = default;
+	/**
+	 * @brief View of the subtree @p name, sharing the parsed tree. Empty if missing.
+	 */
 	NlParams operator [] (const std::string &name) const;
 
+	/**
+	 * @brief Whether the two subtrees have the same values, regardless of the trees they belong to
+	 */
+	bool operator == (const NlParams &other) const;
+	bool operator != (const NlParams &other) const {
+		return !(*this == other);
+	}
+
+	/**
+	 * @brief Get a param without throwing
+	 * @return The value, or std::nullopt if @p name is missing or has a different type
+	 */
+	template<typename T>
+	std::optional<T> tryGet (const std::string &name,
+						const std::optional<int> &index = std::nullopt) const;
+
+	template<typename T, template<typename ...> class container>
+	std::optional<container<T>> tryGet (const std::string &name,
+									const std::optional<int> &index = std::nullopt) const;
+
 	  // Overload for literal and string types
 	/*template<typename T>
 	T get (const c_str &name,
@@ -177,37 +266,156 @@ public:
 
 	DEF_SHARED(NlParams)
 private:
-	XmlRpc::XmlRpcValue _params;
+	std::shared_ptr<const ParamTree> _tree;
+	ParamTree::Node _node;
 	std::string _name;
 	const NlParams *_parent;
 };
 
-inline XmlRpc::XmlRpcValue NlParams::resolveName (const std::optional<std::string> &name) const
+inline ParamTree::ParamTree (const XmlRpc::XmlRpcValue &params):
+	 _root(params)
 {
-	// Need to resort to pointers due to bad programming of external lib XmlRpcValue
-	const XmlRpc::XmlRpcValue *param = &_params;
+	expand (add (_root));
+}
 
-	if (!name.has_value ())
-		return param;
+inline ParamTree::Node ParamTree::add (XmlRpc::XmlRpcValue &value)
+{
+	_nodes.push_back ({&value, INVALID});
 
-	boost::filesystem::path namePath(*name);
+	return _nodes.size () - 1;
+}
 
-	  // relative_path: remove leading '/' if any
-	for (const auto &currentName : namePath.relative_path ()) {
-		const XmlRpc::XmlRpcValue &currentParam = *param;
+inline void ParamTree::expand (Node node)
+{
+	XmlRpc::XmlRpcValue &value = *_nodes[node].value;
 
-		try {
-			param = &currentParam[currentName.string()];
-		} catch (XmlRpc::XmlRpcException e) {
-			throwErrorResolution (getFullPath (*name));
+	if (value.getType () == XmlRpc::XmlRpcValue::TypeArray) {
+		const Node first = _nodes.size ();
+
+		_nodes[node].first = first;
+
+		for (int i = 0; i < value.size (); i++)
+			add (value[i]);
+		for (int i = 0; i < value.size (); i++)
+			expand (first + i);
+	} else if (value.getType () == XmlRpc::XmlRpcValue::TypeStruct) {
+		std::vector<Node> members;
+
+		for (auto &member : value) {
+			const uint32_t key = _keys.emplace (member.first, _keys.size ()).first->second;
+			const Node child = add (member.second);
+
+			_members[memberKey (node, key)] = child;
+			members.push_back (child);
 		}
+
+		for (Node child : members)
+			expand (child);
 	}
+}
+
+inline ParamTree::Node ParamTree::child (Node node, std::string_view key) const
+{
+	const auto internedKey = _keys.find (key);
 
-	return *param;
+	if (internedKey == _keys.end ())
+		return INVALID;
+
+	const auto member = _members.find (memberKey (node, internedKey->second));
+
+	return member == _members.end () ? INVALID : member->second;
 }
 
-inline NlParams NlParams::operator [](const std::string &name) const {
-	return {resolveName (name), name, this};
+inline ParamTree::Node ParamTree::element (Node node, int index) const
+{
+	const XmlRpc::XmlRpcValue &array = value (node);
+
+	if (array.getType () != XmlRpc::XmlRpcValue::TypeArray || index < 0 || index >= array.size ())
+		return INVALID;
+
+	return _nodes[node].first + index;
+}
+
+inline ParamTree::Node ParamTree::find (Node node, std::string_view path) const
+{
+	std::size_t begin = 0;
+
+	// Empty components, as from a leading '/', are skipped
+	while (node != INVALID && begin < path.size ()) {
+		std::size_t end = path.find ('/', begin);
+
+		if (end == std::string_view::npos)
+			end = path.size ();
+
+		if (end > begin)
+			node = child (node, path.substr (begin, end - begin));
+
+		begin = end + 1;
+	}
+
+	return node;
+}
+
+inline const XmlRpc::XmlRpcValue *NlParams::find (const std::optional<std::string> &name) const
+{
+	if (_tree == nullptr)
+		return nullptr;
+
+	const ParamTree::Node node = name.has_value () ? _tree->find (_node, *name) : _node;
+
+	return node == ParamTree::INVALID ? nullptr : &_tree->value (node);
+}
+
+inline NlParams NlParams::operator [](const std::string &name) const
+{
+	// Missing subtrees give empty params: their values resolve to the defaults
+	const ParamTree::Node node = _tree == nullptr ? ParamTree::INVALID : _tree->find (_node, name);
+
+	return NlParams (node == ParamTree::INVALID ? nullptr : _tree, node, name, this);
+}
+
+inline bool NlParams::operator == (const NlParams &other) const
+{
+	const XmlRpc::XmlRpcValue *value = find (std::nullopt);
+	const XmlRpc::XmlRpcValue *otherValue = other.find (std::nullopt);
+
+	if (value == nullptr || otherValue == nullptr)
+		return value == otherValue;
+
+	return value == otherValue || *value == *otherValue;
+}
+
+template<typename T>
+std::optional<T> NlParams::tryGet (const std::string &name, const std::optional<int> &index) const
+{
+	const std::optional<empty_container<T>> value = tryGet<T, empty_container> (name, index);
+
+	return value.has_value () ? std::optional<T> (empty_container<T> (*value)) : std::nullopt;
+}
+
+template<typename T, template<typename ...> class container>
+std::optional<container<T>> NlParams::tryGet (const std::string &name, const std::optional<int> &index) const
+{
+	const XmlRpc::XmlRpcValue *found = find (name);
+
+	if (found == nullptr)
+		return std::nullopt;
+
+	if (index.has_value () && (found->getType () != XmlRpc::XmlRpcValue::TypeArray || *index < 0 || *index >= found->size ()))
+		return std::nullopt;
+
+	XmlRpc::XmlRpcValue param = index.has_value () ? (*found)[*index] : *found;
+	Type<T, container> currentType{this};
+
+	if (!currentType.checkType (param.getType ()))
+		return std::nullopt;
+
+	// Only nested values, as the elements of a vector, can still fail
+	try {
+		return currentType.convert (param);
+	} catch (const XmlRpc::XmlRpcException &) {
+		return std::nullopt;
+	}
 }
 
 
@@ -287,19 +495,17 @@ container<T> NlParams::get (const std::optional<std::string> &name,
 					   const std::optional<container<T>> &defaultValue,
 					   const std::optional<int> &index) const
 {
-	XmlRpc::XmlRpcValue param;
+	const XmlRpc::XmlRpcValue *found = find (name);
 
-	try {
-		param = resolveName (name);
-	} catch (const XmlRpc::XmlRpcException &e) {
+	if (found == nullptr || found->getType () == XmlRpc::XmlRpcValue::TypeInvalid) {
 		if (defaultValue.has_value ())
 			return *defaultValue;
-		else
-			throw e;
+
+		throwErrorResolution (getFullPath (name.value_or ("")));
 	}
 
-	if (param.getType () == XmlRpc::XmlRpcValue::TypeInvalid && defaultValue.has_value ())
-		return *defaultValue;
+	// Only the resolved value is copied for the conversion
+	XmlRpc::XmlRpcValue param = *found;
 
 	return get<T, container> (param, name, index);
 }
@@ -352,7 +558,9 @@ std::enable_if_t<std::is_enum_v<T>, container<T>>
 					   const std::optional<container<T>> &defaultValue,
 					   const std::optional<int> &index) const
 {
-	if (!resolveName (name).valid () && defaultValue.has_value ())
+	const XmlRpc::XmlRpcValue *found = find (name);
+
+	if ((found == nullptr || !found->valid ()) && defaultValue.has_value ())
 		return *defaultValue;
 
 	container<std::string> stringValues = get<std::string, container> (name, std::nullopt, index);
@@ -408,15 +616,31 @@ inline void NlParams::throwErrorEnum (const std::string &value, const std::optio
 	throw XmlRpc::XmlRpcException (msg.str());
 }
 
+inline NlParams::NlParams ():
+	 _node(ParamTree::INVALID),
+	 _parent(nullptr)
+{
+}
+
 inline NlParams::NlParams (const XmlRpc::XmlRpcValue &params, const std::string &name, const NlParams *parent):
-	 _params(params),
+	 _tree(std::make_shared<const ParamTree> (params)),
+	 _node(_tree->root ()),
+	 _name(name),
+	 _parent(parent)
+{
+}
+
+inline NlParams::NlParams (const std::shared_ptr<const ParamTree> &tree, ParamTree::Node node, const std::string &name, const NlParams *parent):
+	 _tree(tree),
+	 _node(node),
 	 _name(name),
 	 _parent(parent)
 {
 }
 
 inline void NlParams::setParams (XmlRpc::XmlRpcValue &params) {
-	_params = params;
+	_tree = std::make_shared<const ParamTree> (params);
+	_node = _tree->root ();
 }
 
 inline NlParams &NlParams::operator = (XmlRpc::XmlRpcValue &params)
@@ -426,6 +650,204 @@ inline NlParams &NlParams::operator = (XmlRpc::XmlRpcValue &params)
 	return *this;
 }
 
+/**
+ * @brief Field of a params struct bound to a param name, see @ref paramField
+ */
+template<class Struct, typename T>
+struct ParamField {
+	const char *name;
+	T Struct::*member;
+	std::optional<T> defaultValue;
+};
+
+/**
+ * @brief Bind @p member of a params struct to the param @p name, optional if @p defaultValue is given.
+ * Params structs list their fields in a static fields () function returning a tuple of them:
+ * @code
+ * struct Params {
+ *	int integer;
+ *	std::vector<float> gains;
+ *
+ *	static auto fields () {
+ *		return std::make_tuple (paramField ("integer", &Params::integer),
+ *						    paramField ("gains", &Params::gains, {1, 1}));
+ *	}
+ * };
+ * @endcode
+ */
+template<class Struct, typename T>
+ParamField<Struct, T> paramField (const char *name, T Struct::*member, const std::optional<typename std::common_type<T>::type> &defaultValue = std::nullopt) {
+	return {name, member, defaultValue};
+}
+
+/**
+ * @brief Params structs filled together from their bound fields (see @ref paramField)
+ */
+class ParamsBinding
+{
+public:
+	/**
+	 * @brief Bind the fields of @p params, which must outlive the binding
+	 */
+	template<class Struct>
+	void bind (Struct &params);
+
+	/**
+	 * @brief Fill all the bound fields from @p params
+	 * @param errors An error is appended for each missing or mistyped field
+	 */
+	void fill (const NlParams &params, std::vector<std::string> &errors) const;
+
+	/**
+	 * @brief Check that all the bound fields can be filled from @p params, without modifying them
+	 * @param errors An error is appended for each missing or mistyped field
+	 */
+	void validate (const NlParams &params, std::vector<std::string> &errors) const;
+
+	bool empty () const {
+		return _fields.empty ();
+	}
+
+private:
+	template<typename T>
+	struct Getter {
+		static T get (const NlParams &params, const char *name, const std::optional<T> &defaultValue) {
+			return params.get<T> (name, defaultValue);
+		}
+	};
+
+	template<typename T>
+	struct Getter<std::vector<T>> {
+		static std::vector<T> get (const NlParams &params, const char *name, const std::optional<std::vector<T>> &defaultValue) {
+			return params.get<T, std::vector> (name, defaultValue);
+		}
+	};
+
+	template<class Struct, typename T>
+	void add (Struct &params, const ParamField<Struct, T> &field);
+
+private:
+	// Fill the field, or only get it if the last argument is false
+	std::vector<std::function<void (const NlParams &, std::vector<std::string> &, bool)>> _fields;
+};
+
+template<class Struct>
+void ParamsBinding::bind (Struct &params) {
+	std::apply ([&] (const auto &...fields) {
+		(add (params, fields), ...);
+	}, Struct::fields ());
+}
+
+template<class Struct, typename T>
+void ParamsBinding::add (Struct &params, const ParamField<Struct, T> &field)
+{
+	_fields.push_back ([&params, field] (const NlParams &nlParams, std::vector<std::string> &errors, bool assign) {
+		try {
+			T value = Getter<T>::get (nlParams, field.name, field.defaultValue);
+
+			if (assign)
+				params.*field.member = std::move (value);
+		} catch (const XmlRpc::XmlRpcException &e) {
+			errors.push_back (e.getMessage ());
+		}
+	});
+}
+
+inline void ParamsBinding::fill (const NlParams &params, std::vector<std::string> &errors) const
+{
+	for (const auto &field : _fields)
+		field (params, errors, true);
+}
+
+inline void ParamsBinding::validate (const NlParams &params, std::vector<std::string> &errors) const
+{
+	for (const auto &field : _fields)
+		field (params, errors, false);
+}
+
+/**
+ * @brief Shared pointer published to concurrent readers (read-copy-update).
+ * Readers never block: they only take a reference to the current value, that a newer one cannot invalidate.
+ * Storing waits for the readers that could still be copying the replaced pointer, which takes a few instructions each,
+ * so it must not be done on latency critical paths.
+ */
+template<typename T>
+class SnapshotCell
+{
+public:
+	SnapshotCell (std::shared_ptr<const T> value = nullptr);
+	SnapshotCell (const SnapshotCell &) = delete;
+	SnapshotCell &operator = (const SnapshotCell &) = delete;
+	~SnapshotCell ();
+
+	std::shared_ptr<const T> load () const;
+	void store (std::shared_ptr<const T> value);
+
+private:
+	using Pointer = std::shared_ptr<const T>;
+
+	std::atomic<const Pointer *> _current;
+	// Readers copying the pointer, by parity of the epoch they entered
+	mutable std::array<std::atomic<uint64_t>, 2> _readers;
+	std::atomic<uint64_t> _epoch;
+	std::mutex _storeMutex;
+};
+
+template<typename T>
+SnapshotCell<T>::SnapshotCell (std::shared_ptr<const T> value):
+	 _current(new Pointer (std::move (value))),
+	 _epoch(0)
+{
+	for (std::atomic<uint64_t> &readers : _readers)
+		readers.store (0, std::memory_order_relaxed);
+}
+
+template<typename T>
+SnapshotCell<T>::~SnapshotCell () {
+	delete _current.load (std::memory_order_relaxed);
+}
+
+template<typename T>
+std::shared_ptr<const T> SnapshotCell<T>::load () const
+{
+	uint64_t epoch = _epoch.load (std::memory_order_seq_cst);
+
+	// Retry only if a store started meanwhile
+	while (true) {
+		_readers[epoch & 1].fetch_add (1, std::memory_order_seq_cst);
+
+		const uint64_t current = _epoch.load (std::memory_order_seq_cst);
+
+		if (current == epoch)
+			break;
+
+		_readers[epoch & 1].fetch_sub (1, std::memory_order_release);
+		epoch = current;
+	}
+
+	std::shared_ptr<const T> value = *_current.load (std::memory_order_seq_cst);
+
+	_readers[epoch & 1].fetch_sub (1, std::memory_order_release);
+
+	return value;
+}
+
+template<typename T>
+void SnapshotCell<T>::store (std::shared_ptr<const T> value)
+{
+	std::lock_guard<std::mutex> lock(_storeMutex);
+	const Pointer *old = _current.exchange (new Pointer (std::move (value)), std::memory_order_seq_cst);
+	const uint64_t epoch = _epoch.load (std::memory_order_relaxed);
+
+	// Readers entering the new epoch see the new pointer: wait for the ones of the previous epoch
+	_epoch.store (epoch + 1, std::memory_order_seq_cst);
+
+	while (_readers[epoch & 1].load (std::memory_order_acquire) != 0)
+		std::this_thread::yield ();
+
+	delete old;
+}
+
 /* Standard types: literals and strings */
 
 template<typename T, template<typename ...> class container>
@@ -0,0 +1,434 @@
+#ifndef NL_PROFILER_H
+#define NL_PROFILER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "nl_stats.h"
+
+/**
+ * @file nl_profiler.h
+ * @author Nicola Lissandrini
+ */
+
+/**
+ * @defgroup profiler Zone profiler
+ * @details Scoped zones measured into per-thread histograms, cheap enough to be left in hot paths:
+ * @code
+ * void Planner::plan () {
+ *	PROFILE_ZONE ("plan");
+ *	...
+ *	{
+ *		PROFILE_ZONE ("expand");
+ *		...
+ *	}
+ * }
+ * @endcode
+ * Each zone is identified by a static site, registered once. Zones nested at run time form a call tree, aggregated
+ * over the threads by @ref ZoneProfiler::report. Defining DISABLE_PROFILE_ZONES removes all the zones at compile time.
+ */
+
+namespace nlib {
+
+/**
+ * @brief Static call site of a zone, see @ref PROFILE_ZONE
+ * @ingroup profiler
+ */
+struct ProfileSite
+{
+	ProfileSite (const char *name, const char *file, int line);
+
+	const char *name;
+	const char *file;
+	int line;
+	uint32_t id;
+};
+
+/**
+ * @brief Statistics of a zone in a call path, see @ref ZoneProfiler::report
+ * @ingroup profiler
+ */
+struct ZoneStats
+{
+	std::string name;
+	std::string file;
+	int line;
+	/// @brief Depth in the call tree, 0 for outermost zones
+	int depth;
+	/// @brief Duration of the zone, including the nested ones
+	LatencySummary latency;
+	/// @brief Total time spent in the zone, in nanoseconds
+	double total;
+};
+
+/**
+ * @brief Call tree of the zones entered by a thread. For internal use.
+ * @ingroup profiler
+ */
+class ThreadProfile
+{
+public:
+	static constexpr uint32_t ROOT = 0;
+	static constexpr uint32_t NO_SITE = UINT32_MAX;
+
+	struct Node {
+		Node (uint32_t site, uint32_t parent):
+			 site(site),
+			 parent(parent)
+		{}
+
+		const uint32_t site;
+		const uint32_t parent;
+		std::vector<uint32_t> children;
+		LatencyHistogram latency;
+	};
+
+	ThreadProfile ();
+
+	/// @brief Profile of the calling thread
+	static ThreadProfile &current ();
+
+	/// @brief Enter the zone of @p site, nested in the current one
+	uint32_t enter (uint32_t site);
+	void leave (uint32_t node, uint64_t nanoseconds);
+
+private:
+	friend class ZoneProfiler;
+
+	// Nodes are only added by the owner thread, under the mutex, and read by the reports under the mutex
+	std::deque<Node> _nodes;
+	std::mutex _mutex;
+	uint32_t _current;
+};
+
+/**
+ * @brief Scope measured as a zone of @p site
+ * @ingroup profiler
+ */
+class ProfileZone
+{
+public:
+	explicit ProfileZone (const ProfileSite &site);
+	ProfileZone (const ProfileZone &) = delete;
+	ProfileZone &operator = (const ProfileZone &) = delete;
+	~ProfileZone ();
+
+private:
+	ThreadProfile &_profile;
+	const uint32_t _node;
+	const uint64_t _start;
+};
+
+/**
+ * @brief Registry of the zone sites and of the thread profiles, aggregated into reports
+ * @ingroup profiler
+ */
+class ZoneProfiler
+{
+public:
+	static ZoneProfiler &instance ();
+
+	/**
+	 * @brief Statistics of each call path, aggregated over all the threads, in depth first order.
+	 * It can be called from any thread while zones are measured.
+	 */
+	std::vector<ZoneStats> report () const;
+
+	/// @brief Write the report as a table, times in microseconds
+	void writeTable (std::ostream &out) const;
+	/// @brief Write the report as CSV, times in microseconds
+	void writeCsv (std::ostream &out) const;
+
+private:
+	friend struct ProfileSite;
+	friend class ThreadProfile;
+
+	ZoneProfiler () = default;
+
+	uint32_t addSite (const ProfileSite *site);
+	std::shared_ptr<ThreadProfile> addThread ();
+
+private:
+	mutable std::mutex _mutex;
+	std::vector<const ProfileSite *> _sites;
+	// Kept after the threads exit, so that their zones are still reported
+	std::vector<std::shared_ptr<ThreadProfile>> _threads;
+};
+
+/**
+ * @brief Write the profiler table to a file periodically, from a background thread, and when destroyed
+ * @ingroup profiler
+ */
+class PeriodicProfileReport
+{
+public:
+	PeriodicProfileReport (const std::string &path, const std::chrono::milliseconds &period, bool csv = false);
+	PeriodicProfileReport (const PeriodicProfileReport &) = delete;
+	PeriodicProfileReport &operator = (const PeriodicProfileReport &) = delete;
+	~PeriodicProfileReport ();
+
+private:
+	void write () const;
+
+private:
+	const std::string _path;
+	const std::chrono::milliseconds _period;
+	const bool _csv;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	bool _stop;
+	std::thread _thread;
+};
+
+inline ProfileSite::ProfileSite (const char *name, const char *file, int line):
+	 name(name),
+	 file(file),
+	 line(line),
+	 id(ZoneProfiler::instance ().addSite (this))
+{}
+
+inline ThreadProfile::ThreadProfile ():
+	 _current(ROOT)
+{
+	_nodes.emplace_back (NO_SITE, ROOT);
+}
+
+inline ThreadProfile &ThreadProfile::current ()
+{
+	thread_local std::shared_ptr<ThreadProfile> profile = ZoneProfiler::instance ().addThread ();
+
+	return *profile;
+}
+
+inline uint32_t ThreadProfile::enter (uint32_t site)
+{
+	// Only this thread adds nodes: its reads need no lock
+	for (uint32_t child : _nodes[_current].children) {
+		if (_nodes[child].site == site)
+			return _current = child;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	const uint32_t node = _nodes.size ();
+
+	_nodes.emplace_back (site, _current);
+	_nodes[_current].children.push_back (node);
+
+	return _current = node;
+}
+
+inline void ThreadProfile::leave (uint32_t node, uint64_t nanoseconds)
+{
+	_nodes[node].latency.record (nanoseconds);
+	_current = _nodes[node].parent;
+}
+
+inline ProfileZone::ProfileZone (const ProfileSite &site):
+	 _profile(ThreadProfile::current ()),
+	 _node(_profile.enter (site.id)),
+	 _start(LatencySpan::now ())
+{}
+
+inline ProfileZone::~ProfileZone () {
+	_profile.leave (_node, LatencySpan::now () - _start);
+}
+
+inline ZoneProfiler &ZoneProfiler::instance ()
+{
+	static ZoneProfiler profiler;
+
+	return profiler;
+}
+
+inline uint32_t ZoneProfiler::addSite (const ProfileSite *site)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_sites.push_back (site);
+
+	return _sites.size () - 1;
+}
+
+inline std::shared_ptr<ThreadProfile> ZoneProfiler::addThread ()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_threads.push_back (std::make_shared<ThreadProfile> ());
+
+	return _threads.back ();
+}
+
+inline std::vector<ZoneStats> ZoneProfiler::report () const
+{
+	// Call paths of all the threads merged in a single tree, children by site
+	struct Merged {
+		Merged (uint32_t site): site(site) {}
+
+		const uint32_t site;
+		std::map<uint32_t, std::size_t> children;
+		LatencyHistogram latency;
+	};
+
+	std::deque<Merged> merged;
+	std::vector<const ProfileSite *> sites;
+	std::vector<std::shared_ptr<ThreadProfile>> threads;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		sites = _sites;
+		threads = _threads;
+	}
+
+	merged.emplace_back (ThreadProfile::NO_SITE);
+
+	for (const std::shared_ptr<ThreadProfile> &thread : threads) {
+		std::lock_guard<std::mutex> lock(thread->_mutex);
+		// Thread node and corresponding merged node
+		std::vector<std::pair<uint32_t, std::size_t>> stack{{ThreadProfile::ROOT, 0}};
+
+		while (!stack.empty ()) {
+			const auto [node, mergedNode] = stack.back ();
+
+			stack.pop_back ();
+
+			for (uint32_t child : thread->_nodes[node].children) {
+				const uint32_t site = thread->_nodes[child].site;
+				auto found = merged[mergedNode].children.find (site);
+
+				if (found == merged[mergedNode].children.end ()) {
+					found = merged[mergedNode].children.emplace (site, merged.size ()).first;
+					merged.emplace_back (site);
+				}
+
+				merged[found->second].latency.merge (thread->_nodes[child].latency);
+				stack.emplace_back (child, found->second);
+			}
+		}
+	}
+
+	std::vector<ZoneStats> report;
+	std::vector<std::pair<std::size_t, int>> stack;
+
+	// Children by site id, that is by order of first execution: reversed to be popped in order
+	for (auto it = merged[0].children.rbegin (); it != merged[0].children.rend (); it++)
+		stack.emplace_back (it->second, 0);
+
+	while (!stack.empty ()) {
+		const auto [node, depth] = stack.back ();
+		const ProfileSite *site = sites[merged[node].site];
+		const LatencySummary latency = merged[node].latency.summary ();
+
+		stack.pop_back ();
+		report.push_back (ZoneStats{site->name, site->file, site->line, depth, latency, latency.mean * latency.count});
+
+		for (auto it = merged[node].children.rbegin (); it != merged[node].children.rend (); it++)
+			stack.emplace_back (it->second, depth + 1);
+	}
+
+	return report;
+}
+
+inline void ZoneProfiler::writeTable (std::ostream &out) const
+{
+	const std::vector<ZoneStats> zones = report ();
+	const std::ios::fmtflags flags = out.flags ();
+
+	out << std::left << std::setw (40) << "zone" << std::right
+		<< std::setw (10) << "count" << std::setw (14) << "total_us" << std::setw (12) << "mean_us"
+		<< std::setw (12) << "min_us" << std::setw (12) << "p50_us" << std::setw (12) << "p99_us"
+		<< std::setw (12) << "max_us" << "\n";
+
+	out << std::fixed << std::setprecision (1);
+
+	for (const ZoneStats &zone : zones) {
+		out << std::left << std::setw (40) << (std::string (2 * zone.depth, ' ') + zone.name) << std::right
+			<< std::setw (10) << zone.latency.count << std::setw (14) << zone.total / 1e3
+			<< std::setw (12) << zone.latency.mean / 1e3 << std::setw (12) << zone.latency.min / 1e3
+			<< std::setw (12) << zone.latency.p50 / 1e3 << std::setw (12) << zone.latency.p99 / 1e3
+			<< std::setw (12) << zone.latency.max / 1e3 << "\n";
+	}
+
+	out.flags (flags);
+}
+
+inline void ZoneProfiler::writeCsv (std::ostream &out) const
+{
+	out << "zone,file,line,depth,count,total_us,mean_us,min_us,p50_us,p90_us,p99_us,max_us\n";
+
+	for (const ZoneStats &zone : report ()) {
+		out << zone.name << "," << zone.file << "," << zone.line << "," << zone.depth << ","
+			<< zone.latency.count << "," << zone.total / 1e3 << "," << zone.latency.mean / 1e3 << ","
+			<< zone.latency.min / 1e3 << "," << zone.latency.p50 / 1e3 << "," << zone.latency.p90 / 1e3 << ","
+			<< zone.latency.p99 / 1e3 << "," << zone.latency.max / 1e3 << "\n";
+	}
+}
+
+inline PeriodicProfileReport::PeriodicProfileReport (const std::string &path, const std::chrono::milliseconds &period, bool csv):
+	 _path(path),
+	 _period(period),
+	 _csv(csv),
+	 _stop(false)
+{
+	_thread = std::thread ([this] {
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		while (!_wake.wait_for (lock, _period, [this] { return _stop; }))
+			write ();
+	});
+}
+
+inline PeriodicProfileReport::~PeriodicProfileReport ()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+
+	_wake.notify_one ();
+	_thread.join ();
+
+	write ();
+}
+
+inline void PeriodicProfileReport::write () const
+{
+	std::ofstream file(_path, std::ios::trunc);
+
+	if (_csv)
+		ZoneProfiler::instance ().writeCsv (file);
+	else
+		ZoneProfiler::instance ().writeTable (file);
+}
+
+}
+
+#define NL_PROFILE_CONCAT_(a, b) a##b
+#define NL_PROFILE_CONCAT(a, b) NL_PROFILE_CONCAT_(a, b)
+
+#ifdef DISABLE_PROFILE_ZONES
+#define PROFILE_ZONE(name) static_cast<void> (0)
+#else
+/// @brief Measure the rest of the enclosing scope as the zone @p name, a string literal
+/// @ingroup profiler
+#define PROFILE_ZONE(name) \
+	static const nlib::ProfileSite NL_PROFILE_CONCAT(_profileSite, __LINE__) (name, __FILE__, __LINE__); \
+	const nlib::ProfileZone NL_PROFILE_CONCAT(_profileZone, __LINE__) (NL_PROFILE_CONCAT(_profileSite, __LINE__))
+#endif
+
+/// @brief Measure the rest of the enclosing function as a zone named after it
+/// @ingroup profiler
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+
+#endif // NL_PROFILER_H
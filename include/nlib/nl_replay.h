@@ -0,0 +1,736 @@
+#ifndef NL_REPLAY_H
+#define NL_REPLAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "nl_modflow.h"
+
+#ifdef INCLUDE_ROSBAG
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#endif
+
+/**
+ * @file nl_replay.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/// @brief Simulated time of a replay, since the beginning of the recording
+using ReplayTime = std::chrono::nanoseconds;
+
+constexpr char RECORDING_MAGIC[4] = {'N', 'L', 'R', 'C'};
+constexpr uint32_t RECORDING_VERSION = 1;
+
+struct RecordingHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t sourcesCount;
+	uint64_t recordsCount;
+	uint64_t payloadSize;
+};
+
+template<typename T, typename Enable = void>
+struct IsReplayRosMessage : std::false_type {};
+
+#ifdef INCLUDE_ROSBAG
+template<typename T>
+struct IsReplayRosMessage<T, std::enable_if_t<ros::message_traits::IsMessage<T>::value>> : std::true_type {};
+#endif
+
+/**
+ * @brief Encoding of the values of type @p T in a Recording. Specialize it to replay other types.
+ * Provided for trivially copyable types, strings, vectors of trivially copyable types and, with INCLUDE_ROSBAG, ROS messages.
+ */
+template<typename T, typename Enable = void>
+struct ReplayCodec {
+	static_assert (sizeof (T) == 0, "Specialize ReplayCodec to replay this type");
+};
+
+template<typename T>
+struct ReplayCodec<T, std::enable_if_t<std::is_trivially_copyable_v<T> && !IsReplayRosMessage<T>::value>>
+{
+	static void encode (const T &value, std::vector<char> &buffer) {
+		const char *bytes = reinterpret_cast<const char *> (&value);
+
+		buffer.insert (buffer.end (), bytes, bytes + sizeof (T));
+	}
+
+	static bool decode (const char *data, std::size_t size, T &value) {
+		if (size != sizeof (T))
+			return false;
+
+		memcpy (&value, data, sizeof (T));
+		return true;
+	}
+};
+
+template<>
+struct ReplayCodec<std::string>
+{
+	static void encode (const std::string &value, std::vector<char> &buffer) {
+		buffer.insert (buffer.end (), value.begin (), value.end ());
+	}
+
+	static bool decode (const char *data, std::size_t size, std::string &value) {
+		value.assign (data, size);
+		return true;
+	}
+};
+
+template<typename T>
+struct ReplayCodec<std::vector<T>, std::enable_if_t<std::is_trivially_copyable_v<T>>>
+{
+	static void encode (const std::vector<T> &value, std::vector<char> &buffer) {
+		const char *bytes = reinterpret_cast<const char *> (value.data ());
+
+		buffer.insert (buffer.end (), bytes, bytes + value.size () * sizeof (T));
+	}
+
+	// The capacity of @p value is reused
+	static bool decode (const char *data, std::size_t size, std::vector<T> &value) {
+		if (size % sizeof (T) != 0)
+			return false;
+
+		value.resize (size / sizeof (T));
+		memcpy (value.data (), data, size);
+		return true;
+	}
+};
+
+#ifdef INCLUDE_ROSBAG
+/// @brief ROS messages are stored serialized, as in bags
+template<typename T>
+struct ReplayCodec<T, std::enable_if_t<IsReplayRosMessage<T>::value>>
+{
+	static void encode (const T &value, std::vector<char> &buffer) {
+		const uint32_t size = ros::serialization::serializationLength (value);
+		const std::size_t offset = buffer.size ();
+
+		buffer.resize (offset + size);
+
+		ros::serialization::OStream stream(reinterpret_cast<uint8_t *> (buffer.data () + offset), size);
+		ros::serialization::serialize (stream, value);
+	}
+
+	static bool decode (const char *data, std::size_t size, T &value) {
+		ros::serialization::IStream stream(reinterpret_cast<uint8_t *> (const_cast<char *> (data)), size);
+
+		try {
+			ros::serialization::deserialize (stream, value);
+		} catch (const ros::serialization::StreamOverrunException &e) {
+			return false;
+		}
+
+		return true;
+	}
+};
+#endif
+
+/**
+ * @brief Recorded source data: timed values of named sources, in the compact native capture format.
+ * The values are encoded with ReplayCodec and stored contiguously.
+ */
+class Recording
+{
+public:
+	struct Record {
+		ReplayTime time;
+		uint32_t source;
+		uint32_t size;
+		uint64_t offset;
+	};
+
+	/// @return Index of the source @p name, added if new
+	uint32_t addSource (const std::string &name);
+
+	template<typename T>
+	void add (ReplayTime time, uint32_t source, const T &value);
+	/// @brief Add a value already encoded, e.g. a serialized ROS message
+	void addEncoded (ReplayTime time, uint32_t source, const char *data, std::size_t size);
+
+	const std::vector<std::string> &sources () const {
+		return _sources;
+	}
+
+	const std::vector<Record> &records () const {
+		return _records;
+	}
+
+	const char *payload (const Record &record) const {
+		return _payloads.data () + record.offset;
+	}
+
+	/// @brief Time of the latest record
+	ReplayTime duration () const;
+
+	void write (std::ostream &out) const;
+	/// @return The recording written by @ref write, std::nullopt if the stream is not a valid recording
+	static std::optional<Recording> read (std::istream &in);
+
+private:
+	static constexpr std::size_t RECORD_SIZE = sizeof (int64_t) + 2 * sizeof (uint32_t);
+
+	std::vector<std::string> _sources;
+	std::vector<Record> _records;
+	std::vector<char> _payloads;
+};
+
+/// @brief Value emitted on a captured sink during a replay
+struct CapturedOutput {
+	ReplayTime time;
+	std::string sink;
+	std::string value;
+
+	bool operator == (const CapturedOutput &other) const {
+		return time == other.time && sink == other.sink && value == other.value;
+	}
+};
+
+struct ReplayResult {
+	uint64_t records = 0;
+	// Records of sources not added to the replay, or that cannot be decoded
+	uint64_t skipped = 0;
+	uint64_t ticks = 0;
+	ReplayTime span{0};
+	std::chrono::nanoseconds wall{0};
+	std::vector<CapturedOutput> outputs;
+
+	/// @brief Simulated time replayed per wall clock time
+	double speedup () const {
+		return wall.count () > 0 ? double (span.count ()) / wall.count () : 0;
+	}
+
+	/// @brief Records replayed per second of wall clock time
+	double throughput () const {
+		return wall.count () > 0 ? records * 1e9 / wall.count () : 0;
+	}
+
+	/// @brief One line per output, "time_ns sink value", for diffing
+	void writeOutputs (std::ostream &out) const;
+};
+
+/**
+ * @brief Headless replay of recordings through a ModFlow graph, as fast as the graph computes.
+ * Each record is decoded and fed to the source of the same name with NlSources::callSource, in time order,
+ * with no ROS master. A simulated clock calls the tick, standing for the synchronous clock of the node, at every period
+ * elapsed between records. Values emitted on the captured sinks are collected with their simulated time.
+ *
+ * Replays are deterministic with synchronous dispatch. With the executor enabled, see @ref setLockstep.
+ * Sources and sinks are declared on the ModFlow before the first run, which finalizes it.
+ * @ingroup modflow
+ */
+class NlReplay
+{
+	class CaptureBase {
+	public:
+		virtual ~CaptureBase () = default;
+	};
+
+	template<typename ...T>
+	class SinkCapture : public CaptureBase {
+	public:
+		using Format = std::function<void (std::ostream &, const T &...)>;
+
+		SinkCapture (NlReplay *replay, const std::string &name, const Format &format):
+			 _replay(replay),
+			 _name(name),
+			 _format(format)
+		{}
+
+		void onOutput (const T &...value) {
+			std::ostringstream text;
+
+			_format (text, value...);
+			_replay->capture (_name, text.str ());
+		}
+
+	private:
+		NlReplay *const _replay;
+		const std::string _name;
+		const Format _format;
+	};
+
+public:
+	/// @param modFlow Initialized and not yet finalized
+	explicit NlReplay (const NlModFlow::Ptr &modFlow);
+	NlReplay (const NlReplay &) = delete;
+	NlReplay &operator = (const NlReplay &) = delete;
+
+	/// @brief Declare the source @p name, fed with the records of the source of the same name
+	template<typename T>
+	void addSource (const std::string &name);
+
+	/// @brief Capture the values emitted on the sink @p name, printed space separated with operator <<
+	template<typename ...T>
+	void captureSink (const std::string &name);
+
+	/// @brief Capture the values emitted on the sink @p name, printed by @p format
+	template<typename ...T>
+	void captureSink (const std::string &name, const std::function<void (std::ostream &, const T &...)> &format);
+
+	/**
+	 * @brief Call @p tick at every @p period of simulated time, e.g. to call the sources of the synchronous clock.
+	 * Ticks due at the time of a record are called before it.
+	 */
+	void setClock (ReplayTime period, const std::function<void (ReplayTime)> &tick);
+
+	/// @brief With the executor enabled, wait for the graph to be idle after each record and tick, for deterministic outputs
+	void setLockstep (bool lockstep) {
+		_lockstep = lockstep;
+	}
+
+	/// @brief Replay @p recording, finalizing the ModFlow on the first run. The graph keeps its state between runs.
+	ReplayResult run (const Recording &recording);
+
+	/// @brief Simulated time of the record or tick being replayed
+	ReplayTime now () const {
+		return _now.load ();
+	}
+
+	NlModFlow &modFlow () {
+		return *_modFlow;
+	}
+
+private:
+	void checkNotFinalized (const std::string &what) const;
+	void capture (const std::string &sink, std::string &&value);
+	void settle ();
+
+private:
+	struct Source {
+		std::string name;
+		// Decode the payload and call the source
+		std::function<bool (const char *, std::size_t)> feed;
+	};
+
+	const NlModFlow::Ptr _modFlow;
+	std::vector<Source> _sources;
+	std::vector<std::unique_ptr<CaptureBase>> _captures;
+	ReplayTime _clockPeriod;
+	std::function<void (ReplayTime)> _tick;
+	// Written by run, read by the sinks on the executor workers
+	std::atomic<ReplayTime> _now;
+	bool _lockstep;
+	bool _finalized;
+	// Sinks may be called by the executor workers
+	std::mutex _outputsMutex;
+	std::vector<CapturedOutput> _outputs;
+};
+
+/**
+ * @brief Replay each of @p recordings on its own graph, on up to @p threads threads
+ * @param makeReplay Called once per recording, from the worker threads, to build a replay on a new ModFlow
+ * @return Results in the order of @p recordings
+ */
+std::vector<ReplayResult> replayParallel (const std::vector<Recording> &recordings,
+								  const std::function<std::unique_ptr<NlReplay> ()> &makeReplay,
+								  int threads);
+
+#ifdef INCLUDE_ROSBAG
+/**
+ * @brief Recording of the messages of a bag, with times relative to its beginning
+ * @param topicSources Source of each topic to replay
+ * @return std::nullopt if the bag cannot be read
+ */
+std::optional<Recording> recordingFromBag (const std::string &path, const std::map<std::string, std::string> &topicSources);
+#endif
+
+inline uint32_t Recording::addSource (const std::string &name)
+{
+	auto found = std::find (_sources.begin (), _sources.end (), name);
+
+	if (found != _sources.end ())
+		return std::distance (_sources.begin (), found);
+
+	_sources.push_back (name);
+
+	return _sources.size () - 1;
+}
+
+template<typename T>
+void Recording::add (ReplayTime time, uint32_t source, const T &value)
+{
+	const std::size_t offset = _payloads.size ();
+
+	ReplayCodec<T>::encode (value, _payloads);
+	_records.push_back (Record{time, source, uint32_t (_payloads.size () - offset), offset});
+}
+
+inline void Recording::addEncoded (ReplayTime time, uint32_t source, const char *data, std::size_t size)
+{
+	_records.push_back (Record{time, source, uint32_t (size), _payloads.size ()});
+	_payloads.insert (_payloads.end (), data, data + size);
+}
+
+inline ReplayTime Recording::duration () const
+{
+	ReplayTime latest{0};
+
+	for (const Record &record : _records)
+		latest = std::max (latest, record.time);
+
+	return latest;
+}
+
+inline void Recording::write (std::ostream &out) const
+{
+	const RecordingHeader header{{RECORDING_MAGIC[0], RECORDING_MAGIC[1], RECORDING_MAGIC[2], RECORDING_MAGIC[3]},
+							 RECORDING_VERSION, uint32_t (_sources.size ()), _records.size (), _payloads.size ()};
+
+	out.write (reinterpret_cast<const char *> (&header), sizeof (header));
+
+	for (const std::string &source : _sources) {
+		const uint32_t size = source.size ();
+
+		out.write (reinterpret_cast<const char *> (&size), sizeof (size));
+		out.write (source.data (), size);
+	}
+
+	// Records are stored in order with their payloads, so offsets are implicit
+	std::vector<char> table(_records.size () * RECORD_SIZE);
+	std::vector<char> payloads;
+
+	payloads.reserve (_payloads.size ());
+
+	for (std::size_t i = 0; i < _records.size (); i++) {
+		const Record &record = _records[i];
+		const int64_t time = record.time.count ();
+		char *entry = table.data () + i * RECORD_SIZE;
+
+		memcpy (entry, &time, sizeof (time));
+		memcpy (entry + sizeof (time), &record.source, sizeof (uint32_t));
+		memcpy (entry + sizeof (time) + sizeof (uint32_t), &record.size, sizeof (uint32_t));
+		payloads.insert (payloads.end (), payload (record), payload (record) + record.size);
+	}
+
+	out.write (table.data (), table.size ());
+	out.write (payloads.data (), payloads.size ());
+}
+
+// Read @p size bytes into @p data, growing it as they arrive: a corrupt size fails at the end of the stream
+// instead of allocating more than the stream holds
+template<typename Bytes>
+bool readBytes (std::istream &in, uint64_t size, Bytes &data)
+{
+	constexpr uint64_t CHUNK = 1 << 20;
+
+	data.clear ();
+
+	while (data.size () < size) {
+		const std::size_t begin = data.size ();
+		const std::size_t chunk = std::min (size - begin, CHUNK);
+
+		data.resize (begin + chunk);
+
+		if (!in.read (&data[begin], chunk))
+			return false;
+	}
+
+	return true;
+}
+
+inline std::optional<Recording> Recording::read (std::istream &in)
+{
+	RecordingHeader header;
+
+	if (!in.read (reinterpret_cast<char *> (&header), sizeof (header)) ||
+		memcmp (header.magic, RECORDING_MAGIC, sizeof (RECORDING_MAGIC)) != 0 || header.version != RECORDING_VERSION)
+		return std::nullopt;
+
+	Recording recording;
+
+	for (uint32_t i = 0; i < header.sourcesCount; i++) {
+		uint32_t size;
+		std::string name;
+
+		if (!in.read (reinterpret_cast<char *> (&size), sizeof (size)) || !readBytes (in, size, name))
+			return std::nullopt;
+
+		recording._sources.push_back (std::move (name));
+	}
+
+	std::vector<char> table;
+
+	if (header.recordsCount > std::numeric_limits<uint64_t>::max () / RECORD_SIZE ||
+		!readBytes (in, header.recordsCount * RECORD_SIZE, table))
+		return std::nullopt;
+
+	recording._records.resize (header.recordsCount);
+	uint64_t offset = 0;
+
+	for (std::size_t i = 0; i < header.recordsCount; i++) {
+		Record &record = recording._records[i];
+		const char *entry = table.data () + i * RECORD_SIZE;
+		int64_t time;
+
+		memcpy (&time, entry, sizeof (time));
+		memcpy (&record.source, entry + sizeof (time), sizeof (uint32_t));
+		memcpy (&record.size, entry + sizeof (time) + sizeof (uint32_t), sizeof (uint32_t));
+		record.time = ReplayTime (time);
+		record.offset = offset;
+		offset += record.size;
+
+		if (record.source >= header.sourcesCount)
+			return std::nullopt;
+	}
+
+	if (offset != header.payloadSize)
+		return std::nullopt;
+
+	if (!readBytes (in, header.payloadSize, recording._payloads))
+		return std::nullopt;
+
+	return recording;
+}
+
+inline void ReplayResult::writeOutputs (std::ostream &out) const
+{
+	for (const CapturedOutput &output : outputs)
+		out << output.time.count () << " " << output.sink << " " << output.value << "\n";
+}
+
+inline NlReplay::NlReplay (const NlModFlow::Ptr &modFlow):
+	 _modFlow(modFlow),
+	 _clockPeriod(0),
+	 _now(ReplayTime (0)),
+	 _lockstep(false),
+	 _finalized(false)
+{}
+
+inline void NlReplay::checkNotFinalized (const std::string &what) const
+{
+	if (_finalized) {
+		std::cout << "Error: replay " << what << " added after the first run.\nAborting" << std::endl;
+		std::abort ();
+	}
+}
+
+template<typename T>
+void NlReplay::addSource (const std::string &name)
+{
+	checkNotFinalized ("source " + name);
+
+	const TypedChannel<T> channel = _modFlow->sources ()->declareSource<T> (name);
+	NlSources::Ptr sources = _modFlow->sources ();
+
+	// The decoded value is reused, keeping its capacity
+	_sources.push_back (Source{name, [sources, channel, value = T ()] (const char *data, std::size_t size) mutable {
+		if (!ReplayCodec<T>::decode (data, size, value))
+			return false;
+
+		sources->callSource (channel, value);
+		return true;
+	}});
+}
+
+template<typename ...T>
+void NlReplay::captureSink (const std::string &name)
+{
+	const std::function<void (std::ostream &, const T &...)> format = [] (std::ostream &out, const T &...value) {
+		bool first = true;
+
+		((out << (first ? "" : " ") << value, first = false), ...);
+	};
+
+	captureSink<T...> (name, format);
+}
+
+template<typename ...T>
+void NlReplay::captureSink (const std::string &name, const std::function<void (std::ostream &, const T &...)> &format)
+{
+	checkNotFinalized ("sink " + name);
+
+	auto capture = std::make_unique<SinkCapture<T...>> (this, name, format);
+
+	_modFlow->sinks ()->declareSink (name, &SinkCapture<T...>::onOutput, capture.get ());
+	_captures.push_back (std::move (capture));
+}
+
+inline void NlReplay::setClock (ReplayTime period, const std::function<void (ReplayTime)> &tick)
+{
+	_clockPeriod = period;
+	_tick = tick;
+}
+
+inline void NlReplay::capture (const std::string &sink, std::string &&value)
+{
+	std::lock_guard<std::mutex> lock(_outputsMutex);
+
+	_outputs.push_back (CapturedOutput{_now.load (), sink, std::move (value)});
+}
+
+inline void NlReplay::settle ()
+{
+	if (_lockstep)
+		_modFlow->waitIdle ();
+}
+
+inline ReplayResult NlReplay::run (const Recording &recording)
+{
+	if (!_finalized) {
+		_modFlow->finalize ();
+		_finalized = true;
+	}
+
+	// Recording source to replay source, resolved once
+	std::vector<const Source *> sources;
+
+	for (const std::string &name : recording.sources ()) {
+		auto found = std::find_if (_sources.begin (), _sources.end (), [&name] (const Source &source) {
+			return source.name == name;
+		});
+
+		sources.push_back (found == _sources.end () ? nullptr : &*found);
+	}
+
+	// Records in time order, keeping the recorded order of simultaneous ones
+	const std::vector<Recording::Record> &records = recording.records ();
+	std::vector<std::size_t> order(records.size ());
+
+	std::iota (order.begin (), order.end (), 0);
+
+	auto earlier = [&records] (std::size_t a, std::size_t b) {
+		return records[a].time < records[b].time;
+	};
+
+	if (!std::is_sorted (order.begin (), order.end (), earlier))
+		std::stable_sort (order.begin (), order.end (), earlier);
+
+	ReplayResult result;
+	ReplayTime nextTick = _clockPeriod;
+	const auto start = std::chrono::steady_clock::now ();
+
+	_outputs.clear ();
+
+	for (std::size_t index : order) {
+		const Recording::Record &record = records[index];
+
+		while (_tick && _clockPeriod.count () > 0 && nextTick <= record.time) {
+			_now = nextTick;
+			_tick (nextTick);
+			settle ();
+			result.ticks++;
+			nextTick += _clockPeriod;
+		}
+
+		_now = record.time;
+
+		const Source *source = sources[record.source];
+
+		if (source == nullptr || !source->feed (recording.payload (record), record.size)) {
+			result.skipped++;
+			continue;
+		}
+
+		settle ();
+		result.records++;
+	}
+
+	_modFlow->waitIdle ();
+
+	result.wall = std::chrono::steady_clock::now () - start;
+	result.span = order.empty () ? ReplayTime (0) : records[order.back ()].time;
+
+	std::lock_guard<std::mutex> lock(_outputsMutex);
+	result.outputs = std::move (_outputs);
+	_outputs.clear ();
+
+	return result;
+}
+
+inline std::vector<ReplayResult> replayParallel (const std::vector<Recording> &recordings,
+										const std::function<std::unique_ptr<NlReplay> ()> &makeReplay,
+										int threads)
+{
+	std::vector<ReplayResult> results(recordings.size ());
+	std::atomic<std::size_t> next(0);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	std::vector<std::thread> workers;
+
+	auto work = [&] () {
+		for (std::size_t i = next++; i < recordings.size (); i = next++) {
+			try {
+				results[i] = makeReplay ()->run (recordings[i]);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+
+				if (!error)
+					error = std::current_exception ();
+			}
+		}
+	};
+
+	const int count = std::max (1, std::min (threads, int (recordings.size ())));
+
+	for (int i = 0; i < count; i++)
+		workers.emplace_back (work);
+
+	for (std::thread &worker : workers)
+		worker.join ();
+
+	if (error)
+		std::rethrow_exception (error);
+
+	return results;
+}
+
+#ifdef INCLUDE_ROSBAG
+inline std::optional<Recording> recordingFromBag (const std::string &path, const std::map<std::string, std::string> &topicSources)
+{
+	rosbag::Bag bag;
+
+	try {
+		bag.open (path, rosbag::bagmode::Read);
+	} catch (const rosbag::BagException &e) {
+		std::cout << "Cannot read bag " << path << ": " << e.what () << std::endl;
+		return std::nullopt;
+	}
+
+	Recording recording;
+	std::map<std::string, uint32_t> sources;
+	std::vector<std::string> topics;
+
+	for (const auto &[topic, source] : topicSources) {
+		sources[topic] = recording.addSource (source);
+		topics.push_back (topic);
+	}
+
+	rosbag::View view(bag, rosbag::TopicQuery (topics));
+	const ros::Time begin = view.getBeginTime ();
+	std::vector<char> buffer;
+
+	for (const rosbag::MessageInstance &instance : view) {
+		buffer.resize (instance.size ());
+
+		// Messages are kept serialized, they are deserialized by ReplayCodec when replayed
+		ros::serialization::OStream stream(reinterpret_cast<uint8_t *> (buffer.data ()), buffer.size ());
+		instance.write (stream);
+
+		recording.addEncoded (ReplayTime ((instance.getTime () - begin).toNSec ()), sources.at (instance.getTopic ()),
+						  buffer.data (), buffer.size ());
+	}
+
+	return recording;
+}
+#endif
+
+}
+
+#endif // NL_REPLAY_H
@@ -3,18 +3,61 @@
 
 #include <nlib/nl_multiarray_ros.h>
 #include <std_msgs/Float32MultiArray.h>
+#include <std_msgs/Float64MultiArray.h>
+
+/*
+ * Conversions write into the storage of the given output message: reusing the same message for each publish,
+ * the data is resized in place and written once, with no allocation in steady state.
+ * Conversions from messages are zero-copy and keep the received message alive.
+ */
 
 #ifdef INCLUDE_TORCH
 #include <torch/all.h>
-inline
-void tensorToMsg (const torch::Tensor &tensor, const std::vector<float> &extraData, std_msgs::Float32MultiArray &outputMsg)
+
+/**
+ * @brief Write @p tensor into @p outputMsg, after @p extraData. Tensors of a different dtype are converted,
+ * non-contiguous ones are copied in a single strided pass.
+ */
+template<class MultiArray>
+void tensorToMsg (const torch::Tensor &tensor, const std::vector<typename MultiArray::_data_type::value_type> &extraData, MultiArray &outputMsg)
 {
-	nlib::MultiArray32Manager array(std::vector<int> (tensor.sizes().begin(), tensor.sizes().end()), extraData.size ());
+	using value_type = typename MultiArray::_data_type::value_type;
+	const torch::ScalarType dtype = c10::CppTypeToScalarType<value_type>::value;
+	const torch::Tensor source = tensor.scalar_type () == dtype && tensor.device ().is_cpu () ?
+								 tensor : tensor.to (torch::kCPU, dtype);
+	const std::vector<int64_t> sizes(source.sizes ().begin (), source.sizes ().end ());
+
+	nlib::MultiArrayManager<MultiArray>::create (outputMsg, std::vector<int> (sizes.begin (), sizes.end ()), extraData.size ());
+
+	value_type *data = outputMsg.data.data () + extraData.size ();
 
-	memcpy (array.data (), extraData.data (), extraData.size () * sizeof (float));
-	memcpy (array.data () + extraData.size (), tensor.data_ptr(), tensor.element_size() * tensor.numel ());
+	memcpy (outputMsg.data.data (), extraData.data (), extraData.size () * sizeof (value_type));
 
-	outputMsg = array.msg();
+	if (source.is_contiguous ())
+		memcpy (data, source.data_ptr (), source.element_size () * source.numel ());
+	else
+		torch::from_blob (data, sizes, torch::TensorOptions ().dtype (dtype)).copy_ (source);
+}
+
+/**
+ * @brief Zero-copy tensor over the data of a received FloatXXMultiArray, after the extra data.
+ * Strides are taken from the layout. The tensor keeps the message alive and must not be written.
+ */
+template<class ConstPtr>
+torch::Tensor msgToTensor (const ConstPtr &msg)
+{
+	using MultiArray = std::remove_const_t<typename ConstPtr::element_type>;
+	using value_type = typename MultiArray::_data_type::value_type;
+	const int dimensions = msg->layout.dim.size ();
+	std::vector<int64_t> sizes(dimensions), strides(dimensions);
+
+	for (int i = 0; i < dimensions; i++) {
+		sizes[i] = msg->layout.dim[i].size;
+		strides[i] = i < dimensions - 1 ? msg->layout.dim[i+1].stride : 1;
+	}
+
+	return torch::from_blob (const_cast<value_type *> (msg->data.data () + msg->layout.data_offset), sizes, strides,
+						[msg] (void *) {}, torch::TensorOptions ().dtype (c10::CppTypeToScalarType<value_type>::value));
 }
 #endif
 
@@ -22,14 +65,37 @@ void tensorToMsg (const torch::Tensor &tensor, const std::vector<float> &extraDa
 #include <eigen3/Eigen/Core>
 namespace nlib {
 
-inline void eigen32ToMsg (const Eigen::MatrixXf &matrix, const std::vector<float> &extraData, std_msgs::Float32MultiArray &msg)
+/**
+ * @brief Write @p matrix into @p msg as a row major {rows, cols} array, after @p extraData
+ */
+template<class MultiArray, class Derived>
+void eigenToMsg (const Eigen::MatrixBase<Derived> &matrix, const std::vector<typename MultiArray::_data_type::value_type> &extraData, MultiArray &msg)
 {
-	MultiArray32Manager arrayManager(std::vector<int> {matrix.rows(), matrix.cols()}, extraData.size ());
+	using value_type = typename MultiArray::_data_type::value_type;
+	using RowMajor = Eigen::Matrix<value_type, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+	MultiArrayManager<MultiArray>::create (msg, std::vector<int> {int (matrix.rows()), int (matrix.cols())}, extraData.size ());
+
+	std::copy (extraData.begin (), extraData.end (), msg.data.begin());
+	Eigen::Map<RowMajor> (msg.data.data () + extraData.size (), matrix.rows (), matrix.cols ()) = matrix;
+}
 
-	auto last = std::copy (extraData.begin (), extraData.end (), arrayManager.array ().begin());
-	std::copy (matrix.data(), matrix.data() + matrix.size(), last);
+inline void eigen32ToMsg (const Eigen::MatrixXf &matrix, const std::vector<float> &extraData, std_msgs::Float32MultiArray &msg) {
+	eigenToMsg (matrix, extraData, msg);
+}
+
+/**
+ * @brief Zero-copy view of a received {rows, cols} FloatXXMultiArray: matrix () is an Eigen map over its data.
+ * The view keeps the message alive.
+ */
+template<class ConstPtr>
+MultiArrayView<std::remove_const_t<typename ConstPtr::element_type>,
+			const typename std::remove_const_t<typename ConstPtr::element_type>::_data_type::value_type, 2>
+msgToEigen (const ConstPtr &msg)
+{
+	using MultiArray = std::remove_const_t<typename ConstPtr::element_type>;
 
-	msg = arrayManager.msg ();
+	return MultiArrayView<MultiArray, const typename MultiArray::_data_type::value_type, 2> (msg);
 }
 }
 #endif
@@ -0,0 +1,733 @@
+#ifndef NL_SHM_BRIDGE_H
+#define NL_SHM_BRIDGE_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "nl_modflow.h"
+
+/**
+ * @file nl_shm_bridge.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+constexpr char SHM_RING_MAGIC[4] = {'N', 'L', 'S', 'R'};
+constexpr uint32_t SHM_RING_VERSION = 1;
+
+/**
+ * @brief Writing of the values of type @p T in place in a shared memory slot, with no serialization.
+ * Specialize it to bridge other types. Provided for trivially copyable types, strings, vectors of trivially copyable types
+ * and FloatXXMultiArray-like types, i.e. with a layout and a data vector.
+ * read reuses the storage of @p value.
+ */
+template<typename T, typename Enable = void>
+struct ShmCodec {
+	static_assert (sizeof (T) == 0, "Specialize ShmCodec to bridge this type");
+};
+
+template<typename T>
+struct ShmCodec<T, std::enable_if_t<std::is_trivially_copyable_v<T>>>
+{
+	static std::size_t size (const T &) {
+		return sizeof (T);
+	}
+
+	static void write (const T &value, char *data) {
+		memcpy (data, &value, sizeof (T));
+	}
+
+	static bool read (const char *data, std::size_t size, T &value) {
+		if (size != sizeof (T))
+			return false;
+
+		memcpy (&value, data, sizeof (T));
+		return true;
+	}
+};
+
+template<>
+struct ShmCodec<std::string>
+{
+	static std::size_t size (const std::string &value) {
+		return value.size ();
+	}
+
+	static void write (const std::string &value, char *data) {
+		memcpy (data, value.data (), value.size ());
+	}
+
+	static bool read (const char *data, std::size_t size, std::string &value) {
+		value.assign (data, size);
+		return true;
+	}
+};
+
+template<typename T>
+struct ShmCodec<std::vector<T>, std::enable_if_t<std::is_trivially_copyable_v<T>>>
+{
+	static std::size_t size (const std::vector<T> &value) {
+		return value.size () * sizeof (T);
+	}
+
+	static void write (const std::vector<T> &value, char *data) {
+		memcpy (data, value.data (), value.size () * sizeof (T));
+	}
+
+	static bool read (const char *data, std::size_t size, std::vector<T> &value) {
+		if (size % sizeof (T) != 0)
+			return false;
+
+		value.resize (size / sizeof (T));
+		memcpy (value.data (), data, size);
+		return true;
+	}
+};
+
+/**
+ * @brief The layout is written as {dimensions, data_offset, {size, stride, label length}..., labels}, followed by the data
+ * as is, 8 bytes aligned
+ */
+template<typename MultiArray>
+struct ShmCodec<MultiArray, std::void_t<decltype (std::declval<MultiArray> ().layout.dim),
+								 decltype (std::declval<MultiArray> ().layout.data_offset),
+								 typename MultiArray::_data_type>>
+{
+	using value_type = typename MultiArray::_data_type::value_type;
+
+	static std::size_t layoutSize (const MultiArray &value) {
+		std::size_t size = 2 * sizeof (uint32_t);
+
+		for (const auto &dim : value.layout.dim)
+			size += 3 * sizeof (uint32_t) + dim.label.size ();
+
+		return (size + 7) & ~std::size_t (7);
+	}
+
+	static std::size_t size (const MultiArray &value) {
+		return layoutSize (value) + value.data.size () * sizeof (value_type);
+	}
+
+	static void write (const MultiArray &value, char *data) {
+		char *cursor = data;
+		auto put = [&cursor] (uint32_t field) {
+			memcpy (cursor, &field, sizeof (field));
+			cursor += sizeof (field);
+		};
+
+		put (value.layout.dim.size ());
+		put (value.layout.data_offset);
+
+		for (const auto &dim : value.layout.dim) {
+			put (dim.size);
+			put (dim.stride);
+			put (dim.label.size ());
+		}
+
+		for (const auto &dim : value.layout.dim) {
+			memcpy (cursor, dim.label.data (), dim.label.size ());
+			cursor += dim.label.size ();
+		}
+
+		memcpy (data + layoutSize (value), value.data.data (), value.data.size () * sizeof (value_type));
+	}
+
+	static bool read (const char *data, std::size_t size, MultiArray &value) {
+		const char *cursor = data;
+		const char *const end = data + size;
+		auto get = [&cursor, end] (uint32_t &field) {
+			if (cursor + sizeof (field) > end)
+				return false;
+
+			memcpy (&field, cursor, sizeof (field));
+			cursor += sizeof (field);
+			return true;
+		};
+
+		uint32_t dimensions, dataOffset;
+
+		if (!get (dimensions) || !get (dataOffset))
+			return false;
+
+		value.layout.dim.resize (dimensions);
+		value.layout.data_offset = dataOffset;
+
+		std::vector<uint32_t> labelSizes(dimensions);
+
+		for (uint32_t i = 0; i < dimensions; i++) {
+			uint32_t dimSize, stride;
+
+			if (!get (dimSize) || !get (stride) || !get (labelSizes[i]))
+				return false;
+
+			value.layout.dim[i].size = dimSize;
+			value.layout.dim[i].stride = stride;
+		}
+
+		for (uint32_t i = 0; i < dimensions; i++) {
+			if (cursor + labelSizes[i] > end)
+				return false;
+
+			value.layout.dim[i].label.assign (cursor, labelSizes[i]);
+			cursor += labelSizes[i];
+		}
+
+		const std::size_t dataBegin = layoutSize (value);
+
+		if (dataBegin > size || (size - dataBegin) % sizeof (value_type) != 0)
+			return false;
+
+		value.data.resize ((size - dataBegin) / sizeof (value_type));
+		memcpy (value.data.data (), data + dataBegin, size - dataBegin);
+
+		return true;
+	}
+};
+
+/// @brief Type names of @p T..., compared by both ends of a ring as Channel::checkType compares the types of a channel
+template<typename ...T>
+std::string shmTypes ()
+{
+	std::string types;
+
+	((types += std::string (typeid (T).name ()) + ";"), ...);
+
+	return types;
+}
+
+/**
+ * @brief Lock-free ring of fixed size slots in a POSIX shared memory segment, for one writer and one reader process.
+ * Whichever end opens the segment first creates it, the other one checks that the slot geometry and the types match.
+ * Slots are written and read in place.
+ */
+class ShmRing
+{
+	enum State : uint32_t {
+		STATE_INIT,
+		STATE_READY,
+		// The writer is gone: the reader opens a new segment once the ring is empty
+		STATE_CLOSED,
+		// Created by the reader, no writer attached yet
+		STATE_WAITING
+	};
+
+	static constexpr std::size_t TYPES_CAPACITY = 1024;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t slotSize;
+		uint32_t slotsCount;
+		char types[TYPES_CAPACITY];
+		std::atomic<uint32_t> state;
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+	};
+
+	static_assert (std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+				"Shared memory rings need lock-free atomics");
+
+public:
+	/**
+	 * @param name Name of the segment, as for shm_open
+	 * @param slotSize Maximum size of the values written in a slot, in bytes
+	 * @param writer Whether this end writes, the segment is removed when the writer closes it, or when the reader
+	 * that created it closes it before any writer attached
+	 */
+	ShmRing (const std::string &name, uint32_t slotSize, uint32_t slotsCount, const std::string &types, bool writer);
+	ShmRing (const ShmRing &) = delete;
+	ShmRing &operator = (const ShmRing &) = delete;
+	~ShmRing ();
+
+	/// @return Payload of the next free slot, nullptr if the ring is full
+	char *beginWrite ();
+	/// @brief Publish the slot returned by beginWrite, with @p size bytes written
+	void commitWrite (uint32_t size);
+
+	/// @return Payload of the oldest written slot, nullptr if the ring is empty
+	const char *beginRead (uint32_t &size);
+	/// @brief Release the slot returned by beginRead
+	void commitRead ();
+
+	/// @brief Whether the writer has closed the segment
+	bool closed () const {
+		return _header->state.load (std::memory_order_acquire) == STATE_CLOSED;
+	}
+
+	uint32_t slotSize () const {
+		return _header->slotSize;
+	}
+
+private:
+	static std::size_t slotStride (uint32_t slotSize) {
+		return (sizeof (uint64_t) + slotSize + 63) & ~std::size_t (63);
+	}
+
+	static std::size_t headerStride () {
+		return (sizeof (Header) + 63) & ~std::size_t (63);
+	}
+
+	// Size and payload of slot @p sequence
+	char *slot (uint64_t sequence) const {
+		return _memory + headerStride () + (sequence % _header->slotsCount) * slotStride (_header->slotSize);
+	}
+
+	[[noreturn]] void fail (const std::string &what) const;
+	static std::string demangleTypes (const std::string &types);
+
+private:
+	const std::string _name;
+	const bool _writer;
+	bool _created;
+	std::size_t _size;
+	char *_memory;
+	Header *_header;
+};
+
+/**
+ * @brief Module forwarding the values emitted on a channel of this graph to a shared memory segment, read by an
+ * @ref NlShmSourceBridge in another process. Values that do not fit in the ring or in a slot are dropped, the channel
+ * never blocks.
+ *
+ * Params, in the subtree of the module name, the same at both ends:
+ * - @c slots Number of slots of the ring. Default 16
+ * - @c slot_size Maximum size of the values of an emit, in bytes, including 8 bytes per value. Default 65536
+ * @ingroup modflow
+ */
+template<typename ...T>
+class NlShmSinkBridge : public NlModule
+{
+	struct Params {
+		int slots;
+		int slotSize;
+
+		static auto fields () {
+			return std::make_tuple (paramField ("slots", &Params::slots, 16),
+								paramField ("slot_size", &Params::slotSize, 1 << 16));
+		}
+	};
+
+public:
+	/**
+	 * @param channel Name of the bridged channel, of this graph
+	 * @param segment Name of the shared memory segment
+	 */
+	NlShmSinkBridge (NlModFlow *modFlow, const std::string &name, const std::string &channel, const std::string &segment);
+
+	void setupNetwork () override;
+
+	/// @brief Number of emits dropped because the ring was full or the values too large
+	uint64_t dropped () const {
+		return _dropped.load (std::memory_order_relaxed);
+	}
+
+	DEF_SHARED (NlShmSinkBridge)
+
+private:
+	void onValue (const T &...value);
+
+private:
+	Params _params;
+	const std::string _channelName;
+	const std::string _segment;
+	std::unique_ptr<ShmRing> _ring;
+	std::atomic<uint64_t> _dropped;
+};
+
+/**
+ * @brief Module emitting on a channel of this graph the values written by an @ref NlShmSinkBridge in another process.
+ * A thread of the module polls the ring and emits from it, as a source would. It is started once the network is ready
+ * and stopped when the ModFlow is destroyed. The executor must be enabled, so that the slots run on their strands
+ * while the thread emits, instead of on the thread, concurrently with the ROS callbacks.
+ *
+ * Params, in the subtree of the module name: @c slots and @c slot_size as the sink bridge, and
+ * - @c poll_us Sleep when the ring is empty, in microseconds. Default 50
+ * @ingroup modflow
+ */
+template<typename ...T>
+class NlShmSourceBridge : public NlModule
+{
+	struct Params {
+		int slots;
+		int slotSize;
+		int pollUs;
+
+		static auto fields () {
+			return std::make_tuple (paramField ("slots", &Params::slots, 16),
+								paramField ("slot_size", &Params::slotSize, 1 << 16),
+								paramField ("poll_us", &Params::pollUs, 50));
+		}
+	};
+
+public:
+	/**
+	 * @param segment Name of the shared memory segment
+	 * @param channel Name of the channel created by the bridge, of this graph
+	 */
+	NlShmSourceBridge (NlModFlow *modFlow, const std::string &name, const std::string &segment, const std::string &channel);
+	~NlShmSourceBridge ();
+
+	void setupNetwork () override;
+	void onNetworkReady () override;
+	void onNetworkStop () override;
+
+	/// @brief Stop emitting, before the graph is destroyed
+	void stop ();
+
+	/// @brief Number of values read that could not be decoded
+	uint64_t invalid () const {
+		return _invalid.load (std::memory_order_relaxed);
+	}
+
+	DEF_SHARED (NlShmSourceBridge)
+
+private:
+	void run ();
+
+	template<std::size_t ...I>
+	bool decode (const char *data, uint32_t size, std::index_sequence<I...>);
+
+private:
+	Params _params;
+	const std::string _segment;
+	const std::string _channelName;
+	TypedChannel<T...> _output;
+	std::unique_ptr<ShmRing> _ring;
+	// Decoded in place, keeping their storage
+	std::tuple<T...> _values;
+	std::atomic<bool> _stop;
+	std::atomic<uint64_t> _invalid;
+	std::thread _thread;
+};
+
+inline ShmRing::ShmRing (const std::string &name, uint32_t slotSize, uint32_t slotsCount, const std::string &types, bool writer):
+	 _name(name),
+	 _writer(writer),
+	 _created(true),
+	 _size(headerStride () + slotsCount * slotStride (slotSize)),
+	 _memory(nullptr),
+	 _header(nullptr)
+{
+	if (slotsCount == 0 || types.size () >= TYPES_CAPACITY)
+		fail ("invalid geometry or too many types");
+
+	int fd = shm_open (name.c_str (), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if (fd < 0 && errno == EEXIST) {
+		_created = false;
+		fd = shm_open (name.c_str (), O_RDWR, 0600);
+	}
+
+	if (fd < 0)
+		fail (std::string ("cannot open: ") + strerror (errno));
+
+	if (_created) {
+		if (ftruncate (fd, _size) != 0)
+			fail (std::string ("cannot resize: ") + strerror (errno));
+	} else {
+		// The creator may not have resized it yet
+		struct stat status;
+		int attempts = 0;
+
+		while (fstat (fd, &status) == 0 && status.st_size == 0 && attempts++ < 1000)
+			std::this_thread::sleep_for (std::chrono::milliseconds (1));
+
+		if (std::size_t (status.st_size) != _size)
+			fail ("slot geometry differs from the other end");
+	}
+
+	void *memory = mmap (nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+
+	if (memory == MAP_FAILED)
+		fail (std::string ("cannot map: ") + strerror (errno));
+
+	_memory = static_cast<char *> (memory);
+
+	if (_created) {
+		_header = new (_memory) Header;
+		memcpy (_header->magic, SHM_RING_MAGIC, sizeof (SHM_RING_MAGIC));
+		_header->version = SHM_RING_VERSION;
+		_header->slotSize = slotSize;
+		_header->slotsCount = slotsCount;
+		memset (_header->types, 0, TYPES_CAPACITY);
+		memcpy (_header->types, types.data (), types.size ());
+		_header->head.store (0, std::memory_order_relaxed);
+		_header->tail.store (0, std::memory_order_relaxed);
+		_header->state.store (writer ? STATE_READY : STATE_WAITING, std::memory_order_release);
+	} else {
+		_header = reinterpret_cast<Header *> (_memory);
+
+		int attempts = 0;
+
+		while (_header->state.load (std::memory_order_acquire) == STATE_INIT && attempts++ < 1000)
+			std::this_thread::sleep_for (std::chrono::milliseconds (1));
+
+		if (memcmp (_header->magic, SHM_RING_MAGIC, sizeof (SHM_RING_MAGIC)) != 0 || _header->version != SHM_RING_VERSION)
+			fail ("not a ring of this version");
+
+		if (_header->slotSize != slotSize || _header->slotsCount != slotsCount)
+			fail ("slot geometry differs from the other end");
+
+		if (types != _header->types) {
+			std::cout << "Type mismatch error on shared memory segment " << name << "\n";
+			std::cout << "Segment carries {" << demangleTypes (_header->types) << "}\n";
+			std::cout << "opened with types {" << demangleTypes (types) << "}" << std::endl;
+			std::abort ();
+		}
+
+		// A new writer reopens the segment left closed by the previous one
+		if (writer)
+			_header->state.store (STATE_READY, std::memory_order_release);
+	}
+}
+
+inline ShmRing::~ShmRing ()
+{
+	uint32_t waiting = STATE_WAITING;
+
+	if (_writer) {
+		_header->state.store (STATE_CLOSED, std::memory_order_release);
+		shm_unlink (_name.c_str ());
+	} else if (_created && _header->state.compare_exchange_strong (waiting, STATE_CLOSED, std::memory_order_acq_rel)) {
+		// Otherwise a writer attached, and removes the segment when closing it
+		shm_unlink (_name.c_str ());
+	}
+
+	munmap (_memory, _size);
+}
+
+inline void ShmRing::fail (const std::string &what) const
+{
+	std::cout << "Error: shared memory segment " << _name << ": " << what << "\nAborting" << std::endl;
+	std::abort ();
+}
+
+inline std::string ShmRing::demangleTypes (const std::string &types)
+{
+	std::string demangled;
+	std::size_t begin = 0, end;
+
+	while ((end = types.find (';', begin)) != std::string::npos) {
+		const std::string name = types.substr (begin, end - begin);
+		int status;
+		char *current = abi::__cxa_demangle (name.c_str (), NULL, NULL, &status);
+
+		demangled += (current != nullptr ? std::string (current) : name) + ", ";
+		free (current);
+		begin = end + 1;
+	}
+
+	return demangled;
+}
+
+inline char *ShmRing::beginWrite ()
+{
+	const uint64_t head = _header->head.load (std::memory_order_relaxed);
+
+	if (head - _header->tail.load (std::memory_order_acquire) >= _header->slotsCount)
+		return nullptr;
+
+	return slot (head) + sizeof (uint64_t);
+}
+
+inline void ShmRing::commitWrite (uint32_t size)
+{
+	const uint64_t head = _header->head.load (std::memory_order_relaxed);
+	const uint64_t slotSize = size;
+
+	memcpy (slot (head), &slotSize, sizeof (slotSize));
+	_header->head.store (head + 1, std::memory_order_release);
+}
+
+inline const char *ShmRing::beginRead (uint32_t &size)
+{
+	const uint64_t tail = _header->tail.load (std::memory_order_relaxed);
+
+	if (tail == _header->head.load (std::memory_order_acquire))
+		return nullptr;
+
+	uint64_t slotSize;
+
+	memcpy (&slotSize, slot (tail), sizeof (slotSize));
+	size = slotSize;
+
+	return slot (tail) + sizeof (uint64_t);
+}
+
+inline void ShmRing::commitRead ()
+{
+	_header->tail.store (_header->tail.load (std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Each value is stored as {size, bytes}, 8 bytes aligned
+inline std::size_t shmValueStride (std::size_t size) {
+	return sizeof (uint64_t) + ((size + 7) & ~std::size_t (7));
+}
+
+template<typename ...T>
+NlShmSinkBridge<T...>::NlShmSinkBridge (NlModFlow *modFlow, const std::string &name, const std::string &channel, const std::string &segment):
+	 NlModule (modFlow, name),
+	 _channelName(channel),
+	 _segment(segment),
+	 _dropped(0)
+{
+	bindParams (_params);
+}
+
+template<typename ...T>
+void NlShmSinkBridge<T...>::setupNetwork ()
+{
+	_ring = std::make_unique<ShmRing> (_segment, _params.slotSize, _params.slots, shmTypes<T...> (), true);
+	requestConnection (_channelName, &NlShmSinkBridge::onValue);
+}
+
+template<typename ...T>
+void NlShmSinkBridge<T...>::onValue (const T &...value)
+{
+	const std::size_t total = (shmValueStride (ShmCodec<T>::size (value)) + ... + 0);
+	char *data = _ring->beginWrite ();
+
+	if (data == nullptr || total > _ring->slotSize ()) {
+		_dropped.fetch_add (1, std::memory_order_relaxed);
+		return;
+	}
+
+	char *cursor = data;
+
+	([&cursor] (const auto &current) {
+		using Value = std::decay_t<decltype (current)>;
+		const uint64_t size = ShmCodec<Value>::size (current);
+
+		memcpy (cursor, &size, sizeof (size));
+		ShmCodec<Value>::write (current, cursor + sizeof (size));
+		cursor += shmValueStride (size);
+	} (value), ...);
+
+	_ring->commitWrite (total);
+}
+
+template<typename ...T>
+NlShmSourceBridge<T...>::NlShmSourceBridge (NlModFlow *modFlow, const std::string &name, const std::string &segment, const std::string &channel):
+	 NlModule (modFlow, name),
+	 _segment(segment),
+	 _channelName(channel),
+	 _stop(false),
+	 _invalid(0)
+{
+	bindParams (_params);
+}
+
+template<typename ...T>
+NlShmSourceBridge<T...>::~NlShmSourceBridge () {
+	stop ();
+}
+
+template<typename ...T>
+void NlShmSourceBridge<T...>::setupNetwork ()
+{
+	if (!executorEnabled ()) {
+		std::cout << "Error: shared memory source " << name () << " requires the executor (mod_flow/executor/threads)\nAborting" << std::endl;
+		std::abort ();
+	}
+
+	_output = createChannel<T...> (_channelName);
+	_ring = std::make_unique<ShmRing> (_segment, _params.slotSize, _params.slots, shmTypes<T...> (), false);
+}
+
+template<typename ...T>
+void NlShmSourceBridge<T...>::onNetworkReady () {
+	_thread = std::thread (&NlShmSourceBridge::run, this);
+}
+
+template<typename ...T>
+void NlShmSourceBridge<T...>::onNetworkStop () {
+	stop ();
+}
+
+template<typename ...T>
+void NlShmSourceBridge<T...>::stop ()
+{
+	_stop = true;
+
+	if (_thread.joinable ())
+		_thread.join ();
+}
+
+template<typename ...T>
+template<std::size_t ...I>
+bool NlShmSourceBridge<T...>::decode (const char *data, uint32_t size, std::index_sequence<I...>)
+{
+	const char *cursor = data;
+	const char *const end = data + size;
+
+	auto read = [&cursor, end] (auto &value) {
+		using Value = std::decay_t<decltype (value)>;
+		uint64_t valueSize;
+
+		if (cursor + sizeof (valueSize) > end)
+			return false;
+
+		memcpy (&valueSize, cursor, sizeof (valueSize));
+
+		if (valueSize > std::size_t (end - cursor) - sizeof (valueSize) ||
+			!ShmCodec<Value>::read (cursor + sizeof (valueSize), valueSize, value))
+			return false;
+
+		cursor += shmValueStride (valueSize);
+		return true;
+	};
+
+	return (read (std::get<I> (_values)) && ...);
+}
+
+template<typename ...T>
+void NlShmSourceBridge<T...>::run ()
+{
+	while (!_stop.load (std::memory_order_relaxed)) {
+		uint32_t size;
+		const char *data = _ring->beginRead (size);
+
+		if (data == nullptr) {
+			// A stopped writer leaves the segment: wait for the next one on a new segment
+			if (_ring->closed ())
+				_ring = std::make_unique<ShmRing> (_segment, _params.slotSize, _params.slots, shmTypes<T...> (), false);
+
+			std::this_thread::sleep_for (std::chrono::microseconds (_params.pollUs));
+			continue;
+		}
+
+		const bool valid = decode (data, size, std::index_sequence_for<T...> ());
+
+		// The slot is released before emitting, so that the writer is not held by the cascade
+		_ring->commitRead ();
+
+		if (!valid) {
+			_invalid.fetch_add (1, std::memory_order_relaxed);
+			continue;
+		}
+
+		std::apply ([this] (const T &...value) {
+			emit (_output, value...);
+		}, _values);
+	}
+}
+
+}
+
+#endif // NL_SHM_BRIDGE_H
@@ -0,0 +1,281 @@
+#ifndef NL_STATS_H
+#define NL_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * @file nl_stats.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/**
+ * @brief Summary of a @ref LatencyHistogram. Times in nanoseconds.
+ * @ingroup modflow
+ */
+struct LatencySummary
+{
+	uint64_t count;
+	double mean;
+	uint64_t min;
+	uint64_t max;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+};
+
+/**
+ * @brief Lock-free HDR-style histogram of latencies in nanoseconds.
+ * Buckets are logarithmic with 32 linear sub-buckets each, so that any value is reported with a relative error
+ * below 3%, from 1 ns up to about 18 minutes. Recording is wait-free and can be done from any thread.
+ * @ingroup modflow
+ */
+class LatencyHistogram
+{
+	static constexpr int SUB_BUCKET_BITS = 5;
+	static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	// Values are clamped to 2^40 ns
+	static constexpr int MAX_BITS = 40;
+	static constexpr std::size_t BUCKETS = SUB_BUCKETS * (MAX_BITS - SUB_BUCKET_BITS + 1);
+
+public:
+	LatencyHistogram ();
+	LatencyHistogram (const LatencyHistogram &) = delete;
+	LatencyHistogram &operator = (const LatencyHistogram &) = delete;
+
+	void record (uint64_t nanoseconds);
+
+	/**
+	 * @brief Value below which @p quantile of the recorded values are
+	 * @param quantile Between 0 and 1
+	 * @return Center of the bucket containing the quantile, 0 if empty
+	 */
+	uint64_t percentile (double quantile) const;
+
+	LatencySummary summary () const;
+
+	/// @brief Add the values recorded by @p other, e.g. to aggregate histograms of different threads
+	void merge (const LatencyHistogram &other);
+
+	uint64_t count () const {
+		return _count.load (std::memory_order_relaxed);
+	}
+
+private:
+	static std::size_t bucket (uint64_t value);
+	static uint64_t bucketCenter (std::size_t index);
+	uint64_t percentile (double quantile, uint64_t count) const;
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKETS> _buckets;
+	std::atomic<uint64_t> _count;
+	std::atomic<uint64_t> _sum;
+	std::atomic<uint64_t> _min;
+	std::atomic<uint64_t> _max;
+};
+
+/**
+ * @brief Measure a scope and record it in a histogram on destruction. Does nothing if the histogram is null.
+ * @ingroup modflow
+ */
+class LatencySpan
+{
+public:
+	LatencySpan (LatencyHistogram *histogram);
+	LatencySpan (const LatencySpan &) = delete;
+	LatencySpan &operator = (const LatencySpan &) = delete;
+	~LatencySpan ();
+
+	/// @brief Current time in nanoseconds on the steady clock
+	static uint64_t now ();
+
+private:
+	LatencyHistogram *const _histogram;
+	uint64_t _start;
+};
+
+/**
+ * @brief Statistics of a connection (see @ref NlModFlow::stats)
+ * @ingroup modflow
+ */
+struct SlotStats
+{
+	std::string channel;
+	std::string slot;
+	std::string module;
+	/// @brief Duration of the slot calls
+	LatencySummary latency;
+};
+
+/**
+ * @brief Statistics of a channel (see @ref NlModFlow::stats)
+ * @ingroup modflow
+ */
+struct ChannelStats
+{
+	std::string name;
+	uint64_t emits;
+	/// @brief For source channels, time from the emit on this channel to the emits on sink channels in the cascades it started
+	LatencySummary endToEnd;
+};
+
+/**
+ * @brief Snapshot of the statistics of a ModFlow graph
+ * @ingroup modflow
+ */
+struct ModFlowStats
+{
+	std::vector<ChannelStats> channels;
+	std::vector<SlotStats> slots;
+};
+
+/**
+ * @brief Counters of a channel and histograms of its connections, updated live by @ref NlModFlow. For internal use.
+ * @ingroup modflow
+ */
+struct ChannelCounters
+{
+	ChannelCounters ():
+		 emits(0)
+	{}
+
+	std::atomic<uint64_t> emits;
+	LatencyHistogram endToEnd;
+	// deque does not move histograms while connections are added
+	std::deque<LatencyHistogram> slots;
+};
+
+inline LatencyHistogram::LatencyHistogram ():
+	 _count(0),
+	 _sum(0),
+	 _min(UINT64_MAX),
+	 _max(0)
+{
+	for (std::atomic<uint64_t> &bucket : _buckets)
+		bucket.store (0, std::memory_order_relaxed);
+}
+
+inline std::size_t LatencyHistogram::bucket (uint64_t value)
+{
+	value = std::min<uint64_t> (value, (uint64_t (1) << MAX_BITS) - 1);
+
+	if (value < SUB_BUCKETS)
+		return value;
+
+	// Keep the SUB_BUCKET_BITS + 1 most significant bits: the first one is implicit in the shift
+	const int shift = 63 - __builtin_clzll (value) - SUB_BUCKET_BITS;
+
+	return SUB_BUCKETS * (shift + 1) + (value >> shift) - SUB_BUCKETS;
+}
+
+inline uint64_t LatencyHistogram::bucketCenter (std::size_t index)
+{
+	if (index < SUB_BUCKETS)
+		return index;
+
+	const int shift = index / SUB_BUCKETS - 1;
+	const uint64_t lower = (index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+
+	return lower + (uint64_t (1) << shift) / 2;
+}
+
+inline void LatencyHistogram::record (uint64_t nanoseconds)
+{
+	_buckets[bucket (nanoseconds)].fetch_add (1, std::memory_order_relaxed);
+	_count.fetch_add (1, std::memory_order_relaxed);
+	_sum.fetch_add (nanoseconds, std::memory_order_relaxed);
+
+	uint64_t current = _min.load (std::memory_order_relaxed);
+	while (nanoseconds < current && !_min.compare_exchange_weak (current, nanoseconds, std::memory_order_relaxed));
+
+	current = _max.load (std::memory_order_relaxed);
+	while (nanoseconds > current && !_max.compare_exchange_weak (current, nanoseconds, std::memory_order_relaxed));
+}
+
+inline uint64_t LatencyHistogram::percentile (double quantile, uint64_t count) const
+{
+	if (count == 0)
+		return 0;
+
+	// Rank of the quantile, at least the first value
+	const uint64_t rank = std::max<uint64_t> (1, std::ceil (quantile * count));
+	uint64_t seen = 0;
+
+	for (std::size_t i = 0; i < BUCKETS; i++) {
+		seen += _buckets[i].load (std::memory_order_relaxed);
+
+		if (seen >= rank)
+			return bucketCenter (i);
+	}
+
+	// Values recorded while reading
+	return _max.load (std::memory_order_relaxed);
+}
+
+inline uint64_t LatencyHistogram::percentile (double quantile) const {
+	return percentile (quantile, count ());
+}
+
+inline LatencySummary LatencyHistogram::summary () const
+{
+	// Counters are read one by one while other threads record, so the snapshot is approximate
+	const uint64_t count = this->count ();
+
+	if (count == 0)
+		return LatencySummary{0, 0, 0, 0, 0, 0, 0, 0};
+
+	return LatencySummary{count,
+					  double (_sum.load (std::memory_order_relaxed)) / count,
+					  _min.load (std::memory_order_relaxed),
+					  _max.load (std::memory_order_relaxed),
+					  percentile (0.5, count),
+					  percentile (0.9, count),
+					  percentile (0.99, count),
+					  percentile (0.999, count)};
+}
+
+inline void LatencyHistogram::merge (const LatencyHistogram &other)
+{
+	for (std::size_t i = 0; i < BUCKETS; i++)
+		_buckets[i].fetch_add (other._buckets[i].load (std::memory_order_relaxed), std::memory_order_relaxed);
+
+	_count.fetch_add (other._count.load (std::memory_order_relaxed), std::memory_order_relaxed);
+	_sum.fetch_add (other._sum.load (std::memory_order_relaxed), std::memory_order_relaxed);
+
+	const uint64_t otherMin = other._min.load (std::memory_order_relaxed);
+	const uint64_t otherMax = other._max.load (std::memory_order_relaxed);
+	uint64_t current = _min.load (std::memory_order_relaxed);
+	while (otherMin < current && !_min.compare_exchange_weak (current, otherMin, std::memory_order_relaxed));
+
+	current = _max.load (std::memory_order_relaxed);
+	while (otherMax > current && !_max.compare_exchange_weak (current, otherMax, std::memory_order_relaxed));
+}
+
+inline uint64_t LatencySpan::now () {
+	return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+inline LatencySpan::LatencySpan (LatencyHistogram *histogram):
+	 _histogram(histogram),
+	 _start(histogram == nullptr ? 0 : now ())
+{}
+
+inline LatencySpan::~LatencySpan ()
+{
+	if (_histogram != nullptr)
+		_histogram->record (now () - _start);
+}
+
+}
+
+#endif // NL_STATS_H
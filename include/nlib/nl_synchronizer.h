@@ -0,0 +1,195 @@
+#ifndef NL_SYNCHRONIZER_H
+#define NL_SYNCHRONIZER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <tuple>
+#include <utility>
+#include "nl_modflow.h"
+
+/**
+ * @file nl_synchronizer.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/**
+ * @brief Module emitting together the inputs of @p N channels that belong to the same time.
+ * Each input channel carries a TimedObject<T, Clock, Duration>. The inputs are buffered per channel, in time order,
+ * and as soon as every channel has one within @c tolerance of the others, the set is emitted on the output channel,
+ * of type TimedObject<T, Clock, Duration>..., and removed. Buffered inputs that can no longer be matched are dropped.
+ *
+ * Params, in the subtree of the module name:
+ * - @c tolerance Maximum time span of an emitted set, in seconds. 0 for exact matches. Default 0
+ * - @c queue_size Maximum number of inputs buffered per channel, older ones are dropped. Default 10
+ * @ingroup modflow
+ */
+template<class Clock, class Duration, typename ...T>
+class NlSynchronizer : public NlModule
+{
+	static constexpr std::size_t N = sizeof... (T);
+
+	template<std::size_t I>
+	using Input = TimedObject<std::tuple_element_t<I, std::tuple<T...>>, Clock, Duration>;
+	using Time = std::chrono::time_point<Clock, Duration>;
+
+	struct Params {
+		double tolerance;
+		int queueSize;
+
+		static auto fields () {
+			return std::make_tuple (paramField ("tolerance", &Params::tolerance, 0.),
+							    paramField ("queue_size", &Params::queueSize, 10));
+		}
+	};
+
+public:
+	/**
+	 * @param inputs Names of the input channels, in the order of the output values
+	 * @param output Name of the output channel, created by the synchronizer
+	 */
+	NlSynchronizer (NlModFlow *modFlow,
+				 const std::string &name,
+				 const std::array<std::string, N> &inputs,
+				 const std::string &output);
+
+	void setupNetwork () override;
+
+	/// @brief Number of inputs dropped because unmatched, out of order or out of the queue
+	uint64_t dropped () const {
+		return _dropped;
+	}
+
+	DEF_SHARED (NlSynchronizer)
+
+private:
+	template<std::size_t I>
+	void onInput (const Input<I> &input);
+
+	template<std::size_t ...I>
+	void connect (std::index_sequence<I...>);
+
+	// Emit as many sets as the buffers allow
+	template<std::size_t ...I>
+	void match (std::index_sequence<I...>);
+
+	template<std::size_t I>
+	void pop ();
+
+private:
+	Params _params;
+	const std::array<std::string, N> _inputNames;
+	const std::string _outputName;
+	TypedChannel<TimedObject<T, Clock, Duration>...> _output;
+	std::tuple<std::deque<TimedObject<T, Clock, Duration>>...> _buffers;
+	// Channels with buffered inputs
+	ReadyMask<N> _ready;
+	uint64_t _dropped;
+};
+
+template<class Clock, class Duration, typename ...T>
+NlSynchronizer<Clock, Duration, T...>::NlSynchronizer (NlModFlow *modFlow,
+											  const std::string &name,
+											  const std::array<std::string, N> &inputs,
+											  const std::string &output):
+	 NlModule (modFlow, name),
+	 _inputNames(inputs),
+	 _outputName(output),
+	 _dropped(0)
+{
+	bindParams (_params);
+}
+
+template<class Clock, class Duration, typename ...T>
+void NlSynchronizer<Clock, Duration, T...>::setupNetwork ()
+{
+	_output = createChannel<TimedObject<T, Clock, Duration>...> (_outputName);
+	connect (std::index_sequence_for<T...> ());
+}
+
+template<class Clock, class Duration, typename ...T>
+template<std::size_t ...I>
+void NlSynchronizer<Clock, Duration, T...>::connect (std::index_sequence<I...>) {
+	(requestConnection (_inputNames[I], &NlSynchronizer::onInput<I>), ...);
+}
+
+template<class Clock, class Duration, typename ...T>
+template<std::size_t I>
+void NlSynchronizer<Clock, Duration, T...>::onInput (const Input<I> &input)
+{
+	auto &buffer = std::get<I> (_buffers);
+
+	if (!buffer.empty () && input.time () < buffer.back ().time ()) {
+		_dropped++;
+		return;
+	}
+
+	buffer.push_back (input);
+
+	if (buffer.size () > std::size_t (std::max (_params.queueSize, 1))) {
+		buffer.pop_front ();
+		_dropped++;
+	}
+
+	_ready.set (I);
+
+	if (_ready.all ())
+		match (std::index_sequence_for<T...> ());
+}
+
+template<class Clock, class Duration, typename ...T>
+template<std::size_t I>
+void NlSynchronizer<Clock, Duration, T...>::pop ()
+{
+	auto &buffer = std::get<I> (_buffers);
+
+	buffer.pop_front ();
+
+	if (buffer.empty ())
+		_ready.reset (I);
+}
+
+template<class Clock, class Duration, typename ...T>
+template<std::size_t ...I>
+void NlSynchronizer<Clock, Duration, T...>::match (std::index_sequence<I...>)
+{
+	const Duration tolerance = std::chrono::duration_cast<Duration> (std::chrono::duration<double> (_params.tolerance));
+	auto distance = [] (const Time &a, const Time &b) {
+		return a > b ? a - b : b - a;
+	};
+
+	while (_ready.all ()) {
+		// The latest first input bounds the set: move every channel to its input closest to it
+		const Time pivot = std::max ({std::get<I> (_buffers).front ().time ()...});
+
+		([&] {
+			auto &buffer = std::get<I> (_buffers);
+
+			while (buffer.size () > 1 && distance (buffer[1].time (), pivot) < distance (buffer[0].time (), pivot)) {
+				buffer.pop_front ();
+				_dropped++;
+			}
+		} (), ...);
+
+		const std::array<Time, N> times{std::get<I> (_buffers).front ().time ()...};
+		const auto [earliest, latest] = std::minmax_element (times.begin (), times.end ());
+
+		if (*latest - *earliest <= tolerance) {
+			emit (_output, std::get<I> (_buffers).front ()...);
+			(pop<I> (), ...);
+		} else {
+			// Every other channel is later than it can be matched with
+			const std::size_t oldest = std::distance (times.begin (), earliest);
+
+			((I == oldest ? pop<I> () : void ()), ...);
+			_dropped++;
+		}
+	}
+}
+
+}
+
+#endif // NL_SYNCHRONIZER_H
@@ -2,6 +2,8 @@
 #define TIMESERIES_H
 
 #include <chrono>
+#include <algorithm>
+#include <array>
 #include <deque>
 #include <type_traits>
 #include <vector>
@@ -9,6 +11,10 @@
 #include <optional>
 #include "nl_utils.h"
 
+#ifdef INCLUDE_EIGEN
+#include <eigen3/Eigen/Geometry>
+#endif
+
 namespace nlib {
 
 template<class T, class Duration = std::chrono::milliseconds>
@@ -84,17 +90,269 @@ std::ostream &operator << (std::ostream & os, const DelayedObject<T, Duration> &
 	return os;
 }
 
-template<typename T, typename Duration = std::chrono::microseconds, typename Clock = std::chrono::system_clock>
-class Timeseries
+/**
+ * @brief Contiguous circular buffer. Appending and removing at both ends is O(1), amortized when the buffer grows.
+ * @tparam T Element type
+ */
+template<typename T>
+class RingBuffer
+{
+	template<bool Const>
+	class Iterator
+	{
+		using Buffer = std::conditional_t<Const, const RingBuffer, RingBuffer>;
+
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = std::conditional_t<Const, const T *, T *>;
+		using reference = std::conditional_t<Const, const T &, T &>;
+
+		Iterator ():
+			 _buffer(nullptr),
+			 _index(0)
+		{}
+
+		Iterator (Buffer *buffer, std::size_t index):
+			 _buffer(buffer),
+			 _index(index)
+		{}
+
+		// Mutable iterators convert to const ones
+		template<bool C = Const, typename = std::enable_if_t<!C>>
+		operator Iterator<true> () const { return Iterator<true> (_buffer, _index); }
+
+		reference operator * () const { return (*_buffer)[_index]; }
+		pointer operator -> () const { return &(*_buffer)[_index]; }
+		reference operator [] (difference_type n) const { return (*_buffer)[_index + n]; }
+
+		Iterator &operator ++ () { _index++; return *this; }
+		Iterator &operator -- () { _index--; return *this; }
+		Iterator operator ++ (int) { Iterator old = *this; _index++; return old; }
+		Iterator operator -- (int) { Iterator old = *this; _index--; return old; }
+		Iterator &operator += (difference_type n) { _index += n; return *this; }
+		Iterator &operator -= (difference_type n) { _index -= n; return *this; }
+		Iterator operator + (difference_type n) const { return Iterator (_buffer, _index + n); }
+		Iterator operator - (difference_type n) const { return Iterator (_buffer, _index - n); }
+		friend Iterator operator + (difference_type n, const Iterator &it) { return it + n; }
+		difference_type operator - (const Iterator &other) const { return difference_type (_index) - difference_type (other._index); }
+
+		bool operator == (const Iterator &other) const { return _index == other._index; }
+		bool operator != (const Iterator &other) const { return _index != other._index; }
+		bool operator < (const Iterator &other) const { return _index < other._index; }
+		bool operator > (const Iterator &other) const { return _index > other._index; }
+		bool operator <= (const Iterator &other) const { return _index <= other._index; }
+		bool operator >= (const Iterator &other) const { return _index >= other._index; }
+
+	private:
+		Buffer *_buffer;
+		std::size_t _index;
+	};
+
+public:
+	using value_type = T;
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+
+	RingBuffer (std::size_t capacity = 0):
+		 _data(capacity),
+		 _head(0),
+		 _size(0)
+	{}
+
+	/// @brief Append @p value, doubling the capacity if the buffer is full
+	void push_back (const T &value) {
+		if (_size == _data.size ())
+			reserve (std::max<std::size_t> (2 * _data.size (), 8));
+
+		_data[physical (_size)] = value;
+		_size++;
+	}
+
+	void pop_front () {
+		_data[_head] = T ();
+		_head = physical (1);
+		_size--;
+	}
+
+	void pop_back () {
+		_data[physical (_size - 1)] = T ();
+		_size--;
+	}
+
+	void clear () {
+		while (!empty ())
+			pop_back ();
+		_head = 0;
+	}
+
+	/// @brief Grow the storage to @p capacity elements, moving the elements to the front
+	void reserve (std::size_t capacity)
+	{
+		if (capacity <= _data.size ())
+			return;
+
+		std::vector<T> data(capacity);
+
+		for (std::size_t i = 0; i < _size; i++)
+			data[i] = std::move ((*this)[i]);
+
+		_data.swap (data);
+		_head = 0;
+	}
+
+	T &operator [] (std::size_t i) { return _data[physical (i)]; }
+	const T &operator [] (std::size_t i) const { return _data[physical (i)]; }
+
+	T &front () { return (*this)[0]; }
+	const T &front () const { return (*this)[0]; }
+	T &back () { return (*this)[_size - 1]; }
+	const T &back () const { return (*this)[_size - 1]; }
+
+	std::size_t size () const { return _size; }
+	bool empty () const { return _size == 0; }
+	std::size_t capacity () const { return _data.size (); }
+
+	iterator begin () { return iterator (this, 0); }
+	iterator end () { return iterator (this, _size); }
+	const_iterator begin () const { return const_iterator (this, 0); }
+	const_iterator end () const { return const_iterator (this, _size); }
+
+private:
+	std::size_t physical (std::size_t i) const {
+		const std::size_t index = _head + i;
+
+		return index >= _data.size () ? index - _data.size () : index;
+	}
+
+private:
+	std::vector<T> _data;
+	std::size_t _head;
+	std::size_t _size;
+};
+
+/**
+ * @brief Scalar type of the interpolation coefficients of @p T: its @c Scalar type if any, as for Eigen types,
+ * double otherwise
+ */
+template<typename T, typename = void>
+struct InterpolationScalar {
+	using type = double;
+};
+
+template<typename T>
+struct InterpolationScalar<T, std::void_t<typename T::Scalar>> {
+	using type = typename T::Scalar;
+};
+
+/**
+ * @brief Interpolation policies of the timeseries containers.
+ * A policy uses @c SUPPORT samples on each side of the query time. Policies with support 1 provide
+ * @c interpolate (first, second, lambda), with @c lambda in [0, 1] the position of the query between the two samples.
+ */
+struct LinearInterpolation
+{
+	static constexpr std::size_t SUPPORT = 1;
+
+	template<typename T, typename Scalar>
+	static T interpolate (const T &first, const T &second, Scalar lambda) {
+		return T(first + lambda * (second - first));
+	}
+};
+
+/// @brief Value of the closest sample
+struct NearestInterpolation
+{
+	static constexpr std::size_t SUPPORT = 1;
+
+	template<typename T, typename Scalar>
+	static T interpolate (const T &first, const T &second, Scalar lambda) {
+		return lambda < Scalar(0.5) ? first : second;
+	}
+};
+
+/// @brief Value of the last sample not after the query time
+struct ZeroOrderHoldInterpolation
+{
+	static constexpr std::size_t SUPPORT = 1;
+
+	template<typename T, typename Scalar>
+	static T interpolate (const T &first, const T &second, Scalar lambda) {
+		return lambda < Scalar(1) ? first : second;
+	}
+};
+
+#ifdef INCLUDE_EIGEN
+/**
+ * @brief Spherical linear interpolation of rotations: Eigen quaternions and, for rigid transforms,
+ * slerp of the rotation part with linear interpolation of the translation
+ */
+struct SlerpInterpolation
+{
+	static constexpr std::size_t SUPPORT = 1;
+
+	template<typename T, typename Scalar>
+	static T interpolate (const T &first, const T &second, Scalar lambda) {
+		return first.slerp (lambda, second);
+	}
+
+	template<typename TransformScalar, int Mode, int Options, typename Scalar>
+	static Eigen::Transform<TransformScalar, 3, Mode, Options> interpolate (const Eigen::Transform<TransformScalar, 3, Mode, Options> &first,
+															  const Eigen::Transform<TransformScalar, 3, Mode, Options> &second,
+															  Scalar lambda)
+	{
+		const Eigen::Quaternion<TransformScalar> firstRotation(first.rotation ());
+		const Eigen::Quaternion<TransformScalar> secondRotation(second.rotation ());
+		Eigen::Transform<TransformScalar, 3, Mode, Options> result = Eigen::Transform<TransformScalar, 3, Mode, Options>::Identity ();
+
+		result.linear () = firstRotation.slerp (lambda, secondRotation).toRotationMatrix ();
+		result.translation () = first.translation () + lambda * (second.translation () - first.translation ());
+
+		return result;
+	}
+};
+#endif
+
+/**
+ * @brief Cubic Hermite interpolation with Catmull-Rom tangents, scaled for non-uniform sampling.
+ * At the ends of the timeseries the missing sample is replaced by the last one.
+ */
+struct CubicInterpolation
+{
+	static constexpr std::size_t SUPPORT = 2;
+
+	/**
+	 * @param previousWeight Duration of the interval over the duration from @p previous to @p second
+	 * @param nextWeight Duration of the interval over the duration from @p first to @p next
+	 */
+	template<typename T, typename Scalar>
+	static T interpolate (const T &previous, const T &first, const T &second, const T &next,
+					  Scalar lambda, Scalar previousWeight, Scalar nextWeight)
+	{
+		const Scalar lambda2 = lambda * lambda;
+		const Scalar lambda3 = lambda2 * lambda;
+		const T firstTangent = T(previousWeight * (second - previous));
+		const T secondTangent = T(nextWeight * (next - first));
+
+		return T((2 * lambda3 - 3 * lambda2 + 1) * first + (lambda3 - 2 * lambda2 + lambda) * firstTangent +
+			    (-2 * lambda3 + 3 * lambda2) * second + (lambda3 - lambda2) * secondTangent);
+	}
+};
+
+/**
+ * @brief Queries shared by the timeseries containers.
+ * @p Derived provides its sorted samples through @c size (), @c delayAt (i) and @c valueAt (i).
+ */
+template<class Derived, typename T, typename Duration, typename Clock, typename Interpolation>
+class TimeseriesBase
 {
 public:
 	using Sample = DelayedObject<T, Duration>;
 	using Time = std::chrono::time_point<Clock, Duration>;
-	using DataType = std::vector<Sample>;
 	using Precision = Duration;
-	using iterator = typename DataType::iterator;
-	using const_iterator = typename DataType::const_iterator;
 	using Neighbors = std::pair<std::optional<Sample>, std::optional<Sample>>;
+	using Scalar = typename InterpolationScalar<T>::type;
 
 	enum class ResultStatus {
 		SUCCESS,
@@ -110,33 +368,19 @@ public:
 
 	using Result = nlib::AlgorithmResult<T, ResultStatus, statusStrings>;
 
-
-	iterator begin () { return _timeseries.begin (); }
-	iterator end () { return _timeseries.end (); }
-
-	const_iterator begin () const { return _timeseries.begin (); }
-	const_iterator end () const { return _timeseries.end (); }
+	/**
+	 * @brief Position hint for queries at increasing times. Any cursor gives correct results,
+	 * a close one makes the search cost logarithmic in the distance from the previous query instead of in the size.
+	 */
+	struct Cursor {
+		std::size_t index = 0;
+	};
 
 	template<typename OtherTime>
 	void setStartTime (const OtherTime &startTime) {
 		_startTime = std::chrono::time_point_cast<Duration> (startTime);
 	}
 
-	const Sample &operator[] (int i) const {
-		return i >= 0 ? _timeseries[i] :
-				   *prev (_timeseries.end (), -i);
-	}
-
-	Sample &operator[] (int i) {
-		return i >= 0 ? _timeseries[i] :
-				   *prev (_timeseries.end (), -i);
-	}
-
-	void add (const Sample &x) {
-		_timeseries.push_back (x);
-	}
-
-
 	Result operator () (const Duration &t) 	{
 		return at (t);
 	}
@@ -145,14 +389,6 @@ public:
 		return at(t);
 	}
 
-	Duration totalDuration () {
-		return _timeseries.back ().delay ();
-	}
-
-	int size () const {
-		return _timeseries.size ();
-	}
-
 	template<typename OtherTime>
 	Result at (const OtherTime &t) const {
 		if (!_startTime.has_value ())
@@ -184,38 +420,449 @@ public:
 
 	Result at (const Duration &t) const
 	{
-		auto [before, after] = neighbors (t);
+		const std::size_t closest = lowerBound (t, 0, samples ());
 
-		if (!before.has_value () || !after.has_value ()) {
+		if (closest == 0 || closest == samples ()) {
 			// Supplied time out of the timeseries limits
 			return ResultStatus::TIME_OUT_OF_BOUNDS;
 		}
 
-		return interpolation (*before, *after, t);
+		return interpolation (closest, t);
 	}
 
-private:
-	T interpolation (const Sample &first, const Sample &second, const Duration &t) const {
-		float lambda = (t - first.delay()).count () / (float) (second.delay () - first.delay()).count ();
+	/// @brief Interpolate at @p t starting the search from @p cursor, which is moved to the result position
+	Result at (const Duration &t, Cursor &cursor) const
+	{
+		const std::size_t closest = seek (t, cursor.index);
 
-		T diff = second.obj () - first.obj ();
+		cursor.index = closest;
 
-		return first.obj () + lambda * diff;
+		if (closest == 0 || closest == samples ())
+			return ResultStatus::TIME_OUT_OF_BOUNDS;
+
+		return interpolation (closest, t);
 	}
 
-	Neighbors neighbors (const Duration &t) const {
-		auto closest = std::lower_bound (_timeseries.begin (), _timeseries.end (), t);
+	template<typename OtherTime>
+	Result at (const OtherTime &t, Cursor &cursor) const {
+		if (!_startTime.has_value ())
+			return ResultStatus::NO_START_TIME;
+
+		return at (elapsed (t), cursor);
+	}
+
+	/**
+	 * @brief Interpolate at @p count times. Consecutive queries start the search from the previous result, so sorted
+	 * times are resolved with a linear merge of queries and samples. Unsorted times are still supported, at the cost of a binary search.
+	 * @param times Query times
+	 * @param values Output array of @p count values. Those out of the timeseries limits are left untouched.
+	 * @param status Output array of @p count results
+	 */
+	void at (const Duration *times, std::size_t count, T *values, ResultStatus *status) const;
+
+	/// @brief Interpolate at @p times, setting @p status of each query
+	std::vector<T> at (const std::vector<Duration> &times, std::vector<ResultStatus> &status) const
+	{
+		std::vector<T> values(times.size ());
+
+		status.resize (times.size ());
+		at (times.data (), times.size (), values.data (), status.data ());
+
+		return values;
+	}
+
+protected:
+	const Derived &derived () const { return static_cast<const Derived &> (*this); }
+
+	std::size_t samples () const { return derived ().size (); }
+
+	// Ratio of durations computed in double: float loses precision with fine durations over long runs
+	static Scalar ratio (const Duration &numerator, const Duration &denominator) {
+		return Scalar(double (numerator.count ()) / double (denominator.count ()));
+	}
+
+	// Interpolate at t between the samples closest - 1 and closest
+	T interpolation (std::size_t closest, const Duration &t) const
+	{
+		const Derived &data = derived ();
+		const Duration &before = data.delayAt (closest - 1);
+		const Duration &after = data.delayAt (closest);
+		const Scalar lambda = ratio (t - before, after - before);
+
+		if constexpr (Interpolation::SUPPORT == 1)
+			return Interpolation::interpolate (data.valueAt (closest - 1), data.valueAt (closest), lambda);
+		else {
+			const std::size_t previous = closest > 1 ? closest - 2 : closest - 1;
+			const std::size_t next = closest + 1 < samples () ? closest + 1 : closest;
+
+			return Interpolation::interpolate (data.valueAt (previous), data.valueAt (closest - 1),
+										data.valueAt (closest), data.valueAt (next), lambda,
+										ratio (after - before, after - data.delayAt (previous)),
+										ratio (after - before, data.delayAt (next) - before));
+		}
+	}
+
+	// Index of the first sample in [first, last) not before t
+	std::size_t lowerBound (const Duration &t, std::size_t first, std::size_t last) const
+	{
+		while (first < last) {
+			const std::size_t middle = first + (last - first) / 2;
+
+			if (derived ().delayAt (middle) < t)
+				first = middle + 1;
+			else
+				last = middle;
+		}
+
+		return first;
+	}
+
+	// Index of the first sample not before t, galloping from hint
+	std::size_t seek (const Duration &t, std::size_t hint) const
+	{
+		const std::size_t size = samples ();
+
+		hint = std::min (hint, size);
+
+		if (hint > 0 && !(derived ().delayAt (hint - 1) < t))
+			return lowerBound (t, 0, hint);
+
+		std::size_t bound = 1;
+
+		while (hint + bound < size && derived ().delayAt (hint + bound) < t)
+			bound *= 2;
+
+		return lowerBound (t, hint + bound / 2, std::min (hint + bound, size));
+	}
 
-		if (closest == _timeseries.begin ())
-			return {std::nullopt, *closest};
-		if (closest == _timeseries.end ())
-			return {*std::prev(closest), std::nullopt};
-		return {*std::prev(closest), *closest};
+	Sample sample (std::size_t i) const {
+		return Sample (derived ().delayAt (i), derived ().valueAt (i));
+	}
+
+	Neighbors neighbors (const Duration &t) const {
+		const std::size_t size = samples ();
+		const std::size_t closest = lowerBound (t, 0, size);
+
+		if (size == 0)
+			return {std::nullopt, std::nullopt};
+		if (closest == 0)
+			return {std::nullopt, sample (closest)};
+		if (closest == size)
+			return {sample (closest - 1), std::nullopt};
+		return {sample (closest - 1), sample (closest)};
 	}
 
 public:
 	std::optional<Time> _startTime;
+};
+
+template<class Derived, typename T, typename Duration, typename Clock, typename Interpolation>
+void TimeseriesBase<Derived, T, Duration, Clock, Interpolation>::at (const Duration *times, std::size_t count, T *values, ResultStatus *status) const
+{
+	// Queries are processed in blocks: the search collects the neighbors, then a separate loop interpolates them
+	constexpr std::size_t BLOCK = 64;
+	const Derived &data = derived ();
+	const std::size_t size = samples ();
+	std::size_t cursor = 0;
+
+	for (std::size_t offset = 0; offset < count; offset += BLOCK) {
+		const std::size_t block = std::min (BLOCK, count - offset);
+		std::array<std::size_t, BLOCK> query;
+		std::array<std::size_t, BLOCK> closest;
+		std::size_t found = 0;
+
+		for (std::size_t i = 0; i < block; i++) {
+			cursor = seek (times[offset + i], cursor);
+
+			if (cursor == 0 || cursor == size) {
+				status[offset + i] = ResultStatus::TIME_OUT_OF_BOUNDS;
+				continue;
+			}
+
+			status[offset + i] = ResultStatus::SUCCESS;
+			query[found] = offset + i;
+			closest[found] = cursor;
+			found++;
+		}
+
+		if constexpr (std::is_arithmetic<T>::value && Interpolation::SUPPORT == 1) {
+			// Contiguous operands, so that the interpolation loop is vectorized
+			std::array<T, BLOCK> first, second;
+			std::array<Scalar, BLOCK> lambda;
+
+			for (std::size_t j = 0; j < found; j++) {
+				const Duration &before = data.delayAt (closest[j] - 1);
+
+				first[j] = data.valueAt (closest[j] - 1);
+				second[j] = data.valueAt (closest[j]);
+				lambda[j] = ratio (times[query[j]] - before, data.delayAt (closest[j]) - before);
+			}
+
+			std::array<T, BLOCK> result;
+
+			for (std::size_t j = 0; j < found; j++)
+				result[j] = Interpolation::interpolate (first[j], second[j], lambda[j]);
+
+			for (std::size_t j = 0; j < found; j++)
+				values[query[j]] = result[j];
+		} else {
+			// Vectorized by the type itself, e.g. Eigen fixed size vectors
+			for (std::size_t j = 0; j < found; j++)
+				values[query[j]] = interpolation (closest[j], times[query[j]]);
+		}
+	}
+}
+
+template<typename T, typename Duration = std::chrono::microseconds, typename Clock = std::chrono::system_clock,
+		 typename Interpolation = LinearInterpolation>
+class Timeseries : public TimeseriesBase<Timeseries<T, Duration, Clock, Interpolation>, T, Duration, Clock, Interpolation>
+{
+	using Base = TimeseriesBase<Timeseries<T, Duration, Clock, Interpolation>, T, Duration, Clock, Interpolation>;
+	friend Base;
+
+public:
+	using typename Base::Sample;
+	using typename Base::Time;
+	using typename Base::Precision;
+	using typename Base::Neighbors;
+	using typename Base::ResultStatus;
+	using typename Base::Result;
+	using typename Base::Cursor;
+	using DataType = std::vector<Sample>;
+	using iterator = typename DataType::iterator;
+	using const_iterator = typename DataType::const_iterator;
+
+	iterator begin () { return _timeseries.begin (); }
+	iterator end () { return _timeseries.end (); }
+
+	const_iterator begin () const { return _timeseries.begin (); }
+	const_iterator end () const { return _timeseries.end (); }
+
+	const Sample &operator[] (int i) const {
+		return i >= 0 ? _timeseries[i] :
+				   *prev (_timeseries.end (), -i);
+	}
+
+	Sample &operator[] (int i) {
+		return i >= 0 ? _timeseries[i] :
+				   *prev (_timeseries.end (), -i);
+	}
+
+	void add (const Sample &x) {
+		_timeseries.push_back (x);
+	}
+
+	Duration totalDuration () {
+		return _timeseries.back ().delay ();
+	}
+
+	int size () const {
+		return _timeseries.size ();
+	}
+
+private:
+	const Duration &delayAt (std::size_t i) const { return _timeseries[i].delay (); }
+	const T &valueAt (std::size_t i) const { return _timeseries[i].obj (); }
+
+public:
+	DataType _timeseries;
+};
+
+/**
+ * @brief Streaming timeseries with bounded memory, stored in a contiguous @ref RingBuffer.
+ * Samples are evicted from the front when there are more than @c maxSize of them or when they are older than
+ * @c maxAge with respect to the newest sample. Appending is amortized O(1).
+ * Samples may arrive slightly out of order: a sample older than the newest one is inserted in its sorted position
+ * if it falls within the last @c reorderWindow samples, otherwise it is rejected, so that the samples stay sorted
+ * for the queries.
+ */
+template<typename T, typename Duration = std::chrono::microseconds, typename Clock = std::chrono::system_clock,
+		 typename Interpolation = LinearInterpolation>
+class BoundedTimeseries : public TimeseriesBase<BoundedTimeseries<T, Duration, Clock, Interpolation>, T, Duration, Clock, Interpolation>
+{
+	using Base = TimeseriesBase<BoundedTimeseries<T, Duration, Clock, Interpolation>, T, Duration, Clock, Interpolation>;
+	friend Base;
+
+public:
+	using typename Base::Sample;
+	using typename Base::Time;
+	using typename Base::Precision;
+	using typename Base::Neighbors;
+	using typename Base::ResultStatus;
+	using typename Base::Result;
+	using typename Base::Cursor;
+	using DataType = RingBuffer<Sample>;
+	using iterator = typename DataType::iterator;
+	using const_iterator = typename DataType::const_iterator;
+
+	/**
+	 * @param maxSize Maximum number of samples, 0 for no limit
+	 * @param maxAge Maximum delay of the oldest sample before the newest one, zero for no limit
+	 * @param reorderWindow Number of newest samples an out-of-order sample can be inserted among
+	 */
+	BoundedTimeseries (std::size_t maxSize = 0,
+				    const Duration &maxAge = Duration::zero (),
+				    std::size_t reorderWindow = 8):
+		 // A spare slot holds the sample added before the oldest one is evicted, so that the ring never grows
+		 _timeseries(maxSize > 0 ? maxSize + 1 : 0),
+		 _maxSize(maxSize),
+		 _maxAge(maxAge),
+		 _reorderWindow(reorderWindow),
+		 _rejected(0)
+	{}
+
+	iterator begin () { return _timeseries.begin (); }
+	iterator end () { return _timeseries.end (); }
+
+	const_iterator begin () const { return _timeseries.begin (); }
+	const_iterator end () const { return _timeseries.end (); }
+
+	const Sample &operator[] (int i) const {
+		return i >= 0 ? _timeseries[i] : _timeseries[_timeseries.size () + i];
+	}
+
+	Sample &operator[] (int i) {
+		return i >= 0 ? _timeseries[i] : _timeseries[_timeseries.size () + i];
+	}
+
+	/**
+	 * @brief Append @p x and evict the samples out of the limits
+	 * @return false if @p x is older than the reorder window and has been rejected
+	 */
+	bool add (const Sample &x)
+	{
+		if (!_timeseries.empty () && x.delay () < _timeseries.back ().delay ()) {
+			if (!insertOutOfOrder (x))
+				return false;
+		} else
+			_timeseries.push_back (x);
+
+		evict ();
+
+		return true;
+	}
+
+	Duration totalDuration () {
+		return _timeseries.back ().delay ();
+	}
+
+	int size () const {
+		return _timeseries.size ();
+	}
+
+	/// @brief Number of samples rejected as too old for the reorder window
+	std::size_t rejected () const {
+		return _rejected;
+	}
+
+private:
+	const Duration &delayAt (std::size_t i) const { return _timeseries[i].delay (); }
+	const T &valueAt (std::size_t i) const { return _timeseries[i].obj (); }
+
+	bool insertOutOfOrder (const Sample &x)
+	{
+		const std::size_t window = std::min (_reorderWindow, _timeseries.size ());
+		const iterator first = _timeseries.end () - window;
+
+		if (window == 0 || x.delay () < first->delay ()) {
+			_rejected++;
+			return false;
+		}
+
+		// Samples of equal delay keep their arrival order
+		const iterator position = std::upper_bound (first, _timeseries.end (), x.delay (),
+											[] (const Duration &delay, const Sample &sample) {
+			return delay < sample.delay ();
+		});
+
+		_timeseries.push_back (x);
+		std::rotate (position, _timeseries.end () - 1, _timeseries.end ());
+
+		return true;
+	}
+
+	void evict ()
+	{
+		while (_maxSize > 0 && _timeseries.size () > _maxSize)
+			_timeseries.pop_front ();
+
+		if (_maxAge == Duration::zero ())
+			return;
+
+		while (_timeseries.back ().delay () - _timeseries.front ().delay () > _maxAge)
+			_timeseries.pop_front ();
+	}
+
+public:
 	DataType _timeseries;
+
+private:
+	const std::size_t _maxSize;
+	const Duration _maxAge;
+	const std::size_t _reorderWindow;
+	std::size_t _rejected;
+};
+
+/**
+ * @brief Timeseries with structure of arrays layout: delays and values are stored in separate contiguous arrays,
+ * so that the search for the query time does not load the values in cache.
+ * Queries are the same of @ref Timeseries, samples are returned by value.
+ */
+template<typename T, typename Duration = std::chrono::microseconds, typename Clock = std::chrono::system_clock,
+		 typename Interpolation = LinearInterpolation>
+class SoaTimeseries : public TimeseriesBase<SoaTimeseries<T, Duration, Clock, Interpolation>, T, Duration, Clock, Interpolation>
+{
+	using Base = TimeseriesBase<SoaTimeseries<T, Duration, Clock, Interpolation>, T, Duration, Clock, Interpolation>;
+	friend Base;
+
+public:
+	using typename Base::Sample;
+	using typename Base::Time;
+	using typename Base::Precision;
+	using typename Base::Neighbors;
+	using typename Base::ResultStatus;
+	using typename Base::Result;
+	using typename Base::Cursor;
+
+	Sample operator[] (int i) const {
+		const std::size_t index = i >= 0 ? i : _delays.size () + i;
+
+		return Sample (_delays[index], _values[index]);
+	}
+
+	void add (const Sample &x) {
+		_delays.push_back (x.delay ());
+		_values.push_back (x.obj ());
+	}
+
+	void reserve (std::size_t size) {
+		_delays.reserve (size);
+		_values.reserve (size);
+	}
+
+	Duration totalDuration () {
+		return _delays.back ();
+	}
+
+	int size () const {
+		return _delays.size ();
+	}
+
+	const std::vector<Duration> &delays () const {
+		return _delays;
+	}
+
+	const std::vector<T> &values () const {
+		return _values;
+	}
+
+private:
+	const Duration &delayAt (std::size_t i) const { return _delays[i]; }
+	const T &valueAt (std::size_t i) const { return _values[i]; }
+
+private:
+	std::vector<Duration> _delays;
+	std::vector<T> _values;
 };
 
 template<typename T, typename Duration>
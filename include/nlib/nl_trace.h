@@ -0,0 +1,454 @@
+#ifndef NL_TRACE_H
+#define NL_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @file nl_trace.h
+ * @author Nicola Lissandrini
+ */
+
+namespace nlib {
+
+/**
+ * @defgroup trace ModFlow trace recorder
+ * @details Binary, low overhead recording of ModFlow emits and slot calls. Each thread writes fixed-size
+ * @ref TraceRecord "records" in its own lock-free ring, which a background thread drains to a file.
+ * The file can be converted offline to Chrome trace / Perfetto JSON with @c nl_trace_convert.
+ *
+ * File format: the 8 bytes magic @ref TRACE_MAGIC followed by blocks, each made of
+ * a @ref TraceBlockHeader and @c size bytes of payload:
+ * - @ref TraceBlockType::Records: array of @ref TraceRecord written by thread @c id
+ * - @ref TraceBlockType::ChannelName, @ref TraceBlockType::ModuleName: name of channel or module @c id
+ * - @ref TraceBlockType::SlotName: name of slot @c index connected to channel @c id
+ * - @ref TraceBlockType::Dropped: a uint64_t count of records dropped by thread @c id as its ring was full
+ */
+
+constexpr char TRACE_MAGIC[8] = {'N', 'L', 'T', 'R', 'A', 'C', 'E', '1'};
+
+/**
+ * @brief What a @ref TraceRecord measures
+ * @ingroup trace
+ */
+enum class TraceKind : uint8_t {
+	/// Emit on a channel, from the emitting module. Synchronous emits include the connected slots.
+	Emit = 0,
+	/// Call of a slot, on the receiving module
+	Slot = 1
+};
+
+/**
+ * @brief Fixed-size trace record
+ * @ingroup trace
+ */
+struct TraceRecord
+{
+	/// @brief Start time in nanoseconds on the steady clock
+	uint64_t timestamp;
+	/// @brief Duration in nanoseconds
+	uint64_t duration;
+	int32_t channelId;
+	/// @brief Emitting module for @ref TraceKind::Emit, receiving module for @ref TraceKind::Slot
+	int32_t moduleId;
+	/// @brief Depth of the event in its cascade
+	int16_t depth;
+	/// @brief Index of the slot in the connections of the channel, -1 for emits
+	int16_t slotIndex;
+	uint8_t kind;
+	uint8_t reserved[3];
+};
+
+static_assert (sizeof (TraceRecord) == 32, "Trace records must be 32 bytes");
+
+/**
+ * @ingroup trace
+ */
+enum class TraceBlockType : uint32_t {
+	Records = 0,
+	ChannelName = 1,
+	ModuleName = 2,
+	SlotName = 3,
+	Dropped = 4
+};
+
+/**
+ * @ingroup trace
+ */
+struct TraceBlockHeader
+{
+	uint32_t type;
+	int32_t id;
+	int32_t index;
+	/// @brief Payload size in bytes
+	uint32_t size;
+};
+
+static_assert (sizeof (TraceBlockHeader) == 16, "Trace block headers must be 16 bytes");
+
+/**
+ * @brief Lock-free single producer, single consumer ring of trace records.
+ * When the ring is full new records are dropped and counted.
+ * @ingroup trace
+ */
+class TraceRing
+{
+public:
+	/// @param capacity Number of records. Rounded up to a power of two.
+	TraceRing (std::size_t capacity);
+
+	/// @brief Append @p record, from the producer thread only
+	void push (const TraceRecord &record);
+
+	/**
+	 * @brief Take all the available records, from the consumer thread only
+	 * @param consumer Called with pointer and count of contiguous records, at most twice
+	 * @return Number of records taken
+	 */
+	template<typename F>
+	std::size_t drain (F &&consumer);
+
+	/// @brief Number of records dropped since last call
+	uint64_t takeDropped ();
+
+private:
+	std::vector<TraceRecord> _records;
+	const std::size_t _mask;
+	// Written by the producer and by the consumer respectively: keep them on separate cache lines
+	alignas(64) std::atomic<std::size_t> _head;
+	alignas(64) std::atomic<std::size_t> _tail;
+	std::atomic<uint64_t> _dropped;
+};
+
+/**
+ * @brief Records trace records from any thread and writes them to a file from a background thread
+ * @ingroup trace
+ */
+class TraceRecorder
+{
+public:
+	/**
+	 * @brief Open @p path and start the drain thread
+	 * @param path Output file
+	 * @param bufferSize Capacity of the ring of each thread, in records
+	 * @param flushPeriod Period of the drain thread
+	 */
+	TraceRecorder (const std::string &path,
+				std::size_t bufferSize,
+				std::chrono::milliseconds flushPeriod);
+	TraceRecorder (const TraceRecorder &) = delete;
+	TraceRecorder &operator = (const TraceRecorder &) = delete;
+
+	/// @brief Stop the drain thread and write the remaining records
+	~TraceRecorder ();
+
+	/// @brief Append @p record to the ring of the calling thread. Lock-free after the first call from each thread.
+	void record (const TraceRecord &record);
+
+	void nameChannel (int32_t id, const std::string &name);
+	void nameModule (int32_t id, const std::string &name);
+	void nameSlot (int32_t channelId, int32_t index, const std::string &name);
+
+	/// @brief Current time for @ref TraceRecord::timestamp
+	static uint64_t now ();
+
+private:
+	struct LocalRing {
+		uint64_t serial = 0;
+		TraceRing *ring = nullptr;
+	};
+
+	// Recorders a thread keeps a ring of at the same time
+	static constexpr std::size_t LOCAL_RINGS = 8;
+
+	TraceRing *registerRing ();
+	void addName (TraceBlockType type, int32_t id, int32_t index, const std::string &name);
+	void writeBlock (TraceBlockType type, int32_t id, int32_t index, const void *data, uint32_t size);
+	void drainLoop ();
+	void drainAll ();
+
+	static uint64_t nextSerial ();
+
+private:
+	// Thread-local rings are cached by serial, a new recorder at the same address has a new serial
+	const uint64_t _serial;
+	const std::size_t _bufferSize;
+	const std::chrono::milliseconds _flushPeriod;
+	std::ofstream _file;
+
+	std::mutex _mutex;
+	std::vector<std::unique_ptr<TraceRing>> _rings;
+	struct PendingName {
+		TraceBlockType type;
+		int32_t id;
+		int32_t index;
+		std::string name;
+	};
+	std::vector<PendingName> _names;
+
+	std::condition_variable _wake;
+	bool _stop;
+	std::thread _drainer;
+};
+
+/**
+ * @brief Measure a scope and record it on destruction. Does nothing if the recorder is null.
+ * @ingroup trace
+ */
+class TraceSpan
+{
+public:
+	TraceSpan (TraceRecorder *recorder,
+			 TraceKind kind,
+			 int32_t channelId,
+			 int32_t moduleId,
+			 int depth,
+			 int slotIndex = -1);
+	TraceSpan (const TraceSpan &) = delete;
+	TraceSpan &operator = (const TraceSpan &) = delete;
+	~TraceSpan ();
+
+private:
+	TraceRecorder *const _recorder;
+	TraceRecord _record;
+};
+
+inline std::size_t roundUpPowerOfTwo (std::size_t value)
+{
+	std::size_t power = 1;
+
+	while (power < value)
+		power <<= 1;
+
+	return power;
+}
+
+inline TraceRing::TraceRing (std::size_t capacity):
+	 _records(roundUpPowerOfTwo (std::max<std::size_t> (capacity, 2))),
+	 _mask(_records.size () - 1),
+	 _head(0),
+	 _tail(0),
+	 _dropped(0)
+{}
+
+inline void TraceRing::push (const TraceRecord &record)
+{
+	const std::size_t head = _head.load (std::memory_order_relaxed);
+
+	if (head - _tail.load (std::memory_order_acquire) == _records.size ()) {
+		_dropped.fetch_add (1, std::memory_order_relaxed);
+		return;
+	}
+
+	_records[head & _mask] = record;
+	_head.store (head + 1, std::memory_order_release);
+}
+
+template<typename F>
+std::size_t TraceRing::drain (F &&consumer)
+{
+	const std::size_t tail = _tail.load (std::memory_order_relaxed);
+	const std::size_t head = _head.load (std::memory_order_acquire);
+	const std::size_t count = head - tail;
+
+	if (count == 0)
+		return 0;
+
+	const std::size_t begin = tail & _mask;
+	const std::size_t first = std::min (count, _records.size () - begin);
+
+	consumer (&_records[begin], first);
+
+	if (first < count)
+		consumer (&_records[0], count - first);
+
+	_tail.store (head, std::memory_order_release);
+
+	return count;
+}
+
+inline uint64_t TraceRing::takeDropped () {
+	return _dropped.exchange (0, std::memory_order_relaxed);
+}
+
+inline uint64_t TraceRecorder::nextSerial () {
+	static std::atomic<uint64_t> serial(0);
+	return ++serial;
+}
+
+inline uint64_t TraceRecorder::now () {
+	return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+inline TraceRecorder::TraceRecorder (const std::string &path,
+							  std::size_t bufferSize,
+							  std::chrono::milliseconds flushPeriod):
+	 _serial(nextSerial ()),
+	 _bufferSize(bufferSize),
+	 _flushPeriod(flushPeriod),
+	 _file(path, std::ios::binary | std::ios::trunc),
+	 _stop(false)
+{
+	if (!_file) {
+		std::cout << "Cannot open trace file " << path << std::endl;
+		assert (false && "Cannot open trace file");
+	}
+
+	_file.write (TRACE_MAGIC, sizeof (TRACE_MAGIC));
+	_drainer = std::thread (&TraceRecorder::drainLoop, this);
+}
+
+inline TraceRecorder::~TraceRecorder ()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_one ();
+	_drainer.join ();
+
+	drainAll ();
+	_file.flush ();
+}
+
+inline TraceRing *TraceRecorder::registerRing ()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_rings.push_back (std::make_unique<TraceRing> (_bufferSize));
+
+	return _rings.back ().get ();
+}
+
+inline void TraceRecorder::record (const TraceRecord &record)
+{
+	thread_local std::vector<LocalRing> locals;
+
+	for (const LocalRing &local : locals) {
+		if (local.serial == _serial) {
+			local.ring->push (record);
+			return;
+		}
+	}
+
+	// The oldest entries are likely of recorders already destroyed
+	if (locals.size () == LOCAL_RINGS)
+		locals.erase (locals.begin ());
+
+	locals.push_back ({_serial, registerRing ()});
+	locals.back ().ring->push (record);
+}
+
+inline void TraceRecorder::addName (TraceBlockType type, int32_t id, int32_t index, const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_names.push_back ({type, id, index, name});
+}
+
+inline void TraceRecorder::nameChannel (int32_t id, const std::string &name) {
+	addName (TraceBlockType::ChannelName, id, 0, name);
+}
+
+inline void TraceRecorder::nameModule (int32_t id, const std::string &name) {
+	addName (TraceBlockType::ModuleName, id, 0, name);
+}
+
+inline void TraceRecorder::nameSlot (int32_t channelId, int32_t index, const std::string &name) {
+	addName (TraceBlockType::SlotName, channelId, index, name);
+}
+
+inline void TraceRecorder::writeBlock (TraceBlockType type, int32_t id, int32_t index, const void *data, uint32_t size)
+{
+	const TraceBlockHeader header{static_cast<uint32_t> (type), id, index, size};
+
+	_file.write (reinterpret_cast<const char *> (&header), sizeof (header));
+	_file.write (static_cast<const char *> (data), size);
+}
+
+inline void TraceRecorder::drainAll ()
+{
+	std::vector<PendingName> names;
+	std::vector<TraceRing *> rings;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		names.swap (_names);
+		for (const std::unique_ptr<TraceRing> &ring : _rings)
+			rings.push_back (ring.get ());
+	}
+
+	for (const PendingName &name : names)
+		writeBlock (name.type, name.id, name.index, name.name.data (), name.name.size ());
+
+	for (std::size_t i = 0; i < rings.size (); i++) {
+		rings[i]->drain ([&] (const TraceRecord *records, std::size_t count) {
+			writeBlock (TraceBlockType::Records, i, 0, records, count * sizeof (TraceRecord));
+		});
+
+		const uint64_t dropped = rings[i]->takeDropped ();
+
+		if (dropped > 0)
+			writeBlock (TraceBlockType::Dropped, i, 0, &dropped, sizeof (dropped));
+	}
+}
+
+inline void TraceRecorder::drainLoop ()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (!_stop) {
+		_wake.wait_for (lock, _flushPeriod, [this] { return _stop; });
+
+		lock.unlock ();
+		drainAll ();
+		_file.flush ();
+		lock.lock ();
+	}
+}
+
+inline TraceSpan::TraceSpan (TraceRecorder *recorder,
+						TraceKind kind,
+						int32_t channelId,
+						int32_t moduleId,
+						int depth,
+						int slotIndex):
+	 _recorder(recorder),
+	 _record()
+{
+	if (_recorder == nullptr)
+		return;
+
+	_record.kind = static_cast<uint8_t> (kind);
+	_record.channelId = channelId;
+	_record.moduleId = moduleId;
+	_record.depth = depth;
+	_record.slotIndex = slotIndex;
+	_record.timestamp = TraceRecorder::now ();
+}
+
+inline TraceSpan::~TraceSpan ()
+{
+	if (_recorder == nullptr)
+		return;
+
+	_record.duration = TraceRecorder::now () - _record.timestamp;
+	_recorder->record (_record);
+}
+
+}
+
+#endif // NL_TRACE_H
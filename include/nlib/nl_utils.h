@@ -1,6 +1,9 @@
 #ifndef NL_UTILS_H
 #define NL_UTILS_H
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <cmath>
@@ -15,6 +18,11 @@
 #include <any>
 #include <list>
 #include <variant>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <typeindex>
+#include "nl_flat_tree.h"
 #ifdef INCLUDE_EIGEN
 #include <eigen3/Eigen/Core>
 #endif
@@ -246,38 +254,195 @@ public:
 
 using ReadyFlagsStr = ReadyFlags<std::string>;
 
+/**
+ * @brief Ready flags of @p N inputs identified by index, stored in a bitmask: all checks are O(1)
+ */
+template<std::size_t N>
+class ReadyMask
+{
+	static_assert (N > 0 && N <= 64, "ReadyMask supports 1 to 64 flags");
+	static constexpr uint64_t ALL = N == 64 ? ~uint64_t (0) : (uint64_t (1) << N) - 1;
+
+public:
+	ReadyMask ():
+		 _mask(0)
+	{}
+
+	void set (std::size_t i) {
+		_mask |= uint64_t (1) << i;
+	}
+	void reset (std::size_t i) {
+		_mask &= ~(uint64_t (1) << i);
+	}
+	void resetFlags () {
+		_mask = 0;
+	}
+	bool get (std::size_t i) const {
+		return (_mask >> i) & 1;
+	}
+	bool operator[] (std::size_t i) const {
+		return get (i);
+	}
+	bool all () const {
+		return _mask == ALL;
+	}
+	bool any () const {
+		return _mask != 0;
+	}
+	uint64_t mask () const {
+		return _mask;
+	}
+
+private:
+	uint64_t _mask;
+};
+
 #if __cplusplus >= 201703L
 
+/**
+ * @brief Typed reference to a resource of a @ref ResourceManager, resolved once by name.
+ * Dereferencing costs two loads, with no lookup and no reference count update, so it can be done in slots.
+ * It refers to the resource slot: resources created again with the same name are seen by existing handles.
+ * The manager must outlive the handle.
+ */
+template<typename T>
+class ResourceHandle
+{
+public:
+	ResourceHandle ():
+		 _object(nullptr)
+	{}
+
+	T &operator * () const {
+		return *get ();
+	}
+
+	T *operator -> () const {
+		return get ();
+	}
+
+	T *get () const {
+		return static_cast<T *> (_object->get ());
+	}
+
+	/// @brief Whether the handle has been resolved
+	explicit operator bool () const {
+		return _object != nullptr;
+	}
+
+private:
+	friend class ResourceManager;
+
+	ResourceHandle (const std::shared_ptr<void> *object):
+		 _object(object)
+	{}
+
+private:
+	const std::shared_ptr<void> *_object;
+};
+
+/**
+ * @brief Objects shared by name between modules.
+ * Resources are created while the graph is set up and resolved to handles (see @ref handle), typically in setupNetwork.
+ * Lookups and dereferences can then run concurrently from any thread, as long as no resource is created meanwhile.
+ */
 class ResourceManager
 {
+	struct Entry {
+		std::shared_ptr<void> object;
+		std::type_index type;
+	};
+
 public:
+	/**
+	 * @brief Create the resource @p name, replacing the existing one, seen by its handles.
+	 * Aborts if the existing resource has a different type.
+	 */
 	template<typename T, typename ...Args>
 	void create (const std::string &name, Args &&...args);
 
+	/**
+	 * @brief Shared pointer to the resource @p name. Aborts if it is missing or has a different type.
+	 */
 	template<typename T>
 	std::shared_ptr<T> get (const std::string &name);
 
+	/**
+	 * @brief Resolve the resource @p name. Aborts if it is missing or has a different type.
+	 */
+	template<typename T>
+	ResourceHandle<T> handle (const std::string &name);
+
+	template<typename T>
+	ResourceHandle<const T> handle (const std::string &name) const;
+
+	bool contains (const std::string &name) const;
+
 private:
-	std::map<std::string, std::any> _resources;
+	template<typename T>
+	const Entry &find (const std::string &name) const;
+
+private:
+	// Nodes are never moved: handles point to the entries
+	std::map<std::string, Entry, std::less<>> _resources;
 };
 
 template<typename T, typename ...Args>
 void ResourceManager::create (const std::string &name, Args &&...args)
 {
-	_resources[name] = std::make_shared<T> (args...);
+	auto found = _resources.find (name);
+
+	// Handles of the existing resource would cast the new one to their type
+	if (found != _resources.end () && found->second.type != typeid (T)) {
+		std::cout << "Error: Resource " << name << " has type " << found->second.type.name () << ". Created again as " << typeid (T).name () << "\nAborting" << std::endl;
+		std::abort ();
+	}
+
+	std::shared_ptr<void> object = std::make_shared<T> (std::forward<Args> (args)...);
+
+	if (found == _resources.end ())
+		_resources.emplace (name, Entry{std::move (object), typeid (T)});
+	else
+		found->second.object = std::move (object);
 }
 
 template<typename T>
-std::shared_ptr<T> ResourceManager::get (const std::string &name) {
-	auto resource = _resources[name];
+const ResourceManager::Entry &ResourceManager::find (const std::string &name) const
+{
+	auto found = _resources.find (name);
+
+	if (found == _resources.end ()) {
+		std::cout << "Error: Resource " << name << " not found\nAborting" << std::endl;
+		std::abort ();
+	}
 
-	if (resource.type () != typeid(std::shared_ptr<T>)) {
-		std::cout << "Error: Resource " << name << " has type " << resource.type ().name () << ". Got " << typeid(std::shared_ptr<T>).name () << "\nAborting" << std::endl;
+	if (found->second.type != typeid (std::remove_const_t<T>)) {
+		std::cout << "Error: Resource " << name << " has type " << found->second.type.name () << ". Got " << typeid (T).name () << "\nAborting" << std::endl;
 		std::abort ();
 	}
 
-	return std::any_cast<std::shared_ptr<T>> (_resources[name]);
+	return found->second;
+}
+
+template<typename T>
+std::shared_ptr<T> ResourceManager::get (const std::string &name) {
+	return std::static_pointer_cast<T> (find<T> (name).object);
 }
+
+template<typename T>
+ResourceHandle<T> ResourceManager::handle (const std::string &name) {
+	return ResourceHandle<T> (&find<T> (name).object);
+}
+
+template<typename T>
+ResourceHandle<const T> ResourceManager::handle (const std::string &name) const {
+	return ResourceHandle<const T> (&find<T> (name).object);
+}
+
+inline bool ResourceManager::contains (const std::string &name) const {
+	return _resources.find (name) != _resources.end ();
+}
+
 template<typename T, typename Status, const char * const * strings = nullptr, Status ...defaultValue>
 class AlgorithmResult
 {
@@ -490,6 +655,7 @@ TreeNode<DataType, LabelType> *TreeNode<DataType, LabelType>::nthDescendant (int
 	return ret;
 }
 
+// For trees of many nodes, see FlatTree in nl_flat_tree.h
 template<typename DataType, typename LabelType = std::monostate, typename ExtraDataType = std::monostate>
 class Tree
 {
@@ -524,27 +690,60 @@ public:
 
 	template<typename Fcn = std::function<DataType(Node *)>>
 	std::string toJson (const Fcn &printData = [](Node *node) {return node->data ();}) const {
-		return toJson (root (), printData);
+		std::stringstream ss;
+
+		writeJson (ss, printData);
+
+		return ss.str ();
 	}
 
+	/**
+	 * @brief Write the tree as JSON to @p out in a single pass, without recursion
+	 * @param printData Callable as printData (Node *), returning a value that can be written to @p out
+	 */
+	template<typename Fcn = std::function<DataType(Node *)>>
+	void writeJson (std::ostream &out, const Fcn &printData = [](Node *node) {return node->data ();}) const;
+
 	template<typename U = DataType>
 	std::string toGraphviz (const std::function<U(Node *)> printNode = [](Node *node) -> DataType {return node->data(); }) {
-		VisitLambda<std::stringstream &> graphvizVisit = [printNode] (Node *node, std::stringstream &str) {
-			if (!node->isRoot ())
-				str << printNode (node->parent()) << " -> " << printNode (node) << "; \n";
-		};
-
 		std::stringstream str;
 
-		str << "digraph Tree {\n";
-
-		traverse<std::stringstream &> (DEPTH_FIRST_PREORDER, graphvizVisit, str);
-
-		str << "}";
+		writeGraphviz (str, printNode);
 
 		return str.str ();
 	}
 
+	/**
+	 * @brief Write the tree as a Graphviz digraph to @p out in a single pass, without recursion
+	 * @param printNode Callable as printNode (Node *), returning a value that can be written to @p out
+	 */
+	template<typename Fcn = std::function<DataType(Node *)>>
+	void writeGraphviz (std::ostream &out, const Fcn &printNode = [](Node *node) {return node->data ();}) const;
+
+	/**
+	 * @brief Write the nodes in preorder in the compact binary format of @ref FlatTree, read by @ref FlatTree::readBinary.
+	 * Data and labels are written as they are in memory, so they must be trivially copyable.
+	 * The tree is traversed once, the node count is patched in the header afterwards: streams that cannot seek
+	 * receive the whole dump built in memory.
+	 */
+	void writeBinary (std::ostream &out) const;
+	/// @brief Append the binary format to @p buffer
+	void writeBinary (std::vector<char> &buffer) const;
+
+	/// @brief Copy of the tree as a @ref FlatTree, with the nodes indexed in preorder. Extra data is not copied.
+	FlatTree<DataType, LabelType> flatten () const;
+
+	/**
+	 * @brief Run @p write on a snapshot of the tree on another thread, so that the tree can be modified meanwhile.
+	 * The snapshot is the tree flattened in a single contiguous copy (see @ref flatten).
+	 * @param write Callable as write (const FlatTree<DataType, LabelType> &), e.g. writing the snapshot to a file
+	 * @return Future that is ready when @p write returns
+	 */
+	template<typename Write>
+	std::future<void> writeAsync (Write write) const;
+
+	std::size_t size () const;
+
 	template<typename U = ExtraDataType>
 	std::enable_if_t<!std::is_same_v<U, std::monostate>, const ExtraDataType &>
 	extraData () const {
@@ -559,6 +758,15 @@ public:
 
 
 private:
+	using Index = typename FlatTree<DataType, LabelType>::Index;
+	static constexpr std::size_t RECORD_SIZE = sizeof (Index) + sizeof (DataType) + sizeof (LabelType);
+
+	// Iterative preorder, calling visit (node, parent) with the preorder index of the parent
+	template<typename Visit>
+	void preorder (const Visit &visit) const;
+
+	static void writeRecord (const Node *node, Index parent, char *record);
+
 	template<typename ...Args>
 	void traverse (Algorithm algorithm, Node *node, const VisitLambda<Args...> &visit, Args ...args) {
 		switch (algorithm) {
@@ -602,37 +810,218 @@ private:
 
 	}
 
-	template<typename Fcn>
-	std::string toJson (Node *node, const Fcn &printData) const {
-		std::stringstream ss;
+private:
+	ExtraDataType _extraData;
+	Node *_root;
+};
 
-		ss << "{";
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Fcn>
+void Tree<DataType, LabelType, ExtraDataType>::writeJson (std::ostream &out, const Fcn &printData) const
+{
+	using ChildIterator = decltype (std::declval<Node &> ().children ().begin ());
+	// Open nodes, with their next child to write
+	std::vector<std::pair<Node *, ChildIterator>> stack;
+
+	auto open = [&] (Node *node) {
+		out << "{";
 
 		if constexpr (!std::is_same_v<LabelType, std::monostate>)
-			ss << "\"label\": " << node->label () << ", ";
+			out << "\"label\": " << node->label () << ", ";
+
+		out << "\"data\": " << printData (node);
 
-		ss << "\"data\": " << printData (node);
+		if (node->isLeaf ())
+			out << "}";
+		else {
+			out << ", \"children\": [";
+			stack.emplace_back (node, node->children ().begin ());
+		}
+	};
 
-		if (!node->isLeaf ()) {
-			ss << ", \"children\": [";
+	open (root ());
 
-			int count = 0;
-			for (Node *child : node->children ()) {
-				ss << toJson (child, printData);
-				if (count < node->childrenCount () - 1)
-					ss << ", ";
-				count++;
-			}
-			ss << "]";
+	while (!stack.empty ()) {
+		Node *node = stack.back ().first;
+		ChildIterator &next = stack.back ().second;
+
+		if (next == node->children ().end ()) {
+			out << "]}";
+			stack.pop_back ();
+			continue;
 		}
-		ss << "}";
-		return ss.str ();
+
+		if (next != node->children ().begin ())
+			out << ", ";
+
+		open (*next++);
 	}
+}
 
-private:
-	ExtraDataType _extraData;
-	Node *_root;
-};
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Fcn>
+void Tree<DataType, LabelType, ExtraDataType>::writeGraphviz (std::ostream &out, const Fcn &printNode) const
+{
+	std::vector<Node *> stack{root ()};
+
+	out << "digraph Tree {\n";
+
+	while (!stack.empty ()) {
+		Node *node = stack.back ();
+
+		stack.pop_back ();
+
+		if (!node->isRoot ())
+			out << printNode (node->parent ()) << " -> " << printNode (node) << "; \n";
+
+		// Children pushed in reverse are written in order
+		const std::size_t first = stack.size ();
+
+		for (Node *child : node->children ())
+			stack.push_back (child);
+		std::reverse (stack.begin () + first, stack.end ());
+	}
+
+	out << "}";
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Visit>
+void Tree<DataType, LabelType, ExtraDataType>::preorder (const Visit &visit) const
+{
+	std::vector<std::pair<Node *, Index>> stack{{root (), FlatTree<DataType, LabelType>::NONE}};
+	Index index = 0;
+
+	while (!stack.empty ()) {
+		const std::pair<Node *, Index> current = stack.back ();
+
+		stack.pop_back ();
+		visit (current.first, current.second);
+
+		// Children pushed in reverse are visited in order
+		const std::size_t first = stack.size ();
+
+		for (Node *child : current.first->children ())
+			stack.emplace_back (child, index);
+		std::reverse (stack.begin () + first, stack.end ());
+
+		index++;
+	}
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+std::size_t Tree<DataType, LabelType, ExtraDataType>::size () const
+{
+	std::size_t count = 0;
+
+	preorder ([&count] (Node *, Index) { count++; });
+
+	return count;
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+void Tree<DataType, LabelType, ExtraDataType>::writeRecord (const Node *node, Index parent, char *record)
+{
+	memcpy (record, &parent, sizeof (Index));
+	memcpy (record + sizeof (Index), &node->data (), sizeof (DataType));
+	memcpy (record + sizeof (Index) + sizeof (DataType), &node->label (), sizeof (LabelType));
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+void Tree<DataType, LabelType, ExtraDataType>::writeBinary (std::ostream &out) const
+{
+	static_assert (std::is_trivially_copyable_v<DataType> && std::is_trivially_copyable_v<LabelType>,
+				"Binary format requires trivially copyable data and labels");
+
+	const std::ostream::pos_type start = out.tellp ();
+
+	// The count in the header is patched at the end: unseekable streams get the tree built in memory first
+	if (start == std::ostream::pos_type (-1)) {
+		std::vector<char> buffer;
+
+		writeBinary (buffer);
+		out.write (buffer.data (), buffer.size ());
+		return;
+	}
+
+	const FlatTreeHeader header{{FLAT_TREE_MAGIC[0], FLAT_TREE_MAGIC[1], FLAT_TREE_MAGIC[2], FLAT_TREE_MAGIC[3]},
+								FLAT_TREE_VERSION, sizeof (DataType), sizeof (LabelType), 0};
+	// Records are written in blocks, to keep the stream calls few
+	constexpr std::size_t BLOCK_RECORDS = std::max<std::size_t> (1, 65536 / RECORD_SIZE);
+	std::vector<char> block(BLOCK_RECORDS * RECORD_SIZE);
+	std::size_t count = 0;
+	uint64_t total = 0;
+
+	out.write (reinterpret_cast<const char *> (&header), sizeof (header));
+
+	preorder ([&] (Node *node, Index parent) {
+		writeRecord (node, parent, block.data () + count * RECORD_SIZE);
+		total++;
+
+		if (++count == BLOCK_RECORDS) {
+			out.write (block.data (), count * RECORD_SIZE);
+			count = 0;
+		}
+	});
+
+	out.write (block.data (), count * RECORD_SIZE);
+
+	const std::ostream::pos_type end = out.tellp ();
+
+	out.seekp (start + std::streamoff (offsetof (FlatTreeHeader, count)));
+	out.write (reinterpret_cast<const char *> (&total), sizeof (total));
+	out.seekp (end);
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+void Tree<DataType, LabelType, ExtraDataType>::writeBinary (std::vector<char> &buffer) const
+{
+	static_assert (std::is_trivially_copyable_v<DataType> && std::is_trivially_copyable_v<LabelType>,
+				"Binary format requires trivially copyable data and labels");
+
+	const FlatTreeHeader header{{FLAT_TREE_MAGIC[0], FLAT_TREE_MAGIC[1], FLAT_TREE_MAGIC[2], FLAT_TREE_MAGIC[3]},
+								FLAT_TREE_VERSION, sizeof (DataType), sizeof (LabelType), 0};
+	const std::size_t start = buffer.size ();
+	std::size_t offset = start + sizeof (header);
+	uint64_t total = 0;
+
+	buffer.resize (offset);
+	memcpy (buffer.data () + start, &header, sizeof (header));
+
+	// The buffer grows geometrically with the records, the count is filled in afterwards
+	preorder ([&] (Node *node, Index parent) {
+		buffer.resize (offset + RECORD_SIZE);
+		writeRecord (node, parent, buffer.data () + offset);
+		offset += RECORD_SIZE;
+		total++;
+	});
+
+	memcpy (buffer.data () + start + offsetof (FlatTreeHeader, count), &total, sizeof (total));
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+FlatTree<DataType, LabelType> Tree<DataType, LabelType, ExtraDataType>::flatten () const
+{
+	FlatTree<DataType, LabelType> flat(root ()->data (), root ()->label ());
+
+	preorder ([&flat] (Node *node, Index parent) {
+		if (!node->isRoot ())
+			flat.addChild (parent, node->data (), node->label ());
+	});
+
+	return flat;
+}
+
+template<typename DataType, typename LabelType, typename ExtraDataType>
+template<typename Write>
+std::future<void> Tree<DataType, LabelType, ExtraDataType>::writeAsync (Write write) const
+{
+	std::shared_ptr<const FlatTree<DataType, LabelType>> snapshot = std::make_shared<const FlatTree<DataType, LabelType>> (flatten ());
+
+	return std::async (std::launch::async, [snapshot, write = std::move (write)] () {
+		write (*snapshot);
+	});
+}
 
 
 
@@ -806,16 +1195,16 @@ inline std::string secView (double x) {
 /// @param ndiv: number of trials inside the lambda, total time is divided by @p ndiv in printed output
 /// @param enable: enable output printing
 /// @ingroup pt
+/// @note For measurements left in hot paths, see PROFILE_ZONE in nl_profiler.h
 #define PROFILE_N_EN(taken, lambda, ndiv, enable) {\
-std::stringstream ID;\
-	ID << __PRETTY_FUNCTION__ << ":" << __LINE__-2;\
 	auto _start = std::chrono::steady_clock::now ();\
 	lambda();\
 	auto _end = std::chrono::steady_clock::now ();\
 	taken = double(std::chrono::duration_cast<std::chrono::microseconds> (_end - _start).count ())/1e6;\
 	if (enable) {\
-		if (ndiv == 1) std::cout << ID.str() << ": taken: " << secView(taken) << std::endl;\
-		else std::cout << ID.str() << ": total: " << secView(taken) << " each: " << secView(taken/double(ndiv)) << " over " << ndiv << " trials" << std::endl; }}
+		std::cout << __PRETTY_FUNCTION__ << ":" << __LINE__-2;\
+		if (ndiv == 1) std::cout << ": taken: " << secView(taken) << std::endl;\
+		else std::cout << ": total: " << secView(taken) << " each: " << secView(taken/double(ndiv)) << " over " << ndiv << " trials" << std::endl; }}
 
 #ifdef DISABLE_PROFILE_OUTPUT
 #define PROFILE_N(taken,lambda,ndiv) PROFILE_N_EN(taken,lambda,ndiv,false)
@@ -0,0 +1,160 @@
+#include "../include/nlib/nl_trace.h"
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+// Convert a binary ModFlow trace to Chrome trace / Perfetto JSON
+// Usage: nl_trace_convert <input.trace> [<output.json>]
+
+using namespace std;
+using namespace nlib;
+
+struct ThreadRecord {
+	int thread;
+	TraceRecord record;
+};
+
+string escapeJson (const string &value)
+{
+	stringstream escaped;
+
+	for (char c : value) {
+		switch (c) {
+		case '"': escaped << "\\\""; break;
+		case '\\': escaped << "\\\\"; break;
+		case '\n': escaped << "\\n"; break;
+		case '\t': escaped << "\\t"; break;
+		default:
+			if ((unsigned char) c < 0x20) {
+				char code[8];
+				snprintf (code, sizeof (code), "\\u%04x", c);
+				escaped << code;
+			} else
+				escaped << c;
+		}
+	}
+
+	return escaped.str ();
+}
+
+string lookup (const map<int, string> &names, int id, const string &prefix)
+{
+	auto found = names.find (id);
+
+	return found == names.end () ? prefix + to_string (id) : found->second;
+}
+
+// Slot names are full signatures: keep them short in the timeline
+string truncateSignature (const string &name) {
+	return name.substr (0, name.find ('('));
+}
+
+int main (int argc, char **argv)
+{
+	if (argc < 2) {
+		cerr << "Usage: " << argv[0] << " <input.trace> [<output.json>]" << endl;
+		return 1;
+	}
+
+	ifstream input(argv[1], ios::binary);
+	char magic[sizeof (TRACE_MAGIC)];
+
+	if (!input.read (magic, sizeof (magic)) || memcmp (magic, TRACE_MAGIC, sizeof (magic)) != 0) {
+		cerr << "Invalid trace file " << argv[1] << endl;
+		return 1;
+	}
+
+	map<int, string> channels, modules;
+	map<pair<int, int>, string> slots;
+	map<int, uint64_t> dropped;
+	vector<ThreadRecord> records;
+	TraceBlockHeader header;
+
+	while (input.read (reinterpret_cast<char *> (&header), sizeof (header))) {
+		vector<char> payload(header.size);
+
+		if (!input.read (payload.data (), header.size)) {
+			cerr << "Truncated block, ignoring the rest of the file" << endl;
+			break;
+		}
+
+		const string text(payload.begin (), payload.end ());
+
+		switch (static_cast<TraceBlockType> (header.type)) {
+		case TraceBlockType::Records:
+			for (size_t offset = 0; offset + sizeof (TraceRecord) <= payload.size (); offset += sizeof (TraceRecord)) {
+				ThreadRecord current{header.id, {}};
+				memcpy (&current.record, &payload[offset], sizeof (TraceRecord));
+				records.push_back (current);
+			}
+			break;
+		case TraceBlockType::ChannelName:
+			channels[header.id] = text;
+			break;
+		case TraceBlockType::ModuleName:
+			modules[header.id] = text;
+			break;
+		case TraceBlockType::SlotName:
+			slots[{header.id, header.index}] = truncateSignature (text);
+			break;
+		case TraceBlockType::Dropped: {
+			uint64_t count = 0;
+			memcpy (&count, payload.data (), min (payload.size (), sizeof (count)));
+			dropped[header.id] += count;
+			break;
+		}
+		default:
+			cerr << "Unknown block type " << header.type << ", skipped" << endl;
+		}
+	}
+
+	uint64_t origin = UINT64_MAX;
+
+	for (const ThreadRecord &current : records)
+		origin = min (origin, current.record.timestamp);
+
+	ofstream outputFile;
+
+	if (argc > 2)
+		outputFile.open (argv[2]);
+
+	ostream &output = argc > 2 ? outputFile : cout;
+	bool first = true;
+
+	output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+	for (const ThreadRecord &current : records) {
+		const TraceRecord &record = current.record;
+		const bool isEmit = record.kind == static_cast<uint8_t> (TraceKind::Emit);
+		const string channel = lookup (channels, record.channelId, "channel_");
+		string name;
+
+		if (isEmit)
+			name = channel;
+		else {
+			auto slot = slots.find ({record.channelId, record.slotIndex});
+			name = slot == slots.end () ? channel + "[" + to_string (record.slotIndex) + "]" : slot->second;
+		}
+
+		char times[64];
+		snprintf (times, sizeof (times), "\"ts\":%.3f,\"dur\":%.3f",
+				(record.timestamp - origin) / 1e3, record.duration / 1e3);
+
+		output << (first ? "" : ",") << "\n{\"name\":\"" << escapeJson (name) << "\""
+			  << ",\"cat\":\"" << (isEmit ? "emit" : "slot") << "\",\"ph\":\"X\"," << times
+			  << ",\"pid\":1,\"tid\":" << current.thread
+			  << ",\"args\":{\"channel\":\"" << escapeJson (channel) << "\""
+			  << ",\"module\":\"" << escapeJson (lookup (modules, record.moduleId, "module_")) << "\""
+			  << ",\"depth\":" << record.depth << "}}";
+		first = false;
+	}
+
+	output << "\n]}" << endl;
+
+	for (const auto &threadDropped : dropped)
+		cerr << "Thread " << threadDropped.first << " dropped " << threadDropped.second << " records" << endl;
+
+	cerr << "Converted " << records.size () << " records" << endl;
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef NL_TEST_H
+#define NL_TEST_H
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @file nl_test.h
+ * @brief Checks shared by the tests. Each check prints its result, main returns failures == 0 ? 0 : 1.
+ */
+
+inline int failures = 0;
+
+inline void check (const std::string &what, bool ok) {
+	std::cout << (ok ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+
+	if (!ok)
+		failures++;
+}
+
+// Whether @p body aborts in a child process
+template<typename F>
+bool aborts (F &&body)
+{
+	std::cout.flush ();
+
+	const pid_t child = fork ();
+
+	if (child == 0) {
+		body ();
+		_exit (0);
+	}
+
+	int status;
+	waitpid (child, &status, 0);
+
+	return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+#endif // NL_TEST_H
@@ -0,0 +1,128 @@
+#include "../include/nlib/nl_node.h"
+#include <std_msgs/Float64MultiArray.h>
+#include <iostream>
+#include <thread>
+#include "nl_test.h"
+
+using namespace nlib;
+
+enum Outputs {
+	OUTPUT_VALUES
+};
+
+namespace nlib {
+
+template<>
+template<>
+void OutputManager<Outputs>::dataToMsg (std_msgs::Float64MultiArray &outputMsg, const std::vector<double> &data) {
+	outputMsg.data.assign (data.begin (), data.end ());
+}
+
+template<>
+template<>
+void OutputManager<Outputs>::outputData (const Outputs &id, const std::vector<double> &data) {
+	publish<std::vector<double>, std_msgs::Float64MultiArray> (id, data);
+}
+
+}
+
+static void testBoundedQueue ()
+{
+	BoundedQueue<int> queue(4);
+	std::atomic<long> sum(0);
+	std::vector<std::thread> producers;
+	const int perProducer = 20000;
+
+	for (int p = 0; p < 3; p++) {
+		producers.emplace_back ([&] {
+			for (int i = 1; i <= perProducer; i++) {
+				while (!queue.push (int (i)))
+					std::this_thread::yield ();
+			}
+		});
+	}
+
+	std::thread consumer([&] {
+		int value;
+		int popped = 0;
+
+		while (popped < 3 * perProducer) {
+			if (queue.pop (value)) {
+				sum += value;
+				popped++;
+			}
+		}
+	});
+
+	for (std::thread &producer : producers)
+		producer.join ();
+	consumer.join ();
+
+	check ("bounded queue", sum == 3L * perProducer * (perProducer + 1) / 2 && queue.empty ());
+}
+
+static void testPool ()
+{
+	AsyncPublisher::Ptr asyncPublisher = std::make_shared<AsyncPublisher> ();
+	auto publisher = std::make_shared<ros::Publisher> ();
+	auto pool = std::make_shared<MessagePool<std_msgs::Float64MultiArray>> (2);
+	bool reused = true;
+
+	for (int i = 0; i < 100; i++) {
+		boost::shared_ptr<std_msgs::Float64MultiArray> msg = pool->acquire ();
+
+		// Published messages come back with their capacity
+		if (i >= 2 && msg->data.capacity () < 8)
+			reused = false;
+
+		msg->data.assign (8, i);
+		asyncPublisher->publish (publisher, std::move (msg), pool);
+		asyncPublisher->flush ();
+	}
+
+	check ("pooled messages reused", reused);
+
+	boost::shared_ptr<std_msgs::Float64MultiArray> held = pool->acquire ();
+	asyncPublisher->publish (publisher, held, pool);
+	asyncPublisher->flush ();
+
+	check ("held messages not reused", pool->acquire () != held && pool->acquire () != held);
+}
+
+static void testOutputManager ()
+{
+	OutputManager<Outputs> outputs;
+
+	outputs.addOutput (OUTPUT_VALUES, std::make_shared<ros::Publisher> ());
+	outputs.enableAsync (std::make_shared<AsyncPublisher> (8), 2);
+
+	std::vector<std::thread> slots;
+
+	for (int t = 0; t < 4; t++) {
+		slots.emplace_back ([&outputs, t] {
+			for (int i = 0; i < 1000; i++)
+				outputs.outputData (OUTPUT_VALUES, std::vector<double> (16, t));
+		});
+	}
+
+	for (std::thread &slot : slots)
+		slot.join ();
+
+	check ("async output manager", true);
+
+	std::size_t added = 0;
+
+	for (const auto &output : outputs)
+		added += output.first == OUTPUT_VALUES && output.second.publisher != nullptr;
+
+	check ("outputs iterated with their publisher", added == 1);
+}
+
+int main ()
+{
+	testBoundedQueue ();
+	testPool ();
+	testOutputManager ();
+
+	return failures == 0 ? 0 : 1;
+}
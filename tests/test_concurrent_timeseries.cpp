@@ -0,0 +1,75 @@
+#include "../include/nlib/nl_concurrent_timeseries.h"
+#include <iostream>
+#include <thread>
+#include "nl_test.h"
+
+using namespace std::chrono;
+using namespace std::literals::chrono_literals;
+
+using ConcurrentTimeseries = nlib::ConcurrentTimeseries<double, microseconds>;
+using Sample = ConcurrentTimeseries::Sample;
+
+// Values equal the delays, so that any interpolation can be checked exactly
+static bool consistent (const ConcurrentTimeseries::Snapshot &snapshot, std::size_t maxSize)
+{
+	if (snapshot.size () == 0)
+		return true;
+
+	if (std::size_t (snapshot.size ()) > maxSize)
+		return false;
+
+	for (int i = 0; i < snapshot.size (); i++) {
+		if (snapshot[i].obj () != snapshot[0].obj () + 10 * i || snapshot[i].delay ().count () != snapshot[i].obj ())
+			return false;
+	}
+
+	const microseconds middle = (snapshot[0].delay () + snapshot[-1].delay ()) / 2 + 5us;
+	const auto result = snapshot.at (middle);
+
+	return snapshot.size () < 2 || (result.success () && result.value () == middle.count ());
+}
+
+int main ()
+{
+	const int samples = 200000;
+	const std::size_t maxSize = 1000;
+	ConcurrentTimeseries timeseries(maxSize);
+	std::atomic<bool> done{false};
+	std::atomic<int> inconsistent{0};
+	std::atomic<long> snapshots{0};
+	std::vector<std::thread> readers;
+
+	for (int i = 0; i < 3; i++) {
+		readers.emplace_back ([&] {
+			while (!done) {
+				if (!consistent (timeseries.snapshot (), maxSize))
+					inconsistent++;
+				snapshots++;
+			}
+		});
+	}
+
+	for (int i = 0; i < samples; i++)
+		timeseries.add (Sample (microseconds (10 * i), 10. * i));
+
+	const bool rejected = !timeseries.add (Sample (0us, 0.));
+
+	done = true;
+
+	for (std::thread &reader : readers)
+		reader.join ();
+
+	const bool ok = inconsistent == 0 && rejected && timeseries.size () == int (maxSize) &&
+				 timeseries.at (microseconds (10 * samples - 15)).value () == 10 * samples - 15;
+
+	check ("concurrent snapshots: " + std::to_string (snapshots) + " taken, " + std::to_string (inconsistent) + " inconsistent", ok);
+
+	ConcurrentTimeseries byAge(0, 100us);
+
+	for (int i = 0; i < 1000; i++)
+		byAge.add (Sample (microseconds (10 * i), 10. * i));
+
+	check ("evict by age", byAge.size () == 11 && byAge.snapshot ()[0].delay () == 9890us);
+
+	return failures == 0 ? 0 : 1;
+}
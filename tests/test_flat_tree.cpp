@@ -0,0 +1,162 @@
+#include "../include/nlib/nl_flat_tree.h"
+#include "../include/nlib/nl_utils.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "nl_test.h"
+
+using Tree = nlib::FlatTree<int>;
+
+// Output without seek support, as a pipe
+struct UnseekableBuffer : std::streambuf {
+	int overflow (int c) override {
+		content.push_back (c);
+		return c;
+	}
+
+	std::string content;
+};
+
+static std::vector<int> visit (const Tree &tree, Tree::Algorithm algorithm, Tree::Index from = 0)
+{
+	std::vector<int> visited;
+
+	tree.traverse (algorithm, [&] (Tree::Index node) { visited.push_back (tree.data (node)); }, from);
+
+	return visited;
+}
+
+int main ()
+{
+	//      0
+	//    1   2
+	//   3 4   5
+	//         6
+	Tree tree(0);
+	const Tree::Index one = tree.addChild (tree.root (), 1);
+	const Tree::Index two = tree.addChild (tree.root (), 2);
+	tree.addChild (one, 3);
+	tree.addChild (one, 4);
+	const Tree::Index five = tree.addChild (two, 5);
+	const Tree::Index six = tree.addChild (five, 6);
+
+	check ("structure", tree.size () == 7 && tree.depth (six) == 3 && tree.childrenCount (one) == 2 &&
+		  tree.nthAncestor (six, 2) == two && tree.nthDescendant (two, 2) == six && tree.nthDescendant (one, 1) == Tree::NONE);
+	check ("preorder", visit (tree, Tree::DEPTH_FIRST_PREORDER) == std::vector<int>{0, 1, 3, 4, 2, 5, 6});
+	check ("postorder", visit (tree, Tree::DEPTH_FIRST_POSTORDER) == std::vector<int>{3, 4, 1, 6, 5, 2, 0});
+	check ("breadth first", visit (tree, Tree::BREADTH_FIRST) == std::vector<int>{0, 1, 2, 3, 4, 5, 6});
+	check ("subtree", visit (tree, Tree::DEPTH_FIRST_POSTORDER, two) == std::vector<int>{6, 5, 2} &&
+		  visit (tree, Tree::DEPTH_FIRST_PREORDER, one) == std::vector<int>{1, 3, 4});
+
+	nlib::Tree<int> pointerTree(0);
+	nlib::Tree<int>::Node *pointerOne = pointerTree.root ()->addChild (1);
+	pointerOne->addChild (3);
+	pointerOne->addChild (4);
+	pointerTree.root ()->addChild (2)->addChild (5)->addChild (6);
+
+	std::stringstream json, graphviz;
+
+	tree.writeJson (json);
+	tree.writeGraphviz (graphviz);
+
+	check ("json and graphviz", json.str () == pointerTree.toJson () && graphviz.str () == pointerTree.toGraphviz ());
+
+	std::stringstream binary;
+	std::vector<char> buffer;
+
+	tree.writeBinary (binary);
+	tree.writeBinary (buffer);
+
+	const std::optional<Tree> read = Tree::readBinary (binary);
+	std::stringstream readJson;
+
+	if (read.has_value ())
+		read->writeJson (readJson);
+
+	check ("binary", read.has_value () && readJson.str () == json.str () && buffer.size () == binary.str ().size () &&
+		  std::equal (buffer.begin (), buffer.end (), binary.str ().begin ()));
+
+	std::string asyncJson;
+	std::future<void> written = tree.writeAsync ([&] (const Tree &snapshot) {
+		std::stringstream out;
+
+		snapshot.writeJson (out);
+		asyncJson = out.str ();
+	});
+
+	tree.addChild (six, 7);
+	written.wait ();
+
+	check ("async on snapshot", asyncJson == json.str () && tree.size () == 8);
+
+	// Trees are dumped in preorder, in the binary format of flat trees
+	std::stringstream pointerBinary;
+	std::vector<char> pointerBuffer;
+
+	pointerTree.writeBinary (pointerBinary);
+	pointerTree.writeBinary (pointerBuffer);
+
+	const std::string pointerBinaryString = pointerBinary.str ();
+	const std::optional<Tree> pointerRead = Tree::readBinary (pointerBinary);
+	std::stringstream pointerReadJson;
+
+	if (pointerRead.has_value ())
+		pointerRead->writeJson (pointerReadJson);
+
+	check ("tree binary read as flat tree", pointerRead.has_value () && pointerReadJson.str () == json.str () &&
+		  pointerBuffer == std::vector<char> (pointerBinaryString.begin (), pointerBinaryString.end ()) &&
+		  visit (*pointerRead, Tree::DEPTH_FIRST_PREORDER) == std::vector<int>{0, 1, 3, 4, 2, 5, 6});
+
+	// The node count is patched in the header after the records
+	std::stringstream prefixed;
+	UnseekableBuffer unseekable;
+	std::ostream unseekableStream(&unseekable);
+
+	prefixed << "prefix";
+	pointerTree.writeBinary (prefixed);
+	pointerTree.writeBinary (unseekableStream);
+
+	check ("tree binary after other output and to unseekable streams", prefixed.str () == "prefix" + pointerBinaryString &&
+		  unseekable.content == pointerBinaryString);
+
+	std::string pointerAsyncJson;
+	std::future<void> pointerWritten = pointerTree.writeAsync ([&] (const Tree &snapshot) {
+		std::stringstream out;
+
+		snapshot.writeJson (out);
+		pointerAsyncJson = out.str ();
+	});
+
+	pointerOne->addChild (7);
+	pointerWritten.wait ();
+
+	check ("tree async on snapshot", pointerAsyncJson == json.str () && pointerTree.size () == 8);
+
+	// A chain deeper than the stack allows for recursion, then wide: count the nodes of each subtree
+	nlib::FlatTree<int> large(1);
+
+	large.reserve (200000);
+	for (Tree::Index i = 1; i < 200000; i++)
+		large.addChild (i < 100000 ? i - 1 : (i * 7919) % 100000, 1);
+
+	std::vector<int> sequential(large.size ()), parallel(large.size ());
+	auto count = [&] (std::vector<int> &counts) {
+		return [&] (Tree::Index node) {
+			counts[node] = 1;
+
+			for (Tree::Index child : large.children (node))
+				counts[node] += counts[child];
+		};
+	};
+
+	large.traverse (Tree::DEPTH_FIRST_POSTORDER, count (sequential));
+	large.parallelPostorder (count (parallel), 4);
+
+	check ("parallel postorder", sequential[0] == 200000 && sequential == parallel);
+
+	large.clear (0);
+
+	check ("clear", large.size () == 1 && large.isLeaf (large.root ()));
+
+	return failures == 0 ? 0 : 1;
+}
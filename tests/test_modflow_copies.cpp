@@ -0,0 +1,146 @@
+#include "../include/nlib/nl_modflow.h"
+#include <iostream>
+#include "nl_test.h"
+
+using namespace nlib;
+
+struct Counted {
+	static int copies;
+	static int moves;
+
+	Counted () = default;
+	Counted (const Counted &) { copies++; }
+	Counted (Counted &&) { moves++; }
+	Counted &operator = (const Counted &) { copies++; return *this; }
+	Counted &operator = (Counted &&) { moves++; return *this; }
+
+	static void reset () { copies = moves = 0; }
+};
+
+int Counted::copies = 0;
+int Counted::moves = 0;
+
+class Receiver : public NlModule {
+public:
+	Receiver (NlModFlow *modFlow):
+		  NlModule (modFlow, "receiver")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("zero", &Receiver::onZero);
+		requestConnection ("one", &Receiver::onOne);
+		requestConnection ("two", &Receiver::onTwo);
+		requestConnection ("three", &Receiver::onThree);
+		requestConnection ("service", &Receiver::onService);
+		requestConnection ("sink", &Receiver::onSink);
+	}
+
+	void onZero () { calls++; }
+	void onOne (const Counted &) { calls++; }
+	void onTwo (const Counted &, const Counted &) { calls++; }
+	void onThree (const Counted &, const Counted &, const Counted &) { calls++; }
+	Counted onService (const Counted &) { calls++; return Counted (); }
+	void onSink (Counted) { calls++; }
+
+	int calls = 0;
+};
+
+class Sender : public NlModule {
+public:
+	Sender (NlModFlow *modFlow):
+		  NlModule (modFlow, "sender")
+	{}
+
+	void setupNetwork () override {
+		zero = createChannel<> ("zero");
+		one = createChannel<Counted> ("one");
+		two = createChannel<Counted, Counted> ("two");
+		three = createChannel<Counted, Counted, Counted> ("three");
+		service = createChannel<Counted> ("service");
+		sink = createChannel<Counted> ("sink");
+	}
+
+	void sendTyped (const Counted &a, const Counted &b, const Counted &c) {
+		emit (zero);
+		emit (one, a);
+		emit (two, a, b);
+		emit (three, a, b, c);
+	}
+
+	void sendUntyped (const Counted &a, const Counted &b, const Counted &c) {
+		emit (static_cast<const Channel &> (three), a, b, c);
+		emit ("two", a, b);
+	}
+
+	Counted requestService (const Counted &a) {
+		return callService<Counted> (service, a);
+	}
+
+	void sendMoved (Counted &&a) {
+		emitMove (sink, std::move (a));
+	}
+
+private:
+	TypedChannel<> zero;
+	TypedChannel<Counted> one;
+	TypedChannel<Counted, Counted> two;
+	TypedChannel<Counted, Counted, Counted> three;
+	TypedChannel<Counted> service;
+	TypedChannel<Counted> sink;
+};
+
+class CopiesModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		sender = std::dynamic_pointer_cast<Sender> (loadModule<Sender> ());
+		receiver = std::dynamic_pointer_cast<Receiver> (loadModule<Receiver> ());
+	}
+
+	std::shared_ptr<Sender> sender;
+	std::shared_ptr<Receiver> receiver;
+};
+
+static void check (const std::string &what, int calls, int expectedCalls, int expectedMoves) {
+	if (calls == expectedCalls && Counted::copies == 0 && Counted::moves == expectedMoves) {
+		std::cout << "[ OK ] " << what << std::endl;
+		return;
+	}
+
+	std::cout << "[FAIL] " << what << ": calls " << calls << ", copies " << Counted::copies << ", moves " << Counted::moves << std::endl;
+	failures++;
+}
+
+int main () {
+	XmlRpc::XmlRpcValue value;
+	value["sender"]["unused"] = true;
+	value["receiver"]["unused"] = true;
+
+	CopiesModFlow modFlow;
+	modFlow.init (NlParams (value));
+
+	modFlow.finalize ();
+
+	Counted a, b, c;
+	int calls = modFlow.receiver->calls;
+
+	Counted::reset ();
+	modFlow.sender->sendTyped (a, b, c);
+	check ("typed emit, arity 0 to 3", modFlow.receiver->calls - calls, 4, 0);
+
+	calls = modFlow.receiver->calls;
+	Counted::reset ();
+	modFlow.sender->sendUntyped (a, b, c);
+	check ("untyped emit", modFlow.receiver->calls - calls, 2, 0);
+
+	calls = modFlow.receiver->calls;
+	Counted::reset ();
+	modFlow.sender->requestService (a);
+	check ("service return", modFlow.receiver->calls - calls, 1, 0);
+
+	calls = modFlow.receiver->calls;
+	Counted::reset ();
+	modFlow.sender->sendMoved (std::move (a));
+	check ("by-value slot through emitMove", modFlow.receiver->calls - calls, 1, 1);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,428 @@
+#include "../include/nlib/nl_modflow.h"
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include "nl_test.h"
+
+using namespace nlib;
+
+// Allocations made while counting, by any thread
+static std::atomic<bool> countAllocations(false);
+static std::atomic<long> allocations(0);
+
+void *operator new (std::size_t size)
+{
+	if (countAllocations)
+		allocations++;
+
+	if (void *memory = std::malloc (size > 0 ? size : 1))
+		return memory;
+
+	throw std::bad_alloc ();
+}
+
+// Not inlined, so that free is not seen paired with new
+__attribute__((noinline)) void operator delete (void *memory) noexcept {
+	std::free (memory);
+}
+
+__attribute__((noinline)) void operator delete (void *memory, std::size_t) noexcept {
+	std::free (memory);
+}
+
+// Counters are plain members: slots of a module never run concurrently
+class Counter : public NlModule {
+public:
+	Counter (NlModFlow *modFlow, const std::string &name):
+		  NlModule (modFlow, name)
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("input", &Counter::onInput);
+		forward = createChannel<int> (name () + "_forward");
+		scale = resources ().handle<const int> ("scale");
+	}
+
+	void onInput (int value) {
+		count++;
+		sum += *scale * value;
+		emit (forward, value);
+	}
+
+	int count = 0;
+	long sum = 0;
+
+	DEF_SHARED (Counter)
+
+private:
+	TypedChannel<int> forward;
+	// Shared by the counters and read concurrently
+	ResourceHandle<const int> scale;
+};
+
+class Collector : public NlModule {
+public:
+	Collector (NlModFlow *modFlow):
+		  NlModule (modFlow, "collector")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("first_forward", &Collector::onForward);
+		requestConnection ("second_forward", &Collector::onForward);
+		requestConnection ("square", &Collector::square);
+	}
+
+	void onForward (int) {
+		count++;
+		depth = lastEvent ()->depth ();
+	}
+
+	int square (int value) {
+		return value * value;
+	}
+
+	int count = 0;
+	int depth = 0;
+
+	DEF_SHARED (Collector)
+};
+
+class Client : public NlModule {
+public:
+	Client (NlModFlow *modFlow):
+		  NlModule (modFlow, "client")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("request", &Client::onRequest);
+		square = createChannel<int> ("square");
+	}
+
+	void onRequest (int value) {
+		if (callService<int> (square, value) == value * value)
+			served++;
+	}
+
+	int served = 0;
+
+	DEF_SHARED (Client)
+
+private:
+	TypedChannel<int> square;
+};
+
+class ExecutorModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		_resources.create<int> ("scale", 3);
+		first = loadModule<Counter> ("first");
+		second = loadModule<Counter> ("second");
+		client = loadModule<Client> ();
+		collector = loadModule<Collector> ();
+	}
+
+	Counter::Ptr first, second;
+	Collector::Ptr collector;
+	Client::Ptr client;
+};
+
+class Producer : public NlModule {
+public:
+	Producer (NlModFlow *modFlow):
+		  NlModule (modFlow, "producer")
+	{}
+
+	void setupNetwork () override {
+		latest = createChannel<int> ("latest", {4, OverflowPolicy::KeepLatest, nullptr});
+		oldest = createChannel<int> ("oldest", {4, OverflowPolicy::DropOldest, nullptr});
+		blocking = createChannel<int> ("blocking", {2, OverflowPolicy::Block, nullptr});
+		coalesced = createChannel<int> ("coalesced", {4, OverflowPolicy::CoalesceByKey, [] (int value) -> std::size_t { return value % 2; }});
+	}
+
+	void send (const TypedChannel<int> &channel, int count) {
+		for (int i = 0; i < count; i++)
+			emit (channel, i);
+	}
+
+	TypedChannel<int> latest, oldest, blocking, coalesced;
+
+	DEF_SHARED (Producer)
+};
+
+// Slots wait for the gate to open, to fill the queues deterministically
+class SlowConsumer : public NlModule {
+public:
+	SlowConsumer (NlModFlow *modFlow):
+		  NlModule (modFlow, "slow_consumer")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("latest", &SlowConsumer::onLatest);
+		requestConnection ("oldest", &SlowConsumer::onOldest);
+		requestConnection ("blocking", &SlowConsumer::onBlocking);
+		requestConnection ("coalesced", &SlowConsumer::onCoalesced);
+	}
+
+	void onLatest (int value) { wait (); latest.push_back (value); }
+	void onOldest (int value) { wait (); oldest.push_back (value); }
+	void onBlocking (int value) { wait (); blocking.push_back (value); }
+	void onCoalesced (int value) { wait (); coalesced.push_back (value); }
+
+	std::atomic<bool> open{false};
+	std::vector<int> latest, oldest, blocking, coalesced;
+
+	DEF_SHARED (SlowConsumer)
+
+private:
+	void wait () {
+		while (!open)
+			std::this_thread::yield ();
+	}
+};
+
+class QueuesModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		producer = loadModule<Producer> ();
+		consumer = loadModule<SlowConsumer> ();
+	}
+
+	Producer::Ptr producer;
+	SlowConsumer::Ptr consumer;
+};
+
+// Runs a long cascade, waking the other module on its first event
+class Busy : public NlModule {
+public:
+	Busy (NlModFlow *modFlow):
+		  NlModule (modFlow, "busy")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("work", &Busy::onWork);
+		wake = createChannel<int> ("wake");
+	}
+
+	void onWork (int) {
+		if (processed++ == 0) {
+			emit (wake, 0);
+
+			// All the work is queued before the first event is processed
+			while (!open)
+				std::this_thread::yield ();
+		}
+	}
+
+	std::atomic<bool> open{false};
+	std::atomic<int> processed{0};
+	TypedChannel<int> wake;
+
+	DEF_SHARED (Busy)
+};
+
+class Sleeper : public NlModule {
+public:
+	Sleeper (NlModFlow *modFlow, Busy *busy):
+		  NlModule (modFlow, "sleeper"),
+		  busy(busy)
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("wake", &Sleeper::onWake);
+	}
+
+	void onWake (int) {
+		busyProcessed = busy->processed;
+	}
+
+	Busy *busy;
+	int busyProcessed = -1;
+
+	DEF_SHARED (Sleeper)
+};
+
+class FairnessModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		busy = loadModule<Busy> ();
+		sleeper = loadModule<Sleeper> (busy.get ());
+	}
+
+	Busy::Ptr busy;
+	Sleeper::Ptr sleeper;
+};
+
+static void check (const std::string &what, const std::vector<int> &got, const std::vector<int> &expected, const QueueStats &stats, uint64_t dropped)
+{
+	std::string received;
+
+	for (int value : got)
+		received += " " + std::to_string (value);
+
+	check (what + ": received" + received + ", dropped " + std::to_string (stats.dropped),
+		  got == expected && stats.dropped == dropped && stats.depth == 0);
+}
+
+void testQueues ()
+{
+	XmlRpc::XmlRpcValue value;
+	value["mod_flow"]["executor"]["threads"] = 2;
+	value["producer"]["unused"] = true;
+	value["slow_consumer"]["unused"] = true;
+
+	QueuesModFlow modFlow;
+	modFlow.init (NlParams (value));
+	modFlow.finalize ();
+
+	Producer &producer = *modFlow.producer;
+	SlowConsumer &consumer = *modFlow.consumer;
+
+	// The first event is processed while the others are queued
+	producer.send (producer.latest, 10);
+	producer.send (producer.oldest, 10);
+	producer.send (producer.coalesced, 10);
+
+	std::thread blockingProducer([&] { producer.send (producer.blocking, 5); });
+
+	while (modFlow.queueStats (producer.blocking).depth < 2)
+		std::this_thread::yield ();
+
+	consumer.open = true;
+	blockingProducer.join ();
+	modFlow.waitIdle ();
+
+	check ("keep latest", consumer.latest, {0, 9}, modFlow.queueStats (producer.latest), 8);
+	check ("drop oldest", consumer.oldest, {0, 6, 7, 8, 9}, modFlow.queueStats (producer.oldest), 5);
+	check ("coalesce by key", consumer.coalesced, {0, 9, 8}, modFlow.queueStats (producer.coalesced), 7);
+	check ("block", consumer.blocking, {0, 1, 2, 3, 4}, modFlow.queueStats (producer.blocking), 0);
+}
+
+void testStrands ()
+{
+	const int producers = 4;
+	const int emits = 2000;
+
+	XmlRpc::XmlRpcValue value;
+	value["mod_flow"]["executor"]["threads"] = 4;
+	value["first"]["unused"] = true;
+	value["second"]["unused"] = true;
+	value["collector"]["unused"] = true;
+	value["client"]["unused"] = true;
+
+	ExecutorModFlow modFlow;
+	modFlow.init (NlParams (value));
+
+	TypedChannel<int> input = modFlow.sources ()->declareSource<int> ("input");
+	TypedChannel<int> request = modFlow.sources ()->declareSource<int> ("request");
+
+	modFlow.finalize ();
+
+	// Sources are called concurrently, as from an asynchronous spinner
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < producers; i++) {
+		threads.emplace_back ([&] {
+			for (int j = 0; j < emits; j++) {
+				modFlow.sources ()->callSource (input, j);
+				modFlow.sources ()->callSource (request, j % 100);
+			}
+		});
+	}
+
+	for (std::thread &thread : threads)
+		thread.join ();
+
+	modFlow.waitIdle ();
+
+	const int total = producers * emits;
+	const long sum = 3l * producers * emits * (emits - 1) / 2;
+	const bool ok = modFlow.first->count == total && modFlow.second->count == total &&
+				 modFlow.first->sum == sum && modFlow.second->sum == sum &&
+				 modFlow.collector->count == 2 * total && modFlow.collector->depth == 1 &&
+				 modFlow.client->served == total;
+
+	check ("strands: " + std::to_string (modFlow.first->count) + " " + std::to_string (modFlow.second->count) + " " +
+		  std::to_string (modFlow.collector->count) + " " + std::to_string (modFlow.client->served), ok);
+
+	// Workers index the channel tables while running
+	check ("channels fixed after finalize", aborts ([&] { modFlow.sources ()->declareSource<int> ("late"); }));
+}
+
+void testAllocations ()
+{
+	const int emits = 1000;
+
+	XmlRpc::XmlRpcValue value;
+	value["mod_flow"]["executor"]["threads"] = 2;
+	value["first"]["unused"] = true;
+	value["second"]["unused"] = true;
+	value["collector"]["unused"] = true;
+	value["client"]["unused"] = true;
+
+	ExecutorModFlow modFlow;
+	modFlow.init (NlParams (value));
+
+	TypedChannel<int> input = modFlow.sources ()->declareSource<int> ("input");
+	modFlow.sources ()->declareSource<int> ("request");
+
+	modFlow.finalize ();
+
+	auto burst = [&] {
+		for (int i = 0; i < emits; i++)
+			modFlow.sources ()->callSource (input, i);
+
+		modFlow.waitIdle ();
+	};
+
+	// Grow the task pools and the worker queues
+	burst ();
+
+	countAllocations = true;
+	burst ();
+	countAllocations = false;
+
+	// Each of the three emits of an input allocates its delivery, the tasks of the four slot calls are recycled
+	const double perInput = double (allocations) / emits;
+
+	check ("steady-state dispatch: " + std::to_string (perInput) + " allocations per input", perInput < 3.5);
+}
+
+void testFairness ()
+{
+	const int batch = 4;
+
+	XmlRpc::XmlRpcValue value;
+	value["mod_flow"]["executor"]["threads"] = 1;
+	value["mod_flow"]["executor"]["batch"] = batch;
+	value["busy"]["unused"] = true;
+	value["sleeper"]["unused"] = true;
+
+	FairnessModFlow modFlow;
+	modFlow.init (NlParams (value));
+
+	TypedChannel<int> work = modFlow.sources ()->declareSource<int> ("work");
+
+	modFlow.finalize ();
+
+	for (int i = 0; i < 1000; i++)
+		modFlow.sources ()->callSource (work, i);
+
+	modFlow.busy->open = true;
+	modFlow.waitIdle ();
+
+	// The busy strand yields the only worker after each batch
+	check ("strands yield after a batch: woken after " + std::to_string (modFlow.sleeper->busyProcessed) + " events",
+		  modFlow.sleeper->busyProcessed >= 1 && modFlow.sleeper->busyProcessed <= batch);
+}
+
+int main ()
+{
+	testStrands ();
+	testQueues ();
+	testAllocations ();
+	testFairness ();
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include "../include/nlib/nl_modflow.h"
+#include <iostream>
+#include <thread>
+#include "nl_test.h"
+
+using namespace nlib;
+
+// Scales its input by the bound gain, which can be reloaded while running
+class Scaler : public NlModule {
+	struct Params {
+		int gain;
+		int offset;
+
+		static auto fields () {
+			return std::make_tuple (paramField ("gain", &Params::gain),
+							    paramField ("offset", &Params::offset, 0));
+		}
+	};
+
+public:
+	Scaler (NlModFlow *modFlow, const std::string &name):
+		  NlModule (modFlow, name)
+	{
+		bindParams (_params);
+	}
+
+	void setupNetwork () override {
+		requestConnection ("input", &Scaler::onInput);
+	}
+
+	void onParamsChanged (const NlParams &) override {
+		changes++;
+	}
+
+	void onInput (int value) {
+		last = _params.gain * value + _params.offset;
+	}
+
+	int last = 0;
+	int changes = 0;
+
+	DEF_SHARED (Scaler)
+
+private:
+	Params _params;
+};
+
+class ScalerModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		first = loadModule<Scaler> ("first");
+		second = loadModule<Scaler> ("second");
+	}
+
+	Scaler::Ptr first, second;
+};
+
+static XmlRpc::XmlRpcValue graphParams (int threads, int firstGain, int secondGain)
+{
+	XmlRpc::XmlRpcValue value;
+
+	value["mod_flow"]["executor"]["threads"] = threads;
+	value["first"]["gain"] = firstGain;
+	value["second"]["gain"] = secondGain;
+
+	return value;
+}
+
+static void testBinding ()
+{
+	XmlRpc::XmlRpcValue value;
+	value["first"]["gain"] = std::string ("two");
+
+	ScalerModFlow modFlow;
+	std::string message;
+
+	modFlow.init (NlParams (value));
+
+	try {
+		modFlow.finalize ();
+	} catch (const XmlRpc::XmlRpcException &e) {
+		message = e.getMessage ();
+	}
+
+	// Mistyped gain of the first module and missing gain of the second one
+	check ("all binding errors reported", message.find ("2 invalid module params") == 0);
+}
+
+static void testReload (int threads)
+{
+	ScalerModFlow modFlow;
+
+	modFlow.init (NlParams (graphParams (threads, 2, 3)));
+
+	TypedChannel<int> input = modFlow.sources ()->declareSource<int> ("input");
+
+	modFlow.finalize ();
+	modFlow.sources ()->callSource (input, 10);
+	modFlow.waitIdle ();
+
+	const std::string mode = threads > 0 ? " with executor" : "";
+
+	check ("bound params" + mode, modFlow.first->last == 20 && modFlow.second->last == 30);
+
+	modFlow.reloadParams (NlParams (graphParams (threads, 5, 3)));
+	modFlow.sources ()->callSource (input, 10);
+	modFlow.waitIdle ();
+
+	check ("reload changed subtrees" + mode, modFlow.first->last == 50 && modFlow.second->last == 30 &&
+		  modFlow.first->changes == 1 && modFlow.second->changes == 0 &&
+		  modFlow.params ()->get<int> ("first/gain") == 5);
+
+	bool thrown = false;
+	XmlRpc::XmlRpcValue invalid = graphParams (threads, 7, 3);
+	invalid["second"]["gain"] = std::string ("three");
+
+	try {
+		modFlow.reloadParams (NlParams (invalid));
+	} catch (const XmlRpc::XmlRpcException &e) {
+		thrown = true;
+	}
+
+	modFlow.sources ()->callSource (input, 10);
+	modFlow.waitIdle ();
+
+	check ("invalid reload not applied" + mode, thrown && modFlow.first->last == 50 && modFlow.first->changes == 1 &&
+		  modFlow.params ()->get<int> ("first/gain") == 5);
+}
+
+static void testSnapshotCell ()
+{
+	SnapshotCell<int> cell(std::make_shared<const int> (0));
+	std::atomic<bool> stop(false);
+	std::atomic<bool> ordered(true);
+	std::vector<std::thread> readers;
+
+	for (int i = 0; i < 3; i++) {
+		readers.emplace_back ([&] {
+			int last = 0;
+
+			while (!stop.load ()) {
+				const int current = *cell.load ();
+
+				if (current < last)
+					ordered = false;
+				last = current;
+			}
+		});
+	}
+
+	for (int i = 1; i <= 10000; i++)
+		cell.store (std::make_shared<const int> (i));
+
+	stop = true;
+	for (std::thread &reader : readers)
+		reader.join ();
+
+	check ("snapshot cell", ordered && *cell.load () == 10000);
+}
+
+int main ()
+{
+	testBinding ();
+	testReload (0);
+	testReload (2);
+	testSnapshotCell ();
+
+	return failures == 0 ? 0 : 1;
+}
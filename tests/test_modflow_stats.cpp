@@ -0,0 +1,108 @@
+#include "../include/nlib/nl_modflow.h"
+#include <iostream>
+#include "nl_test.h"
+
+using namespace nlib;
+
+class Doubler : public NlModule {
+public:
+	Doubler (NlModFlow *modFlow):
+		  NlModule (modFlow, "doubler")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("input", &Doubler::onInput);
+		output = requireSink<int> ("output");
+	}
+
+	void onInput (int value) {
+		// Only even values reach the sink
+		if (value % 2 == 0)
+			emit (output, 2 * value);
+	}
+
+	DEF_SHARED (Doubler)
+
+private:
+	TypedChannel<int> output;
+};
+
+class StatsModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		loadModule<Doubler> ();
+	}
+};
+
+struct Output {
+	void onOutput (int) { received++; }
+
+	int received = 0;
+};
+
+static void testHistogram ()
+{
+	LatencyHistogram histogram;
+
+	for (uint64_t value = 1; value <= 100000; value++)
+		histogram.record (value);
+
+	const LatencySummary summary = histogram.summary ();
+	auto near = [] (uint64_t value, uint64_t expected) {
+		return std::abs (double (value) - expected) <= 0.03 * expected;
+	};
+
+	check ("histogram percentiles", summary.count == 100000 && summary.min == 1 && summary.max == 100000 &&
+		  near (summary.p50, 50000) && near (summary.p90, 90000) && near (summary.p99, 99000) &&
+		  std::abs (summary.mean - 50000.5) < 1e-6);
+}
+
+static void testGraph (int threads)
+{
+	const int emits = 1000;
+	XmlRpc::XmlRpcValue value;
+	value["mod_flow"]["stats"]["enable"] = true;
+	value["mod_flow"]["executor"]["threads"] = threads;
+	value["doubler"]["unused"] = true;
+
+	StatsModFlow modFlow;
+	Output output;
+
+	modFlow.init (NlParams (value));
+
+	TypedChannel<int> input = modFlow.sources ()->declareSource<int> ("input");
+	modFlow.sinks ()->declareSink ("output", &Output::onOutput, &output);
+
+	modFlow.finalize ();
+
+	for (int i = 0; i < emits; i++)
+		modFlow.sources ()->callSource (input, i);
+
+	modFlow.waitIdle ();
+
+	const ModFlowStats stats = modFlow.stats ();
+	std::map<std::string, ChannelStats> channels;
+	std::map<std::string, SlotStats> slots;
+
+	for (const ChannelStats &channel : stats.channels)
+		channels[channel.name] = channel;
+	for (const SlotStats &slot : stats.slots)
+		slots[slot.channel] = slot;
+
+	const std::string mode = threads > 0 ? " with executor" : "";
+
+	check ("emit counts" + mode, channels["input"].emits == emits && channels["output"].emits == emits / 2);
+	check ("slot latency" + mode, slots["input"].module == "doubler" && slots["input"].latency.count == emits &&
+		  slots["output"].module == "sinks" && slots["output"].latency.count == emits / 2);
+	check ("source to sink latency" + mode, channels["input"].endToEnd.count == emits / 2 &&
+		  channels["output"].endToEnd.count == 0 && output.received == emits / 2);
+}
+
+int main ()
+{
+	testHistogram ();
+	testGraph (0);
+	testGraph (2);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include "../include/nlib/nl_synchronizer.h"
+#include <iostream>
+#include "nl_test.h"
+
+using namespace nlib;
+using namespace std::chrono;
+
+using Clock = system_clock;
+using TimedInt = TimedObject<int, Clock, milliseconds>;
+using TimedDouble = TimedObject<double, Clock, milliseconds>;
+using Synchronizer = NlSynchronizer<Clock, milliseconds, int, double>;
+
+class Fusion : public NlModule {
+public:
+	Fusion (NlModFlow *modFlow):
+		  NlModule (modFlow, "fusion")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("synchronized", &Fusion::onSynchronized);
+	}
+
+	void onSynchronized (const TimedInt &first, const TimedDouble &second) {
+		received.push_back ({first.obj (), second.obj ()});
+	}
+
+	std::vector<std::pair<int, double>> received;
+
+	DEF_SHARED (Fusion)
+};
+
+class SynchronizerModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		synchronizer = loadModule<Synchronizer> ("synchronizer", std::array<std::string, 2>{"ints", "doubles"}, "synchronized");
+		fusion = loadModule<Fusion> ();
+	}
+
+	Synchronizer::Ptr synchronizer;
+	Fusion::Ptr fusion;
+};
+
+static Clock::time_point at (int ms) {
+	return Clock::time_point (milliseconds (ms));
+}
+
+int main ()
+{
+	XmlRpc::XmlRpcValue value;
+	value["synchronizer"]["tolerance"] = 0.005;
+
+	SynchronizerModFlow modFlow;
+
+	modFlow.init (NlParams (value));
+
+	TypedChannel<TimedInt> ints = modFlow.sources ()->declareSource<TimedInt> ("ints");
+	TypedChannel<TimedDouble> doubles = modFlow.sources ()->declareSource<TimedDouble> ("doubles");
+
+	modFlow.finalize ();
+
+	// Ints at 10 ms, doubles at 33 ms with 2 ms of offset
+	for (int i = 0; i < 10; i++)
+		modFlow.sources ()->callSource (ints, TimedInt (at (10 * i), i));
+
+	modFlow.sources ()->callSource (doubles, TimedDouble (at (2), 0.5));
+	modFlow.sources ()->callSource (doubles, TimedDouble (at (35), 3.5));
+	modFlow.sources ()->callSource (doubles, TimedDouble (at (68), 7.));
+	// Far from any int
+	modFlow.sources ()->callSource (doubles, TimedDouble (at (97), 9.5));
+
+	check ("closest matches within tolerance", modFlow.fusion->received == std::vector<std::pair<int, double>>{{0, 0.5}, {3, 3.5}, {7, 7.}});
+	check ("unmatched inputs dropped", modFlow.synchronizer->dropped () == 7);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#define INCLUDE_EIGEN
+#include "../include/nlib/nl_ros_conversions.h"
+#include <boost/make_shared.hpp>
+#include <iostream>
+#include "nl_test.h"
+
+using namespace nlib;
+
+using Array = std_msgs::Float32MultiArray;
+
+// {2, 3, 4} array after 2 extra values: element (i, j, k) is 100 i + 10 j + k
+static Array makeArray ()
+{
+	MultiArrayManager<Array, 3> manager({2, 3, 4}, 2);
+
+	manager.array ()[0] = -1;
+	manager.array ()[1] = -2;
+
+	for (int i = 0; i < 2; i++)
+		for (int j = 0; j < 3; j++)
+			for (int k = 0; k < 4; k++)
+				manager (i, j, k) = 100 * i + 10 * j + k;
+
+	return manager.release ();
+}
+
+int main ()
+{
+	const Array array = makeArray ();
+
+	check ("fixed rank writes in row major order after extra data", array.data.size () == 26 && array.data[0] == -1 &&
+			array.data[2] == 0 && array.data[3] == 1 && array.data[6] == 10 && array.data[14] == 100 && array.data[25] == 123);
+
+	boost::shared_ptr<Array> owned = boost::make_shared<Array> (array);
+	const float *storage = owned->data.data ();
+	Array::ConstPtr received = owned;
+	MultiArrayView<Array, const float, 3> view(received);
+
+	check ("views do not copy", view.data () == storage);
+
+	owned.reset ();
+	received.reset ();
+
+	check ("views keep received messages alive", view (1, 2, 3) == 123 && view.get ({1, 0, 2}) == 102 && view.size (2) == 4);
+	check ("shape", view.shape () == std::array<int, 3>{2, 3, 4});
+
+	bool rows = true;
+
+	for (int i = 0; i < 2; i++)
+		for (int j = 0; j < 3; j++)
+			rows &= view.row (i, j).size () == 4 && view.row (i, j)(3) == 100 * i + 10 * j + 3;
+
+	check ("rows", rows);
+
+	const auto slice = view.slice (1);
+
+	check ("slices", slice.rows () == 3 && slice.cols () == 4 && slice (0, 0) == 100 && slice (2, 1) == 121);
+
+	const auto matrix = view.matrix ();
+
+	check ("matrix flattens the leading dimensions", matrix.rows () == 6 && matrix.cols () == 4 &&
+			matrix (0, 0) == 0 && matrix (4, 3) == 113 && matrix (5, 0) == 120);
+
+	float buffer[6] = {1, 2, 3, 4, 5, 6};
+	MultiArrayView<Array, float, 2> bufferView(buffer, {2, 3});
+
+	bufferView.row (1) *= 10;
+	bufferView (0, 2) = 0;
+	check ("mutable views write the buffer", buffer[2] == 0 && buffer[3] == 40 && buffer[5] == 60);
+
+	Eigen::MatrixXf colMajor(2, 3);
+	colMajor << 1, 2, 3,
+			 4, 5, 6;
+
+	Array msg;
+	eigenToMsg (colMajor, {7}, msg);
+
+	check ("eigenToMsg writes row major", msg.data == std::vector<float>{7, 1, 2, 3, 4, 5, 6} &&
+			msg.layout.dim[0].size == 2 && msg.layout.dim[1].size == 3 && msg.layout.data_offset == 1);
+
+	// Refilling the message reuses its storage
+	const float *before = msg.data.data ();
+	eigenToMsg (Eigen::MatrixXf (colMajor * 2), {7}, msg);
+	check ("eigenToMsg reuses the message", msg.data.data () == before && msg.data[6] == 12);
+
+	const auto converted = msgToEigen (Array::ConstPtr (boost::make_shared<Array> (msg)));
+
+	check ("msgToEigen round trip", converted.matrix () == colMajor * 2);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include "../include/nlib/nl_nodelet.h"
+#include <std_msgs/String.h>
+
+// Compile check of NlNodelet, built as an object library: nodelets are run by a nodelet manager
+
+using namespace nlib;
+
+class Echo : public NlModule {
+public:
+	Echo (NlModFlow *modFlow):
+		  NlModule (modFlow, "echo")
+	{}
+
+	void setupNetwork () override {
+		_echo = createChannel<std::string> ("echo");
+		requestConnection ("string_source", &Echo::onString);
+	}
+
+	void onString (const std::string &value) {
+		emit (_echo, value);
+	}
+
+	DEF_SHARED (Echo)
+
+private:
+	TypedChannel<std::string> _echo;
+};
+
+class EchoModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		loadModule<Echo> ();
+	}
+
+	DEF_SHARED (EchoModFlow)
+};
+
+class EchoNodelet : public NlNodelet<EchoNodelet>
+{
+	NL_NODELET(EchoNodelet)
+
+public:
+	void onInit () override {
+		init<EchoModFlow> ();
+
+		_stringSource = sources()->declareSource<std::string> ("string_source");
+		sinks()->declareSink ("echo", &EchoNodelet::publishString, this);
+
+		finalizeModFlow ();
+	}
+
+	void initROS () {
+		addSub ("string_in", 1, &EchoNodelet::stringCallback);
+		addPub<std_msgs::String> ("string_out", 1);
+	}
+
+	void initParams () {}
+
+	void stringCallback (const std_msgs::String::ConstPtr &stringMsg) {
+		sources()->callSource (_stringSource, stringMsg->data);
+	}
+
+	void publishString (const std::string &value) {
+		std_msgs::String::Ptr stringMsg = boost::make_shared<std_msgs::String> ();
+
+		stringMsg->data = value;
+		publish ("string_out", stringMsg);
+	}
+
+protected:
+	void onSynchronousClock (const ros::TimerEvent &) {}
+
+private:
+	TypedChannel<std::string> _stringSource;
+};
@@ -0,0 +1,83 @@
+#include "../include/nlib/nl_params.h"
+#include <iostream>
+#include "nl_test.h"
+
+using namespace nlib;
+
+template<typename Function>
+static bool throws (Function function) {
+	try {
+		function ();
+	} catch (const XmlRpc::XmlRpcException &) {
+		return true;
+	}
+
+	return false;
+}
+
+struct Bound {
+	int rate;
+	std::vector<int> list;
+	std::string name;
+	double scale;
+
+	static auto fields () {
+		return std::make_tuple (paramField ("rate", &Bound::rate),
+						    paramField ("list", &Bound::list),
+						    paramField ("module/name", &Bound::name),
+						    paramField ("scale", &Bound::scale, 0.5));
+	}
+};
+
+struct Invalid {
+	std::string rate;
+	int missing;
+
+	static auto fields () {
+		return std::make_tuple (paramField ("rate", &Invalid::rate),
+						    paramField ("missing", &Invalid::missing));
+	}
+};
+
+int main ()
+{
+	XmlRpc::XmlRpcValue value;
+	value["rate"] = 10;
+	value["module"]["gain"] = 2.5;
+	value["module"]["name"] = std::string ("first");
+	value["module"]["nested"]["enabled"] = true;
+	value["list"].setSize (3);
+	value["list"][0] = 1;
+	value["list"][1] = 2;
+	value["list"][2] = 3;
+
+	const NlParams params(value, "node");
+	const NlParams module = params["module"];
+
+	check ("get", params.get<int> ("rate") == 10 && params.get<float> ("/module/gain") == 2.5f &&
+		  module.get<std::string> ("name") == "first" && module.get<bool> ("nested/enabled"));
+	check ("get vector and element", params.get<int, std::vector> ("list") == std::vector<int>{1, 2, 3} &&
+		  params.get<int> ("list", std::nullopt, 2) == 3);
+	check ("default values", params.get<int> ("missing", 4) == 4 && module.get<double> ("nested/missing", 1.5) == 1.5);
+	check ("try get", params.tryGet<int> ("rate") == 10 && !params.tryGet<int> ("missing").has_value () &&
+		  !params.tryGet<std::string> ("rate").has_value () && !params.tryGet<int> ("list", 3).has_value () &&
+		  params.tryGet<int, std::vector> ("list").value ().size () == 3);
+	check ("errors", throws ([&] { params.get<int> ("missing"); }) && throws ([&] { params["missing"].get<int> ("value"); }) &&
+		  throws ([&] { params.get<std::string> ("rate"); }) && params["missing"].get<int> ("value", 5) == 5);
+
+	Bound bound;
+	Invalid invalid;
+	ParamsBinding binding;
+	std::vector<std::string> errors;
+
+	binding.bind (bound);
+	binding.fill (params, errors);
+	check ("binding", errors.empty () && bound.rate == 10 && bound.list == std::vector<int>{1, 2, 3} &&
+		  bound.name == "first" && bound.scale == 0.5);
+
+	binding.bind (invalid);
+	binding.fill (params, errors);
+	check ("binding errors", errors.size () == 2);
+
+	return failures == 0 ? 0 : 1;
+}
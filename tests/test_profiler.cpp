@@ -0,0 +1,56 @@
+#include "../include/nlib/nl_profiler.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "nl_test.h"
+
+using namespace nlib;
+
+static void inner () {
+	PROFILE_ZONE ("inner");
+	std::this_thread::sleep_for (std::chrono::microseconds (100));
+}
+
+static void outer (int innerCalls)
+{
+	PROFILE_ZONE ("outer");
+
+	for (int i = 0; i < innerCalls; i++)
+		inner ();
+}
+
+int main ()
+{
+	std::thread thread([] {
+		for (int i = 0; i < 10; i++)
+			outer (2);
+	});
+
+	for (int i = 0; i < 10; i++)
+		outer (1);
+
+	// Outside of outer: a different call path
+	inner ();
+
+	thread.join ();
+
+	const std::vector<ZoneStats> report = ZoneProfiler::instance ().report ();
+
+	check ("call tree", report.size () == 3 &&
+		  report[0].name == "outer" && report[0].depth == 0 && report[0].latency.count == 20 &&
+		  report[1].name == "inner" && report[1].depth == 1 && report[1].latency.count == 30 &&
+		  report[2].name == "inner" && report[2].depth == 0 && report[2].latency.count == 1);
+	check ("nested time", report[0].total >= report[1].total && report[1].latency.min >= 100000);
+
+	std::stringstream table, csv;
+
+	ZoneProfiler::instance ().writeTable (table);
+	ZoneProfiler::instance ().writeCsv (csv);
+
+	const std::string csvText = csv.str ();
+
+	check ("table and csv", table.str ().find ("  inner") != std::string::npos &&
+		  std::count (csvText.begin (), csvText.end (), '\n') == 4);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+#include "../include/nlib/nl_replay.h"
+#include <cstddef>
+#include <iostream>
+#include "nl_test.h"
+
+using namespace nlib;
+using namespace std::chrono;
+
+// Sums the values, reports the sum on every tick and echoes the texts
+class Accumulator : public NlModule {
+public:
+	Accumulator (NlModFlow *modFlow):
+		  NlModule (modFlow, "accumulator")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("value", &Accumulator::onValue);
+		requestConnection ("tick", &Accumulator::onTick);
+		requestConnection ("text", &Accumulator::onText);
+		_sum = requireSink<long> ("sum");
+		_echo = requireSink<std::string, int> ("echo");
+	}
+
+	void onValue (int value) { _total += value; }
+	void onTick () { emit (_sum, _total); }
+	void onText (const std::string &text) { emit (_echo, text, int (text.size ())); }
+
+	DEF_SHARED (Accumulator)
+
+private:
+	long _total = 0;
+	TypedChannel<long> _sum;
+	TypedChannel<std::string, int> _echo;
+};
+
+class ReplayModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		loadModule<Accumulator> ();
+	}
+};
+
+static std::unique_ptr<NlReplay> makeReplay (int threads)
+{
+	XmlRpc::XmlRpcValue value;
+	value["mod_flow"]["executor"]["threads"] = threads;
+
+	auto modFlow = std::make_shared<ReplayModFlow> ();
+	modFlow->init (NlParams (value));
+
+	auto replay = std::make_unique<NlReplay> (modFlow);
+	const TypedChannel<> tick = modFlow->sources ()->declareSource<> ("tick");
+	NlSources::Ptr sources = modFlow->sources ();
+
+	replay->addSource<int> ("value");
+	replay->addSource<std::string> ("text");
+	replay->captureSink<long> ("sum");
+	replay->captureSink<std::string, int> ("echo");
+	replay->setClock (10ms, [sources, tick] (ReplayTime) { sources->callSource (tick); });
+	replay->setLockstep (true);
+
+	return replay;
+}
+
+// Values every 5 ms added in reverse, a text every 30 ms and a source not in the graph
+static Recording makeRecording (int scale)
+{
+	Recording recording;
+	const uint32_t value = recording.addSource ("value");
+	const uint32_t text = recording.addSource ("text");
+	const uint32_t unknown = recording.addSource ("unknown");
+
+	for (int i = 19; i >= 0; i--)
+		recording.add (milliseconds (5 * i), value, scale * i);
+
+	for (int i = 0; i < 4; i++)
+		recording.add (milliseconds (30 * i), text, std::string (i + 1, 'a'));
+
+	recording.add (12ms, unknown, 1.5);
+
+	return recording;
+}
+
+static std::string text (const ReplayResult &result)
+{
+	std::ostringstream out;
+
+	result.writeOutputs (out);
+	return out.str ();
+}
+
+int main ()
+{
+	const Recording recording = makeRecording (1);
+	std::stringstream stream;
+
+	recording.write (stream);
+
+	const std::optional<Recording> read = Recording::read (stream);
+
+	check ("recording round trip", read.has_value () && read->records ().size () == recording.records ().size () &&
+		  read->sources () == recording.sources () && read->duration () == 95ms);
+
+	const std::string bytes = stream.str ();
+	std::istringstream truncated(bytes.substr (0, bytes.size () - 1));
+	std::string corrupt = bytes;
+	const uint64_t hugeCount = uint64_t (1) << 40;
+
+	memcpy (&corrupt[offsetof (RecordingHeader, recordsCount)], &hugeCount, sizeof (hugeCount));
+
+	std::istringstream corrupted(corrupt);
+
+	check ("truncated and corrupt recordings rejected", !Recording::read (truncated).has_value () &&
+		  !Recording::read (corrupted).has_value ());
+
+	const ReplayResult result = makeReplay (0)->run (*read);
+	const std::string outputs = text (result);
+
+	// Ticks at 10..90 ms come before the values of the same time
+	check ("replay", result.records == 24 && result.skipped == 1 && result.ticks == 9 && result.span == 95ms &&
+		  outputs.find ("0 echo a 1\n10000000 sum 1\n") == 0 && outputs.find ("90000000 sum 153\n") != std::string::npos &&
+		  outputs.find ("90000000 echo aaaa 4\n") != std::string::npos && result.speedup () > 0);
+
+	check ("deterministic with executor", result.outputs == makeReplay (2)->run (recording).outputs);
+
+	std::vector<Recording> recordings;
+
+	for (int i = 1; i <= 4; i++)
+		recordings.push_back (makeRecording (i));
+
+	const std::vector<ReplayResult> parallel = replayParallel (recordings, [] { return makeReplay (0); }, 2);
+	bool same = parallel.size () == recordings.size ();
+
+	for (std::size_t i = 0; same && i < recordings.size (); i++)
+		same = parallel[i].outputs == makeReplay (0)->run (recordings[i]).outputs;
+
+	check ("parallel recordings", same && parallel[3].outputs[1].value == "4");
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#include "../include/nlib/nl_utils.h"
+#include <iostream>
+#include "nl_test.h"
+
+using namespace nlib;
+
+struct Calibration {
+	Calibration (double gain):
+		 gain(gain)
+	{}
+
+	double gain;
+};
+
+int main ()
+{
+	ResourceManager resources;
+
+	check ("empty handles are unresolved", !ResourceHandle<Calibration> ());
+
+	resources.create<Calibration> ("calibration", 2.);
+	resources.create<std::vector<int>> ("indices", std::vector<int>{1, 2, 3});
+
+	ResourceHandle<Calibration> calibration = resources.handle<Calibration> ("calibration");
+	const ResourceManager &constResources = resources;
+	ResourceHandle<const std::vector<int>> indices = constResources.handle<std::vector<int>> ("indices");
+
+	check ("handles resolve by name", calibration && calibration->gain == 2. && indices->size () == 3 && (*indices)[2] == 3);
+	check ("handles and get share the object", calibration.get () == resources.get<Calibration> ("calibration").get ());
+
+	calibration->gain = 3.;
+	check ("writes through handles are shared", resources.get<Calibration> ("calibration")->gain == 3.);
+
+	resources.create<Calibration> ("calibration", 5.);
+	check ("handles see resources created again", calibration->gain == 5. && calibration.get () == resources.get<Calibration> ("calibration").get ());
+
+	check ("contains", resources.contains ("calibration") && !resources.contains ("missing"));
+	check ("type mismatch aborts", aborts ([&] { resources.handle<int> ("calibration"); }));
+	check ("missing resource aborts", aborts ([&] { resources.handle<Calibration> ("missing"); }));
+	check ("get with type mismatch aborts", aborts ([&] { resources.get<std::vector<float>> ("indices"); }));
+	check ("creating again with another type aborts", aborts ([&] { resources.create<int> ("calibration", 1); }));
+
+	return failures == 0 ? 0 : 1;
+}
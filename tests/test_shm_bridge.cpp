@@ -0,0 +1,211 @@
+#include "../include/nlib/nl_shm_bridge.h"
+#include <std_msgs/Float32MultiArray.h>
+#include <iostream>
+#include <mutex>
+#include "nl_test.h"
+
+using namespace nlib;
+using namespace std::chrono;
+
+using Array = std_msgs::Float32MultiArray;
+using SinkBridge = NlShmSinkBridge<int, std::string, Array>;
+using SourceBridge = NlShmSourceBridge<int, std::string, Array>;
+
+static const std::string SEGMENT = "/nlib_test_shm_bridge_" + std::to_string (getpid ());
+
+class Receiver : public NlModule {
+public:
+	Receiver (NlModFlow *modFlow):
+		  NlModule (modFlow, "receiver")
+	{}
+
+	void setupNetwork () override {
+		requestConnection ("received", &Receiver::onReceived);
+	}
+
+	void onReceived (const int &index, const std::string &label, const Array &array) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		indices.push_back (index);
+		labels.push_back (label);
+		arrays.push_back (array);
+	}
+
+	std::size_t count () {
+		std::lock_guard<std::mutex> lock(mutex);
+		return indices.size ();
+	}
+
+	std::mutex mutex;
+	std::vector<int> indices;
+	std::vector<std::string> labels;
+	std::vector<Array> arrays;
+
+	DEF_SHARED (Receiver)
+};
+
+class WriterModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		bridge = loadModule<SinkBridge> ("sink_bridge", "samples", SEGMENT);
+	}
+
+	SinkBridge::Ptr bridge;
+};
+
+class ReaderModFlow : public NlModFlow {
+public:
+	ReaderModFlow (const std::string &segment = SEGMENT):
+		  segment(segment)
+	{}
+
+	void loadModules () override {
+		bridge = loadModule<SourceBridge> ("source_bridge", segment, "received");
+		receiver = loadModule<Receiver> ();
+	}
+
+	const std::string segment;
+	SourceBridge::Ptr bridge;
+	Receiver::Ptr receiver;
+};
+
+// Opens the segment with other types
+class MismatchModFlow : public NlModFlow {
+public:
+	void loadModules () override {
+		loadModule<NlShmSourceBridge<double>> ("source_bridge", SEGMENT, "received");
+	}
+};
+
+static Array makeArray (int index)
+{
+	Array array;
+
+	array.layout.dim.resize (2);
+	array.layout.dim[0].label = "rows";
+	array.layout.dim[0].size = 2;
+	array.layout.dim[0].stride = 2 * (index + 1);
+	array.layout.dim[1].label = "columns";
+	array.layout.dim[1].size = index + 1;
+	array.layout.dim[1].stride = index + 1;
+	array.layout.data_offset = index;
+
+	for (int i = 0; i < 2 * (index + 1); i++)
+		array.data.push_back (index + 0.25f * i);
+
+	return array;
+}
+
+// Source bridges require the executor
+static XmlRpc::XmlRpcValue bridgeParams (const std::string &name, bool executor)
+{
+	XmlRpc::XmlRpcValue value;
+
+	value[name]["slots"] = 4;
+	value[name]["slot_size"] = 4096;
+
+	if (executor)
+		value["mod_flow"]["executor"]["threads"] = 1;
+
+	return value;
+}
+
+static bool waitFor (const std::function<bool ()> &condition)
+{
+	const auto deadline = steady_clock::now () + seconds (5);
+
+	while (!condition ()) {
+		if (steady_clock::now () > deadline)
+			return false;
+
+		std::this_thread::sleep_for (milliseconds (1));
+	}
+
+	return true;
+}
+
+int main ()
+{
+	WriterModFlow writer;
+	ReaderModFlow reader;
+
+	writer.init (NlParams (bridgeParams ("sink_bridge", false)));
+	TypedChannel<int, std::string, Array> samples = writer.sources ()->declareSource<int, std::string, Array> ("samples");
+	writer.finalize ();
+
+	reader.init (NlParams (bridgeParams ("source_bridge", true)));
+	reader.finalize ();
+
+	const int count = 100;
+	int written = 0;
+
+	// The ring has 4 slots: wait for the reader when it is full, so that no value is dropped
+	while (written < count) {
+		const uint64_t dropped = writer.bridge->dropped ();
+
+		writer.sources ()->callSource (samples, written, "sample " + std::to_string (written), makeArray (written % 8));
+
+		if (writer.bridge->dropped () == dropped)
+			written++;
+		else
+			waitFor ([&] { return reader.receiver->count () == std::size_t (written); });
+	}
+
+	check ("all values received", waitFor ([&] { return reader.receiver->count () == count; }));
+
+	bool inOrder = true, equal = true;
+
+	for (int i = 0; i < count && i < int (reader.receiver->indices.size ()); i++) {
+		const Array expected = makeArray (i % 8);
+		const Array &array = reader.receiver->arrays[i];
+		bool layout = array.layout.dim.size () == 2 && array.layout.data_offset == expected.layout.data_offset;
+
+		for (std::size_t d = 0; layout && d < 2; d++)
+			layout = array.layout.dim[d].label == expected.layout.dim[d].label &&
+					 array.layout.dim[d].size == expected.layout.dim[d].size &&
+					 array.layout.dim[d].stride == expected.layout.dim[d].stride;
+
+		inOrder = inOrder && reader.receiver->indices[i] == i;
+		equal = equal && layout && array.data == expected.data && reader.receiver->labels[i] == "sample " + std::to_string (i);
+	}
+
+	check ("values in order", inOrder);
+	check ("strings and arrays preserved", equal);
+
+	// Too large for a slot
+	const uint64_t dropped = writer.bridge->dropped ();
+	writer.sources ()->callSource (samples, -1, std::string (8192, 'x'), Array ());
+	check ("values larger than a slot dropped", writer.bridge->dropped () == dropped + 1);
+
+	check ("type mismatch aborts", aborts ([] {
+		MismatchModFlow mismatch;
+
+		mismatch.init (NlParams (bridgeParams ("source_bridge", true)));
+		mismatch.finalize ();
+	}));
+
+	check ("source bridges without executor abort", aborts ([] {
+		ReaderModFlow synchronous(SEGMENT + "_synchronous");
+
+		synchronous.init (NlParams (bridgeParams ("source_bridge", false)));
+		synchronous.finalize ();
+	}));
+
+	// Destroying the graph stops the thread of the bridge and removes the segment no writer attached to
+	const std::string unused = SEGMENT + "_unused";
+
+	{
+		ReaderModFlow waiting(unused);
+
+		waiting.init (NlParams (bridgeParams ("source_bridge", true)));
+		waiting.finalize ();
+	}
+
+	const int fd = shm_open (unused.c_str (), O_RDWR, 0600);
+	check ("segments created by readers removed", fd < 0 && errno == ENOENT);
+
+	reader.bridge->stop ();
+	check ("no invalid values", reader.bridge->invalid () == 0);
+
+	return failures == 0 ? 0 : 1;
+}
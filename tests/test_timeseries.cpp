@@ -0,0 +1,117 @@
+#define INCLUDE_EIGEN
+#include "../include/nlib/nl_timeseries.h"
+#include <iostream>
+#include "nl_test.h"
+
+using namespace std::chrono;
+using namespace std::literals::chrono_literals;
+
+using BoundedTimeseries = nlib::BoundedTimeseries<float, milliseconds>;
+using Sample = BoundedTimeseries::Sample;
+
+static std::vector<long> delays (const BoundedTimeseries &timeseries) {
+	std::vector<long> result;
+
+	for (const Sample &sample : timeseries)
+		result.push_back (sample.delay ().count ());
+
+	return result;
+}
+
+int main ()
+{
+	BoundedTimeseries bySize(4);
+
+	for (int i = 0; i < 10; i++)
+		bySize.add (Sample (milliseconds (10 * i), i));
+
+	check ("evict by size", delays (bySize) == std::vector<long>{60, 70, 80, 90} && bySize[-1].obj () == 9);
+	check ("interpolate", bySize.at (75ms).value () == 7.5f && !bySize.at (50ms).success ());
+
+	BoundedTimeseries byAge(0, 100ms);
+
+	for (int i = 0; i < 1000; i++)
+		byAge.add (Sample (milliseconds (10 * i), i));
+
+	check ("evict by age", byAge.size () == 11 && byAge[0].delay () == 9890ms);
+
+	BoundedTimeseries reordered(0, 0ms, 3);
+
+	for (long delay : {0, 10, 20, 30, 40})
+		reordered.add (Sample (milliseconds (delay), delay));
+
+	const bool inserted = reordered.add (Sample (25ms, 25));
+	const bool rejected = !reordered.add (Sample (5ms, 5));
+
+	check ("out of order insertion", inserted && rejected && reordered.rejected () == 1 &&
+		  delays (reordered) == std::vector<long>{0, 10, 20, 25, 30, 40} && reordered.at (27ms).value () == 27.f);
+
+	// Batch and cursor queries must match single ones, for sorted and unsorted times
+	std::vector<milliseconds> times;
+
+	for (int i = 0; i < 300; i++)
+		times.push_back (milliseconds (9880 + (i * 7919) % 150));
+	for (int i = 0; i < 100; i++)
+		times.push_back (milliseconds (9860 + i));
+
+	std::vector<BoundedTimeseries::ResultStatus> status;
+	const std::vector<float> values = byAge.at (times, status);
+	BoundedTimeseries::Cursor cursor;
+	bool matching = true;
+
+	for (std::size_t i = 0; i < times.size (); i++) {
+		const auto single = byAge.at (times[i]);
+		const auto hinted = byAge.at (times[i], cursor);
+		const bool success = status[i] == BoundedTimeseries::ResultStatus::SUCCESS;
+
+		matching &= single.success () == success && hinted.success () == success &&
+				  (!success || (single.value () == values[i] && hinted.value () == values[i]));
+	}
+
+	check ("batch and cursor queries", matching);
+
+	// Lambda is computed in double: in float the result would be off by one
+	nlib::Timeseries<double, microseconds> precise;
+
+	precise.add ({0us, 0.});
+	precise.add ({100000001us, 100000001.});
+
+	check ("interpolation precision", std::abs (precise.at (100000000us).value () - 100000000.) < 1e-6);
+
+	nlib::Timeseries<float, milliseconds, system_clock, nlib::NearestInterpolation> nearest;
+	nlib::Timeseries<float, milliseconds, system_clock, nlib::ZeroOrderHoldInterpolation> hold;
+	nlib::Timeseries<float, milliseconds, system_clock, nlib::CubicInterpolation> cubic;
+	nlib::SoaTimeseries<float, milliseconds, system_clock, nlib::CubicInterpolation> cubicSoa;
+
+	for (int i = 0; i < 10; i++) {
+		const Sample sample(milliseconds (10 * i), i * i);
+
+		nearest.add (sample);
+		hold.add (sample);
+		cubic.add (sample);
+		cubicSoa.add (sample);
+	}
+
+	check ("nearest and zero order hold", nearest.at (44ms).value () == 16 && nearest.at (46ms).value () == 25 &&
+		  hold.at (49ms).value () == 16 && hold.at (50ms).value () == 25);
+
+	bool quadratic = true;
+
+	for (std::size_t i = 0; i < times.size (); i++) {
+		const milliseconds t = milliseconds (20) + times[i] % 50;
+		const float expected = t.count () * t.count () / 100.f;
+
+		quadratic &= std::abs (cubic.at (t).value () - expected) < 1e-3 && cubicSoa.at (t).value () == cubic.at (t).value ();
+	}
+
+	check ("cubic interpolation", quadratic);
+
+	nlib::Timeseries<Eigen::Quaternionf, milliseconds, system_clock, nlib::SlerpInterpolation> rotations;
+
+	rotations.add ({0ms, Eigen::Quaternionf::Identity ()});
+	rotations.add ({10ms, Eigen::Quaternionf (Eigen::AngleAxisf (M_PI / 2, Eigen::Vector3f::UnitZ ()))});
+
+	check ("slerp", rotations.at (5ms).value ().angularDistance (Eigen::Quaternionf (Eigen::AngleAxisf (M_PI / 4, Eigen::Vector3f::UnitZ ()))) < 1e-5);
+
+	return failures == 0 ? 0 : 1;
+}
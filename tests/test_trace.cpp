@@ -0,0 +1,98 @@
+#include "../include/nlib/nl_trace.h"
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include "nl_test.h"
+
+using namespace nlib;
+
+static std::size_t occurrences (const std::string &text, const std::string &pattern)
+{
+	std::size_t count = 0;
+
+	for (std::size_t at = text.find (pattern); at != std::string::npos; at = text.find (pattern, at + 1))
+		count++;
+
+	return count;
+}
+
+static void recordEmit (TraceRecorder &recorder, int32_t channelId, int32_t moduleId) {
+	TraceSpan span(&recorder, TraceKind::Emit, channelId, moduleId, 0);
+}
+
+static void recordSlot (TraceRecorder &recorder, int32_t channelId, int32_t moduleId, int index) {
+	TraceSpan span(&recorder, TraceKind::Slot, channelId, moduleId, 1, index);
+}
+
+static std::string convert (const std::string &converter, const std::string &trace)
+{
+	const std::string json = trace + ".json";
+
+	if (std::system ((converter + " " + trace + " " + json + " 2> /dev/null").c_str ()) != 0)
+		return "";
+
+	std::ifstream input(json);
+	std::stringstream content;
+
+	content << input.rdbuf ();
+
+	return content.str ();
+}
+
+// Usage: test_trace <nl_trace_convert>
+int main (int argc, char **argv)
+{
+	if (argc < 2) {
+		std::cout << "Usage: " << argv[0] << " <nl_trace_convert>" << std::endl;
+		return 1;
+	}
+
+	const std::string first = "/tmp/nlib_test_trace_first_" + std::to_string (getpid ());
+	const std::string second = "/tmp/nlib_test_trace_second_" + std::to_string (getpid ());
+
+	{
+		TraceRecorder firstRecorder(first, 1024, std::chrono::milliseconds (10));
+		TraceRecorder secondRecorder(second, 1024, std::chrono::milliseconds (10));
+
+		firstRecorder.nameChannel (0, "ticks");
+		firstRecorder.nameModule (3, "producer");
+		firstRecorder.nameModule (4, "consumer");
+		firstRecorder.nameSlot (0, 0, "Consumer::onTick(int const&)");
+
+		// Alternating between recorders keeps one ring per recorder in this thread
+		for (int i = 0; i < 100; i++) {
+			recordEmit (firstRecorder, 0, 3);
+			recordSlot (firstRecorder, 0, 4, 0);
+			recordEmit (secondRecorder, 1, 5);
+		}
+
+		std::thread thread([&] {
+			for (int i = 0; i < 10; i++)
+				recordEmit (firstRecorder, 0, 3);
+		});
+
+		thread.join ();
+	}
+
+	const std::string json = convert (argv[1], first);
+
+	check ("converted to JSON", json.find ("\"traceEvents\":[") != std::string::npos && json.find ("]}") != std::string::npos);
+	check ("all records converted", occurrences (json, "\"ph\":\"X\"") == 210);
+	check ("emits named by channel", occurrences (json, "{\"name\":\"ticks\",\"cat\":\"emit\"") == 110);
+	check ("slots named by truncated signature", occurrences (json, "{\"name\":\"Consumer::onTick\",\"cat\":\"slot\"") == 100);
+	check ("modules named", occurrences (json, "\"module\":\"producer\"") == 110 && occurrences (json, "\"module\":\"consumer\"") == 100);
+	check ("one ring per thread", occurrences (json, "\"tid\":0,") == 200 && occurrences (json, "\"tid\":1,") == 10 &&
+							occurrences (json, "\"tid\":2,") == 0);
+
+	const std::string secondJson = convert (argv[1], second);
+
+	check ("records kept in their recorder", occurrences (secondJson, "\"ph\":\"X\"") == 100 &&
+										occurrences (secondJson, "\"tid\":0,") == 100);
+	check ("unnamed channels numbered", occurrences (secondJson, "\"name\":\"channel_1\"") == 100);
+
+	for (const std::string &path : {first, first + ".json", second, second + ".json"})
+		std::remove (path.c_str ());
+
+	return failures == 0 ? 0 : 1;
+}